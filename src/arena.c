@@ -0,0 +1,210 @@
+/*****************************************************************************
+ * Arena allocator for many small objects with bulk release.                 *
+ *                                                                           *
+ * Copyright (C) 2010-2020 Timo Bingmann                                     *
+ *                                                                           *
+ * This program is free software; you can redistribute it and/or modify it   *
+ * under the terms of the GNU General Public License as published by the     *
+ * Free Software Foundation; either version 3, or (at your option) any       *
+ * later version.                                                            *
+ *                                                                           *
+ * This program is distributed in the hope that it will be useful,           *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+ * GNU General Public License for more details.                              *
+ *                                                                           *
+ * You should have received a copy of the GNU General Public License         *
+ * along with this program; if not, write to the Free Software Foundation,   *
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.        *
+ *****************************************************************************/
+
+#include "arena.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* alignment of all allocations */
+union arena_align
+{
+    void*	p;
+    long	l;
+    long long	ll;
+    double	d;
+};
+
+#define ARENA_ALIGN	sizeof(union arena_align)
+
+/* default block size */
+#define ARENA_BLOCKSIZE	(1024 * 1024)
+
+/**
+ * Blocks are chained into a list for release. The header is padded to
+ * keep the data area aligned.
+ */
+struct arena_block
+{
+    struct arena_block*	next;
+    union arena_align	data[1];
+};
+
+struct arena
+{
+    struct arena_block*	blocks;
+    char		*pos, *end;	/* free space in the current block */
+    size_t		blocksize;
+    size_t		size;
+};
+
+struct arena *arena_create(size_t blocksize)
+{
+    struct arena *a = malloc(sizeof(struct arena));
+
+    if (a == NULL) return NULL;
+
+    a->blocks = NULL;
+    a->pos = a->end = NULL;
+    a->blocksize = blocksize ? blocksize : ARENA_BLOCKSIZE;
+    a->size = 0;
+
+    return a;
+}
+
+/**
+ * Allocate a new block with at least size bytes of data. Large objects
+ * get a block of their own, which is chained behind the current one,
+ * such that its free space is not wasted.
+ */
+static void *arena_newblock(struct arena *a, size_t size)
+{
+    size_t datasize = size > a->blocksize / 4 ? size : a->blocksize;
+    struct arena_block *b = malloc(offsetof(struct arena_block, data) + datasize);
+
+    if (b == NULL)
+    {
+	fprintf(stderr, "arena: out of memory allocating %lu bytes.\n",
+		(unsigned long)datasize);
+	exit(-1);
+    }
+
+    a->size += offsetof(struct arena_block, data) + datasize;
+
+    if (datasize != a->blocksize && a->blocks)
+    {
+	b->next = a->blocks->next;
+	a->blocks->next = b;
+	return b->data;
+    }
+
+    b->next = a->blocks;
+    a->blocks = b;
+
+    a->pos = (char*)b->data + size;
+    a->end = (char*)b->data + datasize;
+
+    return b->data;
+}
+
+/**
+ * Take size bytes from the current block at the given alignment, or
+ * from a new block if they do not fit.
+ */
+static void *arena_take(struct arena *a, size_t size, size_t align)
+{
+    char *p;
+
+    if (a->pos == NULL)
+	return arena_newblock(a, size);
+
+    p = (char*)(((uintptr_t)a->pos + align - 1) & ~(uintptr_t)(align - 1));
+
+    if (p > a->end || (size_t)(a->end - p) < size)
+	return arena_newblock(a, size);
+
+    a->pos = p + size;
+
+    return p;
+}
+
+void *arena_alloc(struct arena *a, size_t size)
+{
+    return arena_take(a, size, ARENA_ALIGN);
+}
+
+void *arena_calloc(struct arena *a, size_t size)
+{
+    return memset(arena_alloc(a, size), 0, size);
+}
+
+void *arena_memdup(struct arena *a, const void *ptr, size_t size)
+{
+    return memcpy(arena_alloc(a, size), ptr, size);
+}
+
+/* strings need no alignment and are packed tightly */
+char *arena_strdup(struct arena *a, const char *str)
+{
+    size_t len = strlen(str) + 1;
+    return memcpy(arena_take(a, len, 1), str, len);
+}
+
+char *arena_strndup(struct arena *a, const char *str, size_t len)
+{
+    char *s;
+    const char *e = memchr(str, 0, len);
+
+    if (e) len = e - str;
+
+    s = arena_take(a, len + 1, 1);
+    memcpy(s, str, len);
+    s[len] = 0;
+
+    return s;
+}
+
+void arena_merge(struct arena *dst, struct arena *src)
+{
+    struct arena_block *tail;
+
+    if (src->blocks)
+    {
+	for (tail = src->blocks; tail->next; tail = tail->next) ;
+
+	if (dst->blocks)
+	{
+	    /* chain src's blocks behind the current block of dst */
+	    tail->next = dst->blocks->next;
+	    dst->blocks->next = src->blocks;
+	}
+	else
+	{
+	    dst->blocks = src->blocks;
+	    dst->pos = src->pos;
+	    dst->end = src->end;
+	}
+
+	dst->size += src->size;
+    }
+
+    free(src);
+}
+
+size_t arena_size(const struct arena *a)
+{
+    return a->size;
+}
+
+void arena_destroy(struct arena *a)
+{
+    while (a->blocks)
+    {
+	struct arena_block *b = a->blocks;
+	a->blocks = b->next;
+	free(b);
+    }
+
+    free(a);
+}
+
+/*****************************************************************************/
@@ -0,0 +1,90 @@
+/*****************************************************************************
+ * Arena allocator for many small objects with bulk release.                 *
+ *                                                                           *
+ * Copyright (C) 2010-2020 Timo Bingmann                                     *
+ *                                                                           *
+ * This program is free software; you can redistribute it and/or modify it   *
+ * under the terms of the GNU General Public License as published by the     *
+ * Free Software Foundation; either version 3, or (at your option) any       *
+ * later version.                                                            *
+ *                                                                           *
+ * This program is distributed in the hope that it will be useful,           *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+ * GNU General Public License for more details.                              *
+ *                                                                           *
+ * You should have received a copy of the GNU General Public License         *
+ * along with this program; if not, write to the Free Software Foundation,   *
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.        *
+ *****************************************************************************/
+
+#ifndef _ARENA_H
+#define _ARENA_H 1
+
+#include <stddef.h>
+
+/**
+ * An arena hands out memory by bumping a pointer within large blocks
+ * obtained from malloc(). Objects cannot be freed individually: all
+ * memory is released at once by arena_destroy(). This avoids the
+ * per-object header and call overhead of malloc() for millions of
+ * small objects with the same lifetime. All returned pointers are
+ * aligned for any basic type.
+ */
+
+/** opaque structure declaration */
+struct arena;
+
+/**
+ * Create a new arena, which allocates blocks of blocksize bytes, or a
+ * default size if zero.
+ */
+struct arena *arena_create(size_t blocksize);
+
+/**
+ * Allocate size bytes from the arena. Never returns NULL: exits the
+ * program if no memory is left.
+ */
+void *arena_alloc(struct arena *a, size_t size);
+
+/**
+ * Allocate size zero-initialized bytes from the arena.
+ */
+void *arena_calloc(struct arena *a, size_t size);
+
+/**
+ * Copy size bytes of ptr into the arena.
+ */
+void *arena_memdup(struct arena *a, const void *ptr, size_t size);
+
+/**
+ * Copy a string into the arena.
+ */
+char *arena_strdup(struct arena *a, const char *str);
+
+/**
+ * Copy at most len characters of a string into the arena and terminate
+ * it.
+ */
+char *arena_strndup(struct arena *a, const char *str, size_t len);
+
+/**
+ * Returns the number of bytes obtained from malloc() for blocks.
+ */
+size_t arena_size(const struct arena *a);
+
+/**
+ * Move all memory of the arena src into dst and release src, hence
+ * objects allocated by several threads from their own arenas can be
+ * kept together. The current block of dst is kept for allocations.
+ */
+void arena_merge(struct arena *dst, struct arena *src);
+
+/**
+ * Release all memory allocated from the arena and the arena itself.
+ */
+void arena_destroy(struct arena *a);
+
+#endif /* _ARENA_H */
+
+/*****************************************************************************/
@@ -0,0 +1,613 @@
+/*****************************************************************************
+ * Benchmark of the file list index structures on synthetic path sets.       *
+ *                                                                           *
+ * Copyright (C) 2010-2020 Timo Bingmann                                     *
+ *                                                                           *
+ * This program is free software; you can redistribute it and/or modify it   *
+ * under the terms of the GNU General Public License as published by the     *
+ * Free Software Foundation; either version 3, or (at your option) any       *
+ * later version.                                                            *
+ *                                                                           *
+ * This program is distributed in the hope that it will be useful,           *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+ * GNU General Public License for more details.                              *
+ *                                                                           *
+ * You should have received a copy of the GNU General Public License         *
+ * along with this program; if not, write to the Free Software Foundation,   *
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.        *
+ *****************************************************************************/
+
+/*
+ * Runs the same workload against each index structure, which may hold
+ * the file list: paths are inserted in random order, then looked up in
+ * another random order and finally iterated in path order. For each
+ * operation the time in ns/op and, if perf_event_open() is available,
+ * the cache misses per operation are printed, followed by the memory
+ * used per entry. Build with --enable-optimize for meaningful numbers.
+ *
+ * Usage: bench_index [-n entries] [-w deep|archive|flat|all] [-f pathfile]
+ *
+ * Alternative index structures are compared by adding an entry to the
+ * table g_indexes below.
+ */
+
+#include "arena.h"
+#include "rbtree.h"
+#include "hashindex.h"
+#include "dirtree.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#if HAVE_LINUX_PERF_EVENT_H
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+/*****************************************************************************
+ * Path set generators                                                       *
+ *****************************************************************************/
+
+struct pathset
+{
+    char**	paths;
+    size_t	size, max;
+};
+
+static void pathset_add(struct pathset *ps, const char *path)
+{
+    if (ps->size >= ps->max)
+    {
+	ps->max = ps->max ? 2 * ps->max : 1024;
+	ps->paths = realloc(ps->paths, sizeof(char*) * ps->max);
+    }
+
+    ps->paths[ps->size++] = strdup(path);
+}
+
+static void pathset_free(struct pathset *ps)
+{
+    size_t i;
+
+    for (i = 0; i < ps->size; ++i)
+	free(ps->paths[i]);
+
+    free(ps->paths);
+    memset(ps, 0, sizeof(*ps));
+}
+
+/* deterministic xorshift random numbers */
+static uint64_t g_rand = 88172645463325252ULL;
+
+static uint64_t rand64(void)
+{
+    g_rand ^= g_rand << 13;
+    g_rand ^= g_rand >> 7;
+    g_rand ^= g_rand << 17;
+    return g_rand;
+}
+
+/* geometric distribution with given mean, for skewed directory sizes */
+static unsigned int rand_geometric(unsigned int mean)
+{
+    unsigned int n = 1;
+    while (rand64() % mean != 0) ++n;
+    return n;
+}
+
+/**
+ * Deep synthetic tree: every directory holds a few files and four
+ * subdirectories, down to depth eight.
+ */
+static void gen_deep(struct pathset *ps, const char *dir, unsigned int depth,
+		     size_t n)
+{
+    char path[1024];
+    unsigned int i;
+
+    for (i = 0; i < 6 && ps->size < n; ++i)
+    {
+	snprintf(path, sizeof(path), "%s%sfile%u.dat", dir, *dir ? "/" : "", i);
+	pathset_add(ps, path);
+    }
+
+    for (i = 0; depth < 8 && i < 4 && ps->size < n; ++i)
+    {
+	snprintf(path, sizeof(path), "%s%sdir%u", dir, *dir ? "/" : "", i);
+	gen_deep(ps, path, depth + 1, n);
+    }
+
+    /* continue with siblings of the top directory until n is reached */
+    if (depth == 0 && ps->size < n)
+    {
+	snprintf(path, sizeof(path), "more%u", (unsigned int)ps->size);
+	gen_deep(ps, path, 0, n);
+    }
+}
+
+/**
+ * Archive-like tree with long, similar names and skewed directory
+ * sizes: photo collections by date, music by artist and album, and
+ * source trees.
+ */
+static void gen_archive(struct pathset *ps, size_t n)
+{
+    char path[1024];
+    unsigned int dir = 0, i, files;
+
+    while (ps->size < n)
+    {
+	unsigned int kind = rand64() % 3;
+	files = rand_geometric(kind == 0 ? 200 : 12);
+
+	for (i = 0; i < files && ps->size < n; ++i)
+	{
+	    if (kind == 0)
+		snprintf(path, sizeof(path), "photos/%04u/%04u-%02u-%02u %s/IMG_%05u.JPG",
+			 1990 + dir % 30, 1990 + dir % 30, 1 + dir % 12, 1 + dir % 28,
+			 (dir % 2) ? "Holiday" : "Family", i);
+	    else if (kind == 1)
+		snprintf(path, sizeof(path), "music/Artist %05u/Album %u (%04u)/%02u - Track Title %u.flac",
+			 dir / 8, dir % 8, 1960 + dir % 60, i + 1, i);
+	    else
+		snprintf(path, sizeof(path), "src/project%u/lib/module%u/component%u/file_%u_%u.c",
+			 dir / 100, dir / 10 % 10, dir % 10, i, (unsigned int)(rand64() % 1000));
+
+	    pathset_add(ps, path);
+	}
+
+	++dir;
+    }
+}
+
+/**
+ * Flat tree of a few huge directories with random names, like mail or
+ * object stores.
+ */
+static void gen_flat(struct pathset *ps, size_t n)
+{
+    char path[256];
+
+    while (ps->size < n)
+    {
+	uint64_t r = rand64();
+
+	snprintf(path, sizeof(path), "objects/%02x/%014llx%016llx",
+		 (unsigned int)(r & 0xFF), (unsigned long long)(r >> 8),
+		 (unsigned long long)rand64());
+	pathset_add(ps, path);
+    }
+}
+
+/**
+ * Read paths from a file, one per line, as written by find.
+ */
+static int gen_file(struct pathset *ps, const char *filename, size_t n)
+{
+    FILE *fp = fopen(filename, "r");
+    char line[4096];
+
+    if (!fp)
+    {
+	perror(filename);
+	return 0;
+    }
+
+    while (ps->size < n && fgets(line, sizeof(line), fp))
+    {
+	size_t len = strlen(line);
+	char *p = line;
+
+	if (len && line[len-1] == '\n') line[--len] = 0;
+	if (p[0] == '.' && p[1] == '/') p += 2;
+	if (*p) pathset_add(ps, p);
+    }
+
+    fclose(fp);
+    return 1;
+}
+
+static int strcmpptr(const void *a, const void *b)
+{
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+/* sort and remove duplicate paths, then shuffle into random order */
+static void pathset_prepare(struct pathset *ps)
+{
+    size_t i, j;
+
+    qsort(ps->paths, ps->size, sizeof(char*), strcmpptr);
+
+    for (i = j = 0; i < ps->size; ++i)
+    {
+	if (j > 0 && strcmp(ps->paths[j-1], ps->paths[i]) == 0)
+	    free(ps->paths[i]);
+	else
+	    ps->paths[j++] = ps->paths[i];
+    }
+
+    ps->size = j;
+
+    for (i = ps->size; i > 1; --i)
+    {
+	char *t;
+	j = rand64() % i;
+	t = ps->paths[i-1]; ps->paths[i-1] = ps->paths[j]; ps->paths[j] = t;
+    }
+}
+
+/*****************************************************************************
+ * Index structures under test                                               *
+ *****************************************************************************/
+
+/* common state, each index uses some of it */
+struct ix
+{
+    struct arena*	arena;
+    struct rb_tree*	tree;
+    struct hashindex*	hash;
+    struct dirtree*	dirtree;
+};
+
+static int ix_strcmp(const void *a, const void *b)
+{
+    return strcmp(a, b);
+}
+
+static int ix_dtcmp(const void *a, const void *b)
+{
+    return dt_key_cmp(a, b);
+}
+
+/* rbtree keyed by full path strings */
+
+static void rbstr_create(struct ix *ix)
+{
+    ix->tree = rb_create(ix_strcmp, NULL, NULL, NULL, NULL);
+    rb_set_arena(ix->tree, ix->arena);
+}
+
+static void rbstr_insert(struct ix *ix, const char *path)
+{
+    rb_insert(ix->tree, arena_strdup(ix->arena, path), NULL);
+}
+
+static int rbstr_find(struct ix *ix, const char *path)
+{
+    return rb_find(ix->tree, path) != NULL;
+}
+
+/* rbtree keyed by interned directory nodes and names, as g_filelist */
+
+static void rbdt_create(struct ix *ix)
+{
+    ix->dirtree = dt_create(ix->arena);
+    ix->tree = rb_create(ix_dtcmp, NULL, NULL, NULL, NULL);
+    rb_set_arena(ix->tree, ix->arena);
+}
+
+static void rbdt_insert(struct ix *ix, const char *path)
+{
+    rb_insert(ix->tree, dt_intern(ix->dirtree, path), NULL);
+}
+
+static int rbdt_find(struct ix *ix, const char *path)
+{
+    struct dt_key key;
+
+    return dt_lookup(ix->dirtree, path, &key) && rb_find(ix->tree, &key) != NULL;
+}
+
+static size_t rb_iterate(struct ix *ix)
+{
+    struct rb_node *node;
+    size_t n = 0;
+
+    for (node = rb_begin(ix->tree); node != rb_end(ix->tree);
+	 node = rb_successor(ix->tree, node))
+	++n;
+
+    return n;
+}
+
+/* hash index keyed by full path strings */
+
+static void histr_create(struct ix *ix)
+{
+    ix->hash = hi_create(0);
+}
+
+static void histr_insert(struct ix *ix, const char *path)
+{
+    hi_insert(ix->hash, arena_strdup(ix->arena, path), ix);
+}
+
+static int histr_find(struct ix *ix, const char *path)
+{
+    return hi_find(ix->hash, path) != NULL;
+}
+
+/* hash index keyed by interned directory nodes and names, as g_filehash */
+
+static void hidt_create(struct ix *ix)
+{
+    ix->dirtree = dt_create(ix->arena);
+    ix->hash = hi_create_custom(0, dt_key_hash, dt_key_equal);
+}
+
+static void hidt_insert(struct ix *ix, const char *path)
+{
+    hi_insert(ix->hash, dt_intern(ix->dirtree, path), ix);
+}
+
+static int hidt_find(struct ix *ix, const char *path)
+{
+    struct dt_key key;
+
+    return dt_lookup(ix->dirtree, path, &key) && hi_find(ix->hash, &key) != NULL;
+}
+
+struct index_ops
+{
+    const char*	name;
+    void	(*create)(struct ix *ix);
+    void	(*insert)(struct ix *ix, const char *path);
+    int		(*find)(struct ix *ix, const char *path);
+    size_t	(*iterate)(struct ix *ix);	/* NULL if unordered */
+};
+
+static const struct index_ops g_indexes[] =
+{
+    { "rbtree/string",	rbstr_create,	rbstr_insert,	rbstr_find,	rb_iterate },
+    { "rbtree/dirtree",	rbdt_create,	rbdt_insert,	rbdt_find,	rb_iterate },
+    { "hash/string",	histr_create,	histr_insert,	histr_find,	NULL },
+    { "hash/dirtree",	hidt_create,	hidt_insert,	hidt_find,	NULL },
+    { NULL,		NULL,		NULL,		NULL,		NULL }
+};
+
+/*****************************************************************************
+ * Measurement                                                               *
+ *****************************************************************************/
+
+static double timestamp(void)
+{
+#if ON_WIN32
+    return (double)clock() / CLOCKS_PER_SEC;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+}
+
+/* file descriptor of the cache miss counter, or -1 */
+static int g_perf_fd = -1;
+
+static void perf_open(void)
+{
+#if HAVE_LINUX_PERF_EVENT_H
+    struct perf_event_attr pe;
+
+    memset(&pe, 0, sizeof(pe));
+    pe.type = PERF_TYPE_HARDWARE;
+    pe.size = sizeof(pe);
+    pe.config = PERF_COUNT_HW_CACHE_MISSES;
+    pe.disabled = 1;
+    pe.exclude_kernel = 1;
+    pe.exclude_hv = 1;
+
+    g_perf_fd = syscall(__NR_perf_event_open, &pe, 0, -1, -1, 0);
+#endif
+}
+
+static void perf_start(void)
+{
+#if HAVE_LINUX_PERF_EVENT_H
+    if (g_perf_fd < 0) return;
+
+    ioctl(g_perf_fd, PERF_EVENT_IOC_RESET, 0);
+    ioctl(g_perf_fd, PERF_EVENT_IOC_ENABLE, 0);
+#endif
+}
+
+/* returns the cache misses since perf_start(), or -1 if unavailable */
+static long long perf_stop(void)
+{
+#if HAVE_LINUX_PERF_EVENT_H
+    long long count;
+
+    if (g_perf_fd < 0) return -1;
+
+    ioctl(g_perf_fd, PERF_EVENT_IOC_DISABLE, 0);
+
+    if (read(g_perf_fd, &count, sizeof(count)) != sizeof(count))
+	return -1;
+
+    return count;
+#else
+    return -1;
+#endif
+}
+
+struct measure
+{
+    double	start;
+};
+
+static void measure_start(struct measure *m)
+{
+    perf_start();
+    m->start = timestamp();
+}
+
+static void measure_stop(struct measure *m, const char *index, const char *op,
+			 size_t n)
+{
+    double elapsed = timestamp() - m->start;
+    long long misses = perf_stop();
+
+    if (misses >= 0)
+	printf("  %-16s %-8s %10.1f ns/op %8.2f misses/op\n",
+	       index, op, elapsed * 1e9 / n, (double)misses / n);
+    else
+	printf("  %-16s %-8s %10.1f ns/op        - misses/op\n",
+	       index, op, elapsed * 1e9 / n);
+}
+
+static void run_index(const struct index_ops *ops, const struct pathset *ps,
+		      char **lookups)
+{
+    struct ix ix;
+    struct measure m;
+    size_t i, found = 0;
+
+    memset(&ix, 0, sizeof(ix));
+    ix.arena = arena_create(0);
+
+    ops->create(&ix);
+
+    measure_start(&m);
+    for (i = 0; i < ps->size; ++i)
+	ops->insert(&ix, ps->paths[i]);
+    measure_stop(&m, ops->name, "insert", ps->size);
+
+    measure_start(&m);
+    for (i = 0; i < ps->size; ++i)
+	found += ops->find(&ix, lookups[i]);
+    measure_stop(&m, ops->name, "find", ps->size);
+
+    if (found != ps->size)
+	fprintf(stderr, "bench_index: %s found only %u of %u paths\n",
+		ops->name, (unsigned int)found, (unsigned int)ps->size);
+
+    if (ops->iterate)
+    {
+	measure_start(&m);
+	found = ops->iterate(&ix);
+	measure_stop(&m, ops->name, "iterate", ps->size);
+
+	if (found != ps->size)
+	    fprintf(stderr, "bench_index: %s iterated %u of %u paths\n",
+		    ops->name, (unsigned int)found, (unsigned int)ps->size);
+    }
+
+    /* arena blocks hold nodes, keys and directories, plus hash tables */
+    printf("  %-16s %-8s %10.1f bytes/entry\n", ops->name, "memory",
+	   (double)(arena_size(ix.arena) + (ix.hash ? hi_memory(ix.hash) : 0)) / ps->size);
+
+    if (ix.tree) rb_destroy(ix.tree);
+    if (ix.hash) hi_destroy(ix.hash);
+    if (ix.dirtree) dt_destroy(ix.dirtree);
+    arena_destroy(ix.arena);
+}
+
+static void run_workload(const char *name, struct pathset *ps)
+{
+    char **lookups;
+    size_t i, pathbytes = 0;
+    unsigned int k;
+
+    pathset_prepare(ps);
+
+    if (ps->size == 0) return;
+
+    /* look up copies in another random order, not the inserted keys */
+    lookups = malloc(sizeof(char*) * ps->size);
+
+    for (i = 0; i < ps->size; ++i)
+    {
+	lookups[i] = strdup(ps->paths[(i * 7919) % ps->size]);
+	pathbytes += strlen(ps->paths[i]) + 1;
+    }
+
+    /* 7919 is prime, all entries are found unless size is a multiple */
+    if (ps->size % 7919 == 0)
+    {
+	for (i = 0; i < ps->size; ++i)
+	{
+	    free(lookups[i]);
+	    lookups[i] = strdup(ps->paths[ps->size - 1 - i]);
+	}
+    }
+
+    printf("workload %s: %u paths, %.1f bytes per path string\n",
+	   name, (unsigned int)ps->size, (double)pathbytes / ps->size);
+
+    for (k = 0; g_indexes[k].name; ++k)
+	run_index(&g_indexes[k], ps, lookups);
+
+    for (i = 0; i < ps->size; ++i)
+	free(lookups[i]);
+    free(lookups);
+}
+
+int main(int argc, char *argv[])
+{
+    size_t n = 200000;
+    const char *workload = "all";
+    const char *pathfile = NULL;
+    struct pathset ps;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:w:f:")) != -1)
+    {
+	switch (opt)
+	{
+	case 'n': n = strtoul(optarg, NULL, 10); break;
+	case 'w': workload = optarg; break;
+	case 'f': pathfile = optarg; break;
+	default:
+	    fprintf(stderr, "Usage: %s [-n entries] [-w deep|archive|flat|all] [-f pathfile]\n",
+		    argv[0]);
+	    return 1;
+	}
+    }
+
+    perf_open();
+
+    if (g_perf_fd < 0)
+	printf("cache miss counter not available.\n");
+
+    memset(&ps, 0, sizeof(ps));
+
+    if (pathfile)
+    {
+	if (!gen_file(&ps, pathfile, n)) return 1;
+	run_workload(pathfile, &ps);
+	pathset_free(&ps);
+	return 0;
+    }
+
+    if (strcmp(workload, "deep") == 0 || strcmp(workload, "all") == 0)
+    {
+	gen_deep(&ps, "", 0, n);
+	run_workload("deep", &ps);
+	pathset_free(&ps);
+    }
+
+    if (strcmp(workload, "archive") == 0 || strcmp(workload, "all") == 0)
+    {
+	gen_archive(&ps, n);
+	run_workload("archive", &ps);
+	pathset_free(&ps);
+    }
+
+    if (strcmp(workload, "flat") == 0 || strcmp(workload, "all") == 0)
+    {
+	gen_flat(&ps, n);
+	run_workload("flat", &ps);
+	pathset_free(&ps);
+    }
+
+    if (g_perf_fd >= 0) close(g_perf_fd);
+
+    return 0;
+}
+
+/*****************************************************************************/
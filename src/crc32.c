@@ -108,4 +108,65 @@ uint32_t crc32(uint32_t crc, const unsigned char* buf, unsigned int len)
     return crc ^ 0xffffffffUL;
 }
 
+/* multiply the 32x32 bit matrix over GF(2) with a vector */
+static uint32_t gf2_matrix_times(const uint32_t* mat, uint32_t vec)
+{
+    uint32_t sum = 0;
+
+    while (vec)
+    {
+	if (vec & 1) sum ^= *mat;
+	vec >>= 1;
+	++mat;
+    }
+
+    return sum;
+}
+
+static void gf2_matrix_square(uint32_t* square, const uint32_t* mat)
+{
+    int n;
+
+    for (n = 0; n < 32; ++n)
+	square[n] = gf2_matrix_times(mat, mat[n]);
+}
+
+uint32_t crc32_combine(uint32_t crc1, uint32_t crc2, uint64_t len2)
+{
+    uint32_t even[32], odd[32], row;
+    int n;
+
+    if (len2 == 0) return crc1;
+
+    /* operator for one zero bit in odd */
+    odd[0] = 0xedb88320UL;
+    row = 1;
+    for (n = 1; n < 32; ++n)
+    {
+	odd[n] = row;
+	row <<= 1;
+    }
+
+    gf2_matrix_square(even, odd);	/* two zero bits */
+    gf2_matrix_square(odd, even);	/* four zero bits */
+
+    /* apply len2 zero bytes to crc1, squaring the operator for each bit
+     * of len2, starting with one zero byte */
+    do
+    {
+	gf2_matrix_square(even, odd);
+	if (len2 & 1) crc1 = gf2_matrix_times(even, crc1);
+	len2 >>= 1;
+
+	if (len2 == 0) break;
+
+	gf2_matrix_square(odd, even);
+	if (len2 & 1) crc1 = gf2_matrix_times(odd, crc1);
+	len2 >>= 1;
+    }
+    while (len2 != 0);
+
+    return crc1 ^ crc2;
+}
+
 /*****************************************************************************/
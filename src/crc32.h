@@ -31,6 +31,13 @@ enum { CRC32_DIGEST_SIZE = 4 };
  */
 extern uint32_t crc32(uint32_t crc, const unsigned char* buf, unsigned int len);
 
+/**
+ * Returns the CRC32 value of two concatenated buffers from the values
+ * crc1 and crc2 of the buffers and the length of the second one, hence
+ * parts of a file can be checksummed independently.
+ */
+extern uint32_t crc32_combine(uint32_t crc1, uint32_t crc2, uint64_t len2);
+
 #endif /* _CRC32_H */
 
 /*****************************************************************************/
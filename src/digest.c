@@ -63,6 +63,13 @@ __md5_finish(struct digest_ctx *ctx)
     return resbuf;
 }
 
+static void
+__md5_finish_into(struct digest_ctx *ctx, struct digest_result *out)
+{
+    out->size = MD5_DIGEST_SIZE;
+    md5_finish_ctx(&ctx->ctx.md5, (char*)out + 1);
+}
+
 static struct digest_result*
 __md5_read(struct digest_ctx *ctx)
 {
@@ -85,6 +92,7 @@ void digest_init_md5(struct digest_ctx* ctx)
     ctx->init = __md5_init;
     ctx->process = __md5_process;
     ctx->finish = __md5_finish;
+    ctx->finish_into = __md5_finish_into;
     ctx->read = __md5_read;
     ctx->process_buffer = __md5_process_buffer;
 
@@ -120,6 +128,13 @@ __sha1_finish(struct digest_ctx *ctx)
     return resbuf;
 }
 
+static void
+__sha1_finish_into(struct digest_ctx *ctx, struct digest_result *out)
+{
+    out->size = SHA1_DIGEST_SIZE;
+    sha1_finish_ctx(&ctx->ctx.sha1, (char*)out + 1);
+}
+
 static struct digest_result*
 __sha1_read(struct digest_ctx *ctx)
 {
@@ -142,6 +157,7 @@ void digest_init_sha1(struct digest_ctx* ctx)
     ctx->init = __sha1_init;
     ctx->process = __sha1_process;
     ctx->finish = __sha1_finish;
+    ctx->finish_into = __sha1_finish_into;
     ctx->read = __sha1_read;
     ctx->process_buffer = __sha1_process_buffer;
 
@@ -177,6 +193,13 @@ __sha256_finish(struct digest_ctx *ctx)
     return resbuf;
 }
 
+static void
+__sha256_finish_into(struct digest_ctx *ctx, struct digest_result *out)
+{
+    out->size = SHA256_DIGEST_SIZE;
+    sha256_finish_ctx(&ctx->ctx.sha256, (char*)out + 1);
+}
+
 static struct digest_result*
 __sha256_read(struct digest_ctx *ctx)
 {
@@ -199,6 +222,7 @@ void digest_init_sha256(struct digest_ctx* ctx)
     ctx->init = __sha256_init;
     ctx->process = __sha256_process;
     ctx->finish = __sha256_finish;
+    ctx->finish_into = __sha256_finish_into;
     ctx->read = __sha256_read;
     ctx->process_buffer = __sha256_process_buffer;
 
@@ -234,6 +258,13 @@ __sha512_finish(struct digest_ctx *ctx)
     return resbuf;
 }
 
+static void
+__sha512_finish_into(struct digest_ctx *ctx, struct digest_result *out)
+{
+    out->size = SHA512_DIGEST_SIZE;
+    sha512_finish_ctx(&ctx->ctx.sha512, (char*)out + 1);
+}
+
 static struct digest_result*
 __sha512_read(struct digest_ctx *ctx)
 {
@@ -256,6 +287,7 @@ void digest_init_sha512(struct digest_ctx* ctx)
     ctx->init = __sha512_init;
     ctx->process = __sha512_process;
     ctx->finish = __sha512_finish;
+    ctx->finish_into = __sha512_finish_into;
     ctx->read = __sha512_read;
     ctx->process_buffer = __sha512_process_buffer;
 
@@ -291,6 +323,13 @@ __crc32_finish(struct digest_ctx *ctx)
     return resbuf;
 }
 
+static void
+__crc32_finish_into(struct digest_ctx *ctx, struct digest_result *out)
+{
+    out->size = CRC32_DIGEST_SIZE;
+    memcpy((char*)out + 1, &ctx->ctx.crc32, sizeof(uint32_t));
+}
+
 static struct digest_result*
 __crc32_read(struct digest_ctx *ctx)
 {
@@ -314,6 +353,7 @@ void digest_init_crc32(struct digest_ctx* ctx)
     ctx->init = __crc32_init;
     ctx->process = __crc32_process;
     ctx->finish = __crc32_finish;
+    ctx->finish_into = __crc32_finish_into;
     ctx->read = __crc32_read;
     ctx->process_buffer = __crc32_process_buffer;
 
@@ -355,57 +395,95 @@ char* digest_bin2hex_dup(const struct digest_result* res)
     return digest_bin2hex(res, out);
 }
 
-struct digest_result* digest_hex2bin(const char* str, int len)
+/* value of hex digit characters, -1 for all others */
+static const signed char hexval[256] = {
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+     0,  1,  2,  3,  4,  5,  6,  7,  8,  9, -1, -1, -1, -1, -1, -1,
+    -1, 10, 11, 12, 13, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, 10, 11, 12, 13, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+};
+
+int digest_hex2bin_buf(const char* str, int len, struct digest_result* out)
 {
-    static const char hexval[256] = {
-	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
-	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
-	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
-	 0,  1,  2,  3,  4,  5,  6,  7,  8,  9, -1, -1, -1, -1, -1, -1,
-	-1, 10, 11, 12, 13, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1,
-	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
-	-1, 10, 11, 12, 13, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1,
-	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
-	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
-	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
-	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
-	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
-	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
-	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
-	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
-	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
-    };
-
-    struct digest_result* resbuf;
     int i;
 
     if (len < 0) len = strlen(str);
 
     if (len % 2 != 0)
-	return NULL;
+	return 0;
 
-    resbuf = malloc_result(len / 2);
+    out->size = len / 2;
 
     for (i = 0; i < len; i += 2)
     {
 	if (hexval[(unsigned char)str[i]] < 0)
-	{
-	    free(resbuf);
-	    return NULL;
-	}
+	    return 0;
+
 	if (hexval[(unsigned char)str[i+1]] < 0)
-	{
-	    free(resbuf);
-	    return NULL;
-	}
+	    return 0;
 
-	((unsigned char*)resbuf+1)[i/2] =
+	((unsigned char*)out+1)[i/2] =
 	    hexval[(unsigned char)str[i]] * 16 +
 	    hexval[(unsigned char)str[i+1]];
     }
-    
-    return resbuf;
 
+    return 1;
+}
+
+int digest_hex2bin_prefix(const char* str, int maxsize, struct digest_result* out)
+{
+    unsigned char* data = (unsigned char*)out + 1;
+    int i, hi, lo;
+
+    for (i = 0; i < 2 * maxsize; i += 2)
+    {
+	if ((hi = hexval[(unsigned char)str[i]]) < 0)
+	    break;
+
+	if ((lo = hexval[(unsigned char)str[i+1]]) < 0)
+	{
+	    ++i; /* count the odd digit */
+	    break;
+	}
+
+	data[i/2] = hi * 16 + lo;
+    }
+
+    out->size = i / 2;
+
+    return i;
+}
+
+struct digest_result* digest_hex2bin(const char* str, int len)
+{
+    struct digest_result* resbuf;
+
+    if (len < 0) len = strlen(str);
+
+    if (len % 2 != 0)
+	return NULL;
+
+    resbuf = malloc_result(len / 2);
+
+    if (!digest_hex2bin_buf(str, len, resbuf))
+    {
+	free(resbuf);
+	return NULL;
+    }
+
+    return resbuf;
 }
 
 int digest_equal(const struct digest_result* a, const struct digest_result* b)
@@ -42,6 +42,9 @@ typedef struct digest_result
     */
 } digest_result;
 
+/** largest digest size of all algorithms */
+enum { DIGEST_MAX_SIZE = SHA512_DIGEST_SIZE };
+
 /**
  * class-like structure with function pointers and integrated digest
  * algorithm context.
@@ -66,6 +69,10 @@ typedef struct digest_ctx
 
     struct digest_result* (*finish)(struct digest_ctx *ctx);
 
+    /* finish into a caller-supplied buffer with room for
+     * digest_size() bytes of data, without allocating */
+    void (*finish_into)(struct digest_ctx *ctx, struct digest_result *out);
+
     struct digest_result* (*read)(struct digest_ctx *ctx);
 
     struct digest_result* (*process_buffer)(const char *buffer, size_t len);
@@ -94,6 +101,16 @@ extern char* digest_bin2hex_dup(const struct digest_result* res);
 
 extern struct digest_result* digest_hex2bin(const char* str, int len);
 
+/* decode hex string into out, which must have room for len/2 bytes of
+ * data. Returns 0 on malformed input. */
+extern int digest_hex2bin_buf(const char* str, int len, struct digest_result* out);
+
+/* decode the hex digits at the start of str into out, which must have
+ * room for maxsize bytes, in one pass. Returns the number of digits
+ * read, which stops at the first other character or after 2 * maxsize
+ * digits. */
+extern int digest_hex2bin_prefix(const char* str, int maxsize, struct digest_result* out);
+
 extern int digest_equal(const struct digest_result* a, const struct digest_result* b);
 
 extern int digest_cmp(const struct digest_result* a, const struct digest_result* b);
@@ -0,0 +1,281 @@
+/*****************************************************************************
+ * Machine-wide digest cache in a memory mapped file shared by processes     *
+ *                                                                           *
+ * Copyright (C) 2010-2020 Timo Bingmann                                     *
+ *                                                                           *
+ * This program is free software; you can redistribute it and/or modify it   *
+ * under the terms of the GNU General Public License as published by the     *
+ * Free Software Foundation; either version 3, or (at your option) any       *
+ * later version.                                                            *
+ *                                                                           *
+ * This program is distributed in the hope that it will be useful,           *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+ * GNU General Public License for more details.                              *
+ *                                                                           *
+ * You should have received a copy of the GNU General Public License         *
+ * along with this program; if not, write to the Free Software Foundation,   *
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.        *
+ *****************************************************************************/
+
+#include "digestcache.h"
+#include "crc32.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if !ON_WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/* number of slots searched for a key */
+#define DC_PROBE	8
+
+static const char dc_magic[8] = { 'd', 'i', 'g', 'u', 'p', 'd', 'c', '1' };
+
+/** file header, followed by the slots */
+struct dc_header
+{
+    char		magic[8];
+    uint64_t		slots;
+};
+
+/** one cache entry, all zero if empty */
+struct dc_slot
+{
+    struct dc_key	key;
+    uint32_t		crc;	/* of the slot with crc set to zero */
+    unsigned char	len;
+    unsigned char	digest[DC_DIGEST_MAX];
+};
+
+struct digestcache
+{
+    int			fd;
+    void*		map;
+    size_t		mapsize;
+    struct dc_slot*	slot;
+    uint64_t		mask;
+};
+
+#if !ON_WIN32
+
+/* lock the whole file for reading or writing, or unlock it */
+static void dc_lock(struct digestcache *dc, short type)
+{
+    struct flock fl;
+
+    memset(&fl, 0, sizeof(fl));
+    fl.l_type = type;
+    fl.l_whence = SEEK_SET;
+
+    while (fcntl(dc->fd, F_SETLKW, &fl) != 0 && errno == EINTR) ;
+}
+
+/* home slot of a key, independent of mtime and size such that a newer
+ * state of the file replaces the old entry */
+static uint64_t dc_hash(const struct dc_key *key)
+{
+    uint64_t h = key->dev * 0x9E3779B97F4A7C15ULL;
+    h ^= key->ino * 0xC2B2AE3D27D4EB4FULL;
+    h ^= key->type;
+    return h ^ (h >> 29);
+}
+
+static int dc_samefile(const struct dc_key *a, const struct dc_key *b)
+{
+    return a->dev == b->dev && a->ino == b->ino && a->type == b->type;
+}
+
+/* crc of the slot's bytes including padding, which an assignment of
+ * the struct need not copy */
+static uint32_t dc_slotcrc(const struct dc_slot *s)
+{
+    struct dc_slot copy;
+    memcpy(&copy, s, sizeof(copy));
+    copy.crc = 0;
+    return crc32(0, (const unsigned char*)&copy, sizeof(copy));
+}
+
+/* initialize a new cache file or check an existing one and map it,
+ * while the file is locked */
+static int dc_map(struct digestcache *dc, uint64_t slots)
+{
+    struct dc_header header;
+    struct stat st;
+
+    if (fstat(dc->fd, &st) != 0)
+	return 0;
+
+    if (st.st_size == 0)
+    {
+	/* new cache: the table is a sparse file of zeros */
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, dc_magic, sizeof(header.magic));
+	header.slots = slots;
+
+	if (ftruncate(dc->fd, sizeof(header) + slots * sizeof(struct dc_slot)) != 0 ||
+	    pwrite(dc->fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header))
+	    return 0;
+    }
+    else if (pread(dc->fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header) ||
+	     memcmp(header.magic, dc_magic, sizeof(header.magic)) != 0 ||
+	     header.slots == 0 || (header.slots & (header.slots - 1)) != 0 ||
+	     (uint64_t)st.st_size < sizeof(header) + header.slots * sizeof(struct dc_slot))
+    {
+	errno = EINVAL;
+	return 0;
+    }
+
+    dc->mapsize = sizeof(header) + header.slots * sizeof(struct dc_slot);
+    dc->map = mmap(NULL, dc->mapsize, PROT_READ | PROT_WRITE, MAP_SHARED, dc->fd, 0);
+
+    if (dc->map == MAP_FAILED)
+	return 0;
+
+    dc->slot = (struct dc_slot*)((char*)dc->map + sizeof(header));
+    dc->mask = header.slots - 1;
+
+    return 1;
+}
+
+struct digestcache *dc_open(const char *path, size_t slots)
+{
+    struct digestcache *dc;
+    uint64_t n = 64;
+    int ok, err;
+
+    while (n < slots) n *= 2;
+
+    dc = calloc(1, sizeof(struct digestcache));
+
+    if ((dc->fd = open(path, O_RDWR | O_CREAT, 0600)) < 0)
+    {
+	free(dc);
+	return NULL;
+    }
+
+    dc_lock(dc, F_WRLCK);
+    ok = dc_map(dc, n);
+    err = errno;
+    dc_lock(dc, F_UNLCK);
+
+    if (!ok)
+    {
+	close(dc->fd);
+	free(dc);
+	errno = err;
+	return NULL;
+    }
+
+    return dc;
+}
+
+unsigned int dc_lookup(struct digestcache *dc, const struct dc_key *key,
+		       unsigned char *digest)
+{
+    uint64_t h = dc_hash(key);
+    unsigned int i, len = 0;
+
+    dc_lock(dc, F_RDLCK);
+
+    for (i = 0; i < DC_PROBE; ++i)
+    {
+	const struct dc_slot *s = &dc->slot[(h + i) & dc->mask];
+
+	if (s->len == 0 || !dc_samefile(&s->key, key))
+	    continue;
+
+	if (s->key.mtime == key->mtime && s->key.size == key->size &&
+	    s->len <= DC_DIGEST_MAX && s->crc == dc_slotcrc(s))
+	{
+	    len = s->len;
+	    memcpy(digest, s->digest, len);
+	}
+	break;
+    }
+
+    dc_lock(dc, F_UNLCK);
+    return len;
+}
+
+void dc_store(struct digestcache *dc, const struct dc_key *key,
+	      const unsigned char *digest, unsigned int len)
+{
+    uint64_t h = dc_hash(key);
+    struct dc_slot *s = NULL, entry;
+    unsigned int i;
+
+    if (len == 0 || len > DC_DIGEST_MAX) return;
+
+    /* prepare the entry including padding bytes, which enter the crc */
+    memset(&entry, 0, sizeof(entry));
+    entry.key = *key;
+    entry.len = len;
+    memcpy(entry.digest, digest, len);
+    entry.crc = dc_slotcrc(&entry);
+
+    dc_lock(dc, F_WRLCK);
+
+    /* use the slot of the same file, or the first empty one, otherwise
+     * replace the home slot */
+    for (i = 0; i < DC_PROBE; ++i)
+    {
+	struct dc_slot *p = &dc->slot[(h + i) & dc->mask];
+
+	if (p->len != 0 && dc_samefile(&p->key, key)) {
+	    s = p;
+	    break;
+	}
+	if (p->len == 0 && !s)
+	    s = p;
+    }
+
+    if (!s) s = &dc->slot[h & dc->mask];
+
+    memcpy(s, &entry, sizeof(entry));
+
+    dc_lock(dc, F_UNLCK);
+}
+
+void dc_close(struct digestcache *dc)
+{
+    munmap(dc->map, dc->mapsize);
+    close(dc->fd);
+    free(dc);
+}
+
+#else /* ON_WIN32 */
+
+struct digestcache *dc_open(const char *path, size_t slots)
+{
+    (void)path; (void)slots;
+    errno = ENOSYS;
+    return NULL;
+}
+
+unsigned int dc_lookup(struct digestcache *dc, const struct dc_key *key,
+		       unsigned char *digest)
+{
+    (void)dc; (void)key; (void)digest;
+    return 0;
+}
+
+void dc_store(struct digestcache *dc, const struct dc_key *key,
+	      const unsigned char *digest, unsigned int len)
+{
+    (void)dc; (void)key; (void)digest; (void)len;
+}
+
+void dc_close(struct digestcache *dc)
+{
+    (void)dc;
+}
+
+#endif
+
+/*****************************************************************************/
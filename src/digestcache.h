@@ -0,0 +1,82 @@
+/*****************************************************************************
+ * Machine-wide digest cache in a memory mapped file shared by processes     *
+ *                                                                           *
+ * Copyright (C) 2010-2020 Timo Bingmann                                     *
+ *                                                                           *
+ * This program is free software; you can redistribute it and/or modify it   *
+ * under the terms of the GNU General Public License as published by the     *
+ * Free Software Foundation; either version 3, or (at your option) any       *
+ * later version.                                                            *
+ *                                                                           *
+ * This program is distributed in the hope that it will be useful,           *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+ * GNU General Public License for more details.                              *
+ *                                                                           *
+ * You should have received a copy of the GNU General Public License         *
+ * along with this program; if not, write to the Free Software Foundation,   *
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.        *
+ *****************************************************************************/
+
+#ifndef _DIGESTCACHE_H
+#define _DIGESTCACHE_H 1
+
+#include <stddef.h>
+#include <inttypes.h>
+
+/**
+ * The digest cache keeps file digests in a fixed-size hash table in a
+ * memory mapped file, such that several digest files covering the same
+ * data do not read it again. Entries are keyed by device, inode and
+ * digest type, and are valid only for the recorded mtime and size. If
+ * the probe window of a key is full, the entry at its home slot is
+ * replaced. Concurrent processes synchronize by fcntl() locks on the
+ * file, and each slot carries a CRC32, such that slots torn by a
+ * crashed writer are ignored. Not available on Windows.
+ */
+
+/** maximum digest length stored */
+#define DC_DIGEST_MAX	64
+
+/** opaque structure declaration */
+struct digestcache;
+
+/** identity and state of a file, type distinguishes digest algorithms */
+struct dc_key
+{
+    uint64_t		dev;
+    uint64_t		ino;
+    int64_t		mtime;
+    int64_t		size;
+    uint32_t		type;
+};
+
+/**
+ * Open the cache file at path, which is created with room for the
+ * given number of slots (rounded up to a power of two) if it does not
+ * exist. Returns NULL and sets errno if the file cannot be opened or is
+ * not a digest cache.
+ */
+struct digestcache *dc_open(const char *path, size_t slots);
+
+/**
+ * Look up the digest of a file. Returns its length, which was copied to
+ * digest, or zero if there is no valid entry for the key.
+ */
+unsigned int dc_lookup(struct digestcache *dc, const struct dc_key *key,
+		       unsigned char *digest);
+
+/**
+ * Save the digest of len bytes of a file, replacing an older entry.
+ */
+void dc_store(struct digestcache *dc, const struct dc_key *key,
+	      const unsigned char *digest, unsigned int len);
+
+/**
+ * Unmap and close the cache file.
+ */
+void dc_close(struct digestcache *dc);
+
+#endif /* _DIGESTCACHE_H */
+
+/*****************************************************************************/
@@ -19,7 +19,6 @@
  *****************************************************************************/
 
 #include <assert.h>
-#include <ctype.h>
 #include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
@@ -34,8 +33,34 @@
 #include <time.h>
 #include <unistd.h>
 
+#if HAVE_SYS_INOTIFY_H
+#include <poll.h>
+#include <signal.h>
+#include <sys/inotify.h>
+#endif
+
+#if HAVE_SYS_XATTR_H
+#include <sys/xattr.h>
+#endif
+
+#if !ON_WIN32
+#include <sys/mman.h>
+#endif
+
+#if HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
 #include "digest.h"
+#include "arena.h"
 #include "rbtree.h"
+#include "hashindex.h"
+#include "dirtree.h"
+#include "psort.h"
+#include "extsort.h"
+#include "digestcache.h"
+#include "sumindex.h"
+#include "pathmatch.h"
 
 /**************************
  * Basic Type Definitions *
@@ -59,15 +84,139 @@ enum FileStatus
     FS_SKIPPED  /* skipped due to --restrict */
 };
 
+/**
+ * Per-file record. The digest is stored inline: records are allocated
+ * with room for the fixed digest size of the algorithm following the
+ * digest's size byte, see fileinfo_alloc(). The rarely used string
+ * fields are kept in the side table g_fileextra.
+ */
 struct FileInfo
 {
-    enum FileStatus	status;
-    time_t		mtime;
     long long		size;
+    time_t		mtime;
+    uint64_t		spanpos;	/* lines of the record in the loaded */
+    uint32_t		spancrc;	/* digest file, see digestreader_span() */
+    uint16_t		spanlen;	/* zero if they cannot be copied */
+    unsigned char	status;		/* enum FileStatus */
+    unsigned char	hasextra;	/* has entry in g_fileextra */
+    unsigned char	loaded;		/* digest was read from the digest file */
+    unsigned char	moved;		/* new file awaiting resolve_moved() */
+    digest_result	digest;		/* size is zero if there is none */
+};
+
+/* identity of a file on the filesystem */
+struct InodeId
+{
+    uint64_t		dev;
+    uint64_t		ino;
+};
+
+struct FileExtra
+{
     char*		error;
-    digest_result*	digest;
     char*               symlink; /* target actually */
-    char*               oldpath; /* for renamed or copied files. */
+    const struct dt_key* oldpath; /* for renamed or copied files. */
+    digest_result*	olddigest; /* loaded digest before it changed */
+    struct InodeId	inode;	/* saved with --inodes */
+    unsigned char	hasinode;
+};
+
+/* temporary properties of the next file collected while parsing */
+struct LineInfo
+{
+    time_t		mtime;
+    long long		size;
+    char*		symlink;
+    struct InodeId	inode;
+    unsigned char	hasinode;
+};
+
+/* state while reading a digest file line by line */
+struct DigestReader
+{
+    FILE*		fp;
+    const char*		map;		/* mapped file, NULL to use getline() */
+    size_t		mapsize;
+    size_t		mappos;
+    size_t		linepos;	/* offset of the current line */
+    char*		line;
+    size_t		linemax;
+    char*		name;		/* buffer for unescaped file names */
+    size_t		namemax;
+    unsigned int	linenum;
+    int			res;		/* result of the last line */
+    uint32_t		crc;
+    struct LineInfo	tempinfo;	/* attributes from comment lines */
+    struct LoadChunk*	chunk;		/* collects entries if parsing a chunk */
+    bool		journal;	/* replaying the journal, see journal_read() */
+
+    size_t		mapoffset;	/* of the map in the digest file */
+    int			spanstate;	/* enum SpanState */
+    size_t		spanstart;	/* offset of the record's first line */
+    uint32_t		spancrc;	/* of the map up to spanstart */
+};
+
+/* state of the lines of the next record while parsing a mapped file */
+enum SpanState { SPAN_NONE, SPAN_OPEN, SPAN_BROKEN };
+
+/* buffered output of a digest file, keeping the crc32 of the bytes
+ * written, see digestwriter_open() */
+struct DigestWriter
+{
+    int			fd;
+    char*		buf;
+    size_t		size;		/* bytes in buf */
+    size_t		bufmax;
+    size_t		crcpos;		/* bytes of buf included in crc */
+    uint32_t		crc;
+    int			error;		/* errno of the first failed write */
+};
+
+/* entry parsed by a thread, which is interned after all chunks are done */
+struct ChunkEntry
+{
+    const char*		name;		/* in the mapped file or chunk arena */
+    size_t		namelen;
+    struct FileInfo*	fileinfo;
+    struct LineInfo*	extra;		/* symlink target and inode, or NULL */
+    unsigned int	linenum;
+};
+
+/* crc line found in a chunk, verified once the preceding chunks' crcs
+ * are known */
+struct ChunkCrc
+{
+    uint32_t		saved;
+    uint32_t		crc;		/* of the chunk up to the line */
+    size_t		pos;		/* offset of the line in the chunk */
+    unsigned int	linenum;
+};
+
+/* part of the mapped digest file, which is parsed by its own thread */
+struct LoadChunk
+{
+    struct DigestReader	reader;		/* over the chunk's lines only */
+    struct arena*	arena;		/* records and copied names */
+    unsigned int	lines;
+
+    struct ChunkEntry*	list;
+    size_t		size, max;
+
+    struct ChunkCrc*	crcs;
+    size_t		crcsize, crcmax;
+};
+
+/* range of the file list, which is formatted by its own thread */
+struct WriteChunk
+{
+    struct DigestWriter* dw;		/* in memory, see digestwriter_buffer() */
+    struct rb_node*	begin;
+    unsigned int	nodes;		/* in the range starting at begin */
+    unsigned int	count;		/* records written */
+    uint32_t		crc;		/* of the formatted bytes */
+
+    char*		path;		/* buffer for the node's path */
+    size_t		pathmax;
 };
 
 /********************************
@@ -88,15 +237,204 @@ char* gopt_digestfile = NULL;
 enum DigestType gopt_digesttype = DT_NONE;
 unsigned int gopt_modify_window = 0;
 const char* gopt_exclude_marker = NULL;
+bool gopt_inodes = FALSE;
+bool gopt_xattr = FALSE;
+bool gopt_index = FALSE;
+unsigned int gopt_writethreads = 0;
+bool gopt_journal = FALSE;
+unsigned int gopt_journal_ratio = 10;
+bool gopt_cache = FALSE;
+char* gopt_cachefile = NULL;
 const char* gopt_matchpattern = NULL;
+struct pathmatch* gopt_pathmatch = NULL;
+char* gopt_subtree = NULL;
+char* gopt_changedfrom = NULL;
+bool gopt_watch = FALSE;
+unsigned int gopt_watch_interval = 600;
+size_t gopt_memlimit = 0;
+
+/* arena holding the nodes of g_filelist, all path
+ * keys, struct FileInfo and the strings and digests they point to.
+ * Nothing in it is freed individually, replaced values remain until
+ * the arena is released on exit, or replaced by filelist_compact(). */
+
+struct arena* g_arena = NULL;
+
+/* directory nodes and interned file path keys */
+
+struct dirtree* g_dirtree = NULL;
 
-/* red-black tree mapping filename string -> struct FileInfo */
+/* red-black tree mapping struct dt_key -> struct FileInfo, ordered by
+ * full path */
 
 struct rb_tree* g_filelist = NULL;
 
-/* red-black tree mapping digest_result -> filename string */
+/* red-black tree mapping struct FileInfo pointer -> struct FileExtra */
+
+struct rb_tree* g_fileextra = NULL;
+
+/* digest size of the algorithm used for new records */
+
+unsigned int g_digestsize = DIGEST_MAX_SIZE;
+
+/* hash index mapping struct dt_key -> node in g_filelist */
+
+struct hashindex* g_filehash = NULL;
+
+/* entries parsed from the digest file, which are sorted and inserted
+ * into g_filelist once the whole file is read */
+
+struct LoadEntry
+{
+    struct dt_key*	key;
+    struct FileInfo*	fileinfo;
+    unsigned int	linenum;
+};
+
+struct LoadEntry* g_loadlist = NULL;
+size_t g_loadlist_size = 0, g_loadlist_max = 0;
+
+/* line number of the first entry replayed from the journal, which are
+ * numbered after the lines of the digest file, or zero if none */
+
+unsigned int g_loadlist_journal = 0;
+
+/* hash table of all digests read from the digest file, used to detect
+ * renamed or copied files. It is built only when the first new file is
+ * found, as most runs find none. Slots are keyed on the leading digest
+ * bytes and point at the entries in g_filelist, slots with equal keys
+ * follow each other in the order of g_filelist. */
+
+struct DigestSlot
+{
+    uint64_t		prefix;
+    struct rb_node*	node;	/* NULL for an empty slot */
+};
+
+struct DigestSlot* g_digestindex = NULL;
+size_t g_digestindex_mask = 0;
+size_t g_digestindex_size = 0;
+double g_digestindex_time = 0;	/* seconds to build */
+
+/* new files with the digest of a loaded entry, which are resolved as
+ * copied or renamed after the scan by resolve_moved() */
+
+struct rb_node** g_moved = NULL;
+size_t g_moved_size = 0, g_moved_max = 0;
+
+/* digests of files with multiple hard links calculated during the
+ * current scan, keyed by device and inode, see digest_inode() */
+
+struct InodeDigest
+{
+    struct InodeId	id;
+    long long		size;
+    time_t		mtime;
+    digest_result	digest;		/* followed by the digest bytes */
+};
+
+struct hashindex* g_inodeindex = NULL;
+struct arena* g_inodearena = NULL;
+unsigned int g_inode_reused = 0;
+
+/* loaded entries by device and inode for --inodes, see inodemap_digest() */
+
+struct InodeEntry
+{
+    struct InodeId	id;
+    struct rb_node*	node;
+};
+
+struct hashindex* g_inodemap = NULL;
+unsigned int g_inodemap_reused = 0;
+
+/* number of digests taken from extended attributes with --xattr */
+unsigned int g_xattr_reused = 0;
+
+/* machine-wide digest cache selected by --cache, opened on first use */
+struct digestcache* g_digestcache = NULL;
+bool g_digestcache_failed = FALSE;
+unsigned int g_digestcache_reused = 0;
+
+/* state of the external memory mode selected by --memory-limit. While
+ * scanning, entries are collected in sorted runs by g_extscan instead
+ * of being processed. During the merge, entries parsed from the digest
+ * file and new records of process_file() are handed over in g_extold
+ * and g_extnew instead of being inserted into g_filelist. */
+
+struct ExtOld
+{
+    struct DigestReader	reader;		/* fp is NULL at the end */
+
+    char*		parsed;		/* entry handed over by loadlist_append() */
+    struct FileInfo*	parsedinfo;
+    unsigned int	parsedline;
+
+    char*		path;		/* pending entry, NULL if none */
+    struct FileInfo*	info;		/* copy outside of g_arena */
+    char*		symlink;
+    struct InodeId	inode;		/* kept for a persistent --inodes */
+    unsigned char	hasinode;
+};
+
+struct extsort* g_extscan = NULL;
+struct ExtOld g_extold;
+struct FileInfo* g_extnew = NULL;
+unsigned int g_ext_total = 0;
+
+/* the digest file as loaded, whose lines of unchanged records are copied
+ * when it is written. The crc32 of the file up to a record's lines is
+ * saved relative to the parsed chunk containing it, hence the crc32 of
+ * the file up to each chunk is kept in bases. */
+
+struct SpanBase
+{
+    uint64_t		pos;		/* offset of the chunk */
+    uint32_t		crc;		/* of the file up to pos */
+};
+
+struct LoadedFile
+{
+    bool		valid;		/* records have spans in this file */
+    uint64_t		size;
+    time_t		mtime;
+    uint64_t		dev, ino;
+    unsigned int	mode;		/* permissions given to the new file */
+    uint32_t		crc;		/* saved on the eof line */
+
+    struct SpanBase*	bases;		/* in file order */
+    size_t		basesize, basemax;
 
-struct rb_tree* g_filedigestmap = NULL;
+    int			fd;		/* opened while writing, see loadedfile_open() */
+    const char*		map;
+    size_t		mapsize;
+};
+
+struct LoadedFile g_loadedfile;
+
+/* journal of updates appended to the loaded digest file with --journal,
+ * see journal_read(). It belongs to the digest file with the stamp
+ * saved here, and is valid up to size, where the next update starts. */
+
+struct Journal
+{
+    bool		valid;		/* digest file ends with an eof line */
+    uint64_t		mainsize;
+    time_t		mainmtime;
+    uint32_t		maincrc;
+
+    char*		options;	/* option lines of the digest file */
+
+    uint64_t		size;		/* of the complete updates */
+    uint32_t		crc;		/* of the journal up to size */
+    uint64_t		filesize;	/* including an incomplete update */
+    unsigned int	updates;
+};
+
+struct Journal g_journal;
+
+#define JOURNAL_SUFFIX	".journal"
+#define JOURNAL_HEADER	"# digup journal of digest file with crc 0x%08x\n"
 
 /* file status counters */
 
@@ -114,57 +452,42 @@ unsigned int g_filelist_skipped = 0;
  * Helper Functions and Utilities *
  **********************************/
 
-/* functional for the g_filelist red-black tree */
-void rbtree_string_free(void *a)
+/* functional for the g_fileextra red-black tree */
+int rbtree_pointer_cmp(const void *a, const void *b)
 {
-    free((char*)a);
+    return ((uintptr_t)a > (uintptr_t)b) - ((uintptr_t)a < (uintptr_t)b);
 }
 
 /* functional for the g_filelist red-black tree */
-void rbtree_fileinfo_free(void *a)
+int rbtree_dt_key_cmp(const void *a, const void *b)
 {
-    struct FileInfo* fileinfo = a;
-
-    if (fileinfo->error)
-	free(fileinfo->error);
-
-    if (fileinfo->digest)
-	free(fileinfo->digest);
-
-    if (fileinfo->symlink)
-	free(fileinfo->symlink);
-
-    if (fileinfo->oldpath)
-	free(fileinfo->oldpath);
-
-    free(fileinfo);
+    return dt_key_cmp((const struct dt_key*)a, (const struct dt_key*)b);
 }
 
-/* functional for the g_filelist red-black tree */
-void rbtree_digest_result_free(void *a)
+/**
+ * Return the full path of a key in g_filelist. The path is built in
+ * one of a few static buffers, hence it stays valid only until the
+ * function has been called that many more times.
+ */
+const char* filelist_path(const void* key)
 {
-    free((digest_result*)a);
-}
+    static char* buf[4] = { NULL, NULL, NULL, NULL };
+    static size_t buflen[4] = { 0, 0, 0, 0 };
+    static unsigned int next = 0;
 
-/* functional for the g_filelist red-black tree */
-void rbtree_null_free(void *a)
-{
-    (void)a;
-}
+    size_t len = dt_key_length(key);
+    unsigned int i = next++ % 4;
 
-/* functional for the g_filelist red-black tree */
-int rbtree_string_cmp(const void *a, const void *b)
-{
-    return strcmp((const char*)a, (const char*)b);
-}
+    if (buflen[i] < len + 1)
+    {
+	buflen[i] = 2 * (len + 1);
+	buf[i] = realloc(buf[i], buflen[i]);
+    }
 
-/* functional for the g_filelist red-black tree */
-int rbtree_digest_result_cmp(const void *a, const void *b)
-{
-    return digest_cmp((const digest_result*)a,	
-		      (const digest_result*)b);
+    return dt_key_path(key, buf[i]);
 }
 
+
 /* functional for qsort() on a char* array */
 static int strcmpptr(const void *p1, const void *p2)
 {
@@ -224,6 +547,20 @@ static int my_asprintf(char **strp, const char *fmt, ...)
     return r;
 }
 
+/* extended attributes functions take additional position and option
+ * arguments on Mac OS X */
+#if HAVE_SYS_XATTR_H
+
+#ifdef __APPLE__
+#define my_getxattr(path,name,value,size)	getxattr(path, name, value, size, 0, 0)
+#define my_setxattr(path,name,value,size)	setxattr(path, name, value, size, 0, 0)
+#else
+#define my_getxattr(path,name,value,size)	getxattr(path, name, value, size)
+#define my_setxattr(path,name,value,size)	setxattr(path, name, value, size, 0)
+#endif
+
+#endif
+
 /* select correct struct stat and functions for 64-bit file sizes in mingw */
 #if ON_WIN32
 
@@ -333,44 +670,279 @@ char* readlink_dup(const char *filename)
 #endif
 }
 
+/* size of the output buffer of struct DigestWriter */
+#define DIGESTWRITER_BUFSIZE	(1024 * 1024)
+
+/* create a writer on a file descriptor, or on memory only if fd < 0 */
+static struct DigestWriter* digestwriter_create(int fd)
+{
+    struct DigestWriter* dw = calloc(1, sizeof(struct DigestWriter));
+
+    dw->fd = fd;
+    dw->bufmax = DIGESTWRITER_BUFSIZE;
+    dw->buf = malloc(dw->bufmax);
+
+    return dw;
+}
+
 /**
- * fprintf() variant which also updates a CRC32 value.
+ * Create or truncate a digest file for writing through a large buffer.
+ * Returns NULL and sets errno on failure.
  */
-int fprintfcrc(uint32_t *crc, FILE* fp, const char *fmt, ...)
+struct DigestWriter* digestwriter_open(const char* path)
 {
-    va_list ap;
-    ssize_t len;
+    int flags = O_WRONLY | O_CREAT | O_TRUNC;
+    int fd;
 
-    static char *out = NULL;
-    static ssize_t outlen = 0;
-    char *tmp;
+#ifdef O_BINARY
+    flags |= O_BINARY;
+#endif
 
-    va_start(ap, fmt);
-    len = vsnprintf(NULL, 0, fmt, ap) + 1;
-    va_end (ap);
+    if ((fd = open(path, flags, 0666)) < 0)
+	return NULL;
+
+    return digestwriter_create(fd);
+}
+
+/**
+ * Create a writer which only collects the formatted lines in its
+ * growing buffer, to be appended to a file by digestwriter_append().
+ */
+struct DigestWriter* digestwriter_buffer(void)
+{
+    return digestwriter_create(-1);
+}
+
+/* write data to the file, unless a write failed before */
+static void digestwriter_write(struct DigestWriter* dw, const char* data, size_t len)
+{
+    size_t pos = 0;
+
+    while (pos < len && !dw->error)
+    {
+	ssize_t wb = write(dw->fd, data + pos, len - pos);
+
+	if (wb < 0 && errno == EINTR)
+	    continue;
+
+	if (wb <= 0)
+	    dw->error = (wb < 0) ? errno : EIO;
+	else
+	    pos += wb;
+    }
+}
+
+/**
+ * Write out the buffer, updating the crc32 with the bytes not included
+ * yet. The first error is kept and stops all further writes.
+ */
+void digestwriter_flush(struct DigestWriter* dw)
+{
+    dw->crc = crc32(dw->crc, (const unsigned char*)dw->buf + dw->crcpos,
+		    dw->size - dw->crcpos);
+
+    digestwriter_write(dw, dw->buf, dw->size);
+
+    dw->size = dw->crcpos = 0;
+}
+
+/**
+ * Append lines formatted by a writer on memory, with the given crc32 of
+ * them. They are written directly after flushing the buffer.
+ */
+void digestwriter_append(struct DigestWriter* dw, const struct DigestWriter* part,
+			 uint32_t crc)
+{
+    digestwriter_flush(dw);
+
+    dw->crc = crc32_combine(dw->crc, crc, part->size);
+
+    digestwriter_write(dw, part->buf, part->size);
+}
+
+/**
+ * Append len bytes at offset pos of the file srcfd, which are also
+ * mapped at data, with the given crc32 of them. They are copied by the
+ * kernel directly after flushing the buffer, if it supports
+ * copy_file_range() between the files, otherwise written from data.
+ */
+void digestwriter_copy(struct DigestWriter* dw, int srcfd, uint64_t pos,
+		       const char* data, size_t len, uint32_t crc)
+{
+    digestwriter_flush(dw);
+
+    dw->crc = crc32_combine(dw->crc, crc, len);
 
-    if (outlen < len)
+#if HAVE_COPY_FILE_RANGE
     {
-	while (outlen < len)
+	off_t off = pos;
+
+	while (len > 0 && !dw->error)
 	{
-	    outlen = 2 * outlen;
-	    if (outlen < 128) outlen = 128;
+	    ssize_t n = copy_file_range(srcfd, &off, dw->fd, NULL, len, 0);
+
+	    if (n < 0 && errno == EINTR)
+		continue;
+
+	    if (n <= 0) break; /* write the rest instead */
+
+	    data += n;
+	    len -= n;
+	}
+    }
+#else
+    (void)srcfd; (void)pos;
+#endif
+
+    digestwriter_write(dw, data, len);
+}
+
+/**
+ * Returns room for at least n bytes at the end of the buffer, which
+ * are appended by digestwriter_commit(). A writer on memory grows its
+ * buffer instead of flushing it.
+ */
+char* digestwriter_reserve(struct DigestWriter* dw, size_t n)
+{
+    if (dw->size + n > dw->bufmax)
+    {
+	if (dw->fd >= 0)
+	    digestwriter_flush(dw);
+
+	if (dw->size + n > dw->bufmax) {
+	    dw->bufmax = (dw->size + n > 2 * dw->bufmax) ? dw->size + n : 2 * dw->bufmax;
+	    dw->buf = realloc(dw->buf, dw->bufmax);
 	}
+    }
+
+    return dw->buf + dw->size;
+}
+
+/* append the reserved bytes up to end */
+void digestwriter_commit(struct DigestWriter* dw, char* end)
+{
+    dw->size = end - dw->buf;
+}
+
+/* append a string */
+void digestwriter_puts(struct DigestWriter* dw, const char* str)
+{
+    size_t len = strlen(str);
+    char* p = digestwriter_reserve(dw, len);
+
+    memcpy(p, str, len);
+    digestwriter_commit(dw, p + len);
+}
+
+/**
+ * Append the eof line with the crc32 of all preceding bytes, which is
+ * returned.
+ */
+uint32_t digestwriter_eof(struct DigestWriter* dw)
+{
+    char line[32];
+
+    dw->crc = crc32(dw->crc, (const unsigned char*)dw->buf + dw->crcpos,
+		    dw->size - dw->crcpos);
+    dw->crcpos = dw->size;
+
+    sprintf(line, "#: crc 0x%08x eof\n", dw->crc);
+    digestwriter_puts(dw, line);
+
+    /* the eof line itself is not checksummed */
+    dw->crcpos = dw->size;
+
+    return dw->crc;
+}
+
+/**
+ * Flush and close the digest file and release the writer. Returns FALSE
+ * and sets errno if any write failed.
+ */
+bool digestwriter_close(struct DigestWriter* dw)
+{
+    int error;
+
+    if (dw->fd >= 0)
+    {
+	digestwriter_flush(dw);
 
-	tmp = realloc(out, outlen);
-	if (tmp == NULL)
-            return -1;
-        out = tmp;
+	if (close(dw->fd) != 0 && !dw->error)
+	    dw->error = errno;
     }
 
-    va_start(ap, fmt);
-    len = vsnprintf(out, len, fmt, ap);
-    va_end (ap);
+    error = dw->error;
 
-    *crc = crc32(*crc, (unsigned char*)out, len);
-    len = fwrite(out, len, 1, fp);
+    free(dw->buf);
+    free(dw);
 
-    return len;
+    errno = error;
+    return (error == 0);
+}
+
+/* formatting functions of the digest writer, which fill reserved room
+ * at p and return the new end */
+
+static char* dw_puts(char* p, const char* str)
+{
+    size_t len = strlen(str);
+
+    memcpy(p, str, len);
+    return p + len;
+}
+
+static char* dw_unsigned(char* p, unsigned long long v)
+{
+    char digits[24];
+    int n = 0;
+
+    do {
+	digits[n++] = (char)('0' + v % 10);
+	v /= 10;
+    } while (v);
+
+    while (n) *p++ = digits[--n];
+
+    return p;
+}
+
+static char* dw_number(char* p, long long v)
+{
+    if (v >= 0)
+	return dw_unsigned(p, v);
+
+    *p++ = '-';
+    return dw_unsigned(p, 0ULL - (unsigned long long)v);
+}
+
+/* file names containing a backslash or newline are escaped */
+static bool dw_needescape(const char* str, size_t len)
+{
+    return (memchr(str, '\\', len) != NULL || memchr(str, '\n', len) != NULL);
+}
+
+/* append the name escaped like needescape_filename(), which needs room
+ * for up to twice its length */
+static char* dw_name(char* p, const char* str, size_t len)
+{
+    const char* end = str + len;
+
+    for (; str != end; ++str)
+    {
+	if (*str == '\\') {
+	    *p++ = '\\';
+	    *p++ = '\\';
+	}
+	else if (*str == '\n') {
+	    *p++ = '\\';
+	    *p++ = 'n';
+	}
+	else {
+	    *p++ = *str;
+	}
+    }
+
+    return p;
 }
 
 /**
@@ -484,9 +1056,63 @@ void replace_backslahes_with_slashes(char* s)
 
 #endif
 
-/***************************************
- * Functions to calculate file digests *
- ***************************************/
+/**
+ * Normalize a path relative to the top directory in place: leading
+ * "./" and trailing slashes are removed. Returns a pointer into path,
+ * which is empty for the top directory itself, or NULL if the path is
+ * absolute or leaves the top directory via "..".
+ */
+char* normalize_relpath(char* path)
+{
+    char* p = path;
+    size_t len;
+
+    while (p[0] == '.' && p[1] == '/') {
+	p += 2;
+	while (*p == '/') ++p;
+    }
+
+    len = strlen(p);
+    while (len > 0 && p[len-1] == '/') --len;
+    p[len] = 0;
+
+    if (len == 1 && p[0] == '.')
+	return p + 1;
+
+    if (p[0] == '/' || strcmp(p, "..") == 0 || strncmp(p, "../", 3) == 0 ||
+	strstr(p, "/../") || (len >= 3 && strcmp(p + len - 3, "/..") == 0))
+	return NULL;
+
+    return p;
+}
+
+/***************************************
+ * Functions to calculate file digests *
+ ***************************************/
+
+/**
+ * Parse a size in bytes with an optional K, M or G suffix. Returns
+ * FALSE if the string is not a valid size.
+ */
+bool parse_size(const char* str, size_t* out)
+{
+    char* endp;
+    unsigned long long size = strtoull(str, &endp, 10);
+
+    if (endp == str) return FALSE;
+
+    switch (*endp)
+    {
+    case 'k': case 'K': size <<= 10; ++endp; break;
+    case 'm': case 'M': size <<= 20; ++endp; break;
+    case 'g': case 'G': size <<= 30; ++endp; break;
+    }
+
+    if (*endp) return FALSE;
+
+    *out = size;
+    return TRUE;
+}
 
 /**
  * Called from digest_file() with a struct digest_ctx. If there is an
@@ -496,7 +1122,7 @@ void replace_backslahes_with_slashes(char* s)
 bool digest_file2(const char* filepath,
 		  long long filesize,
 		  digest_ctx* digctx,
-		  digest_result** outdigest,
+		  digest_result* outdigest,
 		  char** outerror)
 {
     char buffer[1024*1024];
@@ -589,19 +1215,18 @@ bool digest_file2(const char* filepath,
 	return FALSE;
     }
 
-    assert(!*outdigest);
-    *outdigest = digctx->finish(digctx);
+    digctx->finish_into(digctx, outdigest);
 
     return TRUE;
 }
 
 /**
- * Read a filepath and calucate the digest over all data. Returns it
- * as a malloc()ed hex string in outdigest, or returns FALSE if there
- * was a read error.
+ * Read a filepath and calucate the digest over all data. Stores it in
+ * outdigest, which must have room for the algorithm's digest size, or
+ * returns FALSE if there was a read error.
  */
 bool digest_file(const char* filepath, long long filesize,
-                 digest_result** outdigest, char** outerror)
+                 digest_result* outdigest, char** outerror)
 {
     digest_ctx digctx;
 
@@ -632,1776 +1257,6232 @@ bool digest_file(const char* filepath, long long filesize,
     return digest_file2(filepath, filesize, &digctx, outdigest, outerror);
 }
 
-/************************************
- * Functions to parse a digest file *
- ************************************/
-
 /**
- * Parse one digest line and fill in tempinfo according or add a new
- * file to g_filelist. The return value is -1 for an unknown line, 0
- * for a correct digest or symlink line, +1 for a comment line
- * providing additional file info and -2 for and eof flagged line.
+ * Returns the digest size of an algorithm, or the largest one if none
+ * is selected yet.
  */
-int parse_digestline(const char* line, const unsigned int linenum,
-                     struct FileInfo* tempinfo, uint32_t crc)
+unsigned int digesttype_size(enum DigestType type)
 {
-    /*** parse line from digest file ***/
-    size_t p = 0;
+    switch (type)
+    {
+    case DT_MD5: return MD5_DIGEST_SIZE;
+    case DT_SHA1: return SHA1_DIGEST_SIZE;
+    case DT_SHA256: return SHA256_DIGEST_SIZE;
+    case DT_SHA512: return SHA512_DIGEST_SIZE;
+    default: return DIGEST_MAX_SIZE;
+    }
+}
 
-    /* skip initial whitespace */
-    while (isspace(line[p])) ++p;
+/**
+ * Open the machine-wide digest cache selected by --cache on first use:
+ * the given file or by default "digup/digests.cache" in
+ * $XDG_CACHE_HOME or ~/.cache. Returns NULL if no cache is used or it
+ * cannot be opened, which is reported once.
+ */
+struct digestcache* digestcache_get(void)
+{
+#if !ON_WIN32
+    if (g_digestcache || g_digestcache_failed || !gopt_cache)
+	return g_digestcache;
 
-    if (line[p] == '#')
+    if (!gopt_cachefile)
     {
-	/* if first character is a hash then the line might be a
-	   comment or our custom mtime indicator. */
-
-	size_t p_word, p_arg;
+	const char* xdg = getenv("XDG_CACHE_HOME");
+	char *base, *dir;
 
-	++p;
-	if (line[p] != ':')
-	{
-	    /* usual comment */
-	    return 0;
-	}
+	if (xdg && *xdg)
+	    my_asprintf(&base, "%s", xdg);
+	else if (getenv("HOME"))
+	    my_asprintf(&base, "%s/.cache", getenv("HOME"));
+	else
+	    my_asprintf(&base, "/tmp");
 
-	++p;
+	my_asprintf(&dir, "%s/digup", base);
+	mkdir(base, 0700);
+	mkdir(dir, 0700);
 
-	while (line[p])
-	{
-	    while (isspace(line[p])) ++p;
+	my_asprintf(&gopt_cachefile, "%s/digests.cache", dir);
+	free(base);
+	free(dir);
+    }
 
-	    p_word = p;
-	    while (isalpha(line[p]) || line[p] == '\\') ++p;
+    /* about 28 MiB, of which only used pages are allocated */
+    g_digestcache = dc_open(gopt_cachefile, 256 * 1024);
 
-	    if (!isspace(line[p]) && line[p] != 0)
-	    {
-		fprintf(stderr, "%s: \"%s\" line %d: unparseable digest comment line.\n",
-			g_progname, gopt_digestfile, linenum);
+    if (!g_digestcache)
+    {
+	fprintf(stderr, "%s: could not open digest cache \"%s\": %s\n",
+		g_progname, gopt_cachefile, strerror(errno));
+	g_digestcache_failed = TRUE;
+    }
+#endif
 
-		return -1;
-	    }
+    return g_digestcache;
+}
 
-	    if (strncmp(line+p_word, "option", p - p_word) == 0)
-	    {
-		/* read persistent option following */
+/**
+ * Calculate the digest of a regular file like digest_file(), but look
+ * it up in the machine-wide cache first and save it there afterwards.
+ * The cache is keyed by device, inode, mtime and size, and not used
+ * for lookups with --check. External memory mode passes no inode.
+ */
+bool digest_file_cached(const char* filepath, const mystatst* st,
+			digest_result* outdigest, char** outerror)
+{
+    struct digestcache* dc = gopt_memlimit ? NULL : digestcache_get();
+    struct dc_key key;
+    unsigned int len;
+
+    if (!dc)
+	return digest_file(filepath, st->st_size, outdigest, outerror);
+
+    memset(&key, 0, sizeof(key));
+    key.dev = st->st_dev;
+    key.ino = st->st_ino;
+    key.mtime = st->st_mtime;
+    key.size = st->st_size;
+    key.type = gopt_digesttype;
+
+    if (!gopt_fullcheck &&
+	(len = dc_lookup(dc, &key, (unsigned char*)(outdigest + 1))) != 0 &&
+	len == digesttype_size(gopt_digesttype))
+    {
+	outdigest->size = len;
+	++g_digestcache_reused;
+	return TRUE;
+    }
 
-		while (isspace(line[p])) ++p;
+    if (!digest_file(filepath, st->st_size, outdigest, outerror))
+	return FALSE;
 
-		p_arg = p;
-		while (line[p] != 0 && line[p] != '=') ++p;
+    dc_store(dc, &key, (const unsigned char*)(outdigest + 1), outdigest->size);
+    return TRUE;
+}
 
-		if (strncmp(line+p_arg, "--exclude-marker", p - p_arg) == 0 &&
-                    line[p] == '=')
-		{
-		    ++p; /* skip over '=' */
+/* functionals for g_inodeindex and g_inodemap, keyed by structures
+ * starting with a struct InodeId */
+uint64_t inodeid_hash(const void* key)
+{
+    const struct InodeId* id = key;
 
-		    p_arg = p;
-		    while (line[p] != 0) ++p;
+    return (id->dev * 0x9E3779B97F4A7C15ULL) ^ id->ino;
+}
 
-		    if (gopt_exclude_marker) free((void*)gopt_exclude_marker);
+int inodeid_equal(const void* a, const void* b)
+{
+    const struct InodeId* ia = a;
+    const struct InodeId* ib = b;
 
-		    gopt_exclude_marker = strndup(line+p_arg, p - p_arg);
+    return ia->dev == ib->dev && ia->ino == ib->ino;
+}
 
-		    if (gopt_verbose >= 2) {
-			fprintf(stderr, "%s: \"%s\" line %d: persistent option --exclude-marker=%s\n",
-				g_progname, gopt_digestfile, linenum, gopt_exclude_marker);
-		    }
-		}
-		else
-		{
-		    fprintf(stderr, "%s: \"%s\" line %d: unknown persistent option line.\n",
-			    g_progname, gopt_digestfile, linenum);
+/**
+ * Calculate the digest of a regular file like digest_file(). The
+ * digests of files with more than one hard link are kept by device and
+ * inode in g_inodeindex, such that each inode is read only once per
+ * scan. Not used in external memory mode, where it would grow with the
+ * number of such files.
+ */
+bool digest_inode(const char* filepath, const mystatst* st,
+		  digest_result* outdigest, char** outerror)
+{
+#if !ON_WIN32
+    if (st->st_nlink > 1 && !gopt_memlimit)
+    {
+	struct InodeDigest key, *entry;
+	size_t size;
 
-		    return -1;
-		}
-	    }
-	    else if (strncmp(line+p_word, "mtime", p - p_word) == 0)
-	    {
-		/* read number following mtime */
+	if (!g_inodeindex)
+	{
+	    g_inodeindex = hi_create_custom(0, inodeid_hash, inodeid_equal);
+	    g_inodearena = arena_create(0);
+	}
 
-		while (isspace(line[p])) ++p;
+	key.id.dev = st->st_dev;
+	key.id.ino = st->st_ino;
 
-		p_arg = p;
-		while (isdigit(line[p])) ++p;
+	entry = hi_find(g_inodeindex, &key);
 
-		if (!isspace(line[p]) && line[p] != 0)
-		{
-		    fprintf(stderr, "%s: \"%s\" line %d: unparseable digest comment line.\n",
-			    g_progname, gopt_digestfile, linenum);
+	if (entry && entry->size == st->st_size && entry->mtime == st->st_mtime)
+	{
+	    memcpy(outdigest, &entry->digest, 1 + entry->digest.size);
+	    ++g_inode_reused;
+	    return TRUE;
+	}
 
-		    return -1;
-		}
+	if (!digest_file_cached(filepath, st, outdigest, outerror))
+	    return FALSE;
 
-		tempinfo->mtime = strtoul(line + p_arg, NULL, 10);
-	    }
-	    else if (strncmp(line+p_word, "size", p - p_word) == 0)
-	    {
-		/* read number following size */
+	size = offsetof(struct InodeDigest, digest) + 1 + outdigest->size;
+	if (size < sizeof(struct InodeDigest))
+	    size = sizeof(struct InodeDigest);
 
-		while (isspace(line[p])) ++p;
+	entry = arena_alloc(g_inodearena, size);
+	entry->id = key.id;
+	entry->size = st->st_size;
+	entry->mtime = st->st_mtime;
+	memcpy(&entry->digest, outdigest, 1 + outdigest->size);
 
-		p_arg = p;
-		while (isdigit(line[p])) ++p;
+	hi_insert(g_inodeindex, entry, entry);
+	return TRUE;
+    }
+#endif
 
-		if (!isspace(line[p]) && line[p] != 0)
-		{
-		    fprintf(stderr, "%s: \"%s\" line %d: unparseable digest comment line.\n",
-			    g_progname, gopt_digestfile, linenum);
+    return digest_file_cached(filepath, st, outdigest, outerror);
+}
 
-		    return -1;
-		}
+/**
+ * Forget the digests of hard linked files after a scan, as the files
+ * may be modified before the next one.
+ */
+void inodeindex_clear(void)
+{
+    if (!g_inodeindex) return;
 
-		tempinfo->size = strtoull(line + p_arg, NULL, 10);
-	    }
-	    else if (strncmp(line+p_word, "target", p - p_word) == 0)
-	    {
-		/* read the complete following line (after the current
-		 * white space) as the symlink target */
+    hi_destroy(g_inodeindex);
+    arena_destroy(g_inodearena);
 
-		if (!isspace(line[p]))
-		{
-		    fprintf(stderr, "%s: \"%s\" line %d: unparseable digest comment line.\n",
-			    g_progname, gopt_digestfile, linenum);
+    g_inodeindex = NULL;
+    g_inodearena = NULL;
+}
 
-		    return -1;
-		}
-		++p;
+/**
+ * Returns the name of the extended attribute caching the digest of the
+ * selected algorithm with --xattr.
+ */
+const char* xattr_name(void)
+{
+    switch (gopt_digesttype)
+    {
+    case DT_MD5: return "user.digup.md5";
+    case DT_SHA1: return "user.digup.sha1";
+    case DT_SHA256: return "user.digup.sha256";
+    case DT_SHA512: return "user.digup.sha512";
+    default: return NULL;
+    }
+}
 
-		p_arg = p;
-		while (line[p] != 0) ++p;
+/**
+ * Read the digest cached in the extended attribute of a file with
+ * --xattr. The value "mtime size hexdigest" is only used if mtime and
+ * size are equal to the file's current ones. Not used for --check.
+ */
+bool xattr_digest(const char* filepath, const mystatst* st,
+		  digest_result* outdigest)
+{
+#if HAVE_SYS_XATTR_H
+    char value[64 + 2 * DIGEST_MAX_SIZE];
+    char hex[2 * DIGEST_MAX_SIZE + 1];
+    long mtime;
+    long long size;
+    ssize_t len;
 
-		tempinfo->symlink = strndup(line+p_arg, p - p_arg);
-	    }
-	    else if (strncmp(line+p_word, "target\\", p - p_word) == 0)
-	    {
-		/* read the complete following line (after the current
-		 * white space) as the escaped symlink target */
+    if (!gopt_xattr || gopt_fullcheck || !xattr_name())
+	return FALSE;
 
-		if (!isspace(line[p]))
-		{
-		    fprintf(stderr, "%s: \"%s\" line %d: unparseable digest comment line.\n",
-			    g_progname, gopt_digestfile, linenum);
+    len = my_getxattr(filepath, xattr_name(), value, sizeof(value) - 1);
+    if (len <= 0) return FALSE;
 
-		    return -1;
-		}
-		++p;
+    value[len] = 0;
 
-		p_arg = p;
-		while (line[p] != 0) ++p;
+    if (sscanf(value, "%ld %lld %128s", &mtime, &size, hex) != 3)
+	return FALSE;
 
-		tempinfo->symlink = strndup(line+p_arg, p - p_arg);
+    if (mtime != (long)st->st_mtime || size != (long long)st->st_size)
+	return FALSE;
 
-		if (!unescape_filename(tempinfo->symlink))
-		{
-		    fprintf(stderr, "%s: \"%s\" line %d: improperly escaped symlink target.\n",
-			    g_progname, gopt_digestfile, linenum);
-		    free(tempinfo->symlink);
-		    return -1;
-		}
-	    }
-	    else if (strncmp(line+p_word, "symlink", p - p_word) == 0)
-	    {
-		/* read the complete following line (after the current
-		 * white space) as the symlink source file name. */
+    if (strlen(hex) != 2 * digesttype_size(gopt_digesttype) ||
+	!digest_hex2bin_buf(hex, strlen(hex), outdigest))
+	return FALSE;
 
-		char* filename;
-		struct FileInfo* fileinfo;
+    ++g_xattr_reused;
+    return TRUE;
+#else
+    (void)filepath; (void)st; (void)outdigest;
+    return FALSE;
+#endif
+}
 
-		if (!isspace(line[p]))
-		{
-		    fprintf(stderr, "%s: \"%s\" line %d: unparseable digest comment line.\n",
-			    g_progname, gopt_digestfile, linenum);
+/**
+ * Save a calculated digest in the extended attribute of a file with
+ * --xattr. Errors are ignored, e.g. for read-only files or filesystems
+ * without user attributes.
+ */
+void xattr_save(const char* filepath, const mystatst* st,
+		const digest_result* digest)
+{
+#if HAVE_SYS_XATTR_H
+    char value[64 + 2 * DIGEST_MAX_SIZE];
+    char hex[2 * DIGEST_MAX_SIZE + 1];
+    int len;
 
-		    return -1;
-		}
-		++p;
+    if (!gopt_xattr || !xattr_name())
+	return;
 
-		p_arg = p;
-		while (line[p] != 0) ++p;
+    len = snprintf(value, sizeof(value), "%ld %lld %s",
+		   (long)st->st_mtime, (long long)st->st_size,
+		   digest_bin2hex(digest, hex));
 
-		filename = strndup(line+p_arg, p - p_arg);
+    my_setxattr(filepath, xattr_name(), value, len);
+#else
+    (void)filepath; (void)st; (void)digest;
+#endif
+}
 
-		fileinfo = malloc(sizeof(struct FileInfo));
-		memcpy(fileinfo, tempinfo, sizeof(struct FileInfo));
-		if (fileinfo->symlink) /* tempinfo's copy will be freed */
-		    fileinfo->symlink = strdup(fileinfo->symlink);
+/************************************************
+ * Functions to allocate and access file records *
+ ************************************************/
 
-		/* insert fileinfo into filelist */
+/**
+ * Allocate a zeroed record with room for a digest of digestsize bytes
+ * from the given arena.
+ */
+struct FileInfo* fileinfo_alloc_in(struct arena* arena, unsigned int digestsize)
+{
+    size_t size = offsetof(struct FileInfo, digest) + 1 + digestsize;
 
-		if (rb_find(g_filelist, filename) != NULL)
-		{
-		    fprintf(stderr, "%s: \"%s\" line %d: duplicate symlink file name.\n",
-			    g_progname, gopt_digestfile, linenum);
+    if (size < sizeof(struct FileInfo))
+	size = sizeof(struct FileInfo);
 
-		    free(fileinfo->symlink);
-		    free(fileinfo);
-		    return -1;
-		}
+    return arena_calloc(arena, size);
+}
 
-		rb_insert(g_filelist, filename, fileinfo);
+/**
+ * Allocate a zeroed record with room for a digest of digestsize bytes
+ * from g_arena.
+ */
+struct FileInfo* fileinfo_alloc(unsigned int digestsize)
+{
+    return fileinfo_alloc_in(g_arena, digestsize);
+}
 
-		/* return +1 here to clear tempinfo. */
-		return 1;
-	    }
-	    else if (strncmp(line+p_word, "symlink\\", p - p_word) == 0)
-	    {
-		/* read the complete following line (after the current
-		 * white space) as the escaped symlink source file name. */
+/**
+ * Return the side table entry of a record, which is created if it does
+ * not exist and create is set, otherwise NULL is returned.
+ */
+struct FileExtra* fileinfo_extra(struct FileInfo* fileinfo, bool create)
+{
+    struct FileExtra* extra;
 
-		char* filename;
-		struct FileInfo* fileinfo;
+    if (fileinfo->hasextra)
+	return rb_find(g_fileextra, fileinfo)->value;
 
-		if (!isspace(line[p]))
-		{
-		    fprintf(stderr, "%s: \"%s\" line %d: unparseable digest comment line.\n",
-			    g_progname, gopt_digestfile, linenum);
+    if (!create)
+	return NULL;
 
-		    return -1;
-		}
-		++p;
+    extra = arena_calloc(g_arena, sizeof(struct FileExtra));
+    rb_insert(g_fileextra, fileinfo, extra);
+    fileinfo->hasextra = TRUE;
 
-		p_arg = p;
-		while (line[p] != 0) ++p;
+    return extra;
+}
 
-		filename = strndup(line+p_arg, p - p_arg);
+const char* fileinfo_error(const struct FileInfo* fileinfo)
+{
+    return fileinfo->hasextra ?
+	((struct FileExtra*)rb_find(g_fileextra, fileinfo)->value)->error : NULL;
+}
 
-		if (!unescape_filename(filename))
-		{
-		    fprintf(stderr, "%s: \"%s\" line %d: improperly escaped symlink filename.\n",
-			    g_progname, gopt_digestfile, linenum);
-		    free(filename);
-		    return -1;
-		}
+const char* fileinfo_symlink(const struct FileInfo* fileinfo)
+{
+    return fileinfo->hasextra ?
+	((struct FileExtra*)rb_find(g_fileextra, fileinfo)->value)->symlink : NULL;
+}
 
-		fileinfo = malloc(sizeof(struct FileInfo));
-		memcpy(fileinfo, tempinfo, sizeof(struct FileInfo));
-		if (fileinfo->symlink) /* tempinfo's copy will be freed */
-		    fileinfo->symlink = strdup(fileinfo->symlink);
+/**
+ * Returns the device and inode saved for a record with --inodes, or
+ * NULL if there are none.
+ */
+const struct InodeId* fileinfo_inode(const struct FileInfo* fileinfo)
+{
+    const struct FileExtra* extra = fileinfo->hasextra ?
+	rb_find(g_fileextra, fileinfo)->value : NULL;
 
-		/* insert fileinfo into filelist */
+    return (extra && extra->hasinode) ? &extra->inode : NULL;
+}
 
-		if (rb_find(g_filelist, filename) != NULL)
-		{
-		    fprintf(stderr, "%s: \"%s\" line %d: duplicate symlink file name.\n",
-			    g_progname, gopt_digestfile, linenum);
+/**
+ * Save the device and inode of a regular file in its record, if
+ * enabled by --inodes. In external memory mode the merge passes only
+ * size and mtime, hence loaded records keep their saved inode.
+ */
+void fileinfo_set_inode(struct FileInfo* fileinfo, const mystatst* st)
+{
+#if !ON_WIN32
+    struct FileExtra* extra;
 
-		    free(fileinfo->symlink);
-		    free(fileinfo);
-		    return -1;
-		}
+    if (!gopt_inodes || gopt_memlimit) return;
 
-		rb_insert(g_filelist, filename, fileinfo);
+    extra = fileinfo_extra(fileinfo, TRUE);
 
-		/* return +1 here to clear tempinfo. */
-		return 1;
-	    }
-	    else if (strncmp(line+p_word, "crc", p - p_word) == 0)
-	    {
-		/* read hex crc32 value following the word */
+    /* the saved lines of the record are outdated */
+    if (!extra->hasinode || extra->inode.dev != (uint64_t)st->st_dev ||
+	extra->inode.ino != (uint64_t)st->st_ino)
+	fileinfo->spanlen = 0;
 
-		char *crchex;
+    extra->inode.dev = st->st_dev;
+    extra->inode.ino = st->st_ino;
+    extra->hasinode = TRUE;
+#else
+    (void)fileinfo; (void)st;
+#endif
+}
 
-		while (isspace(line[p])) ++p;
+const char* fileinfo_oldpath(const struct FileInfo* fileinfo)
+{
+    const struct dt_key* oldpath = fileinfo->hasextra ?
+	((struct FileExtra*)rb_find(g_fileextra, fileinfo)->value)->oldpath : NULL;
 
-		if (line[p] != '0' || line[++p] != 'x')
-		{
-		    fprintf(stderr, "%s: \"%s\" line %d: unparseable crc line.\n",
-			    g_progname, gopt_digestfile, linenum);
-		    return 0;
-		}
-		++p;
+    return oldpath ? filelist_path(oldpath) : NULL;
+}
 
-		p_arg = p;
-		while (isxdigit(line[p])) ++p;
+/**
+ * Allocate a record from the attributes collected on comment lines in
+ * the given arena, with room for a digest of digestsize bytes. The
+ * symlink target and inode are not set, as the side table is shared.
+ */
+struct FileInfo* fileinfo_from_line_in(struct arena* arena,
+				       const struct LineInfo* lineinfo,
+				       unsigned int digestsize)
+{
+    struct FileInfo* fileinfo = fileinfo_alloc_in(arena, digestsize);
 
-		if (p - p_arg != 8)
-		{
-		    fprintf(stderr, "%s: \"%s\" line %d: unparseable sdfsdcrc line.\n",
-			    g_progname, gopt_digestfile, linenum);
-		    return 0;
-		}
+    fileinfo->status = FS_UNSEEN;
+    fileinfo->loaded = TRUE;
+    fileinfo->size = lineinfo->size;
+    fileinfo->mtime = lineinfo->mtime;
 
-		my_asprintf(&crchex, "%08x", crc);
-		
-		if (strncmp(crchex, line+p_arg, p - p_arg) != 0)
-		{
-		    free(crchex);
+    return fileinfo;
+}
 
-		    fprintf(stderr, "%s: \"%s\" line %d: crc32 value saved in file does not match!\n",
-			    g_progname, gopt_digestfile, linenum);
+/**
+ * Save the symlink target and inode collected on comment lines in the
+ * side table entry of a loaded record.
+ */
+void fileinfo_line_extra(struct FileInfo* fileinfo, const struct LineInfo* lineinfo)
+{
+    if (lineinfo->symlink) /* lineinfo's copy will be freed */
+	fileinfo_extra(fileinfo, TRUE)->symlink = arena_strdup(g_arena, lineinfo->symlink);
 
-		    if (gopt_batch)
-		    {
-			exit(-1); /* fail badly */
-		    }
-		    else
-		    {
-			char input[256], *r;
+    if (lineinfo->hasinode)
+    {
+	struct FileExtra* extra = fileinfo_extra(fileinfo, TRUE);
+	extra->inode = lineinfo->inode;
+	extra->hasinode = TRUE;
+    }
+}
 
-			fprintf(stderr, "This indicates an unintentional or intentional modification of the digest file.\n");
-			fprintf(stderr, "Continue despite change (y/n)? ");
+/**
+ * Allocate a record from the attributes collected on comment lines,
+ * with room for a digest of digestsize bytes.
+ */
+struct FileInfo* fileinfo_from_line(const struct LineInfo* lineinfo,
+				    unsigned int digestsize)
+{
+    struct FileInfo* fileinfo = fileinfo_from_line_in(g_arena, lineinfo, digestsize);
 
-			r = fgets(input, sizeof(input), stdin);
+    fileinfo_line_extra(fileinfo, lineinfo);
 
-			if (r == NULL || input[0] != 'y')
-			{
-			    exit(-1);
-			}
-		    }
-		}
-		else
-		{
-		    free(crchex);
-		}
-	    }
-	    else if (strncmp(line+p_word, "eof", p - p_word) == 0)
-	    {
-		return -2;
-	    }
-	    else
-	    {
-		fprintf(stderr, "%s: \"%s\" line %d: unparseable digest comment line.\n",
-			g_progname, gopt_digestfile, linenum);
+    return fileinfo;
+}
 
-		return -1;
-	    }
-	}
+/**
+ * Returns the digest of a record as read from the digest file, which
+ * is kept even if the file's content changed, or NULL if there is none.
+ */
+const digest_result* fileinfo_loaded_digest(const struct FileInfo* fileinfo)
+{
+    if (!fileinfo->loaded)
+	return NULL;
 
-	return 0;
-    }
-    else
+    if (fileinfo->hasextra)
     {
-	/* a usual digest line. */
+	struct FileExtra* extra = rb_find(g_fileextra, fileinfo)->value;
+	if (extra->olddigest) return extra->olddigest;
+    }
 
-	size_t p_hex1;
-	struct FileInfo* fileinfo;
+    return fileinfo->digest.size ? &fileinfo->digest : NULL;
+}
 
-	enum DigestType this_digesttype = DT_NONE;
-	char* filename = NULL;
+/**
+ * Replace the inline digest of the record in node, or clear it if
+ * digest is NULL. The first time a loaded digest is replaced, a copy is
+ * kept in the side table, such that renamed or copied files are still
+ * detected by the old content.
+ */
+void fileinfo_set_digest(struct rb_node* node, const digest_result* digest)
+{
+    struct FileInfo* fileinfo = node->value;
 
-	bool escaped_filename = FALSE;
+    if (fileinfo->loaded && fileinfo->digest.size)
+    {
+	struct FileExtra* extra = fileinfo_extra(fileinfo, TRUE);
 
-	if (line[p] == '\\')
-	{
-	    ++p;
-	    escaped_filename = TRUE;
-	}
+	if (!extra->olddigest)
+	    extra->olddigest = arena_memdup(g_arena, &fileinfo->digest, 1 + fileinfo->digest.size);
+    }
 
-	p_hex1 = p;
-	while (isxdigit(line[p])) ++p;
+    if (digest)
+	memcpy(&fileinfo->digest, digest, 1 + digest->size);
+    else
+	fileinfo->digest.size = 0;
+}
 
-	if (!isspace(line[p]))
-	{
-	    /* digest is not followed by a space -> error. */
-	    return -1;
-	}
+/************************************
+ * Functions to parse a digest file *
+ ************************************/
 
-	fileinfo = malloc(sizeof(struct FileInfo));
-	memcpy(fileinfo, tempinfo, sizeof(struct FileInfo));
-	if (fileinfo->symlink) /* tempinfo's copy will be freed */
-	    fileinfo->symlink = strdup(fileinfo->symlink);
+/**
+ * Append an entry parsed from the digest file to g_loadlist, taking
+ * ownership of fileinfo. The file name of len characters is interned in
+ * g_dirtree.
+ */
+void loadlist_append(const char* filename, size_t len,
+		     struct FileInfo* fileinfo, unsigned int linenum)
+{
+    if (gopt_memlimit)
+    {
+	/* streamed by ext_old_next() instead */
+	g_extold.parsed = strndup(filename, len);
+	g_extold.parsedinfo = fileinfo;
+	g_extold.parsedline = linenum;
+	return;
+    }
 
-	if (p_hex1 + 2 * MD5_DIGEST_SIZE == p)
-	{
-	    fileinfo->digest = digest_hex2bin( line+p_hex1, p - p_hex1 );
-	    this_digesttype = DT_MD5;
-	}
-	else if (p_hex1 + 2 * SHA1_DIGEST_SIZE == p)
-	{
-	    fileinfo->digest = digest_hex2bin( line+p_hex1, p - p_hex1 );
-	    this_digesttype = DT_SHA1;
-	}
-	else if (p_hex1 + 2 * SHA256_DIGEST_SIZE == p)
-	{
-	    fileinfo->digest = digest_hex2bin( line+p_hex1, p - p_hex1 );
-	    this_digesttype = DT_SHA256;
-	}
-	else if (p_hex1 + 2 * SHA512_DIGEST_SIZE == p)
-	{
-	    fileinfo->digest = digest_hex2bin( line+p_hex1, p - p_hex1 );
-	    this_digesttype = DT_SHA512;
-	}
-	else
-	{
-	    fprintf(stderr, "%s: \"%s\" line %d: no proper hex digest detected on line.\n",
-		    g_progname, gopt_digestfile, linenum);
+    if (g_loadlist_size >= g_loadlist_max)
+    {
+	g_loadlist_max = g_loadlist_max ? 2 * g_loadlist_max : 1024;
+	g_loadlist = realloc(g_loadlist, sizeof(struct LoadEntry) * g_loadlist_max);
+    }
 
-	    free(fileinfo);
-	    return -1;
-	}
+    g_loadlist[g_loadlist_size].key = dt_intern_n(g_dirtree, filename, len);
+    g_loadlist[g_loadlist_size].fileinfo = fileinfo;
+    g_loadlist[g_loadlist_size].linenum = linenum;
+    ++g_loadlist_size;
+}
 
-	if (!fileinfo->digest)
-	{
-	    assert(fileinfo->digest);
-	    fprintf(stderr, "%s: \"%s\" line %d: no proper hex digest detected on line.\n",
-		    g_progname, gopt_digestfile, linenum);
+/**
+ * Save the lines of the record just parsed from a mapped file in it,
+ * which are its optional mtime line and the digest or symlink line, if
+ * they can be copied verbatim when writing the digest file.
+ */
+static void digestreader_span(struct DigestReader* dr, struct FileInfo* fileinfo)
+{
+    size_t len = dr->mappos - dr->spanstart;
 
-	    free(fileinfo);
-	    return -1;
-	}
+    if (dr->spanstate == SPAN_OPEN && dr->map[dr->mappos - 1] == '\n' &&
+	len <= 0xFFFF)
+    {
+	fileinfo->spanpos = dr->mapoffset + dr->spanstart;
+	fileinfo->spancrc = dr->spancrc;
+	fileinfo->spanlen = len;
+    }
 
-	if (gopt_digesttype != DT_NONE && this_digesttype != gopt_digesttype)
-	{
-	    fprintf(stderr, "%s: \"%s\" line %d: different digest types in file.\n",
-		    g_progname, gopt_digestfile, linenum);
+    dr->spanstate = SPAN_NONE;
+}
 
-	    free(fileinfo);
-	    exit(0);
-	}
+/**
+ * Add the record of a digest or symlink line to the entries loaded by
+ * the reader, with the attributes collected on the preceding comment
+ * lines. Threads parsing a chunk collect entries in the chunk instead,
+ * as the directory tree and side table are shared. digest is NULL for
+ * symlinks.
+ */
+void loadlist_add(struct DigestReader* dr, const char* filename, size_t len,
+		  const digest_result* digest)
+{
+    unsigned int digestsize = digest ? digest->size : DIGEST_MAX_SIZE;
+    struct LoadChunk* chunk = dr->chunk;
+    struct ChunkEntry* ce;
 
-	++p;
+    if (!chunk)
+    {
+	struct FileInfo* fileinfo = fileinfo_from_line(&dr->tempinfo, digestsize);
 
-	/* after digest terminating white space follows a "type
-	   indicator": text or binary. We always use binary. */
+	if (digest) memcpy(&fileinfo->digest, digest, 1 + digest->size);
+	if (dr->map) digestreader_span(dr, fileinfo);
 
-	if (line[p] != ' ' && line[p] != '*')
-	{
-	    fprintf(stderr, "%s: \"%s\" line %d: improper type indicator.\n",
-		    g_progname, gopt_digestfile, linenum);
+	loadlist_append(filename, len, fileinfo, dr->linenum);
+	return;
+    }
 
-	    return -1;
-	}
+    if (chunk->size >= chunk->max)
+    {
+	chunk->max = chunk->max ? 2 * chunk->max : 1024;
+	chunk->list = realloc(chunk->list, sizeof(struct ChunkEntry) * chunk->max);
+    }
 
-	++p;
+    ce = &chunk->list[chunk->size++];
 
-	/* all non-null character after type indicator and \n are relevant. */
+    /* unescaped names are overwritten by the next line */
+    ce->name = (filename == dr->name) ? arena_strndup(chunk->arena, filename, len) : filename;
+    ce->namelen = len;
+    ce->linenum = dr->linenum;
 
-	filename = strdup(line + p);
+    ce->fileinfo = fileinfo_from_line_in(chunk->arena, &dr->tempinfo, digestsize);
+    if (digest) memcpy(&ce->fileinfo->digest, digest, 1 + digest->size);
+    digestreader_span(dr, ce->fileinfo);
 
-	if (escaped_filename)
-	{
-	    if (!unescape_filename(filename))
-	    {
-		fprintf(stderr, "%s: \"%s\" line %d: improperly escaped file name.\n",
-			g_progname, gopt_digestfile, linenum);
+    ce->extra = NULL;
 
-		return -1;
-	    }
-	}
+    if (dr->tempinfo.symlink || dr->tempinfo.hasinode)
+    {
+	ce->extra = arena_memdup(chunk->arena, &dr->tempinfo, sizeof(struct LineInfo));
 
-#if ON_WIN32
-        /* on Windows: replace backslashes in filename with forward slashes */
-        replace_backslahes_with_slashes(filename);
-#endif
+	if (dr->tempinfo.symlink)
+	    ce->extra->symlink = arena_strdup(chunk->arena, dr->tempinfo.symlink);
+    }
+}
 
-	/* insert fileinfo into filelist */
+/**
+ * Remember a crc line found while parsing a chunk, where crc covers the
+ * chunk up to the line at offset pos.
+ */
+void loadchunk_crc(struct LoadChunk* chunk, uint32_t saved, uint32_t crc,
+		   size_t pos, unsigned int linenum)
+{
+    if (chunk->crcsize >= chunk->crcmax)
+    {
+	chunk->crcmax = chunk->crcmax ? 2 * chunk->crcmax : 4;
+	chunk->crcs = realloc(chunk->crcs, sizeof(struct ChunkCrc) * chunk->crcmax);
+    }
 
-	if (rb_find(g_filelist, filename) != NULL)
-	{
-	    fprintf(stderr, "%s: \"%s\" line %d: duplicate file name.\n",
-		    g_progname, gopt_digestfile, linenum);
+    chunk->crcs[chunk->crcsize].saved = saved;
+    chunk->crcs[chunk->crcsize].crc = crc;
+    chunk->crcs[chunk->crcsize].pos = pos;
+    chunk->crcs[chunk->crcsize].linenum = linenum;
+    ++chunk->crcsize;
+}
 
-	    return -1;
-	}
+/* order loaded entries by file name, then by line number */
+static int loadentry_cmp(const void *p1, const void *p2)
+{
+    const struct LoadEntry* a = p1;
+    const struct LoadEntry* b = p2;
+    int r = dt_key_cmp(a->key, b->key);
 
-	rb_insert(g_filelist, filename, fileinfo);
+    if (r != 0) return r;
 
-	gopt_digesttype = this_digesttype;
+    return (a->linenum < b->linenum) ? -1 : (a->linenum > b->linenum);
+}
 
-	/* return +1 here to clear tempinfo. */
-	return 1;
-    }
+/* fetch next loaded entry for rb_build_sorted() */
+static void loadlist_next(void *cookie, void **key, void **value)
+{
+    struct LoadEntry** le = cookie;
+
+    *key = (*le)->key;
+    *value = (*le)->fileinfo;
+    ++*le;
 }
 
-bool select_digestfile(void)
+/**
+ * Merge the sorted entries of the digest file with the sorted entries
+ * replayed from the journal, which start at mid.
+ */
+static void loadlist_merge(size_t mid)
 {
-    /*
-      Check for existing standard digest file names. However, if
-      multiple exist, failed with an error message.
-    */
+    struct LoadEntry* list = malloc(sizeof(struct LoadEntry) * g_loadlist_size);
+    size_t i = 0, j = mid, k = 0;
 
-    if (access("md5sum.txt", F_OK) == 0)
+    while (i < mid && j < g_loadlist_size)
     {
-	gopt_digesttype = DT_MD5;
-	gopt_digestfile = "md5sum.txt";
+	if (loadentry_cmp(&g_loadlist[j], &g_loadlist[i]) < 0)
+	    list[k++] = g_loadlist[j++];
+	else
+	    list[k++] = g_loadlist[i++];
     }
 
-    if (access("sha1sum.txt", F_OK) == 0)
+    while (i < mid) list[k++] = g_loadlist[i++];
+    while (j < g_loadlist_size) list[k++] = g_loadlist[j++];
+
+    free(g_loadlist);
+    g_loadlist = list;
+    g_loadlist_max = g_loadlist_size;
+}
+
+/* sort part of the loaded entries, unless they are sorted already */
+static void loadlist_sort(struct LoadEntry* list, size_t size)
+{
+    size_t i;
+
+    for (i = 1; i < size; ++i)
     {
-	if (gopt_digestfile != NULL)
+	if (loadentry_cmp(&list[i-1], &list[i]) > 0)
 	{
-	    fprintf(stderr, "%s: multiple digest files found in current directory. Select one using --file.\n",
-		    g_progname);
-	    return FALSE;
+	    psort(list, size, sizeof(struct LoadEntry), loadentry_cmp, 0);
+	    break;
 	}
-
-	gopt_digesttype = DT_SHA1;
-	gopt_digestfile = "sha1sum.txt";
     }
+}
 
-    if (access("sha128sum.txt", F_OK) == 0)
+/**
+ * Sort the loaded entries and build g_filelist and the hash index
+ * g_filehash, which is sized for the number of entries. Digest files
+ * written by digup are already sorted, otherwise the list is sorted in
+ * parallel. Duplicate file names are reported and dropped. Entries
+ * replayed from the journal are sorted separately and merged, they
+ * replace earlier entries of the same name, and deletions drop them.
+ * The tree is then built bottom-up in linear time.
+ */
+void loadlist_finish(void)
+{
+    size_t i, j, mid = g_loadlist_size;
+    struct LoadEntry* iter;
+    struct rb_node* node;
+
+    if (g_loadlist_journal)
     {
-	if (gopt_digestfile != NULL)
-	{
-	    fprintf(stderr, "%s: multiple digest files found in current directory. Select one using --file.\n",
-		    g_progname);
-	    return FALSE;
-	}
+	while (mid > 0 && g_loadlist[mid-1].linenum >= g_loadlist_journal)
+	    --mid;
+    }
 
-	gopt_digesttype = DT_SHA1;
-	gopt_digestfile = "sha128sum.txt";
+    loadlist_sort(g_loadlist, mid);
+
+    if (mid < g_loadlist_size)
+    {
+	loadlist_sort(g_loadlist + mid, g_loadlist_size - mid);
+	loadlist_merge(mid);
     }
 
-    if (access("sha256sum.txt", F_OK) == 0)
+    for (i = j = 0; i < g_loadlist_size; ++i)
     {
-	if (gopt_digestfile != NULL)
+	struct LoadEntry* le = &g_loadlist[i];
+
+	/* the scan of --subtree returns its entries to FS_UNSEEN, see
+	 * filelist_mark_subtree(), and --changed-from only those of the
+	 * listed paths, see changed_scan() */
+	if (le->fileinfo && gopt_subtree)
+	    le->fileinfo->status = FS_SKIPPED;
+	else if (le->fileinfo && gopt_changedfrom)
+	    le->fileinfo->status = FS_SEEN;
+
+	if (j > 0 && dt_key_equal(g_loadlist[j-1].key, le->key))
 	{
-	    fprintf(stderr, "%s: multiple digest files found in current directory. Select one using --file.\n",
-		    g_progname);
-	    return FALSE;
+	    if (g_loadlist_journal && le->linenum >= g_loadlist_journal)
+	    {
+		/* later update from the journal */
+		g_loadlist[j-1] = *le;
+		continue;
+	    }
+
+	    fprintf(stderr, "%s: \"%s\" line %d: duplicate %sfile name.\n",
+		    g_progname, gopt_digestfile, le->linenum,
+		    fileinfo_symlink(le->fileinfo) ? "symlink " : "");
+
+	    continue; /* dropped entry remains in the arena */
 	}
 
-	gopt_digesttype = DT_SHA256;
-	gopt_digestfile = "sha256sum.txt";
+	g_loadlist[j++] = *le;
     }
 
-    if (access("sha512sum.txt", F_OK) == 0)
+    if (g_loadlist_journal)
     {
-	if (gopt_digestfile != NULL)
+	/* drop the entries deleted by the journal */
+	size_t size = j;
+
+	for (i = j = 0; i < size; ++i)
 	{
-	    fprintf(stderr, "%s: multiple digest files found in current directory. Select one using --file.\n",
-		    g_progname);
-	    return FALSE;
+	    if (g_loadlist[i].fileinfo)
+		g_loadlist[j++] = g_loadlist[i];
 	}
+    }
 
-	gopt_digesttype = DT_SHA512;
-	gopt_digestfile = "sha512sum.txt";
+    iter = g_loadlist;
+    rb_build_sorted(g_filelist, j, loadlist_next, &iter);
+
+    /* leave room for new files found during the scan */
+    g_filehash = hi_create_custom(j + j / 8, dt_key_hash, dt_key_equal);
+
+    for (node = rb_begin(g_filelist); node != rb_end(g_filelist);
+	 node = rb_successor(g_filelist, node))
+    {
+	hi_insert(g_filehash, node->key, node);
     }
 
-    return TRUE;
+    free(g_loadlist);
+    g_loadlist = NULL;
+    g_loadlist_size = g_loadlist_max = 0;
+    g_loadlist_journal = 0;
 }
 
-bool read_digestfile(void)
+/* locale independent character classes of the digest file parser. A
+ * line ends with NUL or newline, as lines are not copied out of the
+ * mapped digest file. */
+#define dl_eol(c)	((c) == 0 || (c) == '\n')
+#define dl_space(c)	((c) == ' ' || (c) == '\t' || (c) == '\r' || (c) == '\v' || (c) == '\f')
+#define dl_digit(c)	((c) >= '0' && (c) <= '9')
+#define dl_alpha(c)	(((c) | 0x20) >= 'a' && ((c) | 0x20) <= 'z')
+#define dl_xdigit(c)	(dl_digit(c) || (((c) | 0x20) >= 'a' && ((c) | 0x20) <= 'f'))
+
+/* decimal value of the digits between p and end */
+static unsigned long long dl_number(const char* p, const char* end)
 {
-    FILE* sumfile;
-    struct FileInfo tempinfo;
+    unsigned long long v = 0;
 
-    char *line = NULL;
-    size_t linemax = 0;
-    ssize_t linelen;
-    unsigned int linenum = 0;
+    while (p != end)
+	v = 10 * v + (*p++ - '0');
 
-    int res = 0;
-    uint32_t crc = 0, nextcrc;
+    return v;
+}
 
-    if (gopt_digestfile == NULL)
-    {
-	if (!select_digestfile())
-	    return FALSE;
+/* end of the text from p to the end of the line, which is cut short by
+ * a NUL character */
+static size_t dl_rest(const char* line, size_t p, size_t linelen)
+{
+    const char* nul = memchr(line + p, 0, linelen - p);
 
-	if (gopt_digestfile == NULL)
-	{
-	    fprintf(stderr, "%s: no digest file found. Creating \"sha1sum.txt\" from full scan.\n",
-		    g_progname);
+    return nul ? (size_t)(nul - line) : linelen;
+}
 
-	    gopt_digesttype = DT_SHA1;
-	    gopt_digestfile = "sha1sum.txt";
-	    return TRUE;
-	}
+/**
+ * Copy len characters of a line into the reader's buffer for file names,
+ * which are modified by unescaping.
+ */
+char* digestreader_name(struct DigestReader* dr, const char* str, size_t len)
+{
+    if (dr->namemax < len + 1)
+    {
+	dr->namemax = 2 * (len + 1);
+	dr->name = realloc(dr->name, dr->namemax);
     }
 
+    memcpy(dr->name, str, len);
+    dr->name[len] = 0;
 
-    sumfile = fopen(gopt_digestfile, "rb");
-    if (sumfile == NULL)
-    {
-	if (errno == ENOENT)
-	{
-	    fprintf(stderr, "%s: could not open digest file \"%s\": performing full scan.\n",
-		    g_progname, gopt_digestfile);
+    return dr->name;
+}
 
-	    if (gopt_digesttype == DT_NONE)
-	    {
-		fprintf(stderr, "%s: to create a new digest file specify the digest --type (see --help).\n",
-			g_progname);
-		return FALSE;
-	    }
+/**
+ * Report a crc32 value in the digest file which does not match the
+ * preceding lines, and ask whether to continue unless in batch mode.
+ */
+void digestfile_crc_mismatch(unsigned int linenum)
+{
+    fprintf(stderr, "%s: \"%s\" line %d: crc32 value saved in file does not match!\n",
+	    g_progname, gopt_digestfile, linenum);
 
-	    return TRUE;
-	}
-	else
-	{
-	    fprintf(stderr, "%s: could not open digest file \"%s\": %s\n",
-		    g_progname, gopt_digestfile, strerror(errno));
-	    return FALSE;
-	}
+    if (gopt_batch)
+    {
+	exit(-1); /* fail badly */
     }
-
-    memset(&tempinfo, 0, sizeof(struct FileInfo));
-    tempinfo.status = FS_UNSEEN;
-
-    while ( (linelen = getline(&line, &linemax, sumfile)) >= 0 )
+    else
     {
-	++linenum;
-
-	if (res == -2) /* last line indicated eof */
-	{
-	    fprintf(stderr, "%s: \"%s\" line %d: superfluous line after eof.\n",
-		    g_progname, gopt_digestfile, linenum);
-	}
-
-	nextcrc = crc32(crc, (unsigned char*)line, linelen);
+	char input[256], *r;
 
-	/* remove trailing newline */
-	if (linelen > 0 && line[linelen-1] == '\n')
-	    line[linelen-1] = 0;
+	fprintf(stderr, "This indicates an unintentional or intentional modification of the digest file.\n");
+	fprintf(stderr, "Continue despite change (y/n)? ");
 
-	res = parse_digestline(line, linenum, &tempinfo, crc);
+	r = fgets(input, sizeof(input), stdin);
 
-	if (res != 0)
+	if (r == NULL || input[0] != 'y')
 	{
-	    /* Illegal or valid digest line found. Clear fileinfo. */
-
-	    if (tempinfo.symlink)
-		free(tempinfo.symlink);
-
-	    memset(&tempinfo, 0, sizeof(struct FileInfo));
-	    tempinfo.status = FS_UNSEEN;
+	    exit(-1);
 	}
-
-	crc = nextcrc;
     }
+}
 
-    if (line) free(line);
+/**
+ * Parse one digest line and fill in tempinfo according or add a new
+ * file to g_filelist. The line of linelen characters may include the
+ * terminating newline, hence records are parsed in place from the
+ * mapped file. The reader provides the line number, the attributes
+ * collected on preceding comment lines and the crc of all lines
+ * before. The return value is -1 for an unknown line, 0 for a correct
+ * digest or symlink line, +1 for a comment line providing additional
+ * file info and -2 for and eof flagged line. While replaying the
+ * journal, -3 marks the commit line of a complete update and a wrong
+ * crc on it returns -1.
+ */
+int parse_digestline(struct DigestReader* dr, const char* line, size_t linelen)
+{
+    /*** parse line from digest file ***/
+    const unsigned int linenum = dr->linenum;
+    struct LineInfo* tempinfo = &dr->tempinfo;
+    size_t p = 0;
 
-    if (rb_isempty(g_filelist))
+    if (linelen > 0 && line[linelen-1] == '\n')
+	--linelen;
+
+    /* skip initial whitespace */
+    while (dl_space(line[p])) ++p;
+
+    if (line[p] == '#')
     {
-	fprintf(stderr, "%s: %s: no digests found in file.\n",
-		g_progname, gopt_digestfile);
+	/* if first character is a hash then the line might be a
+	   comment or our custom mtime indicator. */
 
-	if (gopt_digesttype == DT_NONE)
+	size_t p_word, p_arg;
+
+	++p;
+	if (line[p] != ':')
 	{
-	    fprintf(stderr, "%s: to create a new digest file specify the digest --type (see --help).\n",
-		    g_progname);
-	    return FALSE;
+	    /* usual comment */
+	    return 0;
 	}
-    }
-    else
-    {
-	/* Insert all file digests into the map for fast lookup. */
-	/* Simulanteously mark files as skipped that don't match --restrict */
 
-	struct rb_node* node;
+	++p;
 
-	for (node = rb_begin(g_filelist); node != rb_end(g_filelist); node = rb_successor(g_filelist, node))
+	while (!dl_eol(line[p]))
 	{
-	    struct FileInfo* fileinfo = node->value;
+	    while (dl_space(line[p])) ++p;
 
-	    if (gopt_matchpattern && strstr(node->key, gopt_matchpattern) == NULL)
-	    {
-		fileinfo->status = FS_SKIPPED;
-		++g_filelist_skipped;
-	    }
+	    p_word = p;
+	    while (dl_alpha(line[p]) || line[p] == '\\') ++p;
 
-	    if (fileinfo->digest)
+	    if (!dl_space(line[p]) && !dl_eol(line[p]))
 	    {
-		rb_insert(g_filedigestmap, digest_dup(fileinfo->digest), node->key);
+		fprintf(stderr, "%s: \"%s\" line %d: unparseable digest comment line.\n",
+			g_progname, gopt_digestfile, linenum);
+
+		return -1;
 	    }
-	}
-    }
 
-    fclose(sumfile);
+	    if (strncmp(line+p_word, "option", p - p_word) == 0)
+	    {
+		/* read persistent option following */
 
-    return TRUE;
-}
+		while (dl_space(line[p])) ++p;
 
-/*************************************************************
- * Functions to recursively scan directories and process file *
- *************************************************************/
+		p_arg = p;
+		while (!dl_eol(line[p]) && line[p] != '=') ++p;
 
-bool process_file(const char* filepath, const mystatst* st)
-{
-    struct rb_node* fileiter;
-    struct rb_node* digestiter;
+		if (strncmp(line+p_arg, "--exclude-marker", p - p_arg) == 0 &&
+                    line[p] == '=')
+		{
+		    ++p; /* skip over '=' */
 
-    if (filepath[0] == '.' && filepath[1] == '/')
-	filepath += 2;
+		    p_arg = p;
+		    p = dl_rest(line, p, linelen);
 
-    /* skip over the digestfile */
-    if (strcmp(filepath, gopt_digestfile) == 0)
-	return TRUE;
+		    if (gopt_exclude_marker) free((void*)gopt_exclude_marker);
 
-    /* silently skip over ignored filepaths */
-    if (gopt_matchpattern && strstr(filepath, gopt_matchpattern) == NULL)
-	return TRUE;
+		    gopt_exclude_marker = strndup(line+p_arg, p - p_arg);
 
-    if (gopt_verbose >= 2) {
-	fprintf(stdout, "%s ", filepath);
-    }
+		    if (gopt_verbose >= 2) {
+			fprintf(stderr, "%s: \"%s\" line %d: persistent option --exclude-marker=%s\n",
+				g_progname, gopt_digestfile, linenum, gopt_exclude_marker);
+		    }
+		}
+		else if (p - p_arg == 8 && strncmp(line+p_arg, "--inodes", 8) == 0)
+		{
+		    gopt_inodes = TRUE;
 
-    /* lookup file info for mtime */
+		    if (gopt_verbose >= 2) {
+			fprintf(stderr, "%s: \"%s\" line %d: persistent option --inodes\n",
+				g_progname, gopt_digestfile, linenum);
+		    }
+		}
+		else if (p - p_arg == 7 && strncmp(line+p_arg, "--index", 7) == 0)
+		{
+		    gopt_index = TRUE;
 
-    fileiter = rb_find(g_filelist, filepath);
+		    if (gopt_verbose >= 2) {
+			fprintf(stderr, "%s: \"%s\" line %d: persistent option --index\n",
+				g_progname, gopt_digestfile, linenum);
+		    }
+		}
+		else if (p - p_arg == 9 && strncmp(line+p_arg, "--journal", 9) == 0)
+		{
+		    gopt_journal = TRUE;
 
-    if (fileiter != NULL)
-    {
-	struct FileInfo* fileinfo = fileiter->value;
-	digest_result* filedigest = NULL;
+		    if (gopt_verbose >= 2) {
+			fprintf(stderr, "%s: \"%s\" line %d: persistent option --journal\n",
+				g_progname, gopt_digestfile, linenum);
+		    }
+		}
+		else
+		{
+		    fprintf(stderr, "%s: \"%s\" line %d: unknown persistent option line.\n",
+			    g_progname, gopt_digestfile, linenum);
 
-	if (fileinfo->status != FS_UNSEEN)
-	{
-	    if (gopt_verbose >= 2) {
-		fprintf(stdout, " same file processed twice??? This should never occur.\n");
-	    }
-	    else {
-		fprintf(stdout, "%s same file processed twice??? This should never occur.\n", filepath);
+		    return -1;
+		}
 	    }
-	    return TRUE;
-	}
+	    else if (strncmp(line+p_word, "mtime", p - p_word) == 0)
+	    {
+		/* read number following mtime */
 
-	if (gopt_fullcheck)
-	{
-	    if (gopt_verbose >= 2) {
-		fprintf(stdout, "check ");
-	    }
-	}
-	else if ((unsigned int)labs(st->st_mtime - fileinfo->mtime) > gopt_modify_window ||
-		 st->st_size != fileinfo->size)
-	{
-	    if (gopt_verbose >= 2) {
-		fprintf(stdout, "touched ");
-	    }
-	}
-	else
-	{
-	    if (gopt_verbose >= 2) {
-		fprintf(stdout, "untouched.\n");
-	    }
-	    else if (gopt_verbose == 1 && !gopt_onlymodified) {
-		fprintf(stdout, "%s untouched.\n", filepath);
-	    }
+		while (dl_space(line[p])) ++p;
 
-	    fileinfo->status = FS_SEEN;
-	    ++g_filelist_seen;
+		p_arg = p;
+		while (dl_digit(line[p])) ++p;
 
-	    return TRUE;
-	}
+		if (!dl_space(line[p]) && !dl_eol(line[p]))
+		{
+		    fprintf(stderr, "%s: \"%s\" line %d: unparseable digest comment line.\n",
+			    g_progname, gopt_digestfile, linenum);
 
-	/* calculate file digest */
+		    return -1;
+		}
 
-	if (!digest_file(filepath, st->st_size, &filedigest, &fileinfo->error))
-	{
-	    fileinfo->status = FS_ERROR;
-	    fileinfo->mtime = st->st_mtime;
-	    fileinfo->size = st->st_size;
+		tempinfo->mtime = dl_number(line + p_arg, line + p);
+	    }
+	    else if (strncmp(line+p_word, "size", p - p_word) == 0)
+	    {
+		/* read number following size */
 
-	    ++g_filelist_error;
-	    return FALSE;
-	}
+		while (dl_space(line[p])) ++p;
 
-	if (fileinfo->digest && digest_equal(filedigest, fileinfo->digest))
-	{
-	    if (gopt_verbose >= 2) {
-		fprintf(stdout, " matched.\n");
-	    }
-	    else if (gopt_verbose == 1 && !gopt_onlymodified) {
-		fprintf(stdout, "%s matched.\n", filepath);
-	    }
+		p_arg = p;
+		while (dl_digit(line[p])) ++p;
 
-	    fileinfo->status = FS_TOUCHED;
-	    fileinfo->mtime = st->st_mtime;
-	    fileinfo->size = st->st_size;
-	    free(filedigest);
+		if (!dl_space(line[p]) && !dl_eol(line[p]))
+		{
+		    fprintf(stderr, "%s: \"%s\" line %d: unparseable digest comment line.\n",
+			    g_progname, gopt_digestfile, linenum);
 
-	    ++g_filelist_touched;
-	}
-	else
-	{
-	    if (gopt_verbose >= 2) {
-		fprintf(stdout, " CHANGED.\n");
-	    }
-	    else if (gopt_verbose == 1) {
-		fprintf(stdout, "%s CHANGED.\n", filepath);
+		    return -1;
+		}
+
+		tempinfo->size = dl_number(line + p_arg, line + p);
 	    }
+	    else if (strncmp(line+p_word, "dev", p - p_word) == 0 ||
+		     strncmp(line+p_word, "ino", p - p_word) == 0)
+	    {
+		/* read number following dev or ino, saved by --inodes */
 
-	    fileinfo->status = FS_CHANGED;
-	    fileinfo->mtime = st->st_mtime;
-	    fileinfo->size = st->st_size;
+		bool isdev = (line[p_word] == 'd');
 
-	    if (fileinfo->digest)
-		free(fileinfo->digest);
+		while (dl_space(line[p])) ++p;
 
-	    fileinfo->digest = filedigest;
+		p_arg = p;
+		while (dl_digit(line[p])) ++p;
 
-	    ++g_filelist_changed;
-	}
+		if (!dl_space(line[p]) && !dl_eol(line[p]))
+		{
+		    fprintf(stderr, "%s: \"%s\" line %d: unparseable digest comment line.\n",
+			    g_progname, gopt_digestfile, linenum);
 
-	return TRUE;
-    }
-    else
-    {
-	struct FileInfo* fileinfo = malloc(sizeof(struct FileInfo));
-	memset(fileinfo, 0, sizeof(struct FileInfo));
+		    return -1;
+		}
 
-	fileinfo->status = FS_NEW;
-	fileinfo->mtime = st->st_mtime;
-	fileinfo->size = st->st_size;
+		if (isdev)
+		    tempinfo->inode.dev = dl_number(line + p_arg, line + p);
+		else
+		    tempinfo->inode.ino = dl_number(line + p_arg, line + p);
 
-	if (!digest_file(filepath, st->st_size, &fileinfo->digest, &fileinfo->error))
-	{
-	    fileinfo->status = FS_ERROR;
+		tempinfo->hasinode = TRUE;
+	    }
+	    else if (strncmp(line+p_word, "target", p - p_word) == 0)
+	    {
+		/* read the complete following line (after the current
+		 * white space) as the symlink target */
+
+		if (!dl_space(line[p]))
+		{
+		    fprintf(stderr, "%s: \"%s\" line %d: unparseable digest comment line.\n",
+			    g_progname, gopt_digestfile, linenum);
 
-	    rb_insert(g_filelist, strdup(filepath), fileinfo);
+		    return -1;
+		}
+		++p;
 
-	    ++g_filelist_error;
+		p_arg = p;
+		p = dl_rest(line, p, linelen);
 
-	    return FALSE;
-	}
+		tempinfo->symlink = strndup(line+p_arg, p - p_arg);
+	    }
+	    else if (strncmp(line+p_word, "target\\", p - p_word) == 0)
+	    {
+		/* read the complete following line (after the current
+		 * white space) as the escaped symlink target */
 
-	/* look for existing file with equal digest */
-	digestiter = rb_find(g_filedigestmap, fileinfo->digest);
-	if (digestiter != NULL)
-	{
-	    bool copied = FALSE;
-	    struct rb_node* nodecopy = digestiter;
+		if (!dl_space(line[p]))
+		{
+		    fprintf(stderr, "%s: \"%s\" line %d: unparseable digest comment line.\n",
+			    g_progname, gopt_digestfile, linenum);
+
+		    return -1;
+		}
+		++p;
+
+		p_arg = p;
+		p = dl_rest(line, p, linelen);
+
+		tempinfo->symlink = strndup(line+p_arg, p - p_arg);
 
-	    /* test if the oldfile still exists. */
-	    while (nodecopy != rb_end(g_filedigestmap) &&
-		   digest_equal((digest_result*)nodecopy->key, fileinfo->digest))
+		if (!unescape_filename(tempinfo->symlink))
+		{
+		    fprintf(stderr, "%s: \"%s\" line %d: improperly escaped symlink target.\n",
+			    g_progname, gopt_digestfile, linenum);
+		    free(tempinfo->symlink);
+		    return -1;
+		}
+	    }
+	    else if (strncmp(line+p_word, "symlink", p - p_word) == 0)
 	    {
-		if (access((char*)nodecopy->value, F_OK) == 0)
+		/* read the complete following line (after the current
+		 * white space) as the symlink source file name. */
+
+		if (!dl_space(line[p]))
 		{
-		    copied = TRUE;
-		    digestiter = nodecopy;
+		    fprintf(stderr, "%s: \"%s\" line %d: unparseable digest comment line.\n",
+			    g_progname, gopt_digestfile, linenum);
+
+		    return -1;
 		}
-		else
+		++p;
+
+		p_arg = p;
+		p = dl_rest(line, p, linelen);
+
+		/* append entry to list of loaded entries */
+
+		loadlist_add(dr, line+p_arg, p - p_arg, NULL);
+
+		/* return +1 here to clear tempinfo. */
+		return 1;
+	    }
+	    else if (strncmp(line+p_word, "symlink\\", p - p_word) == 0)
+	    {
+		/* read the complete following line (after the current
+		 * white space) as the escaped symlink source file name. */
+
+		char* filename;
+
+		if (!dl_space(line[p]))
 		{
-		    /* lookup FileInfo of matching file and set oldpath flags */
-		    struct rb_node* filenode = rb_find(g_filelist, nodecopy->value);
+		    fprintf(stderr, "%s: \"%s\" line %d: unparseable digest comment line.\n",
+			    g_progname, gopt_digestfile, linenum);
 
-		    if (filenode == NULL)
-		    {
-			fprintf(stderr, "\n%s: internal error. Cannot find entry for matching file.\n",
-				g_progname);
-		    }
-		    else if (((struct FileInfo*)filenode->value)->status == FS_UNSEEN)
-		    {
-			((struct FileInfo*)filenode->value)->status = FS_OLDPATH;
-			++g_filelist_oldpath;
-		    }
-		    else if (((struct FileInfo*)filenode->value)->status == FS_OLDPATH)
-		    {
-		    }
-		    else
-		    {
-			fprintf(stderr, "\n%s: renamed original file still existed when scanning.\n",
-				g_progname);
-		    }
+		    return -1;
+		}
+		++p;
+
+		p_arg = p;
+		p = dl_rest(line, p, linelen);
+
+		filename = digestreader_name(dr, line+p_arg, p - p_arg);
+
+		if (!unescape_filename(filename))
+		{
+		    fprintf(stderr, "%s: \"%s\" line %d: improperly escaped symlink filename.\n",
+			    g_progname, gopt_digestfile, linenum);
+		    return -1;
 		}
 
-		nodecopy = rb_successor(g_filedigestmap, nodecopy);
+		/* append entry to list of loaded entries */
+
+		loadlist_add(dr, filename, strlen(filename), NULL);
+
+		/* return +1 here to clear tempinfo. */
+		return 1;
 	    }
+	    else if (dr->journal && strncmp(line+p_word, "delete", p - p_word) == 0)
+	    {
+		/* read the rest of the line as the deleted file name */
+
+		if (!dl_space(line[p]))
+		{
+		    fprintf(stderr, "%s: \"%s\" line %d: unparseable digest comment line.\n",
+			    g_progname, gopt_digestfile, linenum);
+
+		    return -1;
+		}
+		++p;
+
+		p_arg = p;
+		p = dl_rest(line, p, linelen);
+
+		/* entry without a record, see loadlist_finish() */
+		loadlist_append(line+p_arg, p - p_arg, NULL, linenum);
 
-	    if (copied)
+		return 1;
+	    }
+	    else if (dr->journal && strncmp(line+p_word, "delete\\", p - p_word) == 0)
 	    {
-		fileinfo->status = FS_COPIED;
-		++g_filelist_copied;
-		if (gopt_verbose >= 2) {
-		    fprintf(stdout, " copied.\n");
+		/* read the rest of the line as the escaped deleted file name */
+
+		char* filename;
+
+		if (!dl_space(line[p]))
+		{
+		    fprintf(stderr, "%s: \"%s\" line %d: unparseable digest comment line.\n",
+			    g_progname, gopt_digestfile, linenum);
+
+		    return -1;
 		}
-		else if (gopt_verbose == 1) {
-		    fprintf(stdout, "%s copied.\n", filepath);
+		++p;
+
+		p_arg = p;
+		p = dl_rest(line, p, linelen);
+
+		filename = digestreader_name(dr, line+p_arg, p - p_arg);
+
+		if (!unescape_filename(filename))
+		{
+		    fprintf(stderr, "%s: \"%s\" line %d: improperly escaped deleted filename.\n",
+			    g_progname, gopt_digestfile, linenum);
+		    return -1;
 		}
+
+		loadlist_append(filename, strlen(filename), NULL, linenum);
+
+		return 1;
 	    }
-	    else
+	    else if (strncmp(line+p_word, "crc", p - p_word) == 0)
 	    {
- 		fileinfo->status = FS_RENAMED;
-		++g_filelist_renamed;
-		if (gopt_verbose >= 2) {
-		    fprintf(stdout, " renamed.\n");
+		/* read hex crc32 value following the word */
+
+		uint32_t saved;
+
+		while (dl_space(line[p])) ++p;
+
+		if (line[p] != '0' || line[++p] != 'x')
+		{
+		    fprintf(stderr, "%s: \"%s\" line %d: unparseable crc line.\n",
+			    g_progname, gopt_digestfile, linenum);
+		    return 0;
+		}
+		++p;
+
+		p_arg = p;
+		while (dl_xdigit(line[p])) ++p;
+
+		if (p - p_arg != 8)
+		{
+		    fprintf(stderr, "%s: \"%s\" line %d: unparseable sdfsdcrc line.\n",
+			    g_progname, gopt_digestfile, linenum);
+		    return 0;
+		}
+
+		saved = strtoul(line + p_arg, NULL, 16);
+
+		if (dr->chunk)
+		{
+		    /* the crc of the preceding chunks is not known yet */
+		    loadchunk_crc(dr->chunk, saved, dr->crc, dr->linepos, linenum);
+		}
+		else if (dr->journal)
+		{
+		    /* the update is incomplete or was overwritten */
+		    if (saved != dr->crc) return -1;
 		}
-		else if (gopt_verbose == 1) {
-		    fprintf(stdout, "%s renamed.\n", filepath);
+		else if (saved != dr->crc)
+		{
+		    digestfile_crc_mismatch(linenum);
 		}
 	    }
+	    else if (strncmp(line+p_word, "eof", p - p_word) == 0)
+	    {
+		return -2;
+	    }
+	    else if (dr->journal && strncmp(line+p_word, "commit", p - p_word) == 0)
+	    {
+		return -3;
+	    }
+	    else
+	    {
+		fprintf(stderr, "%s: \"%s\" line %d: unparseable digest comment line.\n",
+			g_progname, gopt_digestfile, linenum);
 
-	    if (gopt_verbose >= 1) {
-		fprintf(stdout, "<-- %s", (char*)digestiter->value);
+		return -1;
 	    }
+	}
+
+	return 0;
+    }
+    else
+    {
+	/* a usual digest line. */
+
+	size_t p_hex1, p_name;
+	unsigned char digest[1 + DIGEST_MAX_SIZE];
+
+	enum DigestType this_digesttype = DT_NONE;
+	char* filename = NULL;
+
+	bool escaped_filename = FALSE;
+
+	if (line[p] == '\\')
+	{
+	    ++p;
+	    escaped_filename = TRUE;
+	}
+
+	/* decode the digest while scanning for its end */
+
+	p_hex1 = p;
+	p += digest_hex2bin_prefix(line + p, DIGEST_MAX_SIZE, (digest_result*)digest);
+	while (dl_xdigit(line[p])) ++p;
+
+	if (!dl_space(line[p]))
+	{
+	    /* digest is not followed by a space -> error. */
+	    return -1;
+	}
+
+	if (p_hex1 + 2 * MD5_DIGEST_SIZE == p)
+	{
+	    this_digesttype = DT_MD5;
+	}
+	else if (p_hex1 + 2 * SHA1_DIGEST_SIZE == p)
+	{
+	    this_digesttype = DT_SHA1;
+	}
+	else if (p_hex1 + 2 * SHA256_DIGEST_SIZE == p)
+	{
+	    this_digesttype = DT_SHA256;
+	}
+	else if (p_hex1 + 2 * SHA512_DIGEST_SIZE == p)
+	{
+	    this_digesttype = DT_SHA512;
+	}
+	else
+	{
+	    fprintf(stderr, "%s: \"%s\" line %d: no proper hex digest detected on line.\n",
+		    g_progname, gopt_digestfile, linenum);
+
+	    return -1;
+	}
+
+	if (gopt_digesttype != DT_NONE && this_digesttype != gopt_digesttype)
+	{
+	    fprintf(stderr, "%s: \"%s\" line %d: different digest types in file.\n",
+		    g_progname, gopt_digestfile, linenum);
+
+	    exit(0);
+	}
+
+	++p;
+
+	/* after digest terminating white space follows a "type
+	   indicator": text or binary. We always use binary. */
+
+	if (line[p] != ' ' && line[p] != '*')
+	{
+	    fprintf(stderr, "%s: \"%s\" line %d: improper type indicator.\n",
+		    g_progname, gopt_digestfile, linenum);
 
-	    fileinfo->oldpath = strdup((char*)digestiter->value);
+	    return -1;
 	}
 
-	rb_insert(g_filelist, strdup(filepath), fileinfo);
+	++p;
+
+	/* all characters after type indicator up to the newline are
+	   relevant. Plain names are interned directly from the line. */
+
+	p_name = p;
+	p = dl_rest(line, p, linelen);
+
+	/* append entry with inline digest to list of loaded entries */
 
-	if (fileinfo->status == FS_NEW)
+	if (escaped_filename || ON_WIN32)
 	{
-	    if (gopt_verbose >= 2) {
-		fprintf(stdout, " new.");
-	    }
-	    else if (gopt_verbose == 1) {
-		fprintf(stdout, "%s new.", filepath);
-	    }
+	    filename = digestreader_name(dr, line + p_name, p - p_name);
+
+	    if (escaped_filename && !unescape_filename(filename))
+	    {
+		fprintf(stderr, "%s: \"%s\" line %d: improperly escaped file name.\n",
+			g_progname, gopt_digestfile, linenum);
+
+		return -1;
+	    }
+
+#if ON_WIN32
+	    /* on Windows: replace backslashes in filename with forward slashes */
+	    replace_backslahes_with_slashes(filename);
+#endif
+
+	    loadlist_add(dr, filename, strlen(filename), (digest_result*)digest);
+	}
+	else
+	{
+	    loadlist_add(dr, line + p_name, p - p_name, (digest_result*)digest);
+	}
+
+	/* threads parsing chunks only read the type selected before */
+	if (gopt_digesttype != this_digesttype)
+	    gopt_digesttype = this_digesttype;
+
+	/* return +1 here to clear tempinfo. */
+	return 1;
+    }
+}
+
+bool select_digestfile(void)
+{
+    /*
+      Check for existing standard digest file names. However, if
+      multiple exist, failed with an error message.
+    */
+
+    if (access("md5sum.txt", F_OK) == 0)
+    {
+	gopt_digesttype = DT_MD5;
+	gopt_digestfile = "md5sum.txt";
+    }
+
+    if (access("sha1sum.txt", F_OK) == 0)
+    {
+	if (gopt_digestfile != NULL)
+	{
+	    fprintf(stderr, "%s: multiple digest files found in current directory. Select one using --file.\n",
+		    g_progname);
+	    return FALSE;
+	}
+
+	gopt_digesttype = DT_SHA1;
+	gopt_digestfile = "sha1sum.txt";
+    }
+
+    if (access("sha128sum.txt", F_OK) == 0)
+    {
+	if (gopt_digestfile != NULL)
+	{
+	    fprintf(stderr, "%s: multiple digest files found in current directory. Select one using --file.\n",
+		    g_progname);
+	    return FALSE;
+	}
+
+	gopt_digesttype = DT_SHA1;
+	gopt_digestfile = "sha128sum.txt";
+    }
+
+    if (access("sha256sum.txt", F_OK) == 0)
+    {
+	if (gopt_digestfile != NULL)
+	{
+	    fprintf(stderr, "%s: multiple digest files found in current directory. Select one using --file.\n",
+		    g_progname);
+	    return FALSE;
+	}
+
+	gopt_digesttype = DT_SHA256;
+	gopt_digestfile = "sha256sum.txt";
+    }
+
+    if (access("sha512sum.txt", F_OK) == 0)
+    {
+	if (gopt_digestfile != NULL)
+	{
+	    fprintf(stderr, "%s: multiple digest files found in current directory. Select one using --file.\n",
+		    g_progname);
+	    return FALSE;
+	}
+
+	gopt_digesttype = DT_SHA512;
+	gopt_digestfile = "sha512sum.txt";
+    }
+
+    return TRUE;
+}
+
+/**
+ * Find the range [first,last) of all entries below a directory path in
+ * g_filelist, "" is the top directory. Both are found by one search for
+ * the directory's node, without looking at the entries in between.
+ */
+void filelist_dir_range(const char* dirpath,
+			struct rb_node** first, struct rb_node** last)
+{
+    struct dt_key key;
+
+    key.dir = dt_find_dir(g_dirtree, dirpath);
+
+    if (key.dir == NULL)
+    {
+	*first = *last = rb_end(g_filelist);
+	return;
+    }
+
+    key.name = "";
+    *first = rb_lower_bound(g_filelist, &key);
+
+    key.name = NULL; /* sorts after all entries below the directory */
+    *last = rb_lower_bound(g_filelist, &key);
+}
+
+/**
+ * Count the entries outside of --subtree as skipped, which all entries
+ * are loaded as, and return the entries inside to FS_UNSEEN for the
+ * scan, or to FS_SEEN for --changed-from. Only the range of entries
+ * below the subtree is walked, found by an ordered range query.
+ */
+void filelist_mark_subtree(void)
+{
+    struct rb_node *node, *last;
+    unsigned int inside = 0;
+    unsigned char status = gopt_changedfrom ? FS_SEEN : FS_UNSEEN;
+
+    filelist_dir_range(gopt_subtree, &node, &last);
+
+    for (; node != last; node = rb_successor(g_filelist, node))
+    {
+	((struct FileInfo*)node->value)->status = status;
+	++inside;
+    }
+
+    g_filelist_skipped += rb_size(g_filelist) - inside;
+
+    if (gopt_changedfrom)
+	g_filelist_seen += inside;
+}
+
+/**
+ * Reset an entry to FS_UNSEEN and remove it from the status counters,
+ * such that it can be processed again or is reported as deleted.
+ */
+void filelist_reset_entry(struct FileInfo* fileinfo)
+{
+    switch (fileinfo->status)
+    {
+    case FS_UNSEEN: break;
+    case FS_SEEN: --g_filelist_seen; break;
+    case FS_NEW: --g_filelist_new; break;
+    case FS_TOUCHED: --g_filelist_touched; break;
+    case FS_CHANGED: --g_filelist_changed; break;
+    case FS_ERROR: --g_filelist_error; break;
+    case FS_COPIED: --g_filelist_copied; break;
+    case FS_RENAMED: --g_filelist_renamed; break;
+    case FS_OLDPATH: --g_filelist_oldpath; break;
+    case FS_SKIPPED: --g_filelist_skipped; break;
+    }
+
+    if (fileinfo->hasextra) /* arena memory */
+	fileinfo_extra(fileinfo, FALSE)->error = NULL;
+
+    fileinfo->status = FS_UNSEEN;
+    fileinfo->moved = FALSE;
+}
+
+/**
+ * Give an entry in FS_UNSEEN the status and add it to the status
+ * counters.
+ */
+void filelist_set_status(struct FileInfo* fileinfo, unsigned char status)
+{
+    switch (status)
+    {
+    case FS_UNSEEN: break;
+    case FS_SEEN: ++g_filelist_seen; break;
+    case FS_NEW: ++g_filelist_new; break;
+    case FS_TOUCHED: ++g_filelist_touched; break;
+    case FS_CHANGED: ++g_filelist_changed; break;
+    case FS_ERROR: ++g_filelist_error; break;
+    case FS_COPIED: ++g_filelist_copied; break;
+    case FS_RENAMED: ++g_filelist_renamed; break;
+    case FS_OLDPATH: ++g_filelist_oldpath; break;
+    case FS_SKIPPED: ++g_filelist_skipped; break;
+    }
+
+    fileinfo->status = status;
+}
+
+/**
+ * Reset all entries below a directory path, except skipped ones. The
+ * empty path resets the whole list.
+ */
+void filelist_reset_tree(const char* dirpath)
+{
+    struct rb_node *node, *last;
+
+    filelist_dir_range(dirpath, &node, &last);
+
+    for (; node != last; node = rb_successor(g_filelist, node))
+    {
+	struct FileInfo* fileinfo = node->value;
+
+	if (fileinfo->status == FS_SKIPPED) continue;
+
+	filelist_reset_entry(fileinfo);
+    }
+}
+
+/**
+ * Select and open the digest file. Returns FALSE on errors, otherwise
+ * *sumfile is the opened file, or NULL if a new one is to be created.
+ */
+bool open_digestfile(FILE** sumfile)
+{
+    *sumfile = NULL;
+
+    if (gopt_digestfile == NULL)
+    {
+	if (!select_digestfile())
+	    return FALSE;
+
+	if (gopt_digestfile == NULL)
+	{
+	    fprintf(stderr, "%s: no digest file found. Creating \"sha1sum.txt\" from full scan.\n",
+		    g_progname);
+
+	    gopt_digesttype = DT_SHA1;
+	    gopt_digestfile = "sha1sum.txt";
+	    return TRUE;
+	}
+    }
+
+    *sumfile = fopen(gopt_digestfile, "rb");
+    if (*sumfile == NULL)
+    {
+	if (errno == ENOENT)
+	{
+	    fprintf(stderr, "%s: could not open digest file \"%s\": performing full scan.\n",
+		    g_progname, gopt_digestfile);
+
+	    if (gopt_digesttype == DT_NONE)
+	    {
+		fprintf(stderr, "%s: to create a new digest file specify the digest --type (see --help).\n",
+			g_progname);
+		return FALSE;
+	    }
+
+	    return TRUE;
+	}
+	else
+	{
+	    fprintf(stderr, "%s: could not open digest file \"%s\": %s\n",
+		    g_progname, gopt_digestfile, strerror(errno));
+	    return FALSE;
+	}
+    }
+
+    return TRUE;
+}
+
+/**
+ * Open the digest file like open_digestfile() and map it into memory,
+ * hence lines are parsed in place without copying. Falls back to
+ * reading with getline() if the file cannot be mapped.
+ */
+bool digestreader_open(struct DigestReader* dr)
+{
+    if (!open_digestfile(&dr->fp))
+	return FALSE;
+
+#if !ON_WIN32
+    if (dr->fp)
+    {
+	struct stat st;
+
+	if (fstat(fileno(dr->fp), &st) == 0 && S_ISREG(st.st_mode) &&
+	    st.st_size > 0 && (uint64_t)st.st_size <= (size_t)-1)
+	{
+	    void* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(dr->fp), 0);
+
+	    if (map != MAP_FAILED)
+	    {
+#ifdef MADV_SEQUENTIAL
+		madvise(map, st.st_size, MADV_SEQUENTIAL);
+#endif
+		dr->map = map;
+		dr->mapsize = st.st_size;
+		dr->mappos = 0;
+	    }
+	}
+    }
+#endif
+
+    return TRUE;
+}
+
+/**
+ * Read and parse the next line of an opened digest file, entries are
+ * passed on to loadlist_append(). Returns FALSE at the end of the file.
+ */
+bool digestreader_next(struct DigestReader* dr)
+{
+    const char* line;
+    size_t linelen;
+    uint32_t nextcrc;
+
+    if (dr->map)
+    {
+	const char* nl;
+
+	if (dr->mappos >= dr->mapsize)
+	    return FALSE;
+
+	dr->linepos = dr->mappos;
+	line = dr->map + dr->mappos;
+	nl = memchr(line, '\n', dr->mapsize - dr->mappos);
+
+	linelen = nl ? (size_t)(nl + 1 - line) : dr->mapsize - dr->mappos;
+	dr->mappos += linelen;
+
+	if (!nl)
+	{
+	    /* the last line is not terminated within the mapping */
+	    if (dr->linemax < linelen + 1)
+	    {
+		dr->linemax = linelen + 1;
+		dr->line = realloc(dr->line, dr->linemax);
+	    }
+	    memcpy(dr->line, line, linelen);
+	    dr->line[linelen] = 0;
+	    line = dr->line;
+	}
+    }
+    else
+    {
+	ssize_t rb = getline(&dr->line, &dr->linemax, dr->fp);
+
+	if (rb < 0)
+	    return FALSE;
+
+	line = dr->line;
+	linelen = rb;
+    }
+
+    ++dr->linenum;
+
+    if (dr->res == -2) /* last line indicated eof */
+    {
+	fprintf(stderr, "%s: \"%s\" line %d: superfluous line after eof.\n",
+		g_progname, gopt_digestfile, dr->linenum);
+    }
+
+    nextcrc = crc32(dr->crc, (const unsigned char*)line, linelen);
+
+    if (dr->map && dr->spanstate == SPAN_NONE)
+    {
+	dr->spanstate = SPAN_OPEN;
+	dr->spanstart = dr->linepos;
+	dr->spancrc = dr->crc;
+    }
+
+    dr->res = parse_digestline(dr, line, linelen);
+
+    if (dr->res != 0)
+    {
+	/* Illegal or valid digest line found. Clear fileinfo. */
+
+	if (dr->tempinfo.symlink)
+	    free(dr->tempinfo.symlink);
+
+	memset(&dr->tempinfo, 0, sizeof(struct LineInfo));
+
+	dr->spanstate = SPAN_NONE;
+    }
+    else if (dr->spanstate == SPAN_OPEN)
+    {
+	/* only a single mtime line may precede the record's line */
+	if (dr->spanstart != dr->linepos)
+	    dr->spanstate = SPAN_BROKEN;
+	else if (linelen < 9 || memcmp(line, "#: mtime ", 9) != 0)
+	    dr->spanstate = SPAN_NONE;
+    }
+
+    dr->crc = nextcrc;
+
+    return TRUE;
+}
+
+/**
+ * Close the digest file and release the reader's buffers.
+ */
+void digestreader_close(struct DigestReader* dr)
+{
+    if (dr->line) free(dr->line);
+    if (dr->name) free(dr->name);
+    if (dr->tempinfo.symlink) free(dr->tempinfo.symlink);
+
+#if !ON_WIN32
+    if (dr->map) munmap((void*)dr->map, dr->mapsize);
+#endif
+
+    fclose(dr->fp);
+    memset(dr, 0, sizeof(struct DigestReader));
+}
+
+/**
+ * Read the crc32 value saved on the eof line, which ends the opened
+ * digest file as written by digup. Returns FALSE if there is none. The
+ * file is rewound afterwards.
+ */
+bool digestfile_eof_crc(FILE* fp, uint32_t* crc)
+{
+    char tail[32], expect[32];
+    const long len = 23; /* newline and "#: crc 0x%08x eof\n" */
+    unsigned int value;
+    bool ok;
+
+    ok = (fseek(fp, -len, SEEK_END) == 0 &&
+	  fread(tail, 1, len, fp) == (size_t)len);
+    tail[ok ? len : 0] = 0;
+
+    ok = ok && tail[0] == '\n' && sscanf(tail + 1, "#: crc 0x%x eof", &value) == 1;
+
+    if (ok)
+    {
+	sprintf(expect, "\n#: crc 0x%08x eof\n", value);
+	ok = (strcmp(tail, expect) == 0);
+	*crc = value;
+    }
+
+    rewind(fp);
+
+    return ok;
+}
+
+/**
+ * Save the crc32 of the loaded digest file up to pos, where a chunk
+ * starts whose records' spancrc are relative to it.
+ */
+void loadedfile_base(uint64_t pos, uint32_t crc)
+{
+    if (!g_loadedfile.valid) return;
+
+    if (g_loadedfile.basesize >= g_loadedfile.basemax)
+    {
+	g_loadedfile.basemax = g_loadedfile.basemax ? 2 * g_loadedfile.basemax : 16;
+	g_loadedfile.bases = realloc(g_loadedfile.bases,
+				     sizeof(struct SpanBase) * g_loadedfile.basemax);
+    }
+
+    g_loadedfile.bases[g_loadedfile.basesize].pos = pos;
+    g_loadedfile.bases[g_loadedfile.basesize].crc = crc;
+    ++g_loadedfile.basesize;
+}
+
+/**
+ * Remember the digest file opened by the reader, if it is mapped and
+ * ends with an eof line, hence the lines of the records parsed from it
+ * can be copied when writing the digest file.
+ */
+void loadedfile_init(struct DigestReader* dr)
+{
+#if !ON_WIN32
+    struct stat st;
+#endif
+
+    g_loadedfile.valid = FALSE;
+    g_loadedfile.basesize = 0;
+
+#if !ON_WIN32
+    if (!dr->map || fstat(fileno(dr->fp), &st) != 0 ||
+	!digestfile_eof_crc(dr->fp, &g_loadedfile.crc))
+	return;
+
+    g_loadedfile.valid = TRUE;
+    g_loadedfile.size = st.st_size;
+    g_loadedfile.mtime = st.st_mtime;
+    g_loadedfile.dev = st.st_dev;
+    g_loadedfile.ino = st.st_ino;
+    g_loadedfile.mode = st.st_mode & 07777;
+
+    /* lines read before parsing in chunks */
+    loadedfile_base(0, 0);
+#else
+    (void)dr;
+#endif
+}
+
+#if HAVE_PTHREAD_H
+
+/* mapped digest files are split into chunks of at least this size to be
+ * parsed in parallel */
+#define LOADCHUNK_MIN	(4 << 20)
+
+/**
+ * Returns the offset of the line following the first digest line after
+ * pos, hence a chunk starts with a new record and the attributes on
+ * comment lines stay with their digest or symlink line.
+ */
+size_t loadchunk_boundary(const char* map, size_t pos, size_t end)
+{
+    const char* nl = memchr(map + pos, '\n', end - pos);
+
+    while (nl)
+    {
+	const char* line = nl + 1;
+
+	nl = memchr(line, '\n', map + end - line);
+
+	while (line != map + end && dl_space(*line)) ++line;
+
+	if (line != map + end && *line != '#')
+	    return nl ? (size_t)(nl + 1 - map) : end;
+    }
+
+    return end;
+}
+
+/* count the lines of a chunk to number the lines of the following ones */
+static void* loadchunk_count(void* arg)
+{
+    struct LoadChunk* chunk = arg;
+    const char* p = chunk->reader.map;
+    const char* end = p + chunk->reader.mapsize;
+
+    while ((p = memchr(p, '\n', end - p)) != NULL)
+    {
+	++chunk->lines;
+	++p;
+    }
+
+    return NULL;
+}
+
+static void* loadchunk_parse(void* arg)
+{
+    struct LoadChunk* chunk = arg;
+
+    while (digestreader_next(&chunk->reader)) ;
+
+    return NULL;
+}
+
+/**
+ * Run func on all num items of an array, each of the given size, in
+ * parallel and wait for them. Items for which no thread can be started
+ * are processed by the calling thread.
+ */
+void run_parallel(void* items, size_t size, unsigned int num,
+		  void* (*func)(void*))
+{
+    pthread_t* threads = calloc(num, sizeof(pthread_t));
+    bool* threaded = calloc(num, sizeof(bool));
+    unsigned int i;
+
+    for (i = 0; i < num; ++i)
+    {
+	void* item = (char*)items + i * size;
+
+	threaded[i] = (pthread_create(&threads[i], NULL, func, item) == 0);
+
+	if (!threaded[i])
+	    func(item);
+    }
+
+    for (i = 0; i < num; ++i)
+    {
+	if (threaded[i]) pthread_join(threads[i], NULL);
+    }
+
+    free(threaded);
+    free(threads);
+}
+
+/**
+ * Parse the rest of a mapped digest file on the given number of
+ * threads, or one per processor if zero. The file is split into chunks
+ * at record boundaries, which are parsed into records and names in
+ * per-thread arenas. The entries are then added in file order, and crc
+ * lines are verified by combining the crcs of all chunks before, hence
+ * the result is the same as reading line by line.
+ */
+void digestreader_parallel(struct DigestReader* dr, unsigned int threads)
+{
+    struct LoadChunk* chunks;
+    size_t rest = dr->mapsize - dr->mappos, pos, j;
+    unsigned int i, num;
+    uint32_t crc;
+
+    if (!dr->map) return;
+
+    if (threads == 0)
+    {
+	threads = psort_ncpus();
+
+	if (threads > rest / LOADCHUNK_MIN)
+	    threads = rest / LOADCHUNK_MIN;
+    }
+
+    if (threads <= 1) return;
+
+    chunks = calloc(threads, sizeof(struct LoadChunk));
+
+    /* split into nearly equal parts at record boundaries */
+
+    pos = dr->mappos;
+
+    for (num = 0; num < threads && pos < dr->mapsize; ++num)
+    {
+	size_t next = dr->mappos + rest / threads * (num + 1);
+
+	if (num + 1 == threads)
+	    next = dr->mapsize;
+	else
+	    next = loadchunk_boundary(dr->map, next > pos ? next : pos, dr->mapsize);
+
+	chunks[num].reader.map = dr->map + pos;
+	chunks[num].reader.mapsize = next - pos;
+	chunks[num].reader.mapoffset = dr->mapoffset + pos;
+	chunks[num].reader.chunk = &chunks[num];
+	chunks[num].arena = arena_create(0);
+
+	pos = next;
+    }
+
+    run_parallel(chunks, sizeof(struct LoadChunk), num, loadchunk_count);
+
+    chunks[0].reader.linenum = dr->linenum;
+
+    for (i = 1; i < num; ++i)
+	chunks[i].reader.linenum = chunks[i-1].reader.linenum + chunks[i-1].lines;
+
+    run_parallel(chunks, sizeof(struct LoadChunk), num, loadchunk_parse);
+
+    /* add entries in file order, continuing the crc of the lines before */
+
+    crc = dr->crc;
+
+    for (i = 0; i < num; ++i)
+    {
+	struct LoadChunk* chunk = &chunks[i];
+	const struct DigestReader* prev = i ? &chunks[i-1].reader : dr;
+
+	if (prev->res == -2 && chunk->lines > 0) /* last line indicated eof */
+	{
+	    fprintf(stderr, "%s: \"%s\" line %d: superfluous line after eof.\n",
+		    g_progname, gopt_digestfile, prev->linenum + 1);
+	}
+
+	for (j = 0; j < chunk->crcsize; ++j)
+	{
+	    const struct ChunkCrc* cc = &chunk->crcs[j];
+
+	    if (crc32_combine(crc, cc->crc, cc->pos) != cc->saved)
+		digestfile_crc_mismatch(cc->linenum);
+	}
+
+	for (j = 0; j < chunk->size; ++j)
+	{
+	    const struct ChunkEntry* ce = &chunk->list[j];
+
+	    if (ce->extra)
+		fileinfo_line_extra(ce->fileinfo, ce->extra);
+
+	    loadlist_append(ce->name, ce->namelen, ce->fileinfo, ce->linenum);
+	}
+
+	loadedfile_base(chunk->reader.mapoffset, crc);
+
+	crc = crc32_combine(crc, chunk->reader.crc, chunk->reader.mapsize);
+
+	/* the records are kept, the chunk arena becomes part of g_arena */
+	arena_merge(g_arena, chunk->arena);
+
+	if (chunk->list) free(chunk->list);
+	if (chunk->crcs) free(chunk->crcs);
+	if (chunk->reader.line) free(chunk->reader.line);
+	if (chunk->reader.name) free(chunk->reader.name);
+	if (chunk->reader.tempinfo.symlink) free(chunk->reader.tempinfo.symlink);
+    }
+
+    dr->mappos = dr->mapsize;
+    dr->linenum = chunks[num-1].reader.linenum;
+    dr->res = chunks[num-1].reader.res;
+    dr->crc = crc;
+
+    free(chunks);
+}
+
+#else /* !HAVE_PTHREAD_H */
+
+void digestreader_parallel(struct DigestReader* dr, unsigned int threads)
+{
+    (void)dr;
+    (void)threads;
+}
+
+#endif
+
+/**************************************************
+ * Functions for the sum index of the digest file *
+ **************************************************/
+
+/* path of the sum index next to the digest file */
+char* sumindex_path(void)
+{
+    char* path;
+    my_asprintf(&path, "%s" SI_SUFFIX, gopt_digestfile);
+    return path;
+}
+
+/* path of the update journal next to the digest file */
+char* journal_path(void)
+{
+    char* path;
+    my_asprintf(&path, "%s" JOURNAL_SUFFIX, gopt_digestfile);
+    return path;
+}
+
+/**
+ * Returns TRUE if the path is the digest file, its temporary file, its
+ * sum index or its journal, which are skipped while scanning.
+ */
+bool is_digestfile(const char* filepath)
+{
+    size_t len = strlen(gopt_digestfile);
+
+    if (strncmp(filepath, gopt_digestfile, len) != 0)
+	return FALSE;
+
+    filepath += len;
+
+    return (filepath[0] == 0 || strcmp(filepath, ".tmp") == 0 ||
+	    strcmp(filepath, SI_SUFFIX) == 0 ||
+	    strcmp(filepath, SI_SUFFIX ".tmp") == 0 ||
+	    strcmp(filepath, JOURNAL_SUFFIX) == 0);
+}
+
+/**
+ * Start writing the sum index of the digest file for --index, with
+ * records following the given number of header lines. Returns NULL if
+ * it cannot be created, which is reported.
+ */
+struct si_writer* sumindex_create(unsigned int headerlines)
+{
+    char* path;
+    struct si_writer* w;
+
+    if (gopt_digesttype == DT_NONE)
+	return NULL;
+
+    path = sumindex_path();
+    w = si_create(path, gopt_digesttype, digesttype_size(gopt_digesttype), headerlines);
+
+    if (!w)
+    {
+	fprintf(stderr, "%s: could not write index %s: %s\n",
+		g_progname, path, strerror(errno));
+    }
+
+    free(path);
+    return w;
+}
+
+/**
+ * Append the record of a file written to the digest file to the sum
+ * index. Returns FALSE if its digest does not have the index's size.
+ */
+bool sumindex_add(struct si_writer* w, const char* path, const struct FileInfo* fileinfo)
+{
+    struct si_record rec;
+    const char* symlink = fileinfo_symlink(fileinfo);
+    const struct InodeId* inode = fileinfo_inode(fileinfo);
+
+    if (!symlink && fileinfo->digest.size != digesttype_size(gopt_digesttype))
+	return FALSE;
+
+    memset(&rec, 0, sizeof(rec));
+    rec.size = fileinfo->size;
+    rec.mtime = fileinfo->mtime;
+
+    if (symlink)
+    {
+	rec.flags |= SI_SYMLINK;
+    }
+    else if (gopt_inodes && inode) /* saved like digestfile_write_record() */
+    {
+	rec.flags |= SI_INODE;
+	rec.dev = inode->dev;
+	rec.ino = inode->ino;
+    }
+
+    si_add(w, &rec, path, symlink, (const unsigned char*)(&fileinfo->digest + 1));
+
+    return TRUE;
+}
+
+/**
+ * Complete the sum index, stamping it with the digest file just
+ * written and its final crc.
+ */
+void sumindex_finish(struct si_writer* w, uint32_t crc)
+{
+    struct si_stamp stamp;
+    mystatst st;
+
+    memset(&stamp, 0, sizeof(stamp));
+
+    if (mystat(gopt_digestfile, &st) == 0)
+    {
+	stamp.size = st.st_size;
+	stamp.mtime = st.st_mtime;
+	stamp.crc = crc;
+    }
+
+    if (!si_finish(w, &stamp))
+    {
+	char* path = sumindex_path();
+
+	fprintf(stderr, "%s: could not write index %s: %s\n",
+		g_progname, path, strerror(errno));
+
+	free(path);
+    }
+}
+
+/**
+ * Load all records from the sum index of the opened digest file if it
+ * matches the file, instead of parsing it. Only the header lines with
+ * the persistent options are read from the digest file. Returns FALSE
+ * if there is no usable index.
+ */
+bool sumindex_read(struct DigestReader* dr)
+{
+    struct si_stamp stamp;
+    struct sumindex* si;
+    mystatst st;
+    char* path;
+    unsigned int digestsize, headerlines;
+    uint64_t i;
+
+    memset(&stamp, 0, sizeof(stamp));
+
+    if (mystat(gopt_digestfile, &st) != 0 || !digestfile_eof_crc(dr->fp, &stamp.crc))
+	return FALSE;
+
+    stamp.size = st.st_size;
+    stamp.mtime = st.st_mtime;
+
+    path = sumindex_path();
+
+    if ((si = si_open(path, &stamp)) == NULL)
+    {
+	if (errno != ENOENT && gopt_verbose >= 2)
+	{
+	    fprintf(stderr, "%s: ignoring index %s: %s\n", g_progname, path,
+		    errno == ESTALE ? "digest file was changed" : strerror(errno));
+	}
+
+	free(path);
+	return FALSE;
+    }
+
+    free(path);
+
+    digestsize = si_digestsize(si);
+    headerlines = si_headerlines(si);
+
+    if (si_type(si) == DT_NONE || si_type(si) > DT_SHA512 ||
+	digesttype_size(si_type(si)) != digestsize)
+    {
+	si_close(si);
+	return FALSE;
+    }
+
+    /* persistent options */
+    while (dr->linenum < headerlines && digestreader_next(dr)) ;
+
+    gopt_digesttype = si_type(si);
+
+    for (i = 0; i < si_count(si); ++i)
+    {
+	const struct si_record* rec = si_get(si, i);
+	struct FileInfo* fileinfo;
+
+	if (rec->flags & SI_SYMLINK)
+	{
+	    fileinfo = fileinfo_alloc(DIGEST_MAX_SIZE);
+	    fileinfo_extra(fileinfo, TRUE)->symlink = arena_strdup(g_arena, si_string(si, rec->target));
+	}
+	else
+	{
+	    fileinfo = fileinfo_alloc(digestsize);
+	    fileinfo->digest.size = digestsize;
+	    memcpy(&fileinfo->digest + 1, si_digest(rec), digestsize);
+	}
+
+	fileinfo->status = FS_UNSEEN;
+	fileinfo->loaded = TRUE;
+	fileinfo->size = rec->size;
+	fileinfo->mtime = rec->mtime;
+
+	if (rec->flags & SI_INODE)
+	{
+	    struct FileExtra* extra = fileinfo_extra(fileinfo, TRUE);
+	    extra->inode.dev = rec->dev;
+	    extra->inode.ino = rec->ino;
+	    extra->hasinode = TRUE;
+	}
+
+	/* each record takes two lines after the header */
+	loadlist_append(si_string(si, rec->path), rec->pathlen, fileinfo,
+			headerlines + 2 * i + 2);
+    }
+
+    si_close(si);
+
+    return TRUE;
+}
+
+/*************************************************
+ * Functions for the update journal of --journal *
+ *************************************************/
+
+/**
+ * Returns the persistent option lines at the start of the digest file,
+ * which are compared with the current options before appending to the
+ * journal. The file is rewound afterwards.
+ */
+char* journal_read_options(FILE* fp)
+{
+    struct DigestWriter* dw = digestwriter_buffer();
+    char *line = NULL, *options;
+    size_t linemax = 0;
+
+    while (getline(&line, &linemax, fp) >= 0)
+    {
+	if (strncmp(line, "#: option ", 10) == 0)
+	    digestwriter_puts(dw, line);
+	else if (line[0] != '#' || line[1] == ':')
+	    break;
+    }
+
+    options = strndup(dw->buf, dw->size);
+
+    if (line) free(line);
+    digestwriter_close(dw);
+    rewind(fp);
+
+    return options;
+}
+
+/**
+ * Replay the updates appended to the journal of the digest file opened
+ * by the reader, after all its records were loaded. The journal's first
+ * line names the crc of the digest file it belongs to, otherwise it is
+ * ignored. Each update ends with a commit line carrying the crc of the
+ * journal up to it, an incomplete last update is dropped and
+ * overwritten by the next one.
+ */
+void journal_read(struct DigestReader* dr)
+{
+    struct DigestReader jr;
+    const char* digestfile = gopt_digestfile;
+    char header[64];
+    char* path;
+    mystatst st;
+    uint32_t crc;
+    unsigned int base;
+    size_t i, first, committed;
+    ssize_t rb;
+
+    if (g_journal.options) free(g_journal.options);
+    memset(&g_journal, 0, sizeof(g_journal));
+
+    if (mystat(gopt_digestfile, &st) != 0 || !digestfile_eof_crc(dr->fp, &crc))
+	return;
+
+    g_journal.valid = TRUE;
+    g_journal.mainsize = st.st_size;
+    g_journal.mainmtime = st.st_mtime;
+    g_journal.maincrc = crc;
+    g_journal.options = journal_read_options(dr->fp);
+
+    memset(&jr, 0, sizeof(jr));
+
+    path = journal_path();
+
+    if ((jr.fp = fopen(path, "rb")) == NULL)
+    {
+	free(path);
+	return;
+    }
+
+    g_journal.filesize = (mystat(path, &st) == 0) ? st.st_size : 0;
+
+    sprintf(header, JOURNAL_HEADER, crc);
+
+    if ((rb = getline(&jr.line, &jr.linemax, jr.fp)) < 0 ||
+	strcmp(jr.line, header) != 0)
+    {
+	/* the updates are lost, the next write replaces the journal */
+	fprintf(stderr, "%s: ignoring journal %s: digest file was changed\n",
+		g_progname, path);
+
+	digestreader_close(&jr);
+	free(path);
+	return;
+    }
+
+    jr.journal = TRUE;
+    jr.linenum = 1;
+    jr.crc = crc32(0, (const unsigned char*)jr.line, rb);
+
+    g_journal.size = rb;
+    g_journal.crc = jr.crc;
+
+    first = committed = g_loadlist_size;
+
+    gopt_digestfile = path; /* named by the parser's messages */
+
+    while (digestreader_next(&jr) && jr.res != -1)
+    {
+	if (jr.res == -3)
+	{
+	    g_journal.size = ftello(jr.fp);
+	    g_journal.crc = jr.crc;
+	    ++g_journal.updates;
+
+	    committed = g_loadlist_size;
+	}
+    }
+
+    gopt_digestfile = (char*)digestfile;
+
+    if (g_journal.filesize > g_journal.size)
+    {
+	fprintf(stderr, "%s: ignoring incomplete update at the end of journal %s\n",
+		g_progname, path);
+    }
+
+    /* number the entries of the updates after the digest file's lines,
+     * the records loaded from the sum index are numbered beyond them */
+    g_loadlist_size = committed;
+
+    base = dr->linenum;
+    if (first > 0 && g_loadlist[first-1].linenum > base)
+	base = g_loadlist[first-1].linenum;
+
+    for (i = first; i < g_loadlist_size; ++i)
+	g_loadlist[i].linenum += base;
+
+    if (first < g_loadlist_size)
+	g_loadlist_journal = base + 1;
+
+    digestreader_close(&jr);
+    free(path);
+}
+
+bool read_digestfile(void)
+{
+    struct DigestReader dr;
+
+    memset(&dr, 0, sizeof(struct DigestReader));
+
+    if (!digestreader_open(&dr))
+	return FALSE;
+
+    if (dr.fp == NULL)
+	return TRUE;
+
+    /* the options and first record, which selects the digest type, are
+     * read line by line, large files are then parsed in parallel */
+
+    loadedfile_init(&dr);
+
+    if (sumindex_read(&dr))
+    {
+	/* records loaded from the index have no lines to copy */
+	g_loadedfile.valid = FALSE;
+    }
+    else
+    {
+	while (gopt_digesttype == DT_NONE && digestreader_next(&dr)) ;
+
+	digestreader_parallel(&dr, 0);
+
+	while (digestreader_next(&dr)) ;
+    }
+
+    journal_read(&dr);
+
+    digestreader_close(&dr);
+
+    loadlist_finish();
+
+    if (rb_isempty(g_filelist))
+    {
+	fprintf(stderr, "%s: %s: no digests found in file.\n",
+		g_progname, gopt_digestfile);
+
+	if (gopt_digesttype == DT_NONE)
+	{
+	    fprintf(stderr, "%s: to create a new digest file specify the digest --type (see --help).\n",
+		    g_progname);
+	    return FALSE;
+	}
+    }
+    else
+    {
+	/* Mark files as skipped that are outside of --subtree, or don't
+	 * match --restrict or --include */
+
+	struct rb_node *node, *last;
+
+	if (gopt_subtree)
+	    filelist_mark_subtree();
+	else if (gopt_changedfrom)
+	    g_filelist_seen = rb_size(g_filelist);
+
+	if (gopt_matchpattern || gopt_pathmatch)
+	{
+	    filelist_dir_range(gopt_subtree ? gopt_subtree : "", &node, &last);
+
+	    for (; node != last; node = rb_successor(g_filelist, node))
+	    {
+		struct FileInfo* fileinfo = node->value;
+		const char* path = filelist_path(node->key);
+
+		if ((gopt_matchpattern && strstr(path, gopt_matchpattern) == NULL) ||
+		    (gopt_pathmatch && !pm_match_path(gopt_pathmatch, path)))
+		{
+		    filelist_reset_entry(fileinfo); /* FS_SEEN by --changed-from */
+		    fileinfo->status = FS_SKIPPED;
+		    ++g_filelist_skipped;
+		}
+	    }
+	}
+    }
+
+    return TRUE;
+}
+
+/*************************************************************
+ * Functions to recursively scan directories and process file *
+ *************************************************************/
+
+/**
+ * Lookup the entry of a path in g_filelist, returns NULL if the file is
+ * not in the digest file.
+ */
+struct rb_node* filelist_find(const char* filepath)
+{
+    struct dt_key key;
+
+    if (filepath[0] == '.' && filepath[1] == '/')
+	filepath += 2;
+
+    if (!dt_lookup(g_dirtree, filepath, &key))
+	return NULL;
+
+    return hi_find(g_filehash, &key);
+}
+
+/**
+ * Move a malloc()ed string or digest into the arena and free it.
+ * Returns NULL for NULL.
+ */
+void* filelist_keep(void* ptr, size_t size)
+{
+    void* kept;
+
+    if (!ptr) return NULL;
+
+    kept = arena_memdup(g_arena, ptr, size);
+    free(ptr);
+
+    return kept;
+}
+
+char* filelist_keep_string(char* str)
+{
+    return str ? filelist_keep(str, strlen(str) + 1) : NULL;
+}
+
+/**
+ * Insert a new entry into g_filelist and the hash index. The path is
+ * interned in g_dirtree, fileinfo must be arena memory.
+ */
+struct rb_node* filelist_insert(const char* filepath, struct FileInfo* fileinfo)
+{
+    struct rb_node* node;
+
+    if (gopt_memlimit)
+    {
+	/* written out by the merge instead */
+	g_extnew = fileinfo;
+	return NULL;
+    }
+
+    node = rb_insert(g_filelist, dt_intern(g_dirtree, filepath), fileinfo);
+
+    hi_insert(g_filehash, node->key, node);
+
+    return node;
+}
+
+/**
+ * Returns the leading bytes of a digest, which are uniformly
+ * distributed and hence used directly as hash value.
+ */
+uint64_t digestindex_prefix(const digest_result* digest)
+{
+    const unsigned char* data = (const unsigned char*)(digest + 1);
+    uint64_t prefix = 0;
+    unsigned int i;
+
+    for (i = 0; i < 8 && i < digest->size; ++i)
+	prefix = (prefix << 8) | data[i];
+
+    return prefix;
+}
+
+/**
+ * Build g_digestindex from the loaded digests of all entries, sized
+ * for a fill ratio of at most one half. The time taken is shown in the
+ * summary at verbosity level 2.
+ */
+void digestindex_build(void)
+{
+    struct rb_node* node;
+    size_t n = 16;
+    clock_t start = clock();
+
+    while (n < 2 * rb_size(g_filelist)) n *= 2;
+
+    g_digestindex = calloc(n, sizeof(struct DigestSlot));
+    g_digestindex_mask = n - 1;
+
+    for (node = rb_begin(g_filelist); node != rb_end(g_filelist);
+	 node = rb_successor(g_filelist, node))
+    {
+	const digest_result* digest = fileinfo_loaded_digest(node->value);
+	uint64_t prefix;
+	size_t i;
+
+	if (!digest) continue;
+
+	prefix = digestindex_prefix(digest);
+
+	for (i = prefix & g_digestindex_mask; g_digestindex[i].node;
+	     i = (i + 1) & g_digestindex_mask) ;
+
+	g_digestindex[i].prefix = prefix;
+	g_digestindex[i].node = node;
+	++g_digestindex_size;
+    }
+
+    g_digestindex_time = (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+/**
+ * Return the next entry of g_filelist with a loaded digest equal to the
+ * given one, or NULL if there are no more. The index is built on the
+ * first call. The search position *pos must be initialized to
+ * (size_t)-1 for the first call.
+ */
+struct rb_node* digestindex_next(const digest_result* digest, size_t* pos)
+{
+    uint64_t prefix = digestindex_prefix(digest);
+    size_t i;
+
+    if (!g_digestindex)
+	digestindex_build();
+
+    i = (*pos == (size_t)-1) ? (prefix & g_digestindex_mask)
+	: ((*pos + 1) & g_digestindex_mask);
+
+    for (; g_digestindex[i].node; i = (i + 1) & g_digestindex_mask)
+    {
+	if (g_digestindex[i].prefix == prefix &&
+	    digest_equal(fileinfo_loaded_digest(g_digestindex[i].node->value), digest))
+	{
+	    *pos = i;
+	    return g_digestindex[i].node;
+	}
+    }
+
+    return NULL;
+}
+
+/**
+ * Build g_inodemap from the devices and inodes saved with --inodes for
+ * all entries with a loaded digest.
+ */
+void inodemap_build(void)
+{
+    struct rb_node* node;
+
+    g_inodemap = hi_create_custom(0, inodeid_hash, inodeid_equal);
+
+    for (node = rb_begin(g_filelist); node != rb_end(g_filelist);
+	 node = rb_successor(g_filelist, node))
+    {
+	const struct InodeId* id = fileinfo_inode(node->value);
+	struct InodeEntry* entry;
+
+	if (!id || !fileinfo_loaded_digest(node->value)) continue;
+
+	entry = arena_alloc(g_arena, sizeof(struct InodeEntry));
+	entry->id = *id;
+	entry->node = node;
+
+	hi_insert(g_inodemap, entry, entry);
+    }
+}
+
+/**
+ * Take over the digest of a new file from the loaded entry with equal
+ * device and inode, if its size and mtime are unchanged: the file was
+ * renamed or hard linked within the tree and is not read again. Only
+ * used with --inodes and not for --check. The map is built on the
+ * first call.
+ */
+bool inodemap_digest(const mystatst* st, digest_result* outdigest)
+{
+#if !ON_WIN32
+    struct InodeId id;
+    const struct InodeEntry* entry;
+    const struct FileInfo* fileinfo;
+
+    if (!gopt_inodes || gopt_fullcheck || gopt_memlimit)
+	return FALSE;
+
+    if (!g_inodemap)
+	inodemap_build();
+
+    id.dev = st->st_dev;
+    id.ino = st->st_ino;
+
+    if ((entry = hi_find(g_inodemap, &id)) == NULL)
+	return FALSE;
+
+    fileinfo = entry->node->value;
+
+    if (fileinfo->status == FS_ERROR || fileinfo->digest.size == 0 ||
+	fileinfo->size != st->st_size || fileinfo->mtime != st->st_mtime)
+	return FALSE;
+
+    memcpy(outdigest, &fileinfo->digest, 1 + fileinfo->digest.size);
+    ++g_inodemap_reused;
+    return TRUE;
+#else
+    (void)st; (void)outdigest;
+    return FALSE;
+#endif
+}
+
+/**
+ * Scanned entry in the sorted runs of g_extscan, followed by its path.
+ */
+struct ExtEntry
+{
+    long long		size;
+    time_t		mtime;
+    unsigned char	symlink;
+};
+
+/* order scanned entries by path, as in the digest file */
+static int ext_entry_cmp(const void *p1, const void *p2)
+{
+    return strcmp((const char*)p1 + sizeof(struct ExtEntry),
+		  (const char*)p2 + sizeof(struct ExtEntry));
+}
+
+/**
+ * Collect a file or symlink found while scanning in external memory
+ * mode. It is processed when the sorted runs are merged with the
+ * digest file.
+ */
+bool ext_collect(const char* filepath, const mystatst* st, bool symlink)
+{
+    static char* buf = NULL;
+    static size_t bufmax = 0;
+
+    size_t len = sizeof(struct ExtEntry) + strlen(filepath) + 1;
+    struct ExtEntry* ee;
+
+    if (len > bufmax)
+    {
+	bufmax = 2 * len;
+	buf = realloc(buf, bufmax);
+    }
+
+    ee = (struct ExtEntry*)buf;
+    ee->size = st->st_size;
+    ee->mtime = st->st_mtime;
+    ee->symlink = symlink;
+    strcpy(buf + sizeof(struct ExtEntry), filepath);
+
+    es_add(g_extscan, buf, len);
+
+    return TRUE;
+}
+
+/**
+ * Process a regular file found on the filesystem. The caller passes
+ * the filepath's entry in g_filelist as fileiter, or NULL if the file
+ * is not contained in the digest file.
+ */
+bool process_file(const char* filepath, const mystatst* st,
+		  struct rb_node* fileiter)
+{
+    size_t digestpos;
+
+    if (filepath[0] == '.' && filepath[1] == '/')
+	filepath += 2;
+
+    /* skip over the digestfile */
+    if (is_digestfile(filepath))
+	return TRUE;
+
+    /* silently skip over ignored filepaths */
+    if (gopt_matchpattern && strstr(filepath, gopt_matchpattern) == NULL)
+	return TRUE;
+
+    if (g_extscan)
+	return ext_collect(filepath, st, FALSE);
+
+    if (gopt_verbose >= 2) {
+	fprintf(stdout, "%s ", filepath);
+    }
+
+    if (fileiter != NULL)
+    {
+	struct FileInfo* fileinfo = fileiter->value;
+	unsigned char filedigest[1 + DIGEST_MAX_SIZE];
+	char* error = NULL;
+
+	if (fileinfo->status != FS_UNSEEN)
+	{
+	    if (gopt_verbose >= 2) {
+		fprintf(stdout, " same file processed twice??? This should never occur.\n");
+	    }
+	    else {
+		fprintf(stdout, "%s same file processed twice??? This should never occur.\n", filepath);
+	    }
+	    return TRUE;
+	}
+
+	fileinfo_set_inode(fileinfo, st);
+
+	if (gopt_fullcheck)
+	{
+	    if (gopt_verbose >= 2) {
+		fprintf(stdout, "check ");
+	    }
+	}
+	else if ((unsigned int)labs(st->st_mtime - fileinfo->mtime) > gopt_modify_window ||
+		 st->st_size != fileinfo->size)
+	{
+	    if (gopt_verbose >= 2) {
+		fprintf(stdout, "touched ");
+	    }
+	}
+	else
+	{
+	    if (gopt_verbose >= 2) {
+		fprintf(stdout, "untouched.\n");
+	    }
+	    else if (gopt_verbose == 1 && !gopt_onlymodified) {
+		fprintf(stdout, "%s untouched.\n", filepath);
+	    }
+
+	    fileinfo->status = FS_SEEN;
+	    ++g_filelist_seen;
+
+	    return TRUE;
+	}
+
+	/* calculate file digest */
+
+	if (!digest_inode(filepath, st, (digest_result*)filedigest, &error))
+	{
+	    fileinfo_extra(fileinfo, TRUE)->error = filelist_keep_string(error);
+	    fileinfo->status = FS_ERROR;
+	    fileinfo->mtime = st->st_mtime;
+	    fileinfo->size = st->st_size;
+
+	    ++g_filelist_error;
+	    return FALSE;
+	}
+
+	xattr_save(filepath, st, (digest_result*)filedigest);
+
+	if (fileinfo->digest.size &&
+	    digest_equal((digest_result*)filedigest, &fileinfo->digest))
+	{
+	    if (gopt_verbose >= 2) {
+		fprintf(stdout, " matched.\n");
+	    }
+	    else if (gopt_verbose == 1 && !gopt_onlymodified) {
+		fprintf(stdout, "%s matched.\n", filepath);
+	    }
+
+	    fileinfo->status = FS_TOUCHED;
+	    fileinfo->mtime = st->st_mtime;
+	    fileinfo->size = st->st_size;
+
+	    ++g_filelist_touched;
+	}
+	else
+	{
+	    if (gopt_verbose >= 2) {
+		fprintf(stdout, " CHANGED.\n");
+	    }
+	    else if (gopt_verbose == 1) {
+		fprintf(stdout, "%s CHANGED.\n", filepath);
+	    }
+
+	    fileinfo->status = FS_CHANGED;
+	    fileinfo->mtime = st->st_mtime;
+	    fileinfo->size = st->st_size;
+
+	    fileinfo_set_digest(fileiter, (digest_result*)filedigest);
+
+	    ++g_filelist_changed;
+	}
+
+	return TRUE;
+    }
+    else
+    {
+	struct FileInfo* fileinfo = fileinfo_alloc(g_digestsize);
+	char* error = NULL;
+
+	fileinfo->status = FS_NEW;
+	fileinfo->mtime = st->st_mtime;
+	fileinfo->size = st->st_size;
+
+	fileinfo_set_inode(fileinfo, st);
+
+	/* digest is calculated directly into the new record, unless it
+	 * is taken over from a loaded entry with the same inode or from
+	 * the file's extended attribute */
+	if (!inodemap_digest(st, &fileinfo->digest) &&
+	    !xattr_digest(filepath, st, &fileinfo->digest))
+	{
+	    if (!digest_inode(filepath, st, &fileinfo->digest, &error))
+	    {
+		fileinfo_extra(fileinfo, TRUE)->error = filelist_keep_string(error);
+		fileinfo->status = FS_ERROR;
+
+		filelist_insert(filepath, fileinfo);
+
+		++g_filelist_error;
+
+		return FALSE;
+	    }
+
+	    xattr_save(filepath, st, &fileinfo->digest);
+	}
+
+	/* new files with the digest of an existing entry were copied or
+	 * renamed, which is decided after the scan. In external memory
+	 * mode renames are found after the merge. */
+	digestpos = (size_t)-1;
+	fileinfo->moved = !gopt_memlimit &&
+	    digestindex_next(&fileinfo->digest, &digestpos) != NULL;
+
+	fileiter = filelist_insert(filepath, fileinfo);
+
+	++g_filelist_new;
+
+	if (fileinfo->moved)
+	{
+	    if (g_moved_size >= g_moved_max)
+	    {
+		g_moved_max = g_moved_max ? 2 * g_moved_max : 64;
+		g_moved = realloc(g_moved, sizeof(struct rb_node*) * g_moved_max);
+	    }
+	    g_moved[g_moved_size++] = fileiter;
+
+	    if (gopt_verbose >= 2) {
+		fprintf(stdout, " known digest.\n");
+	    }
+	}
+	else
+	{
+	    if (gopt_verbose >= 2) {
+		fprintf(stdout, " new.\n");
+	    }
+	    else if (gopt_verbose == 1) {
+		fprintf(stdout, "%s new.\n", filepath);
+	    }
+	}
+	return TRUE;
+    }
+}
+
+/* orders new file entries by digest, all have the same digest size */
+static int moved_digest_cmp(const void* a, const void* b)
+{
+    const struct FileInfo* fa = (*(struct rb_node* const*)a)->value;
+    const struct FileInfo* fb = (*(struct rb_node* const*)b)->value;
+
+    return memcmp(&fa->digest, &fb->digest, 1 + fa->digest.size);
+}
+
+/**
+ * Resolve the new files collected in g_moved after a scan. If one of
+ * the loaded entries with equal digest was seen on the filesystem, the
+ * file was copied from it, otherwise it was renamed from the first one
+ * and all unseen entries become old paths. Only the status left by the
+ * scan is used, hence no files are accessed and the result does not
+ * depend on the order in which files were scanned. The new files are
+ * sorted by digest, such that the loaded entries of each digest are
+ * visited only once.
+ */
+void resolve_moved(void)
+{
+    struct rb_node** sorted;
+    struct rb_node *filenode, *source = NULL;
+    const digest_result* lastdigest = NULL;
+    bool copied = FALSE;
+    size_t i;
+
+    if (g_moved_size == 0) return;
+
+    sorted = malloc(sizeof(struct rb_node*) * g_moved_size);
+    memcpy(sorted, g_moved, sizeof(struct rb_node*) * g_moved_size);
+    qsort(sorted, g_moved_size, sizeof(struct rb_node*), moved_digest_cmp);
+
+    for (i = 0; i < g_moved_size; ++i)
+    {
+	struct FileInfo* fileinfo = sorted[i]->value;
+	size_t digestpos = (size_t)-1;
+
+	/* skip entries reset while watching and those listed twice */
+	if (!fileinfo->moved || fileinfo->status != FS_NEW) continue;
+
+	if (!lastdigest || !digest_equal(lastdigest, &fileinfo->digest))
+	{
+	    source = NULL;
+	    copied = FALSE;
+
+	    while ((filenode = digestindex_next(&fileinfo->digest, &digestpos)) != NULL)
+	    {
+		struct FileInfo* oldinfo = filenode->value;
+
+		if (oldinfo->status == FS_UNSEEN)
+		{
+		    oldinfo->status = FS_OLDPATH;
+		    ++g_filelist_oldpath;
+		}
+
+		if (oldinfo->status != FS_OLDPATH)
+		{
+		    copied = TRUE;
+		    source = filenode;
+		}
+		else if (!source)
+		{
+		    source = filenode;
+		}
+	    }
+
+	    lastdigest = &fileinfo->digest;
+	}
+
+	--g_filelist_new;
+
+	if (copied)
+	{
+	    fileinfo->status = FS_COPIED;
+	    ++g_filelist_copied;
+	}
+	else
+	{
+	    fileinfo->status = FS_RENAMED;
+	    ++g_filelist_renamed;
+	}
+
+	/* path key in arena */
+	fileinfo_extra(fileinfo, TRUE)->oldpath = source->key;
+    }
+
+    free(sorted);
+
+    /* report in scan order, entries listed twice only once */
+    for (i = 0; i < g_moved_size; ++i)
+    {
+	struct FileInfo* fileinfo = g_moved[i]->value;
+
+	if (!fileinfo->moved) continue;
+
+	fileinfo->moved = FALSE;
+
+	if (gopt_verbose >= 1) {
+	    fprintf(stdout, "%s %s.\n<-- %s\n", filelist_path(g_moved[i]->key),
+		    fileinfo->status == FS_COPIED ? "copied" : "renamed",
+		    fileinfo_oldpath(fileinfo));
+	}
+    }
+
+    g_moved_size = 0;
+}
+
+/**
+ * Process a symlink found on the filesystem, fileiter is its entry in
+ * g_filelist as for process_file().
+ */
+bool process_symlink(const char* filepath, const mystatst* st,
+		     struct rb_node* fileiter)
+{
+    if (filepath[0] == '.' && filepath[1] == '/')
+	filepath += 2;
+
+    /* skip over the digestfile */
+    if (is_digestfile(filepath))
+	return TRUE;
+
+    /* silently skip over ignored filepaths */
+    if (gopt_matchpattern && strstr(filepath, gopt_matchpattern) == NULL)
+	return TRUE;
+
+    if (g_extscan)
+	return ext_collect(filepath, st, TRUE);
+
+    if (gopt_verbose >= 2) {
+	fprintf(stdout, "%s ", filepath);
+    }
+
+    if (fileiter != NULL)
+    {
+	struct FileInfo* fileinfo = fileiter->value;
+	char* linktarget = NULL;
+	char* error = NULL;
+
+	if (fileinfo->status != FS_UNSEEN)
+	{
+	    if (gopt_verbose >= 2) {
+		fprintf(stdout, " same symlink processed twice??? This should never occur.\n");
+	    }
+	    else {
+		fprintf(stdout, "%s same symlink processed twice??? This should never occur.\n", filepath);
+	    }
+	    return TRUE;
+	}
+
+	/* mimic method used for regular files even though reading a
+	 * symlink is no expensive operation. */
+	if (gopt_fullcheck)
+	{
+	    if (gopt_verbose >= 2) {
+		fprintf(stdout, "check ");
+	    }
+	}
+	else if (st->st_mtime != fileinfo->mtime ||
+		 st->st_size != fileinfo->size)
+	{
+	    if (gopt_verbose >= 2) {
+		fprintf(stdout, "touched ");
+	    }
+	}
+	else
+	{
+	    if (gopt_verbose >= 2) {
+		fprintf(stdout, "untouched.\n");
+	    }
+	    else if (gopt_verbose == 1 && !gopt_onlymodified) {
+		fprintf(stdout, "%s untouched.\n", filepath);
+	    }
+
+	    fileinfo->status = FS_SEEN;
+	    ++g_filelist_seen;
+
+	    return TRUE;
+	}
+
+	linktarget = readlink_dup(filepath);
+
+	if (!linktarget)
+	{
+	    if (gopt_verbose >= 2) {
+		fprintf(stdout, " ERROR. Could not read symlink: %s.\n", strerror(errno));
+	    }
+	    else if (gopt_verbose >= 1) {
+		fprintf(stdout, "%s ERROR. Could not read symlink: %s.\n", filepath, strerror(errno));
+	    }
+	    else if (gopt_verbose >= 0) {
+		fprintf(stderr, "%s: could not read symlink \"%s\": %s.\n",
+			g_progname, filepath, strerror(errno));
+	    }
+
+	    my_asprintf(&error, "Could not read symlink: %s.", strerror(errno));
+	    fileinfo_extra(fileinfo, TRUE)->error = filelist_keep_string(error);
+
+	    fileinfo->status = FS_ERROR;
+	    fileinfo->mtime = st->st_mtime;
+	    fileinfo->size = st->st_size;
+
+	    ++g_filelist_error;
+	    return FALSE;
+	}
+
+	if (fileinfo_symlink(fileinfo) &&
+	    strcmp(linktarget, fileinfo_symlink(fileinfo)) == 0)
+	{
+	    if (gopt_verbose >= 2) {
+		fprintf(stdout, "matched.\n");
+	    }
+	    else if (gopt_verbose == 1 && !gopt_onlymodified) {
+		fprintf(stdout, "%s matched.\n", filepath);
+	    }
+
+	    fileinfo->status = FS_TOUCHED;
+	    fileinfo->mtime = st->st_mtime;
+	    fileinfo->size = st->st_size;
+	    free(linktarget);
+
+	    ++g_filelist_touched;
+	}
+	else
+	{
+	    if (gopt_verbose >= 2) {
+		fprintf(stdout, "CHANGED.\n");
+	    }
+	    else if (gopt_verbose == 1) {
+		fprintf(stdout, "%s CHANGED.\n", filepath);
+	    }
+
+	    fileinfo->status = FS_CHANGED;
+	    fileinfo->mtime = st->st_mtime;
+	    fileinfo->size = st->st_size;
+
+	    fileinfo_extra(fileinfo, TRUE)->symlink = filelist_keep_string(linktarget);
+
+	    ++g_filelist_changed;
+	}
+
+	return TRUE;
+    }
+    else
+    {
+	struct FileInfo* fileinfo = fileinfo_alloc(g_digestsize);
+	char* linktarget = readlink_dup(filepath);
+	char* error = NULL;
+
+	fileinfo->status = FS_NEW;
+	fileinfo->mtime = st->st_mtime;
+	fileinfo->size = st->st_size;
+
+	if (linktarget)
+	    fileinfo_extra(fileinfo, TRUE)->symlink = filelist_keep_string(linktarget);
+	else
+	{
+	    if (gopt_verbose >= 2) {
+		fprintf(stdout, " ERROR. Could not read symlink: %s.\n", strerror(errno));
+	    }
+	    else if (gopt_verbose >= 1) {
+		fprintf(stdout, "%s ERROR. Could not read symlink: %s.\n", filepath, strerror(errno));
+	    }
+	    else if (gopt_verbose >= 0) {
+		fprintf(stderr, "%s: could not read symlink \"%s\": %s.\n",
+			g_progname, filepath, strerror(errno));
+	    }
+
+	    my_asprintf(&error, "Could not read symlink: %s.", strerror(errno));
+	    fileinfo_extra(fileinfo, TRUE)->error = filelist_keep_string(error);
+
+	    fileinfo->status = FS_ERROR;
+
+	    filelist_insert(filepath, fileinfo);
+
+	    ++g_filelist_error;
+
+	    return FALSE;
+	}
+
+	filelist_insert(filepath, fileinfo);
+
+	if (gopt_verbose >= 2) {
+	    fprintf(stdout, "new.\n");
+	}
+	else if (gopt_verbose == 1) {
+	    fprintf(stdout, "%s new.\n", filepath);
+	}
+
+	++g_filelist_new;
+
+	return TRUE;
+    }
+}
+
+/**
+ * Dynamically growing array of (dev_t, ino_t) pairs to test for
+ * symlink loops while scanning.
+ */
+
+struct DirLevel
+{
+    dev_t	dev;
+    ino_t	ino;
+};
+
+struct DirLevel* dirstack = NULL;
+size_t dirstackmax = 0;
+size_t dirstacklen = 0;
+
+bool dirstack_push(const mystatst* st)
+{
+#if !ON_WIN32 /* win32 under mingw has no inode numbers. */
+
+    size_t i;
+
+    /* first search in the current stack for the new level */
+    for (i = 0; i < dirstacklen; ++i)
+    {
+	if (dirstack[i].dev == st->st_dev &&
+	    dirstack[i].ino == st->st_ino)
+	{
+	    return FALSE;
+	}
+    }
+
+#endif
+
+    /* add new entry */
+    if (dirstacklen >= dirstackmax)
+    {
+        struct DirLevel* tmp;
+
+	dirstackmax = dirstackmax * 2;
+	if (dirstackmax < 16) dirstackmax = 16;
+
+	tmp = realloc(dirstack, sizeof(struct DirLevel) * dirstackmax);
+        if (!tmp) {
+            return FALSE;
+        }
+        dirstack = tmp;
+    }
+
+    dirstack[dirstacklen].dev = st->st_dev;
+    dirstack[dirstacklen].ino = st->st_ino;
+
+    ++dirstacklen;
+
+    return TRUE;
+}
+
+void dirstack_pop(const mystatst* st)
+{
+    assert( dirstacklen > 0 );
+
+    assert( dirstack[dirstacklen-1].dev == st->st_dev );
+    assert( dirstack[dirstacklen-1].ino == st->st_ino );
+    (void)st;
+
+    if (dirstacklen > 0)
+	--dirstacklen;
+}
+
+/**
+ * Merge-join cursor of a directory listing against g_filelist: both
+ * are sorted, hence the entries of the directory's files can be found
+ * by walking the key range of the directory's node in lockstep with
+ * the listing instead of searching the whole tree for each file.
+ */
+struct FileCursor
+{
+    struct rb_node*	node;	/* current position in g_filelist */
+    const struct dt_dir* dir;	/* node of directory, NULL if unknown */
+};
+
+void filecursor_init(struct FileCursor* fc, const char* path)
+{
+    if (path[0] == '.' && path[1] == 0)
+	path = "";
+    else if (path[0] == '.' && path[1] == '/')
+	path += 2;
+
+    fc->dir = dt_find_dir(g_dirtree, path);
+
+    if (fc->dir)
+    {
+	struct dt_key key;
+	key.dir = fc->dir;
+	key.name = "";
+
+	fc->node = rb_lower_bound(g_filelist, &key);
+    }
+    else
+    {
+	/* no entries are in or below the directory */
+	fc->node = rb_end(g_filelist);
+    }
+}
+
+/**
+ * Advance the cursor up to the file name in the directory and return
+ * its entry in g_filelist, or NULL if it is not contained. File names
+ * must be requested in increasing order. Entries of sub-directories
+ * are skipped over in one jump each.
+ */
+struct rb_node* filecursor_seek(struct FileCursor* fc, const char* name)
+{
+    struct rb_node* end = rb_end(g_filelist);
+    struct dt_key search;
+
+    search.dir = fc->dir;
+    search.name = name;
+
+    while (fc->node != end)
+    {
+	const struct dt_key* key = fc->node->key;
+	int cmp;
+
+	/* stop at end of the directory's key range */
+	if (!dt_within(key->dir, fc->dir))
+	    return NULL;
+
+	cmp = dt_key_cmp(key, &search);
+
+	if (cmp == 0)
+	{
+	    struct rb_node* found = fc->node;
+	    fc->node = rb_successor(g_filelist, fc->node);
+	    return found;
+	}
+	else if (cmp > 0)
+	{
+	    return NULL;
+	}
+
+	if (key->dir == fc->dir)
+	{
+	    /* file in digest file missing in directory: it was deleted. */
+	    fc->node = rb_successor(g_filelist, fc->node);
+	}
+	else
+	{
+	    /* jump over all entries in the sub-directory's node */
+	    struct dt_key skip;
+
+	    for (skip.dir = key->dir; skip.dir->parent != fc->dir;
+		 skip.dir = skip.dir->parent) ;
+
+	    skip.name = NULL;
+	    fc->node = rb_lower_bound(g_filelist, &skip);
+	}
+    }
+
+    return NULL;
+}
+
+#if HAVE_SYS_INOTIFY_H
+
+/**
+ * In --watch mode every directory scanned is registered with inotify.
+ * Watch descriptors are small consecutive integers, hence a plain
+ * array indexed by them maps events back to directory paths.
+ */
+
+int g_inotify_fd = -1;
+
+char** g_watchdirs = NULL;	/* path of watch descriptor, "" for top */
+int g_watchdirs_max = 0;
+unsigned int g_watchdirs_count = 0;
+
+#ifndef IN_EXCL_UNLINK
+#define IN_EXCL_UNLINK	0
+#endif
+
+#define WATCH_MASK	(IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | \
+			 IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR | IN_EXCL_UNLINK)
+
+void watch_add_directory(const char* path)
+{
+    int wd;
+
+    if (g_inotify_fd < 0) return;
+
+    if (path[0] == '.' && path[1] == 0)
+	path = "";
+    else if (path[0] == '.' && path[1] == '/')
+	path += 2;
+
+    wd = inotify_add_watch(g_inotify_fd, path[0] ? path : ".", WATCH_MASK);
+
+    if (wd < 0)
+    {
+	static bool warned = FALSE;
+
+	if (errno != ENOSPC) {
+	    fprintf(stderr, "%s: could not watch directory \"%s\": %s\n",
+		    g_progname, path, strerror(errno));
+	}
+	else if (!warned) {
+	    fprintf(stderr, "%s: inotify watch limit reached at \"%s\": increase /proc/sys/fs/inotify/max_user_watches.\n",
+		    g_progname, path);
+	    warned = TRUE;
+	}
+	return;
+    }
+
+    if (wd >= g_watchdirs_max)
+    {
+	int newmax = g_watchdirs_max * 2;
+	if (newmax <= wd) newmax = wd + 1024;
+
+	g_watchdirs = realloc(g_watchdirs, sizeof(char*) * newmax);
+	memset(g_watchdirs + g_watchdirs_max, 0, sizeof(char*) * (newmax - g_watchdirs_max));
+	g_watchdirs_max = newmax;
+    }
+
+    if (g_watchdirs[wd])
+	free(g_watchdirs[wd]);
+    else
+	++g_watchdirs_count;
+
+    g_watchdirs[wd] = strdup(path);
+}
+
+#endif
+
+/**
+ * Test a directory entry against the compiled --include and --exclude
+ * patterns by advancing the parent directory's matcher state over the
+ * name. Returns FALSE if the entry is not selected, which for
+ * directories means the whole subtree is skipped. The entry's state
+ * and included flag are returned for descending into directories.
+ */
+bool scan_pathmatch(const pm_state* parent, bool parentincluded,
+		    const char* name, bool isdir,
+		    pm_state* state, bool* included)
+{
+    int r;
+
+    if (!gopt_pathmatch) return TRUE;
+
+    pm_enter(gopt_pathmatch, parent, name, state);
+    r = pm_classify(gopt_pathmatch, state, isdir);
+
+    if (r & PM_EXCLUDED) return FALSE;
+
+    *included = parentincluded || (r & PM_INCLUDED);
+
+    if (*included) return TRUE;
+
+    return isdir && (r & PM_PARTIAL);
+}
+
+/**
+ * Recursively scan a directory. pmstate and pmincluded are the
+ * directory's --include/--exclude matcher state, see scan_pathmatch().
+ */
+bool scan_directory(const char* path, const mystatst* st,
+		    const pm_state* pmstate, bool pmincluded)
+{
+    DIR* dirp;
+
+    struct dirent* de;
+
+    char **filenames = NULL;
+    unsigned int filenamepos = 0;
+    unsigned int filenamemax = 0;
+
+    bool exclude_marker_found = FALSE;
+
+    if (!dirstack_push(st))
+    {
+	fprintf(stderr, "%s: filesystem loop detected at \"%s\".\n",
+		g_progname, path);
+	return TRUE;
+    }
+
+    dirp = opendir(path);
+
+    if (dirp == NULL)
+    {
+	dirstack_pop(st);
+	fprintf(stderr, "%s: could not open directory \"%s\": %s\n",
+		g_progname, path, strerror(errno));
+	return FALSE;
+    }
+
+    while ((de = readdir(dirp)))
+    {
+	if (de->d_name[0] == '.' && de->d_name[1] == 0) continue;
+	if (de->d_name[0] == '.' && de->d_name[1] == '.' && de->d_name[2] == 0) continue;
+
+	if (filenamepos >= filenamemax)
+	{
+	    filenamemax *= 2;
+	    if (filenamemax == 0) filenamemax = 8;
+	    filenames = realloc(filenames, sizeof(char*) * filenamemax);
+	}
+
+	filenames[filenamepos++] = strdup( de->d_name );
+
+	if (gopt_exclude_marker)
+	{
+	    if (strcmp(de->d_name, gopt_exclude_marker) == 0)
+		exclude_marker_found = TRUE;
+	}
+    }
+
+    closedir(dirp);
+
+    if (exclude_marker_found)
+    {
+	if (gopt_verbose >= 2) {
+	    fprintf(stderr, "%s: exclude marker found in \"%s\": skipping.\n",
+		    g_progname, path);
+	}
+
+	free(filenames);
+	dirstack_pop(st);
+	return TRUE;
+    }
+
+#if HAVE_SYS_INOTIFY_H
+    watch_add_directory(path);
+#endif
+
+    qsort(filenames, filenamepos, sizeof(char*), strcmpptr);
+
+    {
+	mystatst st;
+	unsigned int fi;
+	struct FileCursor fc;
+
+	pm_state* childstate = NULL;
+	bool childincluded = FALSE;
+
+	filecursor_init(&fc, path);
+
+	if (gopt_pathmatch)
+	    childstate = malloc(sizeof(pm_state) * pm_state_words(gopt_pathmatch));
+
+	for (fi = 0; fi < filenamepos; ++fi)
+	{
+	    char* filepath;
+	    my_asprintf(&filepath, "%s/%s", path, filenames[fi]);
+
+#ifndef S_ISSOCK
+#define S_ISSOCK(x) 0
+#endif
+#ifndef S_ISLNK
+#define S_ISLNK(x) 0
+#endif
+
+	    if (mylstat(filepath, &st) != 0)
+	    {
+		fprintf(stderr, "%s: could not stat file \"%s\": %s\n",
+			g_progname, filepath, strerror(errno));
+	    }
+	    else if (S_ISLNK(st.st_mode))
+	    {
+		if (!gopt_followsymlinks)
+		{
+		    if (scan_pathmatch(pmstate, pmincluded, filenames[fi], FALSE,
+				       childstate, &childincluded))
+			process_symlink(filepath, &st, filecursor_seek(&fc, filenames[fi]));
+		}
+		else
+		{
+		    if (mystat(filepath, &st) != 0)
+		    {
+			fprintf(stderr, "%s: could not stat symlink \"%s\": %s\n",
+				g_progname, filepath, strerror(errno));
+		    }
+		    else if (S_ISCHR(st.st_mode) || S_ISBLK(st.st_mode))
+		    {
+			fprintf(stderr, "%s: skipping special device symlink \"%s\"\n",
+				g_progname, filepath);
+		    }
+		    else if (S_ISFIFO(st.st_mode))
+		    {
+			fprintf(stderr, "%s: skipping named pipe symlink \"%s\"\n",
+				g_progname, filepath);
+		    }
+		    else if (S_ISSOCK(st.st_mode))
+		    {
+			fprintf(stderr, "%s: skipping unix socket symlink \"%s\"\n",
+				g_progname, filepath);
+		    }
+		    else if (S_ISDIR(st.st_mode))
+		    {
+			if (scan_pathmatch(pmstate, pmincluded, filenames[fi], TRUE,
+					   childstate, &childincluded))
+			    scan_directory(filepath, &st, childstate, childincluded);
+		    }
+		    else if (!S_ISREG(st.st_mode))
+		    {
+			fprintf(stderr, "%s: skipping special symlink \"%s\"\n",
+				g_progname, filepath);
+		    }
+		    else
+		    {
+			if (scan_pathmatch(pmstate, pmincluded, filenames[fi], FALSE,
+					   childstate, &childincluded))
+			    process_file(filepath, &st, filecursor_seek(&fc, filenames[fi]));
+		    }
+		}
+	    }
+	    else if (S_ISCHR(st.st_mode) || S_ISBLK(st.st_mode))
+	    {
+		fprintf(stderr, "%s: skipping special device file \"%s\"\n",
+			g_progname, filepath);
+	    }
+	    else if (S_ISFIFO(st.st_mode))
+	    {
+		fprintf(stderr, "%s: skipping named pipe \"%s\"\n",
+			g_progname, filepath);
+	    }
+	    else if (S_ISSOCK(st.st_mode))
+	    {
+		fprintf(stderr, "%s: skipping unix socket \"%s\"\n",
+			g_progname, filepath);
+	    }
+	    else if (S_ISDIR(st.st_mode))
+	    {
+		if (scan_pathmatch(pmstate, pmincluded, filenames[fi], TRUE,
+				   childstate, &childincluded))
+		    scan_directory(filepath, &st, childstate, childincluded);
+	    }
+	    else if (!S_ISREG(st.st_mode))
+	    {
+		fprintf(stderr, "%s: skipping special file \"%s\"\n",
+			g_progname, filepath);
+	    }
+	    else
+	    {
+		if (scan_pathmatch(pmstate, pmincluded, filenames[fi], FALSE,
+				   childstate, &childincluded))
+		    process_file(filepath, &st, filecursor_seek(&fc, filenames[fi]));
+	    }
+
+	    free(filenames[fi]);
+	    free(filepath);
+	}
+
+	if (childstate) free(childstate);
+    }
+
+    free(filenames);
+    dirstack_pop(st);
+
+    return TRUE;
+}
+
+bool start_scan(const char* path)
+{
+    mystatst st;
+
+    if (mylstat(path, &st) != 0)
+    {
+	fprintf(stderr, "%s: could not stat path \"%s\": %s\n",
+		g_progname, path, strerror(errno));
+    }
+    else if (S_ISDIR(st.st_mode))
+    {
+	bool r;
+	pm_state* pmstate = NULL;
+
+	bool pmincluded = TRUE;
+
+	if (gopt_pathmatch)
+	{
+	    pmstate = malloc(sizeof(pm_state) * pm_state_words(gopt_pathmatch));
+	    pm_root(gopt_pathmatch, pmstate);
+	    pmincluded = !pm_has_include(gopt_pathmatch);
+
+	    if (strcmp(path, ".") != 0)
+	    {
+		/* advance matcher state over the components of --subtree */
+		char *pathcopy = strdup(path), *comp, *save = NULL;
+
+		for (comp = strtok_r(pathcopy, "/", &save); comp;
+		     comp = strtok_r(NULL, "/", &save))
+		{
+		    if (!scan_pathmatch(pmstate, pmincluded, comp, TRUE,
+					pmstate, &pmincluded))
+		    {
+			free(pathcopy);
+			free(pmstate);
+			return TRUE;
+		    }
+		}
+
+		free(pathcopy);
+	    }
+	}
+
+	r = scan_directory(path, &st, pmstate, pmincluded);
+
+	if (pmstate) free(pmstate);
+	return r;
+    }
+    else if (!S_ISREG(st.st_mode))
+    {
+	fprintf(stderr, "%s: skipping special path \"%s\"\n",
+		g_progname, path);
+    }
+    else
+    {
+	return process_file(path, &st, filelist_find(path));
+    }
+
+    return FALSE;
+}
+
+/**
+ * Read the list of changed paths given by --changed-from: either
+ * separated by NUL characters, if the input contains any, or by
+ * newlines. Returns a malloc()ed buffer with NUL-terminated paths and
+ * their total length in *outlen, or NULL on error.
+ */
+char* read_changed_list(const char* filename, size_t* outlen)
+{
+    FILE* fp;
+    char* buffer = NULL;
+    size_t len = 0, cap = 0, i;
+
+    if (strcmp(filename, "-") == 0)
+	fp = stdin;
+    else if ((fp = fopen(filename, "rb")) == NULL)
+    {
+	fprintf(stderr, "%s: could not open list of changed paths \"%s\": %s\n",
+		g_progname, filename, strerror(errno));
+	return NULL;
+    }
+
+    while (1)
+    {
+	size_t rb;
+
+	if (len + 1 >= cap)
+	{
+	    cap = cap ? 2 * cap : 65536;
+	    buffer = realloc(buffer, cap);
+	}
+
+	rb = fread(buffer + len, 1, cap - len - 1, fp);
+	if (rb == 0) break;
+	len += rb;
+    }
+
+    if (ferror(fp))
+    {
+	fprintf(stderr, "%s: error reading list of changed paths \"%s\": %s\n",
+		g_progname, filename, strerror(errno));
+	if (fp != stdin) fclose(fp);
+	free(buffer);
+	return NULL;
+    }
+
+    if (fp != stdin) fclose(fp);
+
+    buffer[len] = 0;
+
+    if (memchr(buffer, 0, len) == NULL)
+    {
+	for (i = 0; i < len; ++i)
+	{
+	    if (buffer[i] == '\n') buffer[i] = 0;
+	    else if (buffer[i] == '\r' && buffer[i+1] == '\n') buffer[i] = 0;
+	}
+    }
+
+    *outlen = len;
+    return buffer;
+}
+
+/**
+ * Incremental update from an external list of changed paths instead of
+ * a full directory scan. All entries are loaded as untouched, see
+ * loadlist_finish(), then those of the listed paths (and below listed
+ * directories) are reset and processed again. Listed paths which do not
+ * exist anymore are thus reported as deleted or as source of a rename.
+ */
+bool changed_scan(const char* filename)
+{
+    struct rb_node* node;
+    char *list, *p, *path;
+    size_t listlen;
+    unsigned int listed = 0;
+
+    if ((list = read_changed_list(filename, &listlen)) == NULL)
+	return FALSE;
+
+    /* first pass: normalize paths and reset their entries */
+
+    for (p = list; p < list + listlen; p += strlen(p) + 1)
+    {
+	size_t len = strlen(p);
+
+	if (len == 0) continue;
+
+	path = normalize_relpath(p);
+
+	if (!path)
+	{
+	    fprintf(stderr, "%s: ignoring changed path \"%s\" outside of the top directory.\n",
+		    g_progname, p);
+	    *p = 0;
+	    continue;
+	}
+
+	/* move path to front and clear the remaining characters */
+	if (path != p) memmove(p, path, strlen(path) + 1);
+	memset(p + strlen(p), 0, len - strlen(p));
+
+	if (*p == 0) continue;
+
+	if ((node = filelist_find(p)) != NULL &&
+	    ((struct FileInfo*)node->value)->status != FS_SKIPPED)
+	{
+	    filelist_reset_entry(node->value);
+	}
+
+	filelist_reset_tree(p);
+	++listed;
+    }
+
+    /* second pass: process all listed paths which still exist */
+
+    for (p = list; p < list + listlen; p += strlen(p) + 1)
+    {
+	mystatst st;
+
+	if (*p == 0) continue;
+
+	if (gopt_subtree && (strncmp(p, gopt_subtree, strlen(gopt_subtree)) != 0 ||
+			     (p[strlen(gopt_subtree)] != '/' && p[strlen(gopt_subtree)] != 0)))
+	    continue;
+
+	if (mylstat(p, &st) != 0)
+	    continue; /* deleted */
+
+	node = filelist_find(p);
+
+	if (node && ((struct FileInfo*)node->value)->status != FS_UNSEEN)
+	    continue; /* skipped or listed twice */
+
+	if (S_ISDIR(st.st_mode))
+	{
+	    start_scan(p);
+	    continue;
+	}
+
+	if (gopt_pathmatch && !pm_match_path(gopt_pathmatch, p))
+	    continue;
+
+	if (S_ISLNK(st.st_mode))
+	{
+	    if (!gopt_followsymlinks)
+		process_symlink(p, &st, node);
+	    else if (mystat(p, &st) == 0 && S_ISREG(st.st_mode))
+		process_file(p, &st, node);
+	}
+	else if (S_ISREG(st.st_mode))
+	{
+	    process_file(p, &st, node);
+	}
+    }
+
+    if (gopt_verbose >= 1) {
+	fprintf(stderr, "%s: processed %u changed paths from \"%s\".\n",
+		g_progname, listed, filename);
+    }
+
+    free(list);
+    return TRUE;
+}
+
+/*************************************************
+ * Functions for interactive scan result review  *
+ *************************************************/
+
+struct CommandEntry
+{
+    const char* name;
+    bool	(*func)(void);
+    const char*	help;
+};
+
+static struct CommandEntry cmdlist[16];
+
+/* number of entries, which in external memory mode were streamed */
+unsigned int filelist_total(void)
+{
+    return gopt_memlimit ? g_ext_total : rb_size(g_filelist);
+}
+
+bool filelist_clean(void)
+{
+    return ( filelist_total() == g_filelist_seen + g_filelist_touched );
+}
+
+unsigned int filelist_deleted(void)
+{
+    return filelist_total() - (g_filelist_new + g_filelist_seen + g_filelist_touched + g_filelist_changed + g_filelist_error + g_filelist_renamed + g_filelist_copied + g_filelist_oldpath + g_filelist_skipped);
+}
+
+void print_summary(void)
+{
+    fprintf(stdout, "File scan summary:\n");
+
+    if (g_filelist_new)
+	fprintf(stdout, "        New: %d\n", g_filelist_new);
+
+    if (g_filelist_seen)
+	fprintf(stdout, "  Untouched: %d\n", g_filelist_seen);
+
+    if (g_filelist_touched)
+	fprintf(stdout, "    Touched: %d\n", g_filelist_touched);
+
+    if (g_filelist_changed)
+	fprintf(stdout, "    Changed: %d\n", g_filelist_changed);
+
+    if (g_filelist_error)
+	fprintf(stdout, "     Errors: %d\n", g_filelist_error);
+
+    if (g_filelist_renamed)
+	fprintf(stdout, "    Renamed: %d\n", g_filelist_renamed);
+
+    if (g_filelist_copied)
+	fprintf(stdout, "     Copied: %d\n", g_filelist_copied);
+
+    if (g_filelist_skipped)
+	fprintf(stdout, "    Skipped: %d\n", g_filelist_skipped);
+
+    if (filelist_deleted())
+	fprintf(stdout, "    Deleted: %d\n", filelist_deleted());
+
+    fprintf(stdout, "      Total: %d\n", filelist_total());
+
+    if (g_digestindex && gopt_verbose >= 2)
+	fprintf(stdout, " Digest map: %u digests, built in %.3f s\n",
+		(unsigned int)g_digestindex_size, g_digestindex_time);
+
+    if (g_inode_reused)
+	fprintf(stdout, "  Hardlinks: %u digests reused\n", g_inode_reused);
+
+    if (g_inodemap_reused)
+	fprintf(stdout, "     Inodes: %u digests taken over without reading\n", g_inodemap_reused);
+
+    if (g_xattr_reused)
+	fprintf(stdout, "     Xattrs: %u digests taken over without reading\n", g_xattr_reused);
+
+    if (g_digestcache_reused)
+	fprintf(stdout, "      Cache: %u digests taken from %s\n", g_digestcache_reused, gopt_cachefile);
+}
+
+bool cmd_help(void)
+{
+    int i;
+
+    fprintf(stdout, "Commands: (can be abbreviated)\n");
+
+    for (i = 0; cmdlist[i].name; ++i)
+    {
+	if (!cmdlist[i].help) continue;
+
+	fprintf(stdout, "  %-10s %s\n", cmdlist[i].name, cmdlist[i].help);
+    }
+
+    return TRUE;
+}
+
+bool cmd_new(void)
+{
+    struct rb_node* node;
+    unsigned int count = 0;
+
+    for (node = rb_begin(g_filelist); node != rb_end(g_filelist); node = rb_successor(g_filelist, node))
+    {
+	const struct FileInfo* fileinfo = node->value;
+
+	if (fileinfo->status != FS_NEW) continue;
+
+	fprintf(stdout, "%s new.\n", filelist_path(node->key));
+	++count;
+    }
+
+    if (count == 0) {
+	fprintf(stdout, "%s: no new files encountered during scan.\n",
+		g_progname);
+    }
+
+    return TRUE;
+}
+
+bool cmd_untouched(void)
+{
+    struct rb_node* node;
+    unsigned int count = 0;
+
+    for (node = rb_begin(g_filelist); node != rb_end(g_filelist); node = rb_successor(g_filelist, node))
+    {
+	const struct FileInfo* fileinfo = node->value;
+
+	if (fileinfo->status != FS_SEEN) continue;
+
+	fprintf(stdout, "%s untouched.\n", filelist_path(node->key));
+	++count;
+    }
+
+    if (count == 0) {
+	fprintf(stdout, "%s: no untouched files encountered during scan.\n",
+		g_progname);
+    }
+
+    return TRUE;
+}
+
+bool cmd_touched(void)
+{
+    struct rb_node* node;
+    unsigned int count = 0;
+
+    for (node = rb_begin(g_filelist); node != rb_end(g_filelist);
+         node = rb_successor(g_filelist, node))
+    {
+	const struct FileInfo* fileinfo = node->value;
+
+	if (fileinfo->status != FS_TOUCHED) continue;
+
+	fprintf(stdout, "%s touched.\n", filelist_path(node->key));
+	++count;
+    }
+
+    if (count == 0) {
+	fprintf(stdout, "%s: no touched but unchanged files encountered during scan.\n",
+		g_progname);
+    }
+
+    return TRUE;
+}
+
+bool cmd_changed(void)
+{
+    struct rb_node* node;
+    unsigned int count = 0;
+
+    for (node = rb_begin(g_filelist); node != rb_end(g_filelist);
+         node = rb_successor(g_filelist, node))
+    {
+	const struct FileInfo* fileinfo = node->value;
+
+	if (fileinfo->status != FS_CHANGED) continue;
+
+	fprintf(stdout, "%s CHANGED.\n", filelist_path(node->key));
+	++count;
+    }
+
+    if (count == 0) {
+	fprintf(stdout, "%s: no changed files encountered during scan.\n",
+		g_progname);
+    }
+
+    return TRUE;
+}
+
+bool cmd_deleted(void)
+{
+    struct rb_node* node;
+    unsigned int count = 0;
+
+    for (node = rb_begin(g_filelist); node != rb_end(g_filelist);
+         node = rb_successor(g_filelist, node))
+    {
+	const struct FileInfo* fileinfo = node->value;
+
+	if (fileinfo->status != FS_UNSEEN) continue;
+
+	fprintf(stdout, "%s DELETED.\n", filelist_path(node->key));
+	++count;
+    }
+
+    if (count == 0) {
+	fprintf(stdout, "%s: no deleted files detected during scan.\n",
+		g_progname);
+    }
+
+    return TRUE;
+}
+
+bool cmd_error(void)
+{
+    struct rb_node* node;
+    unsigned int count = 0;
+
+    for (node = rb_begin(g_filelist); node != rb_end(g_filelist);
+         node = rb_successor(g_filelist, node))
+    {
+	const struct FileInfo* fileinfo = node->value;
+
+	if (fileinfo->status != FS_ERROR) continue;
+
+	fprintf(stdout, "%s ERROR. %s\n", filelist_path(node->key), fileinfo_error(fileinfo));
+	++count;
+    }
+
+    if (count == 0) {
+	fprintf(stdout, "%s: no errors encountered during scan.\n",
+		g_progname);
+    }
+
+    return TRUE;
+}
+
+bool cmd_copied(void)
+{
+    struct rb_node* node;
+    unsigned int count = 0;
+
+    for (node = rb_begin(g_filelist); node != rb_end(g_filelist);
+         node = rb_successor(g_filelist, node))
+    {
+	const struct FileInfo* fileinfo = node->value;
+
+	if (fileinfo->status != FS_COPIED) continue;
+
+	fprintf(stdout, "%s copied.\n<-- %s\n", filelist_path(node->key), fileinfo_oldpath(fileinfo));
+	++count;
+    }
+
+    if (count == 0) {
+	fprintf(stdout, "%s: no copied files detected during scan.\n",
+		g_progname);
+    }
+
+    return TRUE;
+}
+
+bool cmd_renamed(void)
+{
+    struct rb_node* node;
+    unsigned int count = 0;
+
+    for (node = rb_begin(g_filelist); node != rb_end(g_filelist);
+         node = rb_successor(g_filelist, node))
+    {
+	const struct FileInfo* fileinfo = node->value;
+
+	if (fileinfo->status != FS_RENAMED) continue;
+
+	fprintf(stdout, "%s renamed.\n<-- %s\n", filelist_path(node->key), fileinfo_oldpath(fileinfo));
+	++count;
+    }
+
+    if (count == 0) {
+	fprintf(stdout, "%s: no renamed files detected during scan.\n",
+		g_progname);
+    }
+
+    return TRUE;
+}
+
+bool cmd_skipped(void)
+{
+    struct rb_node* node;
+    unsigned int count = 0;
+
+    for (node = rb_begin(g_filelist); node != rb_end(g_filelist);
+         node = rb_successor(g_filelist, node))
+    {
+	const struct FileInfo* fileinfo = node->value;
+
+	if (fileinfo->status != FS_SKIPPED) continue;
+
+	fprintf(stdout, "%s SKIPPED.\n", filelist_path(node->key));
+	++count;
+    }
+
+    if (count == 0) {
+	fprintf(stdout, "%s: no files skipped during scan.\n",
+		g_progname);
+    }
+
+    return TRUE;
+}
+
+/**
+ * Write the lines of all persistent options, which are also compared
+ * with the digest file before appending to the journal. Returns the
+ * number of lines written.
+ */
+unsigned int digestfile_write_options(struct DigestWriter* dw)
+{
+    unsigned int lines = 0;
+
+    /* add persisent options to digest file */
+
+    if (gopt_exclude_marker) {
+	digestwriter_puts(dw, "#: option --exclude-marker=");
+	digestwriter_puts(dw, gopt_exclude_marker);
+	digestwriter_puts(dw, "\n");
+	++lines;
+    }
+
+    if (gopt_inodes) {
+	digestwriter_puts(dw, "#: option --inodes\n");
+	++lines;
+    }
+
+    if (gopt_index) {
+	digestwriter_puts(dw, "#: option --index\n");
+	++lines;
+    }
+
+    if (gopt_journal) {
+	digestwriter_puts(dw, "#: option --journal\n");
+	++lines;
+    }
+
+    return lines;
+}
+
+/**
+ * Write the header lines of a digest file: the date of the update and
+ * all persistent options. Returns the number of lines written.
+ */
+unsigned int digestfile_write_header(struct DigestWriter* dw)
+{
+    unsigned int lines = 1;
+
+    /* add a small note current date at the beginning */
+    {
+	time_t tnow = time(NULL);
+	char datenow[64];
+	strftime(datenow, sizeof(datenow), "%Y-%m-%d %H:%M:%S %Z", localtime(&tnow));
+
+	digestwriter_puts(dw, "# ");
+	digestwriter_puts(dw, g_progname);
+	digestwriter_puts(dw, " last update: ");
+	digestwriter_puts(dw, datenow);
+	digestwriter_puts(dw, "\n");
+    }
+
+    return lines + digestfile_write_options(dw);
+}
+
+/* records of unseen, unreadable and moved files are not written */
+bool digestfile_has_record(const struct FileInfo* fileinfo)
+{
+    return (fileinfo->status != FS_UNSEEN &&
+	    fileinfo->status != FS_ERROR &&
+	    fileinfo->status != FS_OLDPATH);
+}
+
+/**
+ * Write the lines of one file record with its properties and digest.
+ * Returns FALSE if the record's status excludes it from the digest file.
+ * The lines are formatted directly into the writer's buffer.
+ */
+bool digestfile_write_record(struct DigestWriter* dw,
+			     const char* path, const struct FileInfo* fileinfo)
+{
+    const char* target = fileinfo_symlink(fileinfo);
+    size_t pathlen = strlen(path);
+    char* p;
+
+    if (!digestfile_has_record(fileinfo)) return FALSE;
+
+    if (target)
+    {
+	size_t targetlen = strlen(target);
+
+	p = digestwriter_reserve(dw, 2 * (pathlen + targetlen) + 96);
+
+	p = dw_puts(p, "#: mtime ");
+	p = dw_number(p, fileinfo->mtime);
+	p = dw_puts(p, " size ");
+	p = dw_number(p, fileinfo->size);
+	p = dw_puts(p, dw_needescape(target, targetlen) ? " target\\ " : " target ");
+	p = dw_name(p, target, targetlen);
+	p = dw_puts(p, dw_needescape(path, pathlen) ? "\n#: symlink\\ " : "\n#: symlink ");
+	p = dw_name(p, path, pathlen);
+	*p++ = '\n';
+    }
+    else
+    {
+	const struct InodeId* inode = gopt_inodes ? fileinfo_inode(fileinfo) : NULL;
+
+	p = digestwriter_reserve(dw, 2 * pathlen + 2 * DIGEST_MAX_SIZE + 112);
+
+	p = dw_puts(p, "#: mtime ");
+	p = dw_number(p, fileinfo->mtime);
+	p = dw_puts(p, " size ");
+	p = dw_number(p, fileinfo->size);
+
+	if (inode)
+	{
+	    p = dw_puts(p, " dev ");
+	    p = dw_unsigned(p, inode->dev);
+	    p = dw_puts(p, " ino ");
+	    p = dw_unsigned(p, inode->ino);
+	}
+
+	*p++ = '\n';
+
+	if (dw_needescape(path, pathlen))
+	    *p++ = '\\';
+
+	digest_bin2hex(&fileinfo->digest, p);
+	p += 2 * fileinfo->digest.size;
+
+	p = dw_puts(p, "  ");
+	p = dw_name(p, path, pathlen);
+	*p++ = '\n';
+    }
+
+    digestwriter_commit(dw, p);
+
+    return TRUE;
+}
+
+/* add a written record to the sum index, which is dropped if it fails */
+static void digestfile_index_add(struct si_writer** index, const char* path,
+				 const struct FileInfo* fileinfo)
+{
+    if (*index && !sumindex_add(*index, path, fileinfo))
+    {
+	si_abort(*index);
+	*index = NULL;
+    }
+}
+
+/**
+ * Open and map the loaded digest file to copy the lines of unchanged
+ * records from it while writing, if it was not changed since it was
+ * loaded. Returns FALSE if all records have to be formatted.
+ */
+bool loadedfile_open(void)
+{
+#if !ON_WIN32
+    char eofline[32];
+    struct stat st;
+    void* map;
+    int fd;
+
+    if (!g_loadedfile.valid || (fd = open(gopt_digestfile, O_RDONLY)) < 0)
+	return FALSE;
+
+    if (fstat(fd, &st) != 0 || (uint64_t)st.st_size != g_loadedfile.size ||
+	st.st_mtime != g_loadedfile.mtime ||
+	(uint64_t)st.st_dev != g_loadedfile.dev ||
+	(uint64_t)st.st_ino != g_loadedfile.ino)
+    {
+	close(fd);
+	return FALSE;
+    }
+
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    if (map == MAP_FAILED)
+    {
+	close(fd);
+	return FALSE;
+    }
+
+    /* the eof line is the same, hence the crc of the lines */
+    sprintf(eofline, "\n#: crc 0x%08x eof\n", g_loadedfile.crc);
+
+    if (memcmp((char*)map + st.st_size - 23, eofline, 23) != 0)
+    {
+	munmap(map, st.st_size);
+	close(fd);
+	return FALSE;
+    }
+
+    g_loadedfile.fd = fd;
+    g_loadedfile.map = map;
+    g_loadedfile.mapsize = st.st_size;
+
+    return TRUE;
+#else
+    return FALSE;
+#endif
+}
+
+/**
+ * Release the mapped loaded digest file after writing. Its records' lines
+ * are not copied again, as the digest file was replaced.
+ */
+void loadedfile_close(void)
+{
+#if !ON_WIN32
+    if (g_loadedfile.map)
+    {
+	munmap((void*)g_loadedfile.map, g_loadedfile.mapsize);
+	close(g_loadedfile.fd);
+	g_loadedfile.map = NULL;
+    }
+#endif
+
+    g_loadedfile.valid = FALSE;
+}
+
+/**
+ * Returns TRUE if the lines of the record in the opened loaded digest
+ * file are the same as written by digestfile_write_record(), hence they
+ * can be copied.
+ */
+static bool loadedfile_has_lines(const struct FileInfo* fileinfo)
+{
+    return (g_loadedfile.map && fileinfo->spanlen &&
+	    (fileinfo->status == FS_SEEN || fileinfo->status == FS_SKIPPED) &&
+	    (gopt_inodes || !fileinfo_inode(fileinfo)));
+}
+
+/* crc32 of the loaded digest file up to the lines of a record */
+static uint32_t loadedfile_crc(const struct FileInfo* fileinfo)
+{
+    const struct SpanBase* base = &g_loadedfile.bases[g_loadedfile.basesize - 1];
+
+    while (base->pos > fileinfo->spanpos) --base;
+
+    return crc32_combine(base->crc, fileinfo->spancrc, fileinfo->spanpos - base->pos);
+}
+
+/* append lines of the loaded digest file through the writer's buffer */
+static void loadedfile_put(struct DigestWriter* dw, uint64_t pos, size_t len)
+{
+    char* p = digestwriter_reserve(dw, len);
+
+    memcpy(p, g_loadedfile.map + pos, len);
+    digestwriter_commit(dw, p + len);
+}
+
+/* consecutive lines of records in the loaded digest file */
+struct CopyRun
+{
+    uint64_t		pos;
+    size_t		len;		/* zero if empty */
+    const struct FileInfo* first;
+    const struct FileInfo* last;
+};
+
+/* runs shorter than this are copied through the writer's buffer */
+#define COPYRUN_MIN	(64 * 1024)
+
+/**
+ * Append a run of records' lines of the loaded digest file. Long runs
+ * are copied between the files, with their crc32 derived from the
+ * saved crcs of the file up to the first and the last record.
+ */
+static void loadedfile_copy(struct DigestWriter* dw, struct CopyRun* run)
+{
+    const struct FileInfo* last = run->last;
+    uint32_t crc;
+
+    if (run->len < COPYRUN_MIN)
+    {
+	loadedfile_put(dw, run->pos, run->len);
+    }
+    else
+    {
+	crc = crc32(loadedfile_crc(last),
+		    (const unsigned char*)g_loadedfile.map + last->spanpos, last->spanlen);
+
+	/* remove the file before the run from the crc */
+	crc ^= crc32_combine(loadedfile_crc(run->first), 0, run->len);
+
+	digestwriter_copy(dw, g_loadedfile.fd, run->pos,
+			  g_loadedfile.map + run->pos, run->len, crc);
+    }
+
+    run->len = 0;
+}
+
+/* extend the run by the lines of a record, or copy it and start anew */
+static void loadedfile_run(struct DigestWriter* dw, struct CopyRun* run,
+			   const struct FileInfo* fileinfo)
+{
+    if (run->len && run->pos + run->len != fileinfo->spanpos)
+	loadedfile_copy(dw, run);
+
+    if (!run->len)
+    {
+	run->pos = fileinfo->spanpos;
+	run->first = fileinfo;
+    }
+
+    run->len += fileinfo->spanlen;
+    run->last = fileinfo;
+}
+
+#if HAVE_PTHREAD_H
+
+/* number of file list nodes formatted by one thread in a round */
+#define WRITECHUNK_NODES	65536
+
+static void* writechunk_format(void* arg)
+{
+    struct WriteChunk* chunk = arg;
+    struct rb_node* node = chunk->begin;
+    unsigned int i;
+
+    chunk->dw->size = 0;
+    chunk->count = 0;
+
+    for (i = 0; i < chunk->nodes; ++i, node = rb_successor(g_filelist, node))
+    {
+	struct FileInfo* fileinfo = node->value;
+	size_t len;
+
+	if (loadedfile_has_lines(fileinfo))
+	{
+	    loadedfile_put(chunk->dw, fileinfo->spanpos, fileinfo->spanlen);
+	    ++chunk->count;
+	    continue;
+	}
+
+	/* filelist_path() is not reentrant */
+	len = dt_key_length(node->key);
+
+	if (chunk->pathmax < len + 1)
+	{
+	    chunk->pathmax = 2 * (len + 1);
+	    chunk->path = realloc(chunk->path, chunk->pathmax);
+	}
+
+	dt_key_path(node->key, chunk->path);
+
+	if (digestfile_write_record(chunk->dw, chunk->path, fileinfo))
+	    ++chunk->count;
+    }
+
+    chunk->crc = crc32(0, (const unsigned char*)chunk->dw->buf, chunk->dw->size);
+
+    return NULL;
+}
+
+/**
+ * Write the records of all files on the given number of threads. In
+ * each round the file list is split into contiguous ranges of nodes,
+ * which are formatted into buffers in parallel. The buffers are then
+ * appended in order, combining their crcs, hence the output is the
+ * same as writing the records one by one. Returns the number of
+ * records.
+ */
+unsigned int digestfile_write_parallel(struct DigestWriter* dw,
+				       struct si_writer** index,
+				       unsigned int threads)
+{
+    struct WriteChunk* chunks = calloc(threads, sizeof(struct WriteChunk));
+    struct rb_node *node = rb_begin(g_filelist), *n;
+    unsigned int i, j, num, digestcount = 0;
+
+    /* split small file lists evenly between the threads */
+    unsigned int chunknodes = (rb_size(g_filelist) + threads - 1) / threads;
+
+    if (chunknodes > WRITECHUNK_NODES)
+	chunknodes = WRITECHUNK_NODES;
+
+    for (i = 0; i < threads; ++i)
+	chunks[i].dw = digestwriter_buffer();
+
+    while (node != rb_end(g_filelist))
+    {
+	for (num = 0; num < threads && node != rb_end(g_filelist); ++num)
+	{
+	    chunks[num].begin = node;
+	    chunks[num].nodes = 0;
+
+	    while (chunks[num].nodes < chunknodes && node != rb_end(g_filelist))
+	    {
+		++chunks[num].nodes;
+		node = rb_successor(g_filelist, node);
+	    }
+	}
+
+	run_parallel(chunks, sizeof(struct WriteChunk), num, writechunk_format);
+
+	for (i = 0; i < num; ++i)
+	{
+	    digestwriter_append(dw, chunks[i].dw, chunks[i].crc);
+	    digestcount += chunks[i].count;
+
+	    if (!*index) continue;
+
+	    for (j = 0, n = chunks[i].begin; j < chunks[i].nodes;
+		 ++j, n = rb_successor(g_filelist, n))
+	    {
+		if (digestfile_has_record(n->value))
+		    digestfile_index_add(index, filelist_path(n->key), n->value);
+	    }
+	}
+    }
+
+    for (i = 0; i < threads; ++i)
+    {
+	digestwriter_close(chunks[i].dw);
+	if (chunks[i].path) free(chunks[i].path);
+    }
+
+    free(chunks);
+
+    return digestcount;
+}
+
+#endif
+
+/**
+ * Write the records of all files in the file list, on multiple threads
+ * if selected by --write-threads. The lines of unchanged records are
+ * copied from the loaded digest file if it was opened by
+ * loadedfile_open(). Returns the number of records.
+ */
+unsigned int digestfile_write_list(struct DigestWriter* dw, struct si_writer** index)
+{
+    unsigned int digestcount = 0;
+    struct rb_node* node;
+    struct CopyRun run;
+
+#if HAVE_PTHREAD_H
+    if (gopt_writethreads > 1)
+	return digestfile_write_parallel(dw, index, gopt_writethreads);
+#endif
+
+    run.len = 0;
+
+    for (node = rb_begin(g_filelist); node != rb_end(g_filelist);
+         node = rb_successor(g_filelist, node))
+    {
+	struct FileInfo* fileinfo = node->value;
+	const char* path;
+
+	if (loadedfile_has_lines(fileinfo))
+	{
+	    loadedfile_run(dw, &run, fileinfo);
+	    ++digestcount;
+
+	    if (*index)
+		digestfile_index_add(index, filelist_path(node->key), fileinfo);
+	    continue;
+	}
+
+	if (run.len) loadedfile_copy(dw, &run);
+
+	path = filelist_path(node->key);
+
+	if (!digestfile_write_record(dw, path, fileinfo))
+	    continue;
+
+	++digestcount;
+
+	digestfile_index_add(index, path, fileinfo);
+    }
+
+    if (run.len) loadedfile_copy(dw, &run);
+
+    return digestcount;
+}
+
+/* returns the lines of the current persistent options */
+static char* journal_options(void)
+{
+    struct DigestWriter* dw = digestwriter_buffer();
+    char* options;
+
+    digestfile_write_options(dw);
+
+    options = strndup(dw->buf, dw->size);
+    digestwriter_close(dw);
+
+    return options;
+}
+
+/**
+ * Returns TRUE if the updates can be appended to the journal instead of
+ * writing the digest file, which requires that neither the digest file
+ * nor the journal were changed since they were loaded, and that the
+ * digest file saves the current persistent options. Once the journal
+ * grows beyond the percentage of the digest file given by --journal, it
+ * is written into the digest file.
+ */
+bool journal_usable(void)
+{
+    mystatst st;
+    uint32_t crc;
+    char *path, *options;
+    FILE* fp;
+    bool ok;
+
+    if (!gopt_journal || !g_journal.valid ||
+	g_journal.size * 100 > g_journal.mainsize * gopt_journal_ratio)
+	return FALSE;
+
+    options = journal_options();
+    ok = (strcmp(options, g_journal.options) == 0);
+    free(options);
+
+    if (!ok) return FALSE;
+
+    if (mystat(gopt_digestfile, &st) != 0 ||
+	(uint64_t)st.st_size != g_journal.mainsize || st.st_mtime != g_journal.mainmtime)
+	return FALSE;
+
+    if ((fp = fopen(gopt_digestfile, "rb")) == NULL)
+	return FALSE;
+
+    ok = digestfile_eof_crc(fp, &crc) && crc == g_journal.maincrc;
+    fclose(fp);
+
+    if (!ok) return FALSE;
+
+    path = journal_path();
+
+    if (mystat(path, &st) == 0)
+	ok = ((uint64_t)st.st_size == g_journal.filesize);
+    else
+	ok = (g_journal.filesize == 0);
+
+    free(path);
+
+    return ok;
+}
+
+/* returns 1 if the record is updated by the journal, 2 if it is
+ * deleted and 0 if it is unchanged */
+static int journal_change(const struct FileInfo* fileinfo)
+{
+    switch (fileinfo->status)
+    {
+    case FS_NEW:
+    case FS_TOUCHED:
+    case FS_CHANGED:
+    case FS_COPIED:
+    case FS_RENAMED:
+	return 1;
+
+    case FS_UNSEEN:
+    case FS_ERROR:
+    case FS_OLDPATH:
+	return fileinfo->loaded ? 2 : 0;
+
+    default:
+	return 0;
+    }
+}
+
+/**
+ * Append the records of all new and modified files and the deletion of
+ * all loaded records without a record now as one update to the journal.
+ * An incomplete update left by an aborted write is overwritten. Returns
+ * TRUE on errors like cmd_write().
+ */
+bool journal_write(void)
+{
+    struct DigestWriter* dw;
+    struct rb_node* node;
+    char* path = journal_path();
+    char line[64];
+    unsigned int updates = 0;
+    int fd, flags = O_WRONLY | O_CREAT;
+
+#ifdef O_BINARY
+    flags |= O_BINARY;
+#endif
+
+    for (node = rb_begin(g_filelist); node != rb_end(g_filelist);
+         node = rb_successor(g_filelist, node))
+    {
+	if (journal_change(node->value)) ++updates;
+    }
+
+    if (updates == 0)
+    {
+	fprintf(stderr, "%s: no updates to append to %s\n",
+		g_progname, path);
+	free(path);
+	return FALSE;
+    }
+
+    if ((fd = open(path, flags, 0666)) < 0 ||
+	ftruncate(fd, g_journal.size) != 0 ||
+	lseek(fd, g_journal.size, SEEK_SET) < 0)
+    {
+	fprintf(stderr, "%s: could not open %s: %s\n",
+		g_progname, path, strerror(errno));
+	if (fd >= 0) close(fd);
+	free(path);
+	return TRUE;
+    }
+
+    dw = digestwriter_create(fd);
+    dw->crc = g_journal.crc;
+
+    if (g_journal.size == 0)
+    {
+	sprintf(line, JOURNAL_HEADER, g_journal.maincrc);
+	digestwriter_puts(dw, line);
+    }
+
+    for (node = rb_begin(g_filelist); node != rb_end(g_filelist);
+         node = rb_successor(g_filelist, node))
+    {
+	struct FileInfo* fileinfo = node->value;
+	int change = journal_change(fileinfo);
+	const char* name;
+	size_t namelen;
+	char* p;
+
+	if (change == 1)
+	{
+	    digestfile_write_record(dw, filelist_path(node->key), fileinfo);
+	}
+	else if (change == 2)
+	{
+	    name = filelist_path(node->key);
+	    namelen = strlen(name);
+
+	    p = digestwriter_reserve(dw, 2 * namelen + 16);
+	    p = dw_puts(p, dw_needescape(name, namelen) ? "#: delete\\ " : "#: delete ");
+	    p = dw_name(p, name, namelen);
+	    *p++ = '\n';
+	    digestwriter_commit(dw, p);
+	}
+    }
+
+    /* the commit line is part of the journal's crc, unlike an eof line */
+    digestwriter_flush(dw);
+
+    sprintf(line, "#: crc 0x%08x commit\n", dw->crc);
+    digestwriter_puts(dw, line);
+
+    digestwriter_flush(dw);
+
+    g_journal.size = lseek(fd, 0, SEEK_CUR);
+    g_journal.crc = dw->crc;
+
+    if (!digestwriter_close(dw))
+    {
+	fprintf(stderr, "%s: could not write %s: %s\n",
+		g_progname, path, strerror(errno));
+
+	/* the incomplete update is ignored when reading the journal */
+	g_journal.valid = FALSE;
+	free(path);
+	return TRUE;
+    }
+
+    g_journal.filesize = g_journal.size;
+    ++g_journal.updates;
+
+    fprintf(stderr, "%s: appended %d updates to %s\n",
+	    g_progname, updates, path);
+
+    free(path);
+
+    return FALSE;
+}
+
+/**
+ * Remove the journal after its updates were written to the digest file
+ * with the given final crc, hence the next updates start a new journal
+ * belonging to it.
+ */
+void journal_reset(uint32_t crc)
+{
+    char* path = journal_path();
+    mystatst st;
+
+    if (remove(path) != 0 && errno != ENOENT)
+    {
+	fprintf(stderr, "%s: could not remove %s: %s\n",
+		g_progname, path, strerror(errno));
+    }
+
+    free(path);
+
+    if (g_journal.options) free(g_journal.options);
+    memset(&g_journal, 0, sizeof(g_journal));
+
+    if (mystat(gopt_digestfile, &st) == 0)
+    {
+	g_journal.valid = TRUE;
+	g_journal.mainsize = st.st_size;
+	g_journal.mainmtime = st.st_mtime;
+	g_journal.maincrc = crc;
+	g_journal.options = journal_options();
+    }
+}
+
+bool cmd_write(void)
+{
+    struct DigestWriter* dw;
+    char* path = gopt_digestfile;
+
+    uint32_t crc;
+    unsigned int digestcount, headerlines;
+    struct si_writer* index = NULL;
+    bool copy;
+
+    if (journal_usable())
+	return journal_write();
+
+    /* lines of unchanged records are copied from the loaded digest file,
+     * hence a temporary file is written which replaces it */
+    copy = loadedfile_open();
+
+    if (copy)
+	my_asprintf(&path, "%s.tmp", gopt_digestfile);
+
+    dw = digestwriter_open(path);
+
+    if (dw == NULL)
+    {
+	fprintf(stderr, "%s: could not open %s: %s\n",
+		g_progname, path, strerror(errno));
+	loadedfile_close();
+	if (copy) free(path);
+	return TRUE;
+    }
+
+#if !ON_WIN32
+    if (copy) fchmod(dw->fd, g_loadedfile.mode);
+#endif
+
+    headerlines = digestfile_write_header(dw);
+
+    if (gopt_index)
+	index = sumindex_create(headerlines);
+
+    /* list files with properties and digests */
+
+    digestcount = digestfile_write_list(dw, &index);
+
+    crc = digestwriter_eof(dw);
+
+    loadedfile_close();
+
+    if (!digestwriter_close(dw))
+    {
+	fprintf(stderr, "%s: could not write %s: %s\n",
+		g_progname, path, strerror(errno));
+	if (index) si_abort(index);
+	if (copy) {
+	    remove(path);
+	    free(path);
+	}
+	return TRUE;
+    }
 
-	    ++g_filelist_new;
+    if (copy)
+    {
+	if (rename(path, gopt_digestfile) != 0)
+	{
+	    fprintf(stderr, "%s: could not rename %s to %s: %s\n",
+		    g_progname, path, gopt_digestfile, strerror(errno));
+	    if (index) si_abort(index);
+	    remove(path);
+	    free(path);
+	    return TRUE;
 	}
 
-	if (gopt_verbose >= 1) {
-	    fprintf(stdout, "\n");
-	}
-	return TRUE;
+	free(path);
     }
+
+    if (index)
+	sumindex_finish(index, crc);
+
+    /* the journal's updates are part of the digest file now */
+    journal_reset(crc);
+
+    fprintf(stderr, "%s: wrote %d digests to %s\n",
+	    g_progname, digestcount, gopt_digestfile);
+
+    return FALSE;
 }
 
-bool process_symlink(const char* filepath, const mystatst* st)
+bool cmd_quit(void)
 {
-    struct rb_node* fileiter;
+    return FALSE;
+}
 
-    if (filepath[0] == '.' && filepath[1] == '/')
-	filepath += 2;
+static struct CommandEntry cmdlist[16] =
+{
+    { "help",		&cmd_help,	"See this help text." },
+    { "new",		&cmd_new,	"Print newly seen files not in digest file." },
+    { "untouched",	&cmd_untouched,	"Print all untouched files." },
+    { "touched",	&cmd_touched,	"Print all files with changed modification time." },
+    { "changed",	&cmd_changed,	"Print files with changed contents." },
+    { "modified",	&cmd_changed,	NULL },
+    { "copied",		&cmd_copied,	"Print files copied from a different path." },
+    { "renamed",	&cmd_renamed,	"Print files renamed from a different path." },
+    { "deleted",	&cmd_deleted,	"Print deleted files." },
+    { "error",		&cmd_error,	"Print files with read errors." },
+    { "skipped",	&cmd_skipped,	"Print files skipped during scan." },
+    { "save",		&cmd_write,	"Write updates to digest file and exit program." },
+    { "write",		&cmd_write,	NULL },
+    { "exit",		&cmd_quit,	"Exit program without saving updates." },
+    { "quit",		&cmd_quit,	NULL },
+    { NULL,             NULL,		NULL },
+};
 
-    /* skip over the digestfile */
-    if (strcmp(filepath, gopt_digestfile) == 0)
-	return TRUE;
+/*****************************************************************
+ * Functions for the external memory mode merging sorted streams *
+ *****************************************************************/
 
-    /* silently skip over ignored filepaths */
-    if (gopt_matchpattern && strstr(filepath, gopt_matchpattern) == NULL)
-	return TRUE;
+/* temporary digest file written during the merge */
+char* g_ext_tmpfile = NULL;
+struct DigestWriter* g_ext_sumfile = NULL;
 
-    if (gopt_verbose >= 2) {
-	fprintf(stdout, "%s ", filepath);
+/**
+ * Abort the external memory mode, removing the temporary digest file.
+ */
+void ext_abort(void)
+{
+    if (g_ext_sumfile)
+    {
+	digestwriter_close(g_ext_sumfile);
+	remove(g_ext_tmpfile);
     }
 
-    /* lookup file info */
+    exit(-1);
+}
+
+/**
+ * Read the next entry of the digest file into g_extold, which keeps a
+ * copy outside of g_arena. The digest file must be sorted by path, as
+ * written by digup, duplicate entries are reported and dropped. Returns
+ * FALSE at the end of the file.
+ */
+bool ext_old_next(void)
+{
+    struct ExtOld* eo = &g_extold;
+    char* prev = eo->path;
+
+    eo->path = NULL;
 
-    fileiter = rb_find(g_filelist, filepath);
+    if (eo->symlink) free(eo->symlink);
+    eo->symlink = NULL;
 
-    if (fileiter != NULL)
+    while (eo->reader.fp && !eo->path)
     {
-	struct FileInfo* fileinfo = fileiter->value;
-	char* linktarget = NULL;
+	int r;
 
-	if (fileinfo->status != FS_UNSEEN)
+	if (!digestreader_next(&eo->reader))
 	{
-	    if (gopt_verbose >= 2) {
-		fprintf(stdout, " same symlink processed twice??? This should never occur.\n");
-	    }
-	    else {
-		fprintf(stdout, "%s same symlink processed twice??? This should never occur.\n", filepath);
-	    }
-	    return TRUE;
+	    digestreader_close(&eo->reader);
+	    break;
 	}
 
-	/* mimic method used for regular files even though reading a
-	 * symlink is no expensive operation. */
-	if (gopt_fullcheck)
-	{
-	    if (gopt_verbose >= 2) {
-		fprintf(stdout, "check ");
-	    }
-	}
-	else if (st->st_mtime != fileinfo->mtime ||
-		 st->st_size != fileinfo->size)
+	if (!eo->parsed) continue;
+
+	r = prev ? strcmp(prev, eo->parsed) : -1;
+
+	if (r == 0)
 	{
-	    if (gopt_verbose >= 2) {
-		fprintf(stdout, "touched ");
-	    }
+	    fprintf(stderr, "%s: \"%s\" line %d: duplicate %sfile name.\n",
+		    g_progname, gopt_digestfile, eo->parsedline,
+		    fileinfo_symlink(eo->parsedinfo) ? "symlink " : "");
+
+	    free(eo->parsed);
+	    eo->parsed = NULL;
+	    continue;
 	}
-	else
+	else if (r > 0)
 	{
-	    if (gopt_verbose >= 2) {
-		fprintf(stdout, "untouched.\n");
-	    }
-	    else if (gopt_verbose == 1 && !gopt_onlymodified) {
-		fprintf(stdout, "%s untouched.\n", filepath);
-	    }
-
-	    fileinfo->status = FS_SEEN;
-	    ++g_filelist_seen;
+	    fprintf(stderr, "%s: \"%s\" line %d: digest file is not sorted by path as needed for --memory-limit.\n",
+		    g_progname, gopt_digestfile, eo->parsedline);
+	    fprintf(stderr, "%s: update it once without --memory-limit to sort it.\n",
+		    g_progname);
 
-	    return TRUE;
+	    ext_abort();
 	}
 
-	linktarget = readlink_dup(filepath);
+	/* copy the entry, as g_arena is reset while merging */
 
-	if (!linktarget)
-	{
-	    if (gopt_verbose >= 2) {
-		fprintf(stdout, " ERROR. Could not read symlink: %s.\n", strerror(errno));
-	    }
-	    else if (gopt_verbose >= 1) {
-		fprintf(stdout, "%s ERROR. Could not read symlink: %s.\n", filepath, strerror(errno));
-	    }
-	    else if (gopt_verbose >= 0) {
-		fprintf(stderr, "%s: could not read symlink \"%s\": %s.\n",
-			g_progname, filepath, strerror(errno));
-	    }
+	memcpy(eo->info, eo->parsedinfo,
+	       offsetof(struct FileInfo, digest) + 1 + eo->parsedinfo->digest.size);
+	eo->info->hasextra = FALSE;
 
-	    my_asprintf(&fileinfo->error, "Could not read symlink: %s.",
-                        strerror(errno));
+	if (fileinfo_symlink(eo->parsedinfo))
+	    eo->symlink = strdup(fileinfo_symlink(eo->parsedinfo));
 
-	    fileinfo->status = FS_ERROR;
-	    fileinfo->mtime = st->st_mtime;
-	    fileinfo->size = st->st_size;
+	eo->hasinode = (fileinfo_inode(eo->parsedinfo) != NULL);
+	if (eo->hasinode)
+	    eo->inode = *fileinfo_inode(eo->parsedinfo);
 
-	    ++g_filelist_error;
-	    return FALSE;
-	}
+	eo->path = eo->parsed;
+	eo->parsed = NULL;
+    }
 
-	if (fileinfo->symlink && strcmp(linktarget, fileinfo->symlink) == 0)
-	{
-	    if (gopt_verbose >= 2) {
-		fprintf(stdout, "matched.\n");
-	    }
-	    else if (gopt_verbose == 1 && !gopt_onlymodified) {
-		fprintf(stdout, "%s matched.\n", filepath);
-	    }
+    if (prev) free(prev);
 
-	    fileinfo->status = FS_TOUCHED;
-	    fileinfo->mtime = st->st_mtime;
-	    fileinfo->size = st->st_size;
-	    free(linktarget);
+    return (eo->path != NULL);
+}
 
-	    ++g_filelist_touched;
-	}
-	else
-	{
-	    if (gopt_verbose >= 2) {
-		fprintf(stdout, "CHANGED.\n");
-	    }
-	    else if (gopt_verbose == 1) {
-		fprintf(stdout, "%s CHANGED.\n", filepath);
-	    }
+/**
+ * Allocate the pending digest file entry of g_extold in g_arena, with
+ * room for any digest as a symlink entry may become a file.
+ */
+struct FileInfo* ext_old_fileinfo(void)
+{
+    struct FileInfo* fileinfo = fileinfo_alloc(DIGEST_MAX_SIZE);
 
-	    fileinfo->status = FS_CHANGED;
-	    fileinfo->mtime = st->st_mtime;
-	    fileinfo->size = st->st_size;
+    memcpy(fileinfo, g_extold.info,
+	   offsetof(struct FileInfo, digest) + 1 + g_extold.info->digest.size);
 
-	    if (fileinfo->symlink)
-		free(fileinfo->symlink);
+    if (g_extold.symlink)
+	fileinfo_extra(fileinfo, TRUE)->symlink = arena_strdup(g_arena, g_extold.symlink);
 
-	    fileinfo->symlink = linktarget;
+    if (g_extold.hasinode)
+    {
+	struct FileExtra* extra = fileinfo_extra(fileinfo, TRUE);
+	extra->inode = g_extold.inode;
+	extra->hasinode = TRUE;
+    }
 
-	    ++g_filelist_changed;
-	}
+    return fileinfo;
+}
 
-	return TRUE;
-    }
-    else
-    {
-	struct FileInfo* fileinfo = malloc(sizeof(struct FileInfo));
-	memset(fileinfo, 0, sizeof(struct FileInfo));
+/**
+ * Release all records in g_arena, which is done between two merged
+ * entries to keep the memory bounded.
+ */
+void ext_reset_arena(void)
+{
+    rb_destroy(g_fileextra);
+    arena_destroy(g_arena);
 
-	fileinfo->status = FS_NEW;
-	fileinfo->mtime = st->st_mtime;
-	fileinfo->size = st->st_size;
-	fileinfo->symlink = readlink_dup(filepath);
+    g_arena = arena_create(0);
 
-	if (!fileinfo->symlink)
-	{
-	    if (gopt_verbose >= 2) {
-		fprintf(stdout, " ERROR. Could not read symlink: %s.\n", strerror(errno));
-	    }
-	    else if (gopt_verbose >= 1) {
-		fprintf(stdout, "%s ERROR. Could not read symlink: %s.\n", filepath, strerror(errno));
-	    }
-	    else if (gopt_verbose >= 0) {
-		fprintf(stderr, "%s: could not read symlink \"%s\": %s.\n",
-			g_progname, filepath, strerror(errno));
-	    }
+    g_fileextra = rb_create(rbtree_pointer_cmp, NULL, NULL, NULL, NULL);
+    rb_set_arena(g_fileextra, g_arena);
+}
 
-	    my_asprintf(&fileinfo->error, "Could not read symlink: %s.",
-                        strerror(errno));
+/**
+ * Test if a digest file entry is outside of --restrict, --include or
+ * --subtree, and hence carried over unchanged as by read_digestfile().
+ */
+bool ext_skipped(const char* path)
+{
+    size_t len;
 
-	    fileinfo->status = FS_ERROR;
+    if (gopt_matchpattern && strstr(path, gopt_matchpattern) == NULL)
+	return TRUE;
 
-	    rb_insert(g_filelist, strdup(filepath), fileinfo);
+    if (gopt_pathmatch && !pm_match_path(gopt_pathmatch, path))
+	return TRUE;
 
-	    ++g_filelist_error;
+    if (!gopt_subtree)
+	return FALSE;
 
-	    return FALSE;
-	}
+    len = strlen(gopt_subtree);
 
-	rb_insert(g_filelist, strdup(filepath), fileinfo);
+    return !(strncmp(path, gopt_subtree, len) == 0 && path[len] == '/');
+}
 
-	if (gopt_verbose >= 2) {
-	    fprintf(stdout, "new.\n");
-	}
-	else if (gopt_verbose == 1) {
-	    fprintf(stdout, "%s new.\n", filepath);
-	}
+/**
+ * Process a scanned entry as during a normal scan, fileinfo is its
+ * entry from the digest file or NULL for a new file.
+ */
+void ext_process(const char* path, const struct ExtEntry* ee,
+		 struct FileInfo* fileinfo)
+{
+    struct rb_node node;
+    mystatst st;
 
-	++g_filelist_new;
+    memset(&node, 0, sizeof(node));
+    node.value = fileinfo;
 
-	return TRUE;
-    }
+    memset(&st, 0, sizeof(st));
+    st.st_size = ee->size;
+    st.st_mtime = ee->mtime;
+
+    if (ee->symlink)
+	process_symlink(path, &st, fileinfo ? &node : NULL);
+    else
+	process_file(path, &st, fileinfo ? &node : NULL);
 }
 
 /**
- * Dynamically growing array of (dev_t, ino_t) pairs to test for
- * symlink loops while scanning.
+ * Deleted or new file in the sort by digest used to find renamed files,
+ * followed by its path. Deleted files sort before new ones.
  */
-
-struct DirLevel
+struct ExtPair
 {
-    dev_t	dev;
-    ino_t	ino;
+    unsigned char	digest[1 + DIGEST_MAX_SIZE];
+    unsigned char	isnew;
 };
 
-struct DirLevel* dirstack = NULL;
-size_t dirstackmax = 0;
-size_t dirstacklen = 0;
+static int ext_pair_cmp(const void *p1, const void *p2)
+{
+    const struct ExtPair* a = p1;
+    const struct ExtPair* b = p2;
+    int r = memcmp(a->digest, b->digest, sizeof(a->digest));
 
-bool dirstack_push(const mystatst* st)
+    if (r != 0) return r;
+    if (a->isnew != b->isnew) return a->isnew - b->isnew;
+
+    return strcmp((const char*)(a + 1), (const char*)(b + 1));
+}
+
+static int ext_path_cmp(const void *p1, const void *p2)
 {
-#if !ON_WIN32 /* win32 under mingw has no inode numbers. */
+    return strcmp(p1, p2);
+}
 
-    size_t i;
+void ext_pair_add(struct extsort* pairs, const struct FileInfo* fileinfo,
+		  bool isnew, const char* path)
+{
+    static char* buf = NULL;
+    static size_t bufmax = 0;
 
-    /* first search in the current stack for the new level */
-    for (i = 0; i < dirstacklen; ++i)
+    size_t len = sizeof(struct ExtPair) + strlen(path) + 1;
+    struct ExtPair* ep;
+
+    if (len > bufmax)
     {
-	if (dirstack[i].dev == st->st_dev &&
-	    dirstack[i].ino == st->st_ino)
-	{
-	    return FALSE;
-	}
+	bufmax = 2 * len;
+	buf = realloc(buf, bufmax);
     }
 
-#endif
+    ep = (struct ExtPair*)buf;
+    memset(ep, 0, sizeof(struct ExtPair));
+    memcpy(ep->digest, &fileinfo->digest, 1 + fileinfo->digest.size);
+    ep->isnew = isnew;
+    strcpy(buf + sizeof(struct ExtPair), path);
 
-    /* add new entry */
-    if (dirstacklen >= dirstackmax)
+    es_add(pairs, buf, len);
+}
+
+/**
+ * Find renamed files in the sort by digest: new files with the digest
+ * of deleted ones were renamed from the first of them, and the deleted
+ * ones become old paths. All other deleted files are added to the sort
+ * by path for reporting. Only the deleted paths of one digest are held
+ * in memory. Copies of existing files are not detected.
+ */
+void ext_find_renamed(struct extsort* pairs, struct extsort* deleted)
+{
+    const struct ExtPair* ep = es_next(pairs, NULL);
+
+    char** group = NULL;
+    size_t groupsize = 0, groupmax = 0, i;
+
+    while (ep)
     {
-        struct DirLevel* tmp;
+	unsigned char digest[1 + DIGEST_MAX_SIZE];
+	bool renamed = FALSE;
 
-	dirstackmax = dirstackmax * 2;
-	if (dirstackmax < 16) dirstackmax = 16;
+	memcpy(digest, ep->digest, sizeof(digest));
 
-	tmp = realloc(dirstack, sizeof(struct DirLevel) * dirstackmax);
-        if (!tmp) {
-            return FALSE;
-        }
-        dirstack = tmp;
-    }
+	for (; ep && !ep->isnew && memcmp(ep->digest, digest, sizeof(digest)) == 0;
+	     ep = es_next(pairs, NULL))
+	{
+	    const char* path = (const char*)(ep + 1);
 
-    dirstack[dirstacklen].dev = st->st_dev;
-    dirstack[dirstacklen].ino = st->st_ino;
+	    if (digest[0] == 0) /* symlink without digest */
+	    {
+		es_add(deleted, path, strlen(path) + 1);
+		continue;
+	    }
+
+	    if (groupsize >= groupmax)
+	    {
+		groupmax = groupmax ? 2 * groupmax : 16;
+		group = realloc(group, sizeof(char*) * groupmax);
+	    }
+
+	    group[groupsize++] = strdup(path);
+	}
+
+	for (; ep && ep->isnew && memcmp(ep->digest, digest, sizeof(digest)) == 0;
+	     ep = es_next(pairs, NULL))
+	{
+	    if (groupsize == 0) continue;
+
+	    if (gopt_verbose >= 1) {
+		fprintf(stdout, "%s renamed.\n<-- %s\n", (const char*)(ep + 1), group[0]);
+	    }
 
-    ++dirstacklen;
+	    --g_filelist_new;
+	    ++g_filelist_renamed;
+	    renamed = TRUE;
+	}
 
-    return TRUE;
-}
+	for (i = 0; i < groupsize; ++i)
+	{
+	    if (renamed)
+		++g_filelist_oldpath;
+	    else
+		es_add(deleted, group[i], strlen(group[i]) + 1);
 
-void dirstack_pop(const mystatst* st)
-{
-    assert( dirstacklen > 0 );
+	    free(group[i]);
+	}
 
-    assert( dirstack[dirstacklen-1].dev == st->st_dev );
-    assert( dirstack[dirstacklen-1].ino == st->st_ino );
-    (void)st;
+	groupsize = 0;
+    }
 
-    if (dirstacklen > 0)
-	--dirstacklen;
+    if (group) free(group);
 }
 
-bool scan_directory(const char* path, const mystatst* st)
+/**
+ * Scan, merge and write in the external memory mode, see ext_main().
+ */
+int ext_merge(void)
 {
-    DIR* dirp;
+    struct extsort *scan, *pairs, *deleted;
+    const struct ExtEntry* ee;
+    const char* path;
 
-    struct dirent* de;
+    unsigned int digestcount = 0, deletedcount = 0;
+    char* journal;
 
-    char **filenames = NULL;
-    unsigned int filenamepos = 0;
-    unsigned int filenamemax = 0;
+    if (!digestreader_open(&g_extold.reader))
+	return -1;
 
-    bool exclude_marker_found = FALSE;
+    /* the streamed digest file does not include the journal's updates */
+    journal = journal_path();
 
-    if (!dirstack_push(st))
+    if (access(journal, F_OK) == 0)
     {
-	fprintf(stderr, "%s: filesystem loop detected at \"%s\".\n",
-		g_progname, path);
-	return TRUE;
+	fprintf(stderr, "%s: the updates in journal %s must be written to the "
+		"digest file without --memory-limit first.\n",
+		g_progname, journal);
+	free(journal);
+	return -1;
     }
 
-    dirp = opendir(path);
+    free(journal);
 
-    if (dirp == NULL)
-    {
-	dirstack_pop(st);
-	fprintf(stderr, "%s: could not open directory \"%s\": %s\n",
-		g_progname, path, strerror(errno));
-	return FALSE;
-    }
+    /* read the options and the first entry, which selects the type */
 
-    while ((de = readdir(dirp)))
+    if (g_extold.reader.fp && !ext_old_next())
     {
-	if (de->d_name[0] == '.' && de->d_name[1] == 0) continue;
-	if (de->d_name[0] == '.' && de->d_name[1] == '.' && de->d_name[2] == 0) continue;
+	fprintf(stderr, "%s: %s: no digests found in file.\n",
+		g_progname, gopt_digestfile);
 
-	if (filenamepos >= filenamemax)
+	if (gopt_digesttype == DT_NONE)
 	{
-	    filenamemax *= 2;
-	    if (filenamemax == 0) filenamemax = 8;
-	    filenames = realloc(filenames, sizeof(char*) * filenamemax);
+	    fprintf(stderr, "%s: to create a new digest file specify the digest --type (see --help).\n",
+		    g_progname);
+	    return -1;
 	}
+    }
 
-	filenames[filenamepos++] = strdup( de->d_name );
+    g_digestsize = digesttype_size(gopt_digesttype);
 
-	if (gopt_exclude_marker)
-	{
-	    if (strcmp(de->d_name, gopt_exclude_marker) == 0)
-		exclude_marker_found = TRUE;
-	}
-    }
+    /* scan the tree into sorted runs */
 
-    closedir(dirp);
+    g_extscan = es_create(gopt_memlimit, ext_entry_cmp);
 
-    if (exclude_marker_found)
+    start_scan(gopt_subtree ? gopt_subtree : ".");
+
+    scan = g_extscan;
+    g_extscan = NULL;
+
+    es_finish(scan);
+
+    if (gopt_verbose >= 2) {
+	fprintf(stderr, "%s: sorted %u scanned entries in %u runs.\n",
+		g_progname, (unsigned int)es_count(scan), (unsigned int)es_runs(scan));
+    }
+
+    if (gopt_update)
     {
-	if (gopt_verbose >= 2) {
-	    fprintf(stderr, "%s: exclude marker found in \"%s\": skipping.\n",
-		    g_progname, path);
+	my_asprintf(&g_ext_tmpfile, "%s.tmp", gopt_digestfile);
+
+	g_ext_sumfile = digestwriter_open(g_ext_tmpfile);
+
+	if (g_ext_sumfile == NULL)
+	{
+	    fprintf(stderr, "%s: could not open %s: %s\n",
+		    g_progname, g_ext_tmpfile, strerror(errno));
+	    es_destroy(scan);
+	    return -1;
 	}
 
-	free(filenames);
-	dirstack_pop(st);
-	return TRUE;
+	digestfile_write_header(g_ext_sumfile);
     }
 
-    qsort(filenames, filenamepos, sizeof(char*), strcmpptr);
+    /* merge digest file entries and scanned entries by path */
+
+    pairs = es_create(gopt_memlimit / 2, ext_pair_cmp);
+
+    ee = es_next(scan, NULL);
 
+    while (g_extold.path || ee)
     {
-	mystatst st;
-	unsigned int fi;
+	int cmp = !ee ? -1 : !g_extold.path ? 1
+	    : strcmp(g_extold.path, (const char*)(ee + 1));
 
-	for (fi = 0; fi < filenamepos; ++fi)
-	{
-	    char* filepath;
-	    my_asprintf(&filepath, "%s/%s", path, filenames[fi]);
+	struct FileInfo* fileinfo;
 
-	    free(filenames[fi]);
+	/* no records are referenced between entries */
+	if (arena_size(g_arena) > gopt_memlimit / 4)
+	    ext_reset_arena();
 
-#ifndef S_ISSOCK
-#define S_ISSOCK(x) 0
-#endif
-#ifndef S_ISLNK
-#define S_ISLNK(x) 0
-#endif
+	++g_ext_total;
 
-	    if (mylstat(filepath, &st) != 0)
-	    {
-		fprintf(stderr, "%s: could not stat file \"%s\": %s\n",
-			g_progname, filepath, strerror(errno));
-	    }
-	    else if (S_ISLNK(st.st_mode))
-	    {
-		if (!gopt_followsymlinks)
-		{
-		    process_symlink(filepath, &st);
-		}
-		else
-		{
-		    if (mystat(filepath, &st) != 0)
-		    {
-			fprintf(stderr, "%s: could not stat symlink \"%s\": %s\n",
-				g_progname, filepath, strerror(errno));
-		    }
-		    else if (S_ISCHR(st.st_mode) || S_ISBLK(st.st_mode))
-		    {
-			fprintf(stderr, "%s: skipping special device symlink \"%s\"\n",
-				g_progname, filepath);
-		    }
-		    else if (S_ISFIFO(st.st_mode))
-		    {
-			fprintf(stderr, "%s: skipping named pipe symlink \"%s\"\n",
-				g_progname, filepath);
-		    }
-		    else if (S_ISSOCK(st.st_mode))
-		    {
-			fprintf(stderr, "%s: skipping unix socket symlink \"%s\"\n",
-				g_progname, filepath);
-		    }
-		    else if (S_ISDIR(st.st_mode))
-		    {
-			scan_directory(filepath, &st);
-		    }
-		    else if (!S_ISREG(st.st_mode))
-		    {
-			fprintf(stderr, "%s: skipping special symlink \"%s\"\n",
-				g_progname, filepath);
-		    }
-		    else
-		    {
-			process_file(filepath, &st);
-		    }
-		}
-	    }
-	    else if (S_ISCHR(st.st_mode) || S_ISBLK(st.st_mode))
-	    {
-		fprintf(stderr, "%s: skipping special device file \"%s\"\n",
-			g_progname, filepath);
-	    }
-	    else if (S_ISFIFO(st.st_mode))
-	    {
-		fprintf(stderr, "%s: skipping named pipe \"%s\"\n",
-			g_progname, filepath);
-	    }
-	    else if (S_ISSOCK(st.st_mode))
-	    {
-		fprintf(stderr, "%s: skipping unix socket \"%s\"\n",
-			g_progname, filepath);
-	    }
-	    else if (S_ISDIR(st.st_mode))
+	if (cmp <= 0)
+	{
+	    path = g_extold.path;
+	    fileinfo = ext_old_fileinfo();
+
+	    if (ext_skipped(path))
 	    {
-		scan_directory(filepath, &st);
+		fileinfo->status = FS_SKIPPED;
+		++g_filelist_skipped;
 	    }
-	    else if (!S_ISREG(st.st_mode))
+	    else if (cmp == 0)
 	    {
-		fprintf(stderr, "%s: skipping special file \"%s\"\n",
-			g_progname, filepath);
+		ext_process(path, ee, fileinfo);
 	    }
-	    else
+	    else /* deleted, unless renamed */
 	    {
-		process_file(filepath, &st);
+		ext_pair_add(pairs, fileinfo, FALSE, path);
 	    }
+	}
+	else
+	{
+	    path = (const char*)(ee + 1);
 
-	    free(filepath);
+	    g_extnew = NULL;
+	    ext_process(path, ee, NULL);
+	    fileinfo = g_extnew;
+
+	    assert(fileinfo);
+
+	    if (fileinfo->status == FS_NEW && fileinfo->digest.size)
+		ext_pair_add(pairs, fileinfo, TRUE, path);
 	}
+
+	if (g_ext_sumfile && digestfile_write_record(g_ext_sumfile, path, fileinfo))
+	    ++digestcount;
+
+	/* advance after the path was used */
+	if (cmp <= 0) ext_old_next();
+	if (cmp >= 0) ee = es_next(scan, NULL);
     }
 
-    free(filenames);
-    dirstack_pop(st);
+    es_destroy(scan);
 
-    return TRUE;
-}
+    /* pair deleted and new files by digest, then report deleted ones */
 
-bool start_scan(const char* path)
-{
-    mystatst st;
+    es_finish(pairs);
 
-    if (mylstat(path, &st) != 0)
-    {
-	fprintf(stderr, "%s: could not stat path \"%s\": %s\n",
-		g_progname, path, strerror(errno));
-    }
-    else if (S_ISDIR(st.st_mode))
-    {
-	return scan_directory(path, &st);
-    }
-    else if (!S_ISREG(st.st_mode))
-    {
-	fprintf(stderr, "%s: skipping special path \"%s\"\n",
-		g_progname, path);
-    }
-    else
-    {
-	return process_file(path, &st);
-    }
+    deleted = es_create(gopt_memlimit / 2, ext_path_cmp);
 
-    return FALSE;
-}
+    ext_find_renamed(pairs, deleted);
 
-/*************************************************
- * Functions for interactive scan result review  *
- *************************************************/
+    es_destroy(pairs);
 
-struct CommandEntry
-{
-    const char* name;
-    bool	(*func)(void);
-    const char*	help;
-};
+    es_finish(deleted);
 
-static struct CommandEntry cmdlist[16];
+    while ((path = es_next(deleted, NULL)))
+    {
+	fprintf(stdout, "%s DELETED.\n", path);
+	++deletedcount;
+    }
 
-bool filelist_clean(void)
-{
-    return ( rb_size(g_filelist) == g_filelist_seen + g_filelist_touched );
-}
+    es_destroy(deleted);
 
-unsigned int filelist_deleted(void)
-{
-    return rb_size(g_filelist) - (g_filelist_new + g_filelist_seen + g_filelist_touched + g_filelist_changed + g_filelist_error + g_filelist_renamed + g_filelist_copied + g_filelist_oldpath + g_filelist_skipped);
-}
+    if (deletedcount == 0 && !gopt_onlymodified) {
+	fprintf(stdout, "%s: no deleted files detected during scan.\n",
+		g_progname);
+    }
 
-void print_summary(void)
-{
-    fprintf(stdout, "File scan summary:\n");
+    if (!filelist_clean() || !gopt_onlymodified)
+	print_summary();
 
-    if (g_filelist_new)
-	fprintf(stdout, "        New: %d\n", g_filelist_new);
+    if (g_ext_sumfile)
+    {
+	bool ok;
 
-    if (g_filelist_seen)
-	fprintf(stdout, "  Untouched: %d\n", g_filelist_seen);
+	digestwriter_eof(g_ext_sumfile);
+	ok = digestwriter_close(g_ext_sumfile);
+	g_ext_sumfile = NULL;
 
-    if (g_filelist_touched)
-	fprintf(stdout, "    Touched: %d\n", g_filelist_touched);
+	if (!ok)
+	{
+	    fprintf(stderr, "%s: could not write %s: %s\n",
+		    g_progname, g_ext_tmpfile, strerror(errno));
+	    remove(g_ext_tmpfile);
+	    return -1;
+	}
 
-    if (g_filelist_changed)
-	fprintf(stdout, "    Changed: %d\n", g_filelist_changed);
+#if ON_WIN32
+	remove(gopt_digestfile); /* rename() does not replace files */
+#endif
 
-    if (g_filelist_error)
-	fprintf(stdout, "     Errors: %d\n", g_filelist_error);
+	if (rename(g_ext_tmpfile, gopt_digestfile) != 0)
+	{
+	    fprintf(stderr, "%s: could not rename %s to %s: %s\n",
+		    g_progname, g_ext_tmpfile, gopt_digestfile, strerror(errno));
+	}
+	else
+	{
+	    fprintf(stderr, "%s: wrote %d digests to %s\n",
+		    g_progname, digestcount, gopt_digestfile);
+	}
+    }
 
-    if (g_filelist_renamed)
-	fprintf(stdout, "    Renamed: %d\n", g_filelist_renamed);
+    return filelist_clean() ? 0 : 1;
+}
 
-    if (g_filelist_copied)
-	fprintf(stdout, "     Copied: %d\n", g_filelist_copied);
+/**
+ * Run the external memory mode selected by --memory-limit. The tree is
+ * scanned into sorted runs of limited size, which are merged with the
+ * digest file read as a sorted stream. Each entry is processed as in
+ * the normal mode and written to a temporary digest file, which then
+ * replaces the old one. Renamed files are found by a second sort of
+ * the deleted and new files by digest.
+ */
+int ext_main(void)
+{
+    struct arena* base;
+    int retcode;
 
-    if (g_filelist_skipped)
-	fprintf(stdout, "    Skipped: %d\n", g_filelist_skipped);
+    /* g_filelist stays empty, g_arena holds only the current entry */
 
-    if (filelist_deleted())
-	fprintf(stdout, "    Deleted: %d\n", filelist_deleted());
+    base = arena_create(0);
+    g_arena = arena_create(0);
+
+    g_dirtree = dt_create(base);
+
+    g_filelist = rb_create(rbtree_dt_key_cmp, NULL, NULL, NULL, NULL);
+    rb_set_arena(g_filelist, base);
 
-    fprintf(stdout, "      Total: %d\n", rb_size(g_filelist));
-}
+    g_fileextra = rb_create(rbtree_pointer_cmp, NULL, NULL, NULL, NULL);
+    rb_set_arena(g_fileextra, g_arena);
 
-bool cmd_help(void)
-{
-    int i;
+    memset(&g_extold, 0, sizeof(g_extold));
+    g_extold.info = malloc(sizeof(struct FileInfo) + DIGEST_MAX_SIZE);
 
-    fprintf(stdout, "Commands: (can be abbreviated)\n");
+    retcode = ext_merge();
 
-    for (i = 0; cmdlist[i].name; ++i)
-    {
-	if (!cmdlist[i].help) continue;
+    if (g_extold.reader.fp) digestreader_close(&g_extold.reader);
+    if (g_extold.path) free(g_extold.path);
+    if (g_extold.symlink) free(g_extold.symlink);
+    free(g_extold.info);
+    if (g_ext_tmpfile) free(g_ext_tmpfile);
 
-	fprintf(stdout, "  %-10s %s\n", cmdlist[i].name, cmdlist[i].help);
-    }
+    dt_destroy(g_dirtree);
+    rb_destroy(g_filelist);
+    rb_destroy(g_fileextra);
+    arena_destroy(g_arena);
+    arena_destroy(base);
 
-    return TRUE;
+    return retcode;
 }
 
-bool cmd_new(void)
+/*********************************************************
+ * Functions to keep the file list updated using inotify *
+ *********************************************************/
+
+/**
+ * Rebuild g_filelist in a new arena from only the entries which have a
+ * record, as if the digest file just written had been loaded again:
+ * the entries become FS_SEEN or stay FS_SKIPPED. Used by --watch after
+ * each write, such that replaced digests, error strings and the entries
+ * of deleted files do not accumulate in g_arena.
+ */
+void filelist_compact(void)
 {
+    struct arena* arena = arena_create(0);
+    struct dirtree* dirtree = dt_create(arena);
+    struct rb_tree* filelist = rb_create(rbtree_dt_key_cmp, NULL, NULL, NULL, NULL);
+    struct rb_tree* fileextra = rb_create(rbtree_pointer_cmp, NULL, NULL, NULL, NULL);
+    struct LoadEntry *list, *iter;
     struct rb_node* node;
-    unsigned int count = 0;
+    size_t n = 0;
 
-    for (node = rb_begin(g_filelist); node != rb_end(g_filelist); node = rb_successor(g_filelist, node))
+    rb_set_arena(filelist, arena);
+    rb_set_arena(fileextra, arena);
+
+    list = malloc(sizeof(struct LoadEntry) * (rb_size(g_filelist) + 1));
+
+    g_filelist_seen = g_filelist_skipped = 0;
+    g_filelist_new = g_filelist_touched = g_filelist_changed = 0;
+    g_filelist_error = g_filelist_copied = g_filelist_renamed = 0;
+    g_filelist_oldpath = 0;
+
+    for (node = rb_begin(g_filelist); node != rb_end(g_filelist);
+	 node = rb_successor(g_filelist, node))
     {
-	const struct FileInfo* fileinfo = node->value;
+	const struct FileInfo* from = node->value;
+	struct FileInfo* to;
+	const char* symlink = fileinfo_symlink(from);
+	const struct InodeId* inode = fileinfo_inode(from);
 
-	if (fileinfo->status != FS_NEW) continue;
+	if (!digestfile_has_record(from)) continue;
 
-	fprintf(stdout, "%s new.\n", (char*)node->key);
-	++count;
-    }
+	to = fileinfo_alloc_in(arena, from->digest.size > g_digestsize ?
+			       from->digest.size : g_digestsize);
 
-    if (count == 0) {
-	fprintf(stdout, "%s: no new files encountered during scan.\n",
-		g_progname);
-    }
+	to->size = from->size;
+	to->mtime = from->mtime;
+	to->loaded = TRUE;
+	memcpy(&to->digest, &from->digest, 1 + from->digest.size);
 
-    return TRUE;
-}
+	if (from->status == FS_SKIPPED) {
+	    to->status = FS_SKIPPED;
+	    ++g_filelist_skipped;
+	}
+	else {
+	    to->status = FS_SEEN;
+	    ++g_filelist_seen;
+	}
 
-bool cmd_untouched(void)
-{
-    struct rb_node* node;
-    unsigned int count = 0;
+	/* only unchanged records have lines in the loaded digest file */
+	if (from->status == FS_SEEN || from->status == FS_SKIPPED)
+	{
+	    to->spanpos = from->spanpos;
+	    to->spancrc = from->spancrc;
+	    to->spanlen = from->spanlen;
+	}
 
-    for (node = rb_begin(g_filelist); node != rb_end(g_filelist); node = rb_successor(g_filelist, node))
-    {
-	const struct FileInfo* fileinfo = node->value;
+	if (symlink || inode)
+	{
+	    struct FileExtra* extra = arena_calloc(arena, sizeof(struct FileExtra));
 
-	if (fileinfo->status != FS_SEEN) continue;
+	    if (symlink) extra->symlink = arena_strdup(arena, symlink);
+	    if (inode) {
+		extra->inode = *inode;
+		extra->hasinode = TRUE;
+	    }
 
-	fprintf(stdout, "%s untouched.\n", (char*)node->key);
-	++count;
+	    rb_insert(fileextra, to, extra);
+	    to->hasextra = TRUE;
+	}
+
+	list[n].key = dt_intern(dirtree, filelist_path(node->key));
+	list[n].fileinfo = to;
+	++n;
     }
 
-    if (count == 0) {
-	fprintf(stdout, "%s: no untouched files encountered during scan.\n",
-		g_progname);
+    /* drop everything referring to the old arena */
+
+    hi_destroy(g_filehash);
+    dt_destroy(g_dirtree);
+    rb_destroy(g_filelist);
+    rb_destroy(g_fileextra);
+    arena_destroy(g_arena);
+
+    free(g_digestindex);
+    g_digestindex = NULL;
+    g_digestindex_mask = g_digestindex_size = 0;
+
+    if (g_inodemap) {
+	hi_destroy(g_inodemap);
+	g_inodemap = NULL;
     }
 
-    return TRUE;
-}
+    g_arena = arena;
+    g_dirtree = dirtree;
+    g_filelist = filelist;
+    g_fileextra = fileextra;
 
-bool cmd_touched(void)
-{
-    struct rb_node* node;
-    unsigned int count = 0;
+    iter = list;
+    rb_build_sorted(g_filelist, n, loadlist_next, &iter);
+    free(list);
+
+    g_filehash = hi_create_custom(n + n / 8, dt_key_hash, dt_key_equal);
 
     for (node = rb_begin(g_filelist); node != rb_end(g_filelist);
-         node = rb_successor(g_filelist, node))
+	 node = rb_successor(g_filelist, node))
     {
-	const struct FileInfo* fileinfo = node->value;
+	hi_insert(g_filehash, node->key, node);
+    }
+}
 
-	if (fileinfo->status != FS_TOUCHED) continue;
+#if HAVE_SYS_INOTIFY_H
 
-	fprintf(stdout, "%s touched.\n", (char*)node->key);
-	++count;
-    }
+volatile sig_atomic_t g_watch_flush = 0;
+volatile sig_atomic_t g_watch_quit = 0;
 
-    if (count == 0) {
-	fprintf(stdout, "%s: no touched but unchanged files encountered during scan.\n",
-		g_progname);
-    }
+/* set if entries were updated since the digest file was written */
+bool g_watch_dirty = FALSE;
 
-    return TRUE;
+void watch_signal(int sig)
+{
+    if (sig == SIGHUP || sig == SIGUSR1)
+	g_watch_flush = 1;
+    else
+	g_watch_quit = 1;
 }
 
-bool cmd_changed(void)
+/**
+ * Return the path of the file name in the watched directory wd as a
+ * malloc()ed string, or NULL for unknown watch descriptors.
+ */
+char* watch_path(int wd, const char* name)
 {
-    struct rb_node* node;
-    unsigned int count = 0;
-
-    for (node = rb_begin(g_filelist); node != rb_end(g_filelist);
-         node = rb_successor(g_filelist, node))
-    {
-	const struct FileInfo* fileinfo = node->value;
-
-	if (fileinfo->status != FS_CHANGED) continue;
+    char* path;
 
-	fprintf(stdout, "%s CHANGED.\n", (char*)node->key);
-	++count;
-    }
+    if (wd < 0 || wd >= g_watchdirs_max || !g_watchdirs[wd])
+	return NULL;
 
-    if (count == 0) {
-	fprintf(stdout, "%s: no changed files encountered during scan.\n",
-		g_progname);
-    }
+    if (!name || !name[0])
+	path = strdup(g_watchdirs[wd]);
+    else if (g_watchdirs[wd][0] == 0)
+	path = strdup(name);
+    else
+	my_asprintf(&path, "%s/%s", g_watchdirs[wd], name);
 
-    return TRUE;
+    return path;
 }
 
-bool cmd_deleted(void)
+/**
+ * Process a new or changed file or symlink reported by inotify. The
+ * file list is dirty only if the entry's record was changed, hence
+ * files closed without modification and the digest file's own writes
+ * do not cause a write. Unchanged entries keep their status, which
+ * tells whether the record was changed since it was loaded.
+ */
+void watch_process(const char* path)
 {
+    mystatst st;
     struct rb_node* node;
-    unsigned int count = 0;
+    struct FileInfo* fileinfo;
+    unsigned char digest[1 + DIGEST_MAX_SIZE];
+    const char *symlink, *target;
+    bool record;
+    unsigned char status = FS_UNSEEN;
+    long long size;
+    time_t mtime;
 
-    for (node = rb_begin(g_filelist); node != rb_end(g_filelist);
-         node = rb_successor(g_filelist, node))
+    if (is_digestfile(path))
+	return;
+
+    if (mylstat(path, &st) != 0)
+	return; /* already gone again */
+
+    if (gopt_pathmatch && !pm_match_path(gopt_pathmatch, path))
+	return;
+
+    node = filelist_find(path);
+
+    if (node)
     {
-	const struct FileInfo* fileinfo = node->value;
+	fileinfo = node->value;
 
-	if (fileinfo->status != FS_UNSEEN) continue;
+	if (fileinfo->status == FS_SKIPPED)
+	    return;
 
-	fprintf(stdout, "%s DELETED.\n", (char*)node->key);
-	++count;
+	record = digestfile_has_record(fileinfo);
+	status = fileinfo->status;
+	size = fileinfo->size;
+	mtime = fileinfo->mtime;
+	symlink = fileinfo_symlink(fileinfo);
+	memcpy(digest, &fileinfo->digest, 1 + fileinfo->digest.size);
+
+	filelist_reset_entry(fileinfo);
     }
 
-    if (count == 0) {
-	fprintf(stdout, "%s: no deleted files detected during scan.\n",
-		g_progname);
+    if (S_ISLNK(st.st_mode))
+    {
+	if (!gopt_followsymlinks)
+	{
+	    process_symlink(path, &st, node);
+	}
+	else if (mystat(path, &st) == 0 && S_ISREG(st.st_mode))
+	{
+	    process_file(path, &st, node);
+	}
+    }
+    else if (S_ISREG(st.st_mode))
+    {
+	process_file(path, &st, node);
     }
 
-    return TRUE;
-}
+    if (!node)
+    {
+	if (filelist_find(path)) g_watch_dirty = TRUE;
+	return;
+    }
 
-bool cmd_error(void)
-{
-    struct rb_node* node;
-    unsigned int count = 0;
+    fileinfo = node->value;
+    target = fileinfo_symlink(fileinfo);
 
-    for (node = rb_begin(g_filelist); node != rb_end(g_filelist);
-         node = rb_successor(g_filelist, node))
+    if (record != digestfile_has_record(fileinfo) ||
+	size != fileinfo->size || mtime != fileinfo->mtime ||
+	(symlink != target && (!symlink || !target || strcmp(symlink, target) != 0)) ||
+	!digest_equal((const digest_result*)digest, &fileinfo->digest))
     {
-	const struct FileInfo* fileinfo = node->value;
+	g_watch_dirty = TRUE;
+    }
+    else if (fileinfo->status == FS_SEEN && status != FS_SEEN)
+    {
+	/* the record still differs from the written one as before */
+	filelist_reset_entry(fileinfo);
+	filelist_set_status(fileinfo, status);
+    }
+}
 
-	if (fileinfo->status != FS_ERROR) continue;
+/**
+ * Process a file or directory which was created or moved into the
+ * tree. New directories are scanned and watched recursively.
+ */
+void watch_arrive(const char* path)
+{
+    mystatst st;
 
-	fprintf(stdout, "%s ERROR. %s\n", (char*)node->key, fileinfo->error);
-	++count;
-    }
+    if (is_digestfile(path) || mylstat(path, &st) != 0)
+	return;
 
-    if (count == 0) {
-	fprintf(stdout, "%s: no errors encountered during scan.\n",
-		g_progname);
+    if (S_ISDIR(st.st_mode))
+    {
+	filelist_reset_tree(path);
+	start_scan(path);
+	g_watch_dirty = TRUE;
+    }
+    else
+    {
+	watch_process(path);
     }
-
-    return TRUE;
 }
 
-bool cmd_copied(void)
+/**
+ * Process a file or directory which was deleted or moved out of the
+ * tree: the entries are reset to FS_UNSEEN and thus dropped.
+ */
+void watch_forget(const char* path, bool isdir, bool movedout)
 {
-    struct rb_node* node;
-    unsigned int count = 0;
+    if (isdir)
+    {
+	filelist_reset_tree(path);
 
-    for (node = rb_begin(g_filelist); node != rb_end(g_filelist);
-         node = rb_successor(g_filelist, node))
+	if (movedout)
+	{
+	    /* remove watches of the directory and all sub-directories */
+	    size_t len = strlen(path);
+	    int wd;
+
+	    for (wd = 0; wd < g_watchdirs_max; ++wd)
+	    {
+		if (!g_watchdirs[wd]) continue;
+
+		if (strncmp(g_watchdirs[wd], path, len) == 0 &&
+		    (g_watchdirs[wd][len] == 0 || g_watchdirs[wd][len] == '/'))
+		{
+		    inotify_rm_watch(g_inotify_fd, wd);
+		}
+	    }
+	}
+    }
+    else
     {
-	const struct FileInfo* fileinfo = node->value;
+	struct rb_node* node = filelist_find(path);
 
-	if (fileinfo->status != FS_COPIED) continue;
+	if (!node || ((struct FileInfo*)node->value)->status == FS_SKIPPED)
+	    return;
 
-	fprintf(stdout, "%s copied.\n<-- %s\n", (char*)node->key, fileinfo->oldpath);
-	++count;
+	filelist_reset_entry(node->value);
     }
 
-    if (count == 0) {
-	fprintf(stdout, "%s: no copied files detected during scan.\n",
-		g_progname);
+    if (gopt_verbose >= 1) {
+	fprintf(stdout, "%s DELETED.\n", path);
     }
 
-    return TRUE;
+    g_watch_dirty = TRUE;
 }
 
-bool cmd_renamed(void)
+/**
+ * Move the entry src within g_filelist to the new path dstkey as
+ * FS_RENAMED, without reading the file again. The original entry
+ * becomes FS_OLDPATH.
+ */
+void watch_move_entry(struct rb_node* src, const char* dstkey)
 {
-    struct rb_node* node;
-    unsigned int count = 0;
+    struct FileInfo* from = src->value;
+    struct FileInfo* to;
+    struct FileExtra* extra;
+    struct rb_node* dst = filelist_find(dstkey);
 
-    for (node = rb_begin(g_filelist); node != rb_end(g_filelist);
-         node = rb_successor(g_filelist, node))
+    if (dst)
     {
-	const struct FileInfo* fileinfo = node->value;
-
-	if (fileinfo->status != FS_RENAMED) continue;
-
-	fprintf(stdout, "%s renamed.\n<-- %s\n", (char*)node->key, fileinfo->oldpath);
-	++count;
+	/* rename replaced an existing file */
+	to = dst->value;
+	filelist_reset_entry(to);
+    }
+    else
+    {
+	to = fileinfo_alloc(g_digestsize);
+	dst = filelist_insert(dstkey, to);
     }
 
-    if (count == 0) {
-	fprintf(stdout, "%s: no renamed files detected during scan.\n",
-		g_progname);
+    /* the digest is copied, strings in the arena are immutable and can
+     * be shared */
+    to->status = FS_RENAMED;
+    to->mtime = from->mtime;
+    to->size = from->size;
+    fileinfo_set_digest(dst, from->digest.size ? &from->digest : NULL);
+    extra = fileinfo_extra(to, TRUE);
+    extra->symlink = (char*)fileinfo_symlink(from);
+    extra->oldpath = src->key;
+    if (fileinfo_inode(from)) {
+	extra->inode = *fileinfo_inode(from);
+	extra->hasinode = TRUE;
+    }
+    else {
+	/* not the inode of a replaced file */
+	extra->hasinode = FALSE;
     }
+    ++g_filelist_renamed;
 
-    return TRUE;
+    filelist_reset_entry(from);
+    from->status = FS_OLDPATH;
+    ++g_filelist_oldpath;
+
+    if (gopt_verbose >= 1) {
+	fprintf(stdout, "%s renamed.\n<-- %s\n", dstkey, filelist_path(src->key));
+    }
 }
 
-bool cmd_skipped(void)
+/**
+ * Process a pair of IN_MOVED_FROM/IN_MOVED_TO events within the tree.
+ */
+void watch_move(const char* from, const char* to, bool isdir)
 {
-    struct rb_node* node;
-    unsigned int count = 0;
-
-    for (node = rb_begin(g_filelist); node != rb_end(g_filelist);
-         node = rb_successor(g_filelist, node))
+    if (isdir)
     {
-	const struct FileInfo* fileinfo = node->value;
+	struct rb_node *node, *last, **nodes = NULL;
+	size_t i, n = 0, nmax = 0, fromlen = strlen(from);
+	int wd;
 
-	if (fileinfo->status != FS_SKIPPED) continue;
+	/* collect entries first, as new ones are inserted while moving */
+	filelist_dir_range(from, &node, &last);
 
-	fprintf(stdout, "%s SKIPPED.\n", (char*)node->key);
-	++count;
-    }
+	for (; node != last; node = rb_successor(g_filelist, node))
+	{
+	    enum FileStatus status = ((struct FileInfo*)node->value)->status;
 
-    if (count == 0) {
-	fprintf(stdout, "%s: no files skipped during scan.\n",
-		g_progname);
-    }
+	    if (status == FS_UNSEEN || status == FS_ERROR ||
+		status == FS_OLDPATH || status == FS_SKIPPED)
+		continue;
 
-    return TRUE;
-}
+	    if (n >= nmax)
+	    {
+		nmax = nmax ? 2 * nmax : 64;
+		nodes = realloc(nodes, sizeof(struct rb_node*) * nmax);
+	    }
+	    nodes[n++] = node;
+	}
 
-bool cmd_write(void)
-{
-    FILE *sumfile = fopen(gopt_digestfile, "wb");
+	for (i = 0; i < n; ++i)
+	{
+	    char* newkey;
+	    my_asprintf(&newkey, "%s%s", to, filelist_path(nodes[i]->key) + fromlen);
 
-    uint32_t crc = 0;
-    char digeststr[128];
-    unsigned int digestcount = 0;
-    struct rb_node* node;
+	    if (!gopt_pathmatch || pm_match_path(gopt_pathmatch, newkey))
+		watch_move_entry(nodes[i], newkey);
+	    else
+		filelist_reset_entry(nodes[i]->value);
+
+	    free(newkey);
+	}
+
+	free(nodes);
+
+	/* rename paths of the directory and all watched sub-directories */
+	for (wd = 0; wd < g_watchdirs_max; ++wd)
+	{
+	    char* newpath;
+
+	    if (!g_watchdirs[wd]) continue;
+
+	    if (strncmp(g_watchdirs[wd], from, fromlen) != 0 ||
+		(g_watchdirs[wd][fromlen] != 0 && g_watchdirs[wd][fromlen] != '/'))
+		continue;
+
+	    my_asprintf(&newpath, "%s%s", to, g_watchdirs[wd] + fromlen);
+	    free(g_watchdirs[wd]);
+	    g_watchdirs[wd] = newpath;
+	}
 
-    if (sumfile == NULL)
+	g_watch_dirty = TRUE;
+    }
+    else
     {
-	fprintf(stderr, "%s: could not open %s: %s\n",
-		g_progname, gopt_digestfile, strerror(errno));
-	return TRUE;
+	struct rb_node* src = filelist_find(from);
+	enum FileStatus status = src ? ((struct FileInfo*)src->value)->status : FS_UNSEEN;
+
+	if (status == FS_UNSEEN || status == FS_ERROR ||
+	    status == FS_OLDPATH || status == FS_SKIPPED ||
+	    (gopt_pathmatch && !pm_match_path(gopt_pathmatch, to)) ||
+	    is_digestfile(to))
+	{
+	    /* no usable source entry: process as deleted and new file */
+	    watch_forget(from, FALSE, TRUE);
+	    watch_process(to);
+	}
+	else
+	{
+	    watch_move_entry(src, to);
+	    g_watch_dirty = TRUE;
+	}
     }
+}
 
-    /* add a small note current date at the beginning */
-    {
-	time_t tnow = time(NULL);
-	char datenow[64];
-	strftime(datenow, sizeof(datenow), "%Y-%m-%d %H:%M:%S %Z", localtime(&tnow));
+/**
+ * Read and process all pending inotify events. IN_MOVED_FROM events
+ * are held back until the IN_MOVED_TO with the same cookie arrives,
+ * otherwise the file was moved out of the tree.
+ */
+void watch_events(void)
+{
+    union {
+	struct inotify_event ev;
+	char buffer[65536];
+    } u;
 
-	fprintfcrc(&crc, sumfile, "# %s last update: %s\n", g_progname, datenow);
-    }
+    char* movedfrom = NULL;
+    uint32_t movedcookie = 0;
+    bool movedisdir = FALSE;
 
-    /* add persisent options to digest file */
+    while (1)
+    {
+	ssize_t len = read(g_inotify_fd, u.buffer, sizeof(u.buffer));
+	char* p;
 
-    if (gopt_exclude_marker) {
-	fprintfcrc(&crc, sumfile, "#: option --exclude-marker=%s\n", gopt_exclude_marker);
-    }
+	if (len <= 0)
+	{
+	    struct pollfd pfd;
 
-    /* list files with properties and digests */
+	    if (!movedfrom) break;
 
-    for (node = rb_begin(g_filelist); node != rb_end(g_filelist);
-         node = rb_successor(g_filelist, node))
-    {
-	struct FileInfo* fileinfo = node->value;
-	char* filename;
+	    /* wait briefly for the matching IN_MOVED_TO event */
+	    pfd.fd = g_inotify_fd;
+	    pfd.events = POLLIN;
 
-	if (fileinfo->status == FS_UNSEEN) continue;
-	if (fileinfo->status == FS_ERROR) continue;
-	if (fileinfo->status == FS_OLDPATH) continue;
+	    if (poll(&pfd, 1, 10) > 0) continue;
 
-	filename = strdup((char*)node->key);
+	    watch_forget(movedfrom, movedisdir, TRUE);
+	    free(movedfrom);
+	    break;
+	}
 
-	if (fileinfo->symlink)
+	for (p = u.buffer; p < u.buffer + len; )
 	{
-#if ON_WIN32 /* mingw uses msvcrt which uses %I64d or %I64u for long long formatting. */
+	    const struct inotify_event* ev = (const struct inotify_event*)p;
+	    char* path;
 
-	    if (needescape_filename(&fileinfo->symlink)) /* may replace the symlink string */
-		fprintfcrc(&crc, sumfile, "#: mtime %ld size %I64d target\\ %s\n", fileinfo->mtime, fileinfo->size, fileinfo->symlink);
-	    else
-		fprintfcrc(&crc, sumfile, "#: mtime %ld size %I64d target %s\n", fileinfo->mtime, fileinfo->size, fileinfo->symlink);
+	    p += sizeof(struct inotify_event) + ev->len;
 
-#else
+	    if (ev->mask & IN_Q_OVERFLOW)
+	    {
+		fprintf(stderr, "%s: inotify event queue overflowed: rescanning.\n",
+			g_progname);
 
-	    if (needescape_filename(&fileinfo->symlink)) /* may replace the symlink string */
-		fprintfcrc(&crc, sumfile, "#: mtime %ld size %lld target\\ %s\n", fileinfo->mtime, fileinfo->size, fileinfo->symlink);
-	    else
-		fprintfcrc(&crc, sumfile, "#: mtime %ld size %lld target %s\n", fileinfo->mtime, fileinfo->size, fileinfo->symlink);
+		if (movedfrom) {
+		    free(movedfrom);
+		    movedfrom = NULL;
+		}
 
-#endif
-	    if (needescape_filename(&filename)) /* may replace the filename string */
-		fprintfcrc(&crc, sumfile, "#: symlink\\ %s\n", filename);
-	    else
-		fprintfcrc(&crc, sumfile, "#: symlink %s\n", filename);
-	}
-	else
-	{
-#if ON_WIN32 /* mingw uses msvcrt which uses %I64d or %I64u for long long formatting. */
+		filelist_reset_tree(gopt_subtree ? gopt_subtree : "");
+		start_scan(gopt_subtree ? gopt_subtree : ".");
+		g_watch_dirty = TRUE;
+		continue;
+	    }
 
-	    fprintfcrc(&crc, sumfile, "#: mtime %ld size %I64d\n", fileinfo->mtime, fileinfo->size);
+	    if (ev->mask & IN_IGNORED)
+	    {
+		/* watch was removed, the directory is gone */
+		if (ev->wd >= 0 && ev->wd < g_watchdirs_max && g_watchdirs[ev->wd])
+		{
+		    free(g_watchdirs[ev->wd]);
+		    g_watchdirs[ev->wd] = NULL;
+		    --g_watchdirs_count;
+		}
+		continue;
+	    }
 
-#else
+	    path = watch_path(ev->wd, ev->len ? ev->name : NULL);
+	    if (!path) continue;
 
-	    fprintfcrc(&crc, sumfile, "#: mtime %ld size %lld\n", fileinfo->mtime, fileinfo->size);
+	    if (movedfrom && !((ev->mask & IN_MOVED_TO) && ev->cookie == movedcookie))
+	    {
+		watch_forget(movedfrom, movedisdir, TRUE);
+		free(movedfrom);
+		movedfrom = NULL;
+	    }
 
-#endif
-	    if (needescape_filename(&filename)) /* may replace the filename string */
-		fprintfcrc(&crc, sumfile, "\\");
+	    if (ev->mask & IN_MOVED_FROM)
+	    {
+		movedfrom = path;
+		movedcookie = ev->cookie;
+		movedisdir = (ev->mask & IN_ISDIR) != 0;
+		continue;
+	    }
+	    else if (ev->mask & IN_MOVED_TO)
+	    {
+		if (movedfrom)
+		{
+		    watch_move(movedfrom, path, movedisdir);
+		    free(movedfrom);
+		    movedfrom = NULL;
+		}
+		else
+		{
+		    watch_arrive(path);
+		}
+	    }
+	    else if (ev->mask & IN_DELETE)
+	    {
+		watch_forget(path, (ev->mask & IN_ISDIR) != 0, FALSE);
+	    }
+	    else if (ev->mask & IN_CREATE)
+	    {
+		mystatst st;
+
+		/* regular files are processed once written and closed,
+		 * except for new hard links to existing files. */
+		if (ev->mask & IN_ISDIR)
+		    watch_arrive(path);
+		else if (mylstat(path, &st) == 0 &&
+			 (S_ISLNK(st.st_mode) || st.st_nlink > 1))
+		    watch_process(path);
+	    }
+	    else if (ev->mask & IN_CLOSE_WRITE)
+	    {
+		watch_process(path);
+	    }
 
-	    fprintfcrc(&crc, sumfile, "%s  %s\n", digest_bin2hex(fileinfo->digest, digeststr), filename);
+	    free(path);
 	}
+    }
 
-	++digestcount;
+    resolve_moved();
+    inodeindex_clear();
+}
 
-	free(filename);
+/**
+ * Keep the file list updated from inotify events after the initial
+ * scan and write the digest file every gopt_watch_interval seconds
+ * if changes occurred, on SIGHUP or SIGUSR1, and on exit by SIGINT or
+ * SIGTERM.
+ */
+bool watch_tree(void)
+{
+    struct sigaction sa;
+    time_t nextflush;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = watch_signal;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGHUP, &sa, NULL);
+    sigaction(SIGUSR1, &sa, NULL);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    if (gopt_verbose >= 0) {
+	fprintf(stderr, "%s: watching %u directories for changes.\n",
+		g_progname, g_watchdirs_count);
     }
 
-    fprintf(sumfile, "#: crc 0x%08x eof\n", crc);
+    nextflush = time(NULL) + gopt_watch_interval;
 
-    fclose(sumfile);
+    while (!g_watch_quit)
+    {
+	struct pollfd pfd;
+	time_t now = time(NULL);
+	int timeout = -1;
 
-    fprintf(stderr, "%s: wrote %d digests to %s\n",
-	    g_progname, digestcount, gopt_digestfile);
+	if (gopt_watch_interval)
+	    timeout = (now >= nextflush) ? 0 : (int)(nextflush - now) * 1000;
 
-    return FALSE;
-}
+	pfd.fd = g_inotify_fd;
+	pfd.events = POLLIN;
 
-bool cmd_quit(void)
-{
-    return FALSE;
+	if (poll(&pfd, 1, timeout) < 0 && errno != EINTR)
+	{
+	    fprintf(stderr, "%s: could not poll inotify events: %s\n",
+		    g_progname, strerror(errno));
+	    break;
+	}
+
+	if (pfd.revents & POLLIN)
+	    watch_events();
+
+	if (g_watch_flush || (gopt_watch_interval && time(NULL) >= nextflush))
+	{
+	    if (g_watch_dirty && !cmd_write()) {
+		filelist_compact();
+		g_watch_dirty = FALSE;
+	    }
+
+	    g_watch_flush = 0;
+	    nextflush = time(NULL) + gopt_watch_interval;
+	}
+    }
+
+    if (g_watch_dirty)
+	cmd_write();
+
+    return TRUE;
 }
 
-static struct CommandEntry cmdlist[16] =
-{
-    { "help",		&cmd_help,	"See this help text." },
-    { "new",		&cmd_new,	"Print newly seen files not in digest file." },
-    { "untouched",	&cmd_untouched,	"Print all untouched files." },
-    { "touched",	&cmd_touched,	"Print all files with changed modification time." },
-    { "changed",	&cmd_changed,	"Print files with changed contents." },
-    { "modified",	&cmd_changed,	NULL },
-    { "copied",		&cmd_copied,	"Print files copied from a different path." },
-    { "renamed",	&cmd_renamed,	"Print files renamed from a different path." },
-    { "deleted",	&cmd_deleted,	"Print deleted files." },
-    { "error",		&cmd_error,	"Print files with read errors." },
-    { "skipped",	&cmd_skipped,	"Print files skipped during scan." },
-    { "save",		&cmd_write,	"Write updates to digest file and exit program." },
-    { "write",		&cmd_write,	NULL },
-    { "exit",		&cmd_quit,	"Exit program without saving updates." },
-    { "quit",		&cmd_quit,	NULL },
-    { NULL,             NULL,		NULL },
-};
+#endif
 
 /**********
  * main() *
@@ -2427,21 +7508,33 @@ void print_usage(void)
 
     printf("Options:\n");
     printf("  -b, --batch           enable non-interactive batch processing mode.\n");
+    printf("      --cache[=FILE]    share digests with other runs in a machine-wide cache.\n");
     printf("  -c, --check           perform full digest check ignoring modification times.\n");
+    printf("      --changed-from=FILE  process only the paths listed in FILE (or - for stdin).\n");
     printf("  -d, --directory=PATH  change into this directory before any operations.\n");
+    printf("      --exclude=GLOB    skip files and directories matching GLOB.\n");
     printf("      --exclude-marker=FILE  skip all directories contain this marker file.\n");
     printf("  -f, --file=FILE       check FILE for existing digests and writing updates.\n");
+    printf("      --include=GLOB    check only files and directories matching GLOB.\n");
+    printf("      --index           write a binary index to load the digest file quickly.\n");
+    printf("      --inodes          save inode numbers to detect renames without reading.\n");
+    printf("      --journal[=PCT]   append updates to a journal up to PCT%% of the file.\n");
     printf("  -l, --links           follow symlinks instead of saving their destination.\n");
     printf("  -m, --modified        suppressing printing of unchanged files.\n");
+    printf("      --memory-limit=SIZE  merge sorted runs on disk to use about SIZE memory.\n");
     printf("      --modify-window=NUM  allow higher delta window for modification times.\n");
     printf("  -q, --quiet           reduce status printing while scanning.\n");
     printf("  -r, --restrict=PAT    run full digest check restricted to files matching PAT.\n");
+    printf("      --subtree=PATH    scan only directory PATH, keeping all other digests.\n");
     printf("  -t, --type=TYPE       select digest type for newly created digest files.\n");
     printf("                          TYPE = md5, sha1, sha256 or sha512.\n");
     printf("  -u, --update          automatically update digest file in batch mode.\n");
     printf("  -v, --verbose         increase status printing during scanning.\n");
     printf("  -V, --version         print digup version and exit.\n");
+    printf("      --watch[=SECS]    keep watching for changes, write digest file every SECS.\n");
+    printf("      --write-threads[=NUM]  format the digest file on NUM threads when writing.\n");
     printf("  -w, --windows         allow a --modify-window of 1 (for FAT filesystems).\n");
+    printf("      --xattr           cache digests in extended attributes of the files.\n");
     printf("\n");
 
     printf("See \"man 1 digup\" for further explanations. This is digup " VERSION "\n");
@@ -2474,6 +7567,18 @@ int main(int argc, char* argv[])
 		{ "windows",    no_argument,       0, 'w' },
 		{ "modify-window", required_argument, 0, 1 },
 		{ "exclude-marker", required_argument, 0, 2 },
+		{ "include",    required_argument, 0, 3 },
+		{ "exclude",    required_argument, 0, 4 },
+		{ "subtree",    required_argument, 0, 5 },
+		{ "watch",      optional_argument, 0, 6 },
+		{ "changed-from", required_argument, 0, 7 },
+		{ "memory-limit", required_argument, 0, 8 },
+		{ "inodes",     no_argument,       0, 9 },
+		{ "xattr",      no_argument,       0, 10 },
+		{ "cache",      optional_argument, 0, 11 },
+		{ "index",      no_argument,       0, 12 },
+		{ "write-threads", optional_argument, 0, 13 },
+		{ "journal",    optional_argument, 0, 14 },
 		{ NULL,	    	0,                 0, 0 }
 	    };
 
@@ -2503,6 +7608,152 @@ int main(int argc, char* argv[])
 	    gopt_exclude_marker = strdup(optarg);
 	    break;
 
+	case 3: case 4:
+	    if (!gopt_pathmatch)
+		gopt_pathmatch = pm_create();
+
+	    if (!pm_add(gopt_pathmatch, optarg, c == 3))
+	    {
+		fprintf(stderr, "%s: invalid glob pattern \"%s\"\n",
+			g_progname, optarg);
+		return -1;
+	    }
+	    break;
+
+	case 5:
+	{
+	    const char* p = normalize_relpath(optarg);
+
+	    if (!p)
+	    {
+		fprintf(stderr, "%s: --subtree must be a relative path below the top directory.\n",
+			g_progname);
+		return -1;
+	    }
+
+	    if (gopt_subtree) free(gopt_subtree);
+	    gopt_subtree = NULL;
+
+	    if (p[0] != 0) /* otherwise top directory: full scan */
+		gopt_subtree = strdup(p);
+	    break;
+	}
+
+	case 7:
+	    gopt_changedfrom = optarg;
+	    break;
+
+	case 8:
+	    if (!parse_size(optarg, &gopt_memlimit) || gopt_memlimit == 0) {
+		fprintf(stderr, "%s: invalid value for memory limit: use a size like 512M\n",
+			g_progname);
+		return -1;
+	    }
+	    break;
+
+	case 9:
+#if !ON_WIN32
+	    gopt_inodes = TRUE;
+	    break;
+#else
+	    fprintf(stderr, "%s: --inodes is not supported on this platform.\n",
+		    g_progname);
+	    return -1;
+#endif
+
+	case 10:
+#if HAVE_SYS_XATTR_H
+	    gopt_xattr = TRUE;
+	    break;
+#else
+	    fprintf(stderr, "%s: --xattr requires extended attributes, which are not supported on this platform.\n",
+		    g_progname);
+	    return -1;
+#endif
+
+	case 11:
+#if !ON_WIN32
+	    gopt_cache = TRUE;
+	    if (optarg) gopt_cachefile = strdup(optarg);
+	    break;
+#else
+	    fprintf(stderr, "%s: --cache is not supported on this platform.\n",
+		    g_progname);
+	    return -1;
+#endif
+
+	case 12:
+#if !ON_WIN32
+	    gopt_index = TRUE;
+	    break;
+#else
+	    fprintf(stderr, "%s: --index is not supported on this platform.\n",
+		    g_progname);
+	    return -1;
+#endif
+
+	case 13:
+	{
+#if HAVE_PTHREAD_H
+	    char *endp;
+
+	    if (!optarg) {
+		gopt_writethreads = psort_ncpus();
+		break;
+	    }
+
+	    gopt_writethreads = strtoul(optarg, &endp, 10);
+	    if (!endp || *endp) {
+		fprintf(stderr, "%s: invalid value for write threads: use an unsigned integer\n",
+			g_progname);
+		return -1;
+	    }
+	    break;
+#else
+	    fprintf(stderr, "%s: --write-threads requires threads, which are not supported on this platform.\n",
+		    g_progname);
+	    return -1;
+#endif
+	}
+
+	case 14:
+	{
+	    char *endp;
+	    gopt_journal = TRUE;
+
+	    if (!optarg) break;
+
+	    gopt_journal_ratio = strtoul(optarg, &endp, 10);
+	    if (!endp || *endp) {
+		fprintf(stderr, "%s: invalid value for journal percentage: use an unsigned integer\n",
+			g_progname);
+		return -1;
+	    }
+	    break;
+	}
+
+	case 6:
+	{
+#if HAVE_SYS_INOTIFY_H
+	    char *endp;
+	    gopt_watch = TRUE;
+
+	    if (!optarg) break;
+
+	    gopt_watch_interval = strtoul(optarg, &endp, 10);
+	    if (!endp || *endp) {
+		fprintf(stderr, "%s: invalid value for watch interval: use an unsigned integer\n",
+			g_progname);
+		return -1;
+	    }
+	    break;
+#else
+	    fprintf(stderr, "%s: --watch requires inotify, which is not supported on this platform.\n",
+		    g_progname);
+	    return -1;
+#endif
+	}
+
 	case 'b':
 	    gopt_batch = TRUE;
 	    --gopt_verbose;
@@ -2632,26 +7883,121 @@ int main(int argc, char* argv[])
     if (gopt_onlymodified && gopt_verbose >= 2)
 	gopt_verbose = 1;
 
+    /* watching implies batch processing and updates */
+
+    if (gopt_watch)
+    {
+	if (!gopt_batch) {
+	    gopt_batch = TRUE;
+	    --gopt_verbose;
+	}
+	gopt_update = TRUE;
+    }
+
     if (gopt_update && !gopt_batch)
     {
 	fprintf(stderr, "%s: automaticcaly updating the digest file requires --batch mode.\n", g_progname);
 	return -1;
     }
 
+    if (gopt_changedfrom && gopt_watch)
+    {
+	fprintf(stderr, "%s: --changed-from cannot be combined with --watch.\n", g_progname);
+	return -1;
+    }
+
+    if (gopt_memlimit && (gopt_changedfrom || gopt_watch))
+    {
+	fprintf(stderr, "%s: --memory-limit cannot be combined with --changed-from or --watch.\n", g_progname);
+	return -1;
+    }
+
+    if (gopt_memlimit && !gopt_batch)
+    {
+	fprintf(stderr, "%s: --memory-limit requires --batch mode.\n", g_progname);
+	return -1;
+    }
+
+    if (gopt_subtree)
+    {
+	mystatst st;
+
+	if (mystat(gopt_subtree, &st) != 0 || !S_ISDIR(st.st_mode))
+	{
+	    fprintf(stderr, "%s: --subtree \"%s\" is not a directory.\n",
+		    g_progname, gopt_subtree);
+	    return -1;
+	}
+    }
+
+    /* external memory mode streams all entries through sorted runs */
+
+    if (gopt_memlimit)
+    {
+	retcode = ext_main();
+
+	if (dirstack) free(dirstack);
+	if (gopt_exclude_marker) free((void*)gopt_exclude_marker);
+	if (gopt_pathmatch) pm_destroy(gopt_pathmatch);
+	if (gopt_subtree) free(gopt_subtree);
+
+	return retcode;
+    }
+
     /* initialize red-black trees */
 
-    g_filelist = rb_create(rbtree_string_cmp, rbtree_string_free, rbtree_fileinfo_free, NULL, NULL);
+    g_arena = arena_create(0);
 
-    g_filedigestmap = rb_create(rbtree_digest_result_cmp, rbtree_digest_result_free, rbtree_null_free, NULL, NULL);
+    g_dirtree = dt_create(g_arena);
+
+    g_filelist = rb_create(rbtree_dt_key_cmp, NULL, NULL, NULL, NULL);
+    rb_set_arena(g_filelist, g_arena);
+
+    g_fileextra = rb_create(rbtree_pointer_cmp, NULL, NULL, NULL, NULL);
+    rb_set_arena(g_fileextra, g_arena);
 
     /* read digest file if it exists */
 
     if (!read_digestfile())
 	return -1;
 
-    /* recursively scan current directory */
+    if (!g_filehash) /* no digest file loaded */
+	g_filehash = hi_create_custom(0, dt_key_hash, dt_key_equal);
+
+    /* records of new files get room for exactly this digest size */
+    g_digestsize = digesttype_size(gopt_digesttype);
+
+#if HAVE_SYS_INOTIFY_H
+    if (gopt_watch)
+    {
+	g_inotify_fd = inotify_init();
+
+	if (g_inotify_fd < 0)
+	{
+	    fprintf(stderr, "%s: could not initialize inotify: %s\n",
+		    g_progname, strerror(errno));
+	    return -1;
+	}
+
+	fcntl(g_inotify_fd, F_SETFL, fcntl(g_inotify_fd, F_GETFL) | O_NONBLOCK);
+    }
+#endif
+
+    /* recursively scan current directory or only the subtree, or
+     * process only the externally listed changes */
+
+    if (gopt_changedfrom)
+    {
+	if (!changed_scan(gopt_changedfrom))
+	    return -1;
+    }
+    else
+    {
+	start_scan(gopt_subtree ? gopt_subtree : ".");
+    }
 
-    start_scan(".");
+    resolve_moved();
+    inodeindex_clear();
 
     if (filelist_deleted() != 0 || !gopt_onlymodified)
     {
@@ -2671,6 +8017,11 @@ int main(int argc, char* argv[])
 	    cmd_write();
 	}
 
+#if HAVE_SYS_INOTIFY_H
+	if (gopt_watch)
+	    watch_tree();
+#endif
+
 	if (filelist_clean())
 	    retcode = 0;
 	else
@@ -2723,13 +8074,38 @@ int main(int argc, char* argv[])
 	}
     }
 
+    hi_destroy(g_filehash);
+    dt_destroy(g_dirtree);
     rb_destroy(g_filelist);
-    rb_destroy(g_filedigestmap);
+    free(g_digestindex);
+    rb_destroy(g_fileextra);
+    arena_destroy(g_arena);
 
     if (dirstack) free(dirstack);
 
+#if HAVE_SYS_INOTIFY_H
+    if (g_inotify_fd >= 0)
+    {
+	int wd;
+
+	for (wd = 0; wd < g_watchdirs_max; ++wd) {
+	    if (g_watchdirs[wd]) free(g_watchdirs[wd]);
+	}
+
+	free(g_watchdirs);
+	close(g_inotify_fd);
+    }
+#endif
+
     if (gopt_exclude_marker) free((void*)gopt_exclude_marker);
 
+    if (gopt_pathmatch) pm_destroy(gopt_pathmatch);
+
+    if (gopt_subtree) free(gopt_subtree);
+
+    if (g_digestcache) dc_close(g_digestcache);
+    if (gopt_cachefile) free(gopt_cachefile);
+
     return retcode;
 }
 
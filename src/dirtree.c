@@ -0,0 +1,284 @@
+/*****************************************************************************
+ * Interned directory tree for compact storage of file paths.                *
+ *                                                                           *
+ * Copyright (C) 2010-2020 Timo Bingmann                                     *
+ *                                                                           *
+ * This program is free software; you can redistribute it and/or modify it   *
+ * under the terms of the GNU General Public License as published by the     *
+ * Free Software Foundation; either version 3, or (at your option) any       *
+ * later version.                                                            *
+ *                                                                           *
+ * This program is distributed in the hope that it will be useful,           *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+ * GNU General Public License for more details.                              *
+ *                                                                           *
+ * You should have received a copy of the GNU General Public License         *
+ * along with this program; if not, write to the Free Software Foundation,   *
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.        *
+ *****************************************************************************/
+
+#include "dirtree.h"
+#include "arena.h"
+#include "hashindex.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct dirtree
+{
+    struct arena*	arena;
+    struct hashindex*	dirs;		/* directory path -> dt_dir */
+    struct dt_dir*	root;
+
+    char*		scratch;	/* terminated copy of a lookup path */
+    size_t		scratchlen;
+};
+
+struct dirtree *dt_create(struct arena *arena)
+{
+    struct dirtree *dt = malloc(sizeof(struct dirtree));
+
+    dt->arena = arena;
+    dt->dirs = hi_create(0);
+    dt->scratch = NULL;
+    dt->scratchlen = 0;
+
+    dt->root = arena_calloc(arena, sizeof(struct dt_dir));
+    dt->root->path = dt->root->name = "";
+    hi_insert(dt->dirs, dt->root->path, dt->root);
+
+    return dt;
+}
+
+const struct dt_dir *dt_root(const struct dirtree *dt)
+{
+    return dt->root;
+}
+
+/**
+ * Find the node of the directory path with len characters, and create
+ * it and all missing parents if requested.
+ */
+static struct dt_dir *dt_get_dir(struct dirtree *dt, const char *path,
+				 size_t len, int create)
+{
+    struct dt_dir *dir;
+    const char *slash;
+
+    if (dt->scratchlen < len + 1)
+    {
+	dt->scratchlen = 2 * (len + 1);
+	dt->scratch = realloc(dt->scratch, dt->scratchlen);
+    }
+
+    memcpy(dt->scratch, path, len);
+    dt->scratch[len] = 0;
+
+    dir = hi_find(dt->dirs, dt->scratch);
+    if (dir || !create) return dir;
+
+    dir = arena_alloc(dt->arena, sizeof(struct dt_dir));
+    dir->path = arena_strndup(dt->arena, path, len);
+    dir->pathlen = len;
+
+    for (slash = dir->path + len; slash != dir->path && slash[-1] != '/'; --slash) ;
+
+    if (slash == dir->path)
+    {
+	dir->parent = dt->root;
+	dir->name = dir->path;
+    }
+    else
+    {
+	/* recursion uses the path copy, as scratch is overwritten */
+	dir->parent = dt_get_dir(dt, dir->path, slash - 1 - dir->path, 1);
+	dir->name = slash;
+    }
+
+    hi_insert(dt->dirs, dir->path, dir);
+
+    return dir;
+}
+
+const struct dt_dir *dt_find_dir(struct dirtree *dt, const char *path)
+{
+    return dt_get_dir(dt, path, strlen(path), 0);
+}
+
+struct dt_key *dt_intern(struct dirtree *dt, const char *path)
+{
+    return dt_intern_n(dt, path, strlen(path));
+}
+
+struct dt_key *dt_intern_n(struct dirtree *dt, const char *path, size_t len)
+{
+    const char *name = path + len;
+    size_t namelen;
+    struct dt_key *key;
+    char *keyname;
+
+    while (name != path && name[-1] != '/') --name;
+    namelen = path + len - name;
+
+    /* the name is stored directly behind the key */
+    key = arena_alloc(dt->arena, sizeof(struct dt_key) + namelen + 1);
+    key->dir = (name == path) ? dt->root : dt_get_dir(dt, path, name - 1 - path, 1);
+    keyname = (char*)(key + 1);
+    memcpy(keyname, name, namelen);
+    keyname[namelen] = 0;
+    key->name = keyname;
+
+    return key;
+}
+
+int dt_lookup(struct dirtree *dt, const char *path, struct dt_key *key)
+{
+    const char *name = strrchr(path, '/');
+
+    if (name == NULL)
+    {
+	key->dir = dt->root;
+	key->name = path;
+	return 1;
+    }
+
+    key->dir = dt_get_dir(dt, path, name - path, 0);
+    key->name = name + 1;
+
+    return key->dir != NULL;
+}
+
+/**
+ * Iterates over the characters of a key's full path, which consists of
+ * up to three segments: the directory path, a slash and the name.
+ */
+struct dt_iter
+{
+    const char*		p;
+    const struct dt_key* key;
+    int			seg;
+};
+
+static void dt_iter_init(struct dt_iter *it, const struct dt_key *key)
+{
+    it->p = key->dir->path;
+    it->key = key;
+    it->seg = 0;
+}
+
+static unsigned char dt_iter_next(struct dt_iter *it)
+{
+    while (*it->p == 0)
+    {
+	if (it->seg == 0)
+	{
+	    /* search key with NULL name: '0' is the character after '/' */
+	    if (it->key->name == NULL)
+		it->p = "0";
+	    else
+		it->p = it->key->dir->pathlen ? "/" : "";
+	}
+	else if (it->seg == 1 && it->key->name)
+	    it->p = it->key->name;
+	else
+	    return 0;
+
+	++it->seg;
+    }
+
+    return *it->p++;
+}
+
+int dt_key_cmp(const struct dt_key *a, const struct dt_key *b)
+{
+    struct dt_iter ia, ib;
+    unsigned char ca, cb;
+
+    if (a->dir == b->dir && a->name && b->name)
+	return strcmp(a->name, b->name);
+
+    /* keys below the top directory sort after all others */
+    if (!a->name && a->dir->pathlen == 0)
+	return (!b->name && b->dir->pathlen == 0) ? 0 : 1;
+    if (!b->name && b->dir->pathlen == 0)
+	return -1;
+
+    dt_iter_init(&ia, a);
+    dt_iter_init(&ib, b);
+
+    do {
+	ca = dt_iter_next(&ia);
+	cb = dt_iter_next(&ib);
+    } while (ca == cb && ca != 0);
+
+    return (int)ca - (int)cb;
+}
+
+uint64_t dt_key_hash(const void *key)
+{
+    const struct dt_key *k = key;
+    const unsigned char *p = (const unsigned char*)k->name;
+
+    /* directory nodes are unique, hence their address is hashed */
+    uint64_t h = 14695981039346656037ULL ^ (uint64_t)(uintptr_t)k->dir;
+
+    while (*p)
+    {
+	h ^= *p++;
+	h *= 1099511628211ULL;
+    }
+
+    return h;
+}
+
+int dt_key_equal(const void *a, const void *b)
+{
+    const struct dt_key *ka = a, *kb = b;
+
+    return ka->dir == kb->dir && strcmp(ka->name, kb->name) == 0;
+}
+
+size_t dt_key_length(const struct dt_key *key)
+{
+    return key->dir->pathlen + (key->dir->pathlen ? 1 : 0) + strlen(key->name);
+}
+
+char *dt_key_path(const struct dt_key *key, char *buf)
+{
+    char *p = buf;
+
+    if (key->dir->pathlen)
+    {
+	memcpy(p, key->dir->path, key->dir->pathlen);
+	p += key->dir->pathlen;
+	*p++ = '/';
+    }
+
+    strcpy(p, key->name);
+
+    return buf;
+}
+
+int dt_within(const struct dt_dir *dir, const struct dt_dir *ancestor)
+{
+    while (dir && dir != ancestor)
+	dir = dir->parent;
+
+    return dir != NULL;
+}
+
+size_t dt_size(const struct dirtree *dt)
+{
+    return hi_size(dt->dirs);
+}
+
+void dt_destroy(struct dirtree *dt)
+{
+    hi_destroy(dt->dirs);
+    free(dt->scratch);
+    free(dt);
+}
+
+/*****************************************************************************/
@@ -0,0 +1,140 @@
+/*****************************************************************************
+ * Interned directory tree for compact storage of file paths.                *
+ *                                                                           *
+ * Copyright (C) 2010-2020 Timo Bingmann                                     *
+ *                                                                           *
+ * This program is free software; you can redistribute it and/or modify it   *
+ * under the terms of the GNU General Public License as published by the     *
+ * Free Software Foundation; either version 3, or (at your option) any       *
+ * later version.                                                            *
+ *                                                                           *
+ * This program is distributed in the hope that it will be useful,           *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+ * GNU General Public License for more details.                              *
+ *                                                                           *
+ * You should have received a copy of the GNU General Public License         *
+ * along with this program; if not, write to the Free Software Foundation,   *
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.        *
+ *****************************************************************************/
+
+#ifndef _DIRTREE_H
+#define _DIRTREE_H 1
+
+#include <stddef.h>
+#include <inttypes.h>
+
+struct arena;
+
+/**
+ * The directory tree stores each directory path only once: a file path
+ * is kept as a key consisting of its directory node and the file name.
+ * Paths of large archives share long directory prefixes, hence this is
+ * much smaller than storing the full path of each file. Directory nodes
+ * are never removed, all memory is allocated from an arena.
+ *
+ * The full path of a key is "dir/name", or just "name" in the top
+ * directory, which has the empty path. Keys are ordered as strcmp()
+ * orders their full paths, hence all entries below a directory form
+ * one range in an ordered container.
+ */
+
+/** a directory node, parent is NULL for the top directory */
+struct dt_dir
+{
+    const struct dt_dir*	parent;
+    const char*			path;	/* full path of the directory */
+    const char*			name;	/* last component within path */
+    size_t			pathlen;
+};
+
+/**
+ * A file path key. A key with name NULL is a search key, which sorts
+ * directly after all keys below dir.
+ */
+struct dt_key
+{
+    const struct dt_dir*	dir;
+    const char*			name;
+};
+
+/** opaque structure declaration */
+struct dirtree;
+
+/**
+ * Create a new directory tree containing only the top directory. Nodes
+ * and keys are allocated from the arena.
+ */
+struct dirtree *dt_create(struct arena *arena);
+
+/**
+ * Returns the node of the top directory.
+ */
+const struct dt_dir *dt_root(const struct dirtree *dt);
+
+/**
+ * Find the node of a directory path. Returns NULL if no file was ever
+ * interned below it.
+ */
+const struct dt_dir *dt_find_dir(struct dirtree *dt, const char *path);
+
+/**
+ * Return a new key for a file path, which is allocated from the arena.
+ * The directory nodes of the path are created as needed.
+ */
+struct dt_key *dt_intern(struct dirtree *dt, const char *path);
+
+/**
+ * Same as dt_intern() for the first len characters of path, which need
+ * not be NUL-terminated.
+ */
+struct dt_key *dt_intern_n(struct dirtree *dt, const char *path, size_t len);
+
+/**
+ * Fill in a key for a file path without allocating anything. The name
+ * points into path. Returns 0 if the directory is not in the tree, hence
+ * the file cannot be either.
+ */
+int dt_lookup(struct dirtree *dt, const char *path, struct dt_key *key);
+
+/**
+ * Compare the full paths of two keys like strcmp().
+ */
+int dt_key_cmp(const struct dt_key *a, const struct dt_key *b);
+
+/**
+ * Hash and equality functions of keys, for hi_create_custom().
+ */
+uint64_t dt_key_hash(const void *key);
+int dt_key_equal(const void *a, const void *b);
+
+/**
+ * Returns the length of the full path of a key.
+ */
+size_t dt_key_length(const struct dt_key *key);
+
+/**
+ * Write the full path of a key into buf, which must hold
+ * dt_key_length() + 1 characters. Returns buf.
+ */
+char *dt_key_path(const struct dt_key *key, char *buf);
+
+/**
+ * Returns nonzero if dir equals ancestor or lies below it.
+ */
+int dt_within(const struct dt_dir *dir, const struct dt_dir *ancestor);
+
+/**
+ * Returns the number of directory nodes.
+ */
+size_t dt_size(const struct dirtree *dt);
+
+/**
+ * Destroy the directory tree. The nodes and keys in the arena are not
+ * released.
+ */
+void dt_destroy(struct dirtree *dt);
+
+#endif /* _DIRTREE_H */
+
+/*****************************************************************************/
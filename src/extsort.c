@@ -0,0 +1,442 @@
+/*****************************************************************************
+ * External merge sort of variable-length records using temporary files.     *
+ *                                                                           *
+ * Copyright (C) 2010-2020 Timo Bingmann                                     *
+ *                                                                           *
+ * This program is free software; you can redistribute it and/or modify it   *
+ * under the terms of the GNU General Public License as published by the     *
+ * Free Software Foundation; either version 3, or (at your option) any       *
+ * later version.                                                            *
+ *                                                                           *
+ * This program is distributed in the hope that it will be useful,           *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+ * GNU General Public License for more details.                              *
+ *                                                                           *
+ * You should have received a copy of the GNU General Public License         *
+ * along with this program; if not, write to the Free Software Foundation,   *
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.        *
+ *****************************************************************************/
+
+#include "extsort.h"
+#include "psort.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* records in the buffer and their lengths are aligned to this */
+#define ES_ALIGN	8
+
+/* maximum number of runs merged at once, limited by open files */
+#define ES_MAXMERGE	128
+
+#define ES_PAD(x)	(((x) + ES_ALIGN - 1) & ~(size_t)(ES_ALIGN - 1))
+
+/** one run being read back */
+struct es_reader
+{
+    FILE*		fp;
+    char*		rec;	/* current record */
+    size_t		len;	/* record length plus one, zero at end of run */
+    size_t		max;	/* allocated size of rec */
+};
+
+/** k-way merge of runs using a binary heap of reader indexes */
+struct es_merge
+{
+    struct es_reader*	rd;
+    size_t*		heap;
+    size_t		k, heapsize;
+    int			last;	/* top was returned and must be advanced */
+};
+
+struct extsort
+{
+    size_t		memlimit;
+    int			(*compar)(const void *a, const void *b);
+
+    char*		buf;	/* records: length followed by data */
+    size_t		buflen, bufmax;
+    size_t*		offs;	/* offsets of records in buf */
+    size_t		n, nmax;
+    const char**	ptrs;	/* sorted record pointers */
+
+    FILE**		runs;
+    size_t		nruns, runsmax;
+    size_t		nspilled;	/* runs written from the buffer */
+
+    size_t		count;
+    size_t		pos;	/* next record if all fit into memory */
+    struct es_merge	merge;
+};
+
+static void es_fail(const char *what)
+{
+    fprintf(stderr, "extsort: could not %s temporary file: %s\n",
+	    what, strerror(errno));
+    exit(-1);
+}
+
+/**
+ * Create a temporary file, which is deleted once closed.
+ */
+static FILE *es_tmpfile(void)
+{
+#if ON_WIN32
+    FILE *fp = tmpfile();
+#else
+    const char *dir = getenv("TMPDIR");
+    char *path;
+    int fd;
+    FILE *fp = NULL;
+
+    if (!dir || !*dir) dir = "/tmp";
+
+    path = malloc(strlen(dir) + 32);
+    sprintf(path, "%s/extsort.XXXXXX", dir);
+
+    if ((fd = mkstemp(path)) >= 0)
+    {
+	unlink(path);
+	fp = fdopen(fd, "w+b");
+    }
+
+    free(path);
+#endif
+
+    if (fp == NULL)
+	es_fail("create");
+
+    return fp;
+}
+
+struct extsort *es_create(size_t memlimit,
+			  int (*compar)(const void *a, const void *b))
+{
+    struct extsort *es = calloc(1, sizeof(struct extsort));
+
+    es->memlimit = memlimit;
+    es->compar = compar;
+
+    return es;
+}
+
+/* comparison function of the current sort, as qsort() passes no context */
+static int (*es_compar)(const void *a, const void *b);
+
+static int es_ptrcmp(const void *a, const void *b)
+{
+    return es_compar(*(const char* const*)a, *(const char* const*)b);
+}
+
+/**
+ * Sort the buffered records into es->ptrs.
+ */
+static void es_sort(struct extsort *es)
+{
+    size_t i;
+
+    es->ptrs = realloc(es->ptrs, sizeof(char*) * (es->n ? es->n : 1));
+
+    for (i = 0; i < es->n; ++i)
+	es->ptrs[i] = es->buf + es->offs[i] + ES_ALIGN;
+
+    es_compar = es->compar;
+    psort(es->ptrs, es->n, sizeof(char*), es_ptrcmp, 0);
+}
+
+static void es_write(FILE *fp, const void *data, size_t len)
+{
+    if (fwrite(data, 1, len, fp) != len)
+	es_fail("write");
+}
+
+static void es_addrun(struct extsort *es, FILE *fp)
+{
+    if (es->nruns >= es->runsmax)
+    {
+	es->runsmax = es->runsmax ? 2 * es->runsmax : 16;
+	es->runs = realloc(es->runs, sizeof(FILE*) * es->runsmax);
+    }
+
+    if (fflush(fp) != 0 || fseek(fp, 0, SEEK_SET) != 0)
+	es_fail("rewind");
+
+    es->runs[es->nruns++] = fp;
+}
+
+/**
+ * Sort the buffered records and write them as a new run.
+ */
+static void es_spill(struct extsort *es)
+{
+    FILE *fp = es_tmpfile();
+    size_t i;
+
+    es_sort(es);
+
+    for (i = 0; i < es->n; ++i)
+    {
+	const size_t *len = (const size_t*)(es->ptrs[i] - ES_ALIGN);
+
+	es_write(fp, len, sizeof(size_t));
+	es_write(fp, es->ptrs[i], *len);
+    }
+
+    es_addrun(es, fp);
+
+    ++es->nspilled;
+    es->n = es->buflen = 0;
+}
+
+void es_add(struct extsort *es, const void *rec, size_t len)
+{
+    size_t need = ES_ALIGN + ES_PAD(len);
+    size_t used = es->buflen + es->n * (sizeof(size_t) + sizeof(char*));
+
+    if (es->n > 0 && used + need > es->memlimit)
+	es_spill(es);
+
+    if (es->buflen + need > es->bufmax)
+    {
+	es->bufmax = es->bufmax ? 2 * es->bufmax : 65536;
+	while (es->buflen + need > es->bufmax) es->bufmax *= 2;
+	es->buf = realloc(es->buf, es->bufmax);
+    }
+
+    if (es->n >= es->nmax)
+    {
+	es->nmax = es->nmax ? 2 * es->nmax : 1024;
+	es->offs = realloc(es->offs, sizeof(size_t) * es->nmax);
+    }
+
+    es->offs[es->n++] = es->buflen;
+    *(size_t*)(es->buf + es->buflen) = len;
+    memcpy(es->buf + es->buflen + ES_ALIGN, rec, len);
+    es->buflen += need;
+
+    ++es->count;
+}
+
+
+/**
+ * Read the next record of a run into the reader, or mark the end of the
+ * run.
+ */
+static void es_read(struct es_reader *rd)
+{
+    size_t len;
+
+    if (fread(&len, sizeof(size_t), 1, rd->fp) != 1)
+    {
+	if (ferror(rd->fp)) es_fail("read");
+	rd->len = 0;
+	return;
+    }
+
+    if (len > rd->max || rd->rec == NULL)
+    {
+	rd->max = len > 256 ? len : 256;
+	free(rd->rec);
+	rd->rec = malloc(rd->max);
+    }
+
+    if (len && fread(rd->rec, 1, len, rd->fp) != len)
+	es_fail("read");
+
+    rd->len = len + 1;
+}
+
+static int es_less(struct es_merge *m, int (*compar)(const void*, const void*),
+		   size_t a, size_t b)
+{
+    int r = compar(m->rd[a].rec, m->rd[b].rec);
+    return (r < 0 || (r == 0 && a < b));
+}
+
+static void es_siftdown(struct es_merge *m,
+			int (*compar)(const void*, const void*), size_t i)
+{
+    while (1)
+    {
+	size_t c = 2 * i + 1, t;
+
+	if (c >= m->heapsize) break;
+
+	if (c + 1 < m->heapsize && es_less(m, compar, m->heap[c+1], m->heap[c]))
+	    ++c;
+
+	if (!es_less(m, compar, m->heap[c], m->heap[i])) break;
+
+	t = m->heap[c]; m->heap[c] = m->heap[i]; m->heap[i] = t;
+	i = c;
+    }
+}
+
+/**
+ * Start merging k runs, which are owned by the merge afterwards.
+ */
+static void es_merge_init(struct es_merge *m,
+			  int (*compar)(const void*, const void*),
+			  FILE **runs, size_t k)
+{
+    size_t i;
+
+    m->k = k;
+    m->rd = calloc(k, sizeof(struct es_reader));
+    m->heap = malloc(sizeof(size_t) * k);
+    m->heapsize = 0;
+    m->last = 0;
+
+    for (i = 0; i < k; ++i)
+    {
+	m->rd[i].fp = runs[i];
+	es_read(&m->rd[i]);
+
+	if (m->rd[i].len)
+	    m->heap[m->heapsize++] = i;
+    }
+
+    for (i = m->heapsize / 2; i-- > 0; )
+	es_siftdown(m, compar, i);
+}
+
+static const void *es_merge_next(struct es_merge *m,
+				 int (*compar)(const void*, const void*),
+				 size_t *len)
+{
+    struct es_reader *rd;
+
+    if (m->last && m->heapsize)
+    {
+	/* advance the run whose record was returned last */
+
+	es_read(&m->rd[m->heap[0]]);
+
+	if (m->rd[m->heap[0]].len == 0)
+	    m->heap[0] = m->heap[--m->heapsize];
+
+	es_siftdown(m, compar, 0);
+    }
+
+    if (m->heapsize == 0) return NULL;
+
+    m->last = 1;
+    rd = &m->rd[m->heap[0]];
+
+    if (len) *len = rd->len - 1;
+    return rd->rec;
+}
+
+static void es_merge_free(struct es_merge *m)
+{
+    size_t i;
+
+    for (i = 0; i < m->k; ++i)
+    {
+	fclose(m->rd[i].fp);
+	free(m->rd[i].rec);
+    }
+
+    free(m->rd);
+    free(m->heap);
+
+    memset(m, 0, sizeof(*m));
+}
+
+void es_finish(struct extsort *es)
+{
+    if (es->nruns == 0)
+    {
+	/* all records fit into memory, return them directly */
+
+	es_sort(es);
+	es->pos = 0;
+	return;
+    }
+
+    if (es->n) es_spill(es);
+
+    free(es->buf), es->buf = NULL;
+    free(es->offs), es->offs = NULL;
+    free(es->ptrs), es->ptrs = NULL;
+    es->bufmax = es->nmax = 0;
+
+    /* reduce the number of runs by intermediate merge passes */
+
+    while (es->nruns > ES_MAXMERGE)
+    {
+	size_t i, j = 0;
+
+	for (i = 0; i < es->nruns; i += ES_MAXMERGE)
+	{
+	    size_t k = es->nruns - i < ES_MAXMERGE ? es->nruns - i : ES_MAXMERGE;
+	    FILE *fp = es_tmpfile();
+	    const void *rec;
+	    size_t len;
+
+	    es_merge_init(&es->merge, es->compar, es->runs + i, k);
+
+	    while ((rec = es_merge_next(&es->merge, es->compar, &len)))
+	    {
+		es_write(fp, &len, sizeof(size_t));
+		es_write(fp, rec, len);
+	    }
+
+	    es_merge_free(&es->merge);
+
+	    if (fflush(fp) != 0 || fseek(fp, 0, SEEK_SET) != 0)
+		es_fail("rewind");
+
+	    es->runs[j++] = fp;
+	}
+
+	es->nruns = j;
+    }
+
+    es_merge_init(&es->merge, es->compar, es->runs, es->nruns);
+    es->nruns = 0;
+}
+
+const void *es_next(struct extsort *es, size_t *len)
+{
+    if (es->merge.rd)
+	return es_merge_next(&es->merge, es->compar, len);
+
+    if (es->pos >= es->n) return NULL;
+
+    if (len) *len = *(const size_t*)(es->ptrs[es->pos] - ES_ALIGN);
+    return es->ptrs[es->pos++];
+}
+
+size_t es_count(const struct extsort *es)
+{
+    return es->count;
+}
+
+size_t es_runs(const struct extsort *es)
+{
+    return es->nspilled;
+}
+
+void es_destroy(struct extsort *es)
+{
+    size_t i;
+
+    if (es->merge.rd)
+	es_merge_free(&es->merge);
+
+    for (i = 0; i < es->nruns; ++i)
+	fclose(es->runs[i]);
+
+    free(es->runs);
+    free(es->buf);
+    free(es->offs);
+    free(es->ptrs);
+    free(es);
+}
+
+/*****************************************************************************/
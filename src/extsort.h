@@ -0,0 +1,81 @@
+/*****************************************************************************
+ * External merge sort of variable-length records using temporary files.     *
+ *                                                                           *
+ * Copyright (C) 2010-2020 Timo Bingmann                                     *
+ *                                                                           *
+ * This program is free software; you can redistribute it and/or modify it   *
+ * under the terms of the GNU General Public License as published by the     *
+ * Free Software Foundation; either version 3, or (at your option) any       *
+ * later version.                                                            *
+ *                                                                           *
+ * This program is distributed in the hope that it will be useful,           *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+ * GNU General Public License for more details.                              *
+ *                                                                           *
+ * You should have received a copy of the GNU General Public License         *
+ * along with this program; if not, write to the Free Software Foundation,   *
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.        *
+ *****************************************************************************/
+
+#ifndef _EXTSORT_H
+#define _EXTSORT_H 1
+
+#include <stddef.h>
+
+/**
+ * The external sorter orders more records than fit into memory. Records
+ * are collected in a buffer of limited size, which is sorted and
+ * written to a temporary file as one run whenever it is full. The runs
+ * are then combined by a k-way merge while the records are read back in
+ * order. If all records fit into the buffer, no file is written at all.
+ *
+ * Records are opaque byte strings, which are stored aligned for any
+ * basic type. Temporary files are created in $TMPDIR or /tmp and are
+ * removed immediately. I/O errors terminate the program.
+ */
+
+/** opaque structure declaration */
+struct extsort;
+
+/**
+ * Create a new sorter, which uses about memlimit bytes to buffer
+ * records. The comparison function orders two records.
+ */
+struct extsort *es_create(size_t memlimit,
+			  int (*compar)(const void *a, const void *b));
+
+/**
+ * Add a record of len bytes, which is copied.
+ */
+void es_add(struct extsort *es, const void *rec, size_t len);
+
+/**
+ * Finish adding records and prepare reading them in order.
+ */
+void es_finish(struct extsort *es);
+
+/**
+ * Return the next record in order and its length, or NULL after the
+ * last one. The record stays valid until the next call.
+ */
+const void *es_next(struct extsort *es, size_t *len);
+
+/**
+ * Returns the number of records added.
+ */
+size_t es_count(const struct extsort *es);
+
+/**
+ * Returns the number of runs written to temporary files.
+ */
+size_t es_runs(const struct extsort *es);
+
+/**
+ * Destroy the sorter and close all temporary files.
+ */
+void es_destroy(struct extsort *es);
+
+#endif /* _EXTSORT_H */
+
+/*****************************************************************************/
@@ -0,0 +1,179 @@
+/*****************************************************************************
+ * Open-addressing hash index from path strings or other keys to pointers.   *
+ *                                                                           *
+ * Copyright (C) 2010-2020 Timo Bingmann                                     *
+ *                                                                           *
+ * This program is free software; you can redistribute it and/or modify it   *
+ * under the terms of the GNU General Public License as published by the     *
+ * Free Software Foundation; either version 3, or (at your option) any       *
+ * later version.                                                            *
+ *                                                                           *
+ * This program is distributed in the hope that it will be useful,           *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+ * GNU General Public License for more details.                              *
+ *                                                                           *
+ * You should have received a copy of the GNU General Public License         *
+ * along with this program; if not, write to the Free Software Foundation,   *
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.        *
+ *****************************************************************************/
+
+#include "hashindex.h"
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct hi_slot
+{
+    uint64_t		hash;
+    const void*		key;	/* NULL for an empty slot */
+    void*		value;
+};
+
+struct hashindex
+{
+    struct hi_slot*	slots;
+    size_t		mask;	/* number of slots minus one */
+    size_t		size;
+
+    uint64_t		(*hash)(const void *key);
+    int			(*equal)(const void *a, const void *b);
+};
+
+/* maximum fill ratio of the table is 7/10 */
+#define HI_FULL(n,slots)	((n) * 10 > (slots) * 7)
+
+/**
+ * 64-bit FNV-1a hash of a string.
+ */
+static uint64_t hi_hash_string(const void *key)
+{
+    const unsigned char *p = key;
+    uint64_t h = 14695981039346656037ULL;
+
+    while (*p)
+    {
+	h ^= *p++;
+	h *= 1099511628211ULL;
+    }
+
+    return h;
+}
+
+static int hi_equal_string(const void *a, const void *b)
+{
+    return strcmp(a, b) == 0;
+}
+
+static void hi_alloc(struct hashindex *hi, size_t capacity)
+{
+    size_t n = 16;
+
+    while (HI_FULL(capacity, n)) n *= 2;
+
+    hi->slots = calloc(n, sizeof(struct hi_slot));
+    hi->mask = n - 1;
+}
+
+/**
+ * Double the number of slots and reinsert all keys.
+ */
+static void hi_grow(struct hashindex *hi)
+{
+    struct hi_slot *old = hi->slots;
+    size_t i, oldn = hi->mask + 1;
+
+    hi_alloc(hi, oldn);
+
+    for (i = 0; i < oldn; ++i)
+    {
+	size_t j;
+
+	if (!old[i].key) continue;
+
+	for (j = old[i].hash & hi->mask; hi->slots[j].key; j = (j + 1) & hi->mask) ;
+
+	hi->slots[j] = old[i];
+    }
+
+    free(old);
+}
+
+struct hashindex *hi_create(size_t capacity)
+{
+    return hi_create_custom(capacity, hi_hash_string, hi_equal_string);
+}
+
+struct hashindex *hi_create_custom(size_t capacity,
+				   uint64_t (*hash)(const void *key),
+				   int (*equal)(const void *a, const void *b))
+{
+    struct hashindex *hi = malloc(sizeof(struct hashindex));
+
+    hi_alloc(hi, capacity);
+    hi->size = 0;
+    hi->hash = hash;
+    hi->equal = equal;
+
+    return hi;
+}
+
+void hi_insert(struct hashindex *hi, const void *key, void *value)
+{
+    uint64_t h = hi->hash(key);
+    size_t i;
+
+    for (i = h & hi->mask; hi->slots[i].key; i = (i + 1) & hi->mask)
+    {
+	if (hi->slots[i].hash == h && hi->equal(hi->slots[i].key, key))
+	{
+	    hi->slots[i].key = key;
+	    hi->slots[i].value = value;
+	    return;
+	}
+    }
+
+    if (HI_FULL(hi->size + 1, hi->mask + 1))
+    {
+	hi_grow(hi);
+	for (i = h & hi->mask; hi->slots[i].key; i = (i + 1) & hi->mask) ;
+    }
+
+    hi->slots[i].hash = h;
+    hi->slots[i].key = key;
+    hi->slots[i].value = value;
+    ++hi->size;
+}
+
+void *hi_find(const struct hashindex *hi, const void *key)
+{
+    uint64_t h = hi->hash(key);
+    size_t i;
+
+    for (i = h & hi->mask; hi->slots[i].key; i = (i + 1) & hi->mask)
+    {
+	if (hi->slots[i].hash == h && hi->equal(hi->slots[i].key, key))
+	    return hi->slots[i].value;
+    }
+
+    return NULL;
+}
+
+size_t hi_size(const struct hashindex *hi)
+{
+    return hi->size;
+}
+
+size_t hi_memory(const struct hashindex *hi)
+{
+    return sizeof(struct hashindex) + (hi->mask + 1) * sizeof(struct hi_slot);
+}
+
+void hi_destroy(struct hashindex *hi)
+{
+    free(hi->slots);
+    free(hi);
+}
+
+/*****************************************************************************/
@@ -0,0 +1,83 @@
+/*****************************************************************************
+ * Open-addressing hash index from path strings or other keys to pointers.   *
+ *                                                                           *
+ * Copyright (C) 2010-2020 Timo Bingmann                                     *
+ *                                                                           *
+ * This program is free software; you can redistribute it and/or modify it   *
+ * under the terms of the GNU General Public License as published by the     *
+ * Free Software Foundation; either version 3, or (at your option) any       *
+ * later version.                                                            *
+ *                                                                           *
+ * This program is distributed in the hope that it will be useful,           *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+ * GNU General Public License for more details.                              *
+ *                                                                           *
+ * You should have received a copy of the GNU General Public License         *
+ * along with this program; if not, write to the Free Software Foundation,   *
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.        *
+ *****************************************************************************/
+
+#ifndef _HASHINDEX_H
+#define _HASHINDEX_H 1
+
+#include <stddef.h>
+#include <inttypes.h>
+
+/**
+ * The hash index maps string keys to opaque pointers for fast point
+ * lookups. It uses open addressing with linear probing in one flat
+ * array of slots, each holding the full hash value, such that most
+ * probes are decided without comparing strings. The key strings are
+ * not copied: they must stay valid as long as they are in the index.
+ * Entries cannot be removed. Other key types can be indexed by passing
+ * hash and equality functions to hi_create_custom().
+ */
+
+/** opaque structure declaration */
+struct hashindex;
+
+/**
+ * Create a new empty hash index, which is sized to hold capacity keys
+ * without growing.
+ */
+struct hashindex *hi_create(size_t capacity);
+
+/**
+ * Create a new empty hash index for keys of another type, which are
+ * hashed and compared by the given functions. The equality function
+ * returns nonzero if the keys are equal.
+ */
+struct hashindex *hi_create_custom(size_t capacity,
+				   uint64_t (*hash)(const void *key),
+				   int (*equal)(const void *a, const void *b));
+
+/**
+ * Insert a key into the index. If the key already exists, its value is
+ * replaced.
+ */
+void hi_insert(struct hashindex *hi, const void *key, void *value);
+
+/**
+ * Find the value of a key. Returns NULL if the key is not contained.
+ */
+void *hi_find(const struct hashindex *hi, const void *key);
+
+/**
+ * Returns the number of keys in the index.
+ */
+size_t hi_size(const struct hashindex *hi);
+
+/**
+ * Returns the number of bytes allocated for the index and its slots.
+ */
+size_t hi_memory(const struct hashindex *hi);
+
+/**
+ * Destroy the hash index. Keys and values are not touched.
+ */
+void hi_destroy(struct hashindex *hi);
+
+#endif /* _HASHINDEX_H */
+
+/*****************************************************************************/
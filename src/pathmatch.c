@@ -0,0 +1,543 @@
+/*****************************************************************************
+ * Compiled include/exclude glob pattern matcher for relative file paths.    *
+ *                                                                           *
+ * Copyright (C) 2010-2020 Timo Bingmann                                     *
+ *                                                                           *
+ * This program is free software; you can redistribute it and/or modify it   *
+ * under the terms of the GNU General Public License as published by the     *
+ * Free Software Foundation; either version 3, or (at your option) any       *
+ * later version.                                                            *
+ *                                                                           *
+ * This program is distributed in the hope that it will be useful,           *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+ * GNU General Public License for more details.                              *
+ *                                                                           *
+ * You should have received a copy of the GNU General Public License         *
+ * along with this program; if not, write to the Free Software Foundation,   *
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.        *
+ *****************************************************************************/
+
+#include "pathmatch.h"
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+/**
+ * Node types of the automaton. Each node consumes one character and
+ * passes on to the next node, except for the star types, which may
+ * also consume nothing or loop on themselves.
+ */
+enum pm_type
+{
+    PMT_CHAR,		/* exactly the character ch */
+    PMT_ANY,		/* '?': any character except '/' */
+    PMT_CLASS,		/* '[...]': any character in class except '/' */
+    PMT_STAR,		/* '*': any sequence not containing '/' */
+    PMT_DSTAR,		/* '**': any sequence */
+    PMT_DSTARSLASH,	/* '**' + '/': empty or any sequence ending with '/' */
+    PMT_ACCEPT		/* end of a pattern */
+};
+
+/* flags of accepting nodes */
+#define PMF_INCLUDE	1
+#define PMF_DIRONLY	2
+
+struct pm_node
+{
+    unsigned char	type;
+    unsigned char	ch;	/* character or accept flags */
+    unsigned char*	cls;	/* 256-bit character class */
+};
+
+/**
+ * The matcher holds the automaton nodes of all patterns, the bit sets
+ * used to test states and scratch space for state calculation.
+ */
+struct pathmatch
+{
+    struct pm_node*	nodes;
+    unsigned int	size, capacity;
+
+    int			has_include;
+
+    unsigned int	words;
+    pm_state*		bits;	/* allocation for all bit sets below */
+
+    pm_state		*start;
+    pm_state		*incl_states, *incl_accept, *incl_accept_file;
+    pm_state		*excl_accept, *excl_accept_file;
+    pm_state		*scratch1, *scratch2, *scratch3, *scratch4;
+};
+
+#define PM_BITS		(sizeof(pm_state) * CHAR_BIT)
+
+#define PM_TEST(s,i)	((s)[(i) / PM_BITS] & (1UL << ((i) % PM_BITS)))
+#define PM_SET(s,i)	((s)[(i) / PM_BITS] |= (1UL << ((i) % PM_BITS)))
+
+/**
+ * Create a new empty matcher object.
+ */
+struct pathmatch *pm_create(void)
+{
+    struct pathmatch *pm = malloc(sizeof(struct pathmatch));
+    if (pm == NULL) return NULL;
+
+    memset(pm, 0, sizeof(struct pathmatch));
+
+    return pm;
+}
+
+/**
+ * Internal function to append a node to the automaton.
+ */
+static struct pm_node *pm_push(struct pathmatch *pm, int type, int ch)
+{
+    struct pm_node *node;
+
+    if (pm->size >= pm->capacity)
+    {
+	pm->capacity *= 2;
+	if (pm->capacity < 16) pm->capacity = 16;
+
+	pm->nodes = realloc(pm->nodes, sizeof(struct pm_node) * pm->capacity);
+    }
+
+    node = &pm->nodes[pm->size++];
+    node->type = type;
+    node->ch = ch;
+    node->cls = NULL;
+
+    return node;
+}
+
+/**
+ * Internal function to recalculate the bit sets after a pattern was
+ * added.
+ */
+static void pm_rebuild(struct pathmatch *pm)
+{
+    unsigned int i, begin = 0;
+
+    pm->words = (pm->size + PM_BITS - 1) / PM_BITS;
+
+    free(pm->bits);
+    pm->bits = calloc(10 * pm->words, sizeof(pm_state));
+
+    pm->start = pm->bits;
+    pm->incl_states = pm->bits + 1 * pm->words;
+    pm->incl_accept = pm->bits + 2 * pm->words;
+    pm->incl_accept_file = pm->bits + 3 * pm->words;
+    pm->excl_accept = pm->bits + 4 * pm->words;
+    pm->excl_accept_file = pm->bits + 5 * pm->words;
+    pm->scratch1 = pm->bits + 6 * pm->words;
+    pm->scratch2 = pm->bits + 7 * pm->words;
+    pm->scratch3 = pm->bits + 8 * pm->words;
+    pm->scratch4 = pm->bits + 9 * pm->words;
+
+    for (i = 0; i < pm->size; ++i)
+    {
+	if (pm->nodes[i].type != PMT_ACCEPT) continue;
+
+	/* nodes [begin,i] form one pattern */
+	PM_SET(pm->start, begin);
+
+	if (pm->nodes[i].ch & PMF_INCLUDE)
+	{
+	    unsigned int j;
+	    for (j = begin; j < i; ++j)
+		PM_SET(pm->incl_states, j);
+
+	    PM_SET(pm->incl_accept, i);
+	    if (!(pm->nodes[i].ch & PMF_DIRONLY))
+		PM_SET(pm->incl_accept_file, i);
+	}
+	else
+	{
+	    PM_SET(pm->excl_accept, i);
+	    if (!(pm->nodes[i].ch & PMF_DIRONLY))
+		PM_SET(pm->excl_accept_file, i);
+	}
+
+	begin = i + 1;
+    }
+}
+
+/**
+ * Compile a glob pattern and add it to the matcher as include pattern
+ * if include is true, otherwise as exclude pattern. Returns 0 if the
+ * pattern has a syntax error.
+ */
+int pm_add(struct pathmatch *pm, const char *pattern, int include)
+{
+    unsigned int oldsize = pm->size;
+    size_t len = strlen(pattern), i;
+    int flags = include ? PMF_INCLUDE : 0;
+
+    /* trailing slash: match only directories */
+    if (len > 0 && pattern[len-1] == '/')
+    {
+	flags |= PMF_DIRONLY;
+	--len;
+    }
+
+    if (len == 0) return 0;
+
+    /* every path is matched with a leading slash */
+    pm_push(pm, PMT_CHAR, '/');
+
+    if (memchr(pattern, '/', len) == NULL)
+    {
+	/* match file name in any directory */
+	pm_push(pm, PMT_DSTARSLASH, 0);
+    }
+    else if (pattern[0] == '/')
+    {
+	++pattern, --len;
+    }
+
+    for (i = 0; i < len; ++i)
+    {
+	if (pattern[i] == '*')
+	{
+	    if (i + 1 < len && pattern[i+1] == '*')
+	    {
+		++i;
+		while (i + 1 < len && pattern[i+1] == '*') ++i;
+
+		if (i + 1 < len && pattern[i+1] == '/') {
+		    ++i;
+		    pm_push(pm, PMT_DSTARSLASH, 0);
+		}
+		else {
+		    pm_push(pm, PMT_DSTAR, 0);
+		}
+	    }
+	    else
+	    {
+		pm_push(pm, PMT_STAR, 0);
+	    }
+	}
+	else if (pattern[i] == '?')
+	{
+	    pm_push(pm, PMT_ANY, 0);
+	}
+	else if (pattern[i] == '[')
+	{
+	    struct pm_node *node = pm_push(pm, PMT_CLASS, 0);
+	    size_t j = i + 1;
+	    int negate = 0, c;
+
+	    if (j < len && (pattern[j] == '!' || pattern[j] == '^'))
+	    {
+		negate = 1;
+		++j;
+	    }
+
+	    node->cls = calloc(32, 1);
+
+	    /* a closing bracket as first character is literal */
+	    if (j < len && pattern[j] == ']')
+	    {
+		node->cls[']' / 8] |= 1 << (']' % 8);
+		++j;
+	    }
+
+	    while (j < len && pattern[j] != ']')
+	    {
+		unsigned char lo = pattern[j], hi = lo;
+
+		if (j + 2 < len && pattern[j+1] == '-' && pattern[j+2] != ']')
+		{
+		    hi = pattern[j+2];
+		    j += 2;
+		}
+
+		for (c = lo; c <= hi; ++c)
+		    node->cls[c / 8] |= 1 << (c % 8);
+
+		++j;
+	    }
+
+	    if (j >= len) goto error; /* unterminated class */
+
+	    if (negate)
+	    {
+		for (c = 0; c < 32; ++c)
+		    node->cls[c] = ~node->cls[c];
+	    }
+
+	    i = j;
+	}
+	else if (pattern[i] == '\\')
+	{
+	    if (++i >= len) goto error;
+	    pm_push(pm, PMT_CHAR, (unsigned char)pattern[i]);
+	}
+	else
+	{
+	    pm_push(pm, PMT_CHAR, (unsigned char)pattern[i]);
+	}
+    }
+
+    pm_push(pm, PMT_ACCEPT, flags);
+
+    if (include) pm->has_include = 1;
+
+    pm_rebuild(pm);
+    return 1;
+
+error:
+    while (pm->size > oldsize)
+	free(pm->nodes[--pm->size].cls);
+
+    return 0;
+}
+
+/**
+ * Returns true if any include patterns were added.
+ */
+int pm_has_include(const struct pathmatch *pm)
+{
+    return pm->has_include;
+}
+
+/**
+ * Returns the number of pm_state words needed to hold a state.
+ */
+unsigned int pm_state_words(const struct pathmatch *pm)
+{
+    return pm->words ? pm->words : 1;
+}
+
+/**
+ * Internal function to add all nodes reachable without consuming a
+ * character. Star nodes always point to the following node, so one
+ * ascending pass suffices.
+ */
+static void pm_closure(const struct pathmatch *pm, pm_state *state)
+{
+    unsigned int i;
+
+    for (i = 0; i < pm->size; ++i)
+    {
+	if (!PM_TEST(state, i)) continue;
+
+	switch (pm->nodes[i].type)
+	{
+	case PMT_STAR:
+	case PMT_DSTAR:
+	case PMT_DSTARSLASH:
+	    PM_SET(state, i + 1);
+	    break;
+	}
+    }
+}
+
+/**
+ * Internal function to advance the automaton over one character from
+ * state in to state out.
+ */
+static void pm_step(const struct pathmatch *pm, const pm_state *in,
+		    unsigned char c, pm_state *out)
+{
+    unsigned int w, i;
+
+    memset(out, 0, pm->words * sizeof(pm_state));
+
+    for (w = 0; w < pm->words; ++w)
+    {
+	pm_state bits = in[w];
+
+	while (bits)
+	{
+	    const struct pm_node *node;
+
+	    /* find lowest set bit */
+	    i = 0;
+	    while (!(bits & (1UL << i))) ++i;
+	    bits &= ~(1UL << i);
+
+	    i += w * PM_BITS;
+	    node = &pm->nodes[i];
+
+	    switch (node->type)
+	    {
+	    case PMT_CHAR:
+		if (node->ch == c) PM_SET(out, i + 1);
+		break;
+	    case PMT_ANY:
+		if (c != '/') PM_SET(out, i + 1);
+		break;
+	    case PMT_CLASS:
+		if (c != '/' && (node->cls[c / 8] & (1 << (c % 8))))
+		    PM_SET(out, i + 1);
+		break;
+	    case PMT_STAR:
+		if (c != '/') PM_SET(out, i);
+		break;
+	    case PMT_DSTAR:
+		PM_SET(out, i);
+		break;
+	    case PMT_DSTARSLASH:
+		PM_SET(out, i);
+		if (c == '/') PM_SET(out, i + 1);
+		break;
+	    case PMT_ACCEPT:
+		break;
+	    }
+	}
+    }
+
+    pm_closure(pm, out);
+}
+
+/**
+ * Internal function returning true if the two states intersect.
+ */
+static int pm_intersect(const struct pathmatch *pm,
+			const pm_state *a, const pm_state *b)
+{
+    unsigned int w;
+
+    for (w = 0; w < pm->words; ++w) {
+	if (a[w] & b[w]) return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * Initialize the state of the top directory.
+ */
+void pm_root(const struct pathmatch *pm, pm_state *state)
+{
+    if (pm->words == 0) {
+	state[0] = 0;
+	return;
+    }
+
+    memcpy(state, pm->start, pm->words * sizeof(pm_state));
+    pm_closure(pm, state);
+}
+
+/**
+ * Internal version of pm_enter() with a name of given length.
+ */
+static void pm_enter_len(struct pathmatch *pm, const pm_state *parent,
+			 const char *name, size_t len, pm_state *state)
+{
+    pm_state *cur = pm->scratch1, *next = pm->scratch2, *tmp;
+    size_t i;
+
+    if (pm->words == 0) {
+	state[0] = 0;
+	return;
+    }
+
+    pm_step(pm, parent, '/', cur);
+
+    for (i = 0; i < len; ++i)
+    {
+	pm_step(pm, cur, (unsigned char)name[i], next);
+	tmp = cur, cur = next, next = tmp;
+    }
+
+    memcpy(state, cur, pm->words * sizeof(pm_state));
+}
+
+/**
+ * Calculate the state of a file or directory name within the directory
+ * of the parent state.
+ */
+void pm_enter(struct pathmatch *pm, const pm_state *parent,
+	      const char *name, pm_state *state)
+{
+    pm_enter_len(pm, parent, name, strlen(name), state);
+}
+
+/**
+ * Classify the path of a state as file or directory, returns a
+ * combination of PM_EXCLUDED, PM_INCLUDED and PM_PARTIAL.
+ */
+int pm_classify(struct pathmatch *pm, const pm_state *state, int isdir)
+{
+    int r = 0;
+
+    if (pm->words == 0) return 0;
+
+    if (pm_intersect(pm, state, isdir ? pm->excl_accept : pm->excl_accept_file))
+	r |= PM_EXCLUDED;
+
+    if (pm_intersect(pm, state, isdir ? pm->incl_accept : pm->incl_accept_file))
+	r |= PM_INCLUDED;
+
+    if (isdir && pm->has_include)
+    {
+	pm_step(pm, state, '/', pm->scratch1);
+
+	if (pm_intersect(pm, pm->scratch1, pm->incl_states))
+	    r |= PM_PARTIAL;
+    }
+
+    return r;
+}
+
+/**
+ * Test a complete relative file path (of a regular file or symlink)
+ * against the patterns. Returns true if the file is selected: neither
+ * it nor any parent directory is excluded, and if include patterns
+ * exist, it or a parent directory is included.
+ */
+int pm_match_path(struct pathmatch *pm, const char *path)
+{
+    pm_state *cur = pm->scratch3, *next = pm->scratch4, *tmp;
+    int included = 0;
+
+    if (pm->words == 0) return 1;
+
+    pm_root(pm, cur);
+
+    while (1)
+    {
+	const char *slash = strchr(path, '/');
+	size_t len = slash ? (size_t)(slash - path) : strlen(path);
+	int r;
+
+	pm_enter_len(pm, cur, path, len, next);
+	tmp = cur, cur = next, next = tmp;
+
+	r = pm_classify(pm, cur, slash != NULL);
+
+	if (r & PM_EXCLUDED) return 0;
+	if (r & PM_INCLUDED) included = 1;
+
+	if (slash == NULL) break;
+
+	if (pm->has_include && !included && !(r & PM_PARTIAL))
+	    return 0;
+
+	path = slash + 1;
+    }
+
+    return !pm->has_include || included;
+}
+
+/**
+ * Destroy the matcher object.
+ */
+void pm_destroy(struct pathmatch *pm)
+{
+    unsigned int i;
+
+    for (i = 0; i < pm->size; ++i)
+	free(pm->nodes[i].cls);
+
+    free(pm->nodes);
+    free(pm->bits);
+    free(pm);
+}
+
+/*****************************************************************************/
@@ -0,0 +1,109 @@
+/*****************************************************************************
+ * Compiled include/exclude glob pattern matcher for relative file paths.    *
+ *                                                                           *
+ * Copyright (C) 2010-2020 Timo Bingmann                                     *
+ *                                                                           *
+ * This program is free software; you can redistribute it and/or modify it   *
+ * under the terms of the GNU General Public License as published by the     *
+ * Free Software Foundation; either version 3, or (at your option) any       *
+ * later version.                                                            *
+ *                                                                           *
+ * This program is distributed in the hope that it will be useful,           *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+ * GNU General Public License for more details.                              *
+ *                                                                           *
+ * You should have received a copy of the GNU General Public License         *
+ * along with this program; if not, write to the Free Software Foundation,   *
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.        *
+ *****************************************************************************/
+
+#ifndef _PATHMATCH_H
+#define _PATHMATCH_H 1
+
+/**
+ * All include and exclude patterns are compiled into one
+ * non-deterministic automaton, which is simulated using a bit set of
+ * active states. Paths are fed into it one component at a time, such
+ * that a recursive directory scan only has to advance the parent
+ * directory's state over each new file name.
+ *
+ * Pattern syntax is similar to .gitignore files: "*" and "?" match any
+ * characters except a slash, "[a-z]" and "[!a-z]" are character
+ * classes and "**" matches across slashes. Patterns without a slash
+ * match the file name in any directory, others are anchored at the top
+ * directory. A trailing slash restricts the pattern to directories. A
+ * matching directory applies to all files below it.
+ *
+ * The matcher uses internal scratch space and is not reentrant.
+ */
+
+/** opaque structure declaration */
+struct pathmatch;
+
+/** bit set of active automaton states */
+typedef unsigned long pm_state;
+
+/** result flags of pm_classify() */
+enum {
+    PM_EXCLUDED = 1,	/* path matches an exclude pattern */
+    PM_INCLUDED = 2,	/* path matches an include pattern */
+    PM_PARTIAL = 4	/* include patterns may match paths below */
+};
+
+/**
+ * Create a new empty matcher object.
+ */
+struct pathmatch *pm_create(void);
+
+/**
+ * Compile a glob pattern and add it to the matcher as include pattern
+ * if include is true, otherwise as exclude pattern. Returns 0 if the
+ * pattern has a syntax error.
+ */
+int pm_add(struct pathmatch *pm, const char *pattern, int include);
+
+/**
+ * Returns true if any include patterns were added.
+ */
+int pm_has_include(const struct pathmatch *pm);
+
+/**
+ * Returns the number of pm_state words needed to hold a state.
+ */
+unsigned int pm_state_words(const struct pathmatch *pm);
+
+/**
+ * Initialize the state of the top directory.
+ */
+void pm_root(const struct pathmatch *pm, pm_state *state);
+
+/**
+ * Calculate the state of a file or directory name within the directory
+ * of the parent state.
+ */
+void pm_enter(struct pathmatch *pm, const pm_state *parent,
+	      const char *name, pm_state *state);
+
+/**
+ * Classify the path of a state as file or directory, returns a
+ * combination of PM_EXCLUDED, PM_INCLUDED and PM_PARTIAL.
+ */
+int pm_classify(struct pathmatch *pm, const pm_state *state, int isdir);
+
+/**
+ * Test a complete relative file path (of a regular file or symlink)
+ * against the patterns. Returns true if the file is selected: neither
+ * it nor any parent directory is excluded, and if include patterns
+ * exist, it or a parent directory is included.
+ */
+int pm_match_path(struct pathmatch *pm, const char *path);
+
+/**
+ * Destroy the matcher object.
+ */
+void pm_destroy(struct pathmatch *pm);
+
+#endif /* _PATHMATCH_H */
+
+/*****************************************************************************/
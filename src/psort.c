@@ -0,0 +1,212 @@
+/*****************************************************************************
+ * Parallel merge sort for large arrays using POSIX threads.                 *
+ *                                                                           *
+ * Copyright (C) 2010-2020 Timo Bingmann                                     *
+ *                                                                           *
+ * This program is free software; you can redistribute it and/or modify it   *
+ * under the terms of the GNU General Public License as published by the     *
+ * Free Software Foundation; either version 3, or (at your option) any       *
+ * later version.                                                            *
+ *                                                                           *
+ * This program is distributed in the hope that it will be useful,           *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+ * GNU General Public License for more details.                              *
+ *                                                                           *
+ * You should have received a copy of the GNU General Public License         *
+ * along with this program; if not, write to the Free Software Foundation,   *
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.        *
+ *****************************************************************************/
+
+#include "psort.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#if HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
+/* arrays smaller than this are not worth starting threads */
+#define PSORT_MIN	65536
+
+unsigned int psort_ncpus(void)
+{
+#ifdef _SC_NPROCESSORS_ONLN
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    if (n > 0) return (unsigned int)n;
+#endif
+    return 1;
+}
+
+#if HAVE_PTHREAD_H
+
+/**
+ * Job of one thread: either sort the run [lo,mid) or merge the two
+ * runs [lo,mid) and [mid,hi) from src into dst.
+ */
+struct psort_job
+{
+    const char		*src;
+    char		*dst;
+    size_t		lo, mid, hi;
+    size_t		size;
+    int			(*compar)(const void *, const void *);
+    pthread_t		thread;
+};
+
+static void *psort_sort_thread(void *arg)
+{
+    struct psort_job *job = arg;
+
+    qsort(job->dst + job->lo * job->size, job->mid - job->lo,
+	  job->size, job->compar);
+
+    return NULL;
+}
+
+static void *psort_merge_thread(void *arg)
+{
+    struct psort_job *job = arg;
+    size_t size = job->size;
+
+    const char *a = job->src + job->lo * size, *aend = job->src + job->mid * size;
+    const char *b = aend, *bend = job->src + job->hi * size;
+    char *out = job->dst + job->lo * size;
+
+    while (a < aend && b < bend)
+    {
+	if (job->compar(b, a) < 0) {
+	    memcpy(out, b, size);
+	    b += size;
+	}
+	else {
+	    memcpy(out, a, size);
+	    a += size;
+	}
+	out += size;
+    }
+
+    memcpy(out, a, aend - a);
+    out += aend - a;
+    memcpy(out, b, bend - b);
+
+    return NULL;
+}
+
+void psort(void *base, size_t num, size_t size,
+	   int (*compar)(const void *, const void *),
+	   unsigned int threads)
+{
+    struct psort_job *jobs;
+    size_t *bounds;
+    char *src = base, *dst, *tmp;
+    unsigned int i, runs;
+
+    if (threads == 0)
+	threads = psort_ncpus();
+
+    if (threads <= 1 || num < PSORT_MIN)
+    {
+	qsort(base, num, size, compar);
+	return;
+    }
+
+    if ((tmp = malloc(num * size)) == NULL)
+    {
+	qsort(base, num, size, compar);
+	return;
+    }
+
+    jobs = malloc(sizeof(struct psort_job) * threads);
+    bounds = malloc(sizeof(size_t) * (threads + 1));
+
+    /* sort one chunk per thread in place */
+
+    for (i = 0; i <= threads; ++i)
+	bounds[i] = num / threads * i + (i < num % threads ? i : num % threads);
+
+    for (i = 0; i < threads; ++i)
+    {
+	jobs[i].dst = base;
+	jobs[i].lo = bounds[i];
+	jobs[i].mid = bounds[i+1];
+	jobs[i].size = size;
+	jobs[i].compar = compar;
+
+	if (pthread_create(&jobs[i].thread, NULL, psort_sort_thread, &jobs[i]) != 0)
+	{
+	    /* run in this thread instead and mark as joined */
+	    psort_sort_thread(&jobs[i]);
+	    jobs[i].compar = NULL;
+	}
+    }
+
+    for (i = 0; i < threads; ++i)
+    {
+	if (jobs[i].compar) pthread_join(jobs[i].thread, NULL);
+    }
+
+    /* merge adjacent runs pairwise until only one is left */
+
+    dst = tmp;
+
+    for (runs = threads; runs > 1; runs = (runs + 1) / 2)
+    {
+	unsigned int j = 0;
+
+	for (i = 0; i < runs; i += 2, ++j)
+	{
+	    jobs[j].src = src;
+	    jobs[j].dst = dst;
+	    jobs[j].lo = bounds[i];
+	    jobs[j].mid = bounds[i+1];
+	    jobs[j].hi = (i + 1 < runs) ? bounds[i+2] : bounds[i+1];
+	    jobs[j].size = size;
+	    jobs[j].compar = compar;
+
+	    if (pthread_create(&jobs[j].thread, NULL, psort_merge_thread, &jobs[j]) != 0)
+	    {
+		psort_merge_thread(&jobs[j]);
+		jobs[j].compar = NULL;
+	    }
+	}
+
+	for (i = 0; i < j; ++i)
+	{
+	    if (jobs[i].compar) pthread_join(jobs[i].thread, NULL);
+	    bounds[i] = jobs[i].lo;
+	}
+	bounds[j] = num;
+
+	tmp = src, src = dst, dst = tmp;
+    }
+
+    if (src != (char*)base)
+    {
+	memcpy(base, src, num * size);
+	free(src);
+    }
+    else
+    {
+	free(dst);
+    }
+
+    free(bounds);
+    free(jobs);
+}
+
+#else /* !HAVE_PTHREAD_H */
+
+void psort(void *base, size_t num, size_t size,
+	   int (*compar)(const void *, const void *),
+	   unsigned int threads)
+{
+    (void)threads;
+    qsort(base, num, size, compar);
+}
+
+#endif
+
+/*****************************************************************************/
@@ -0,0 +1,44 @@
+/*****************************************************************************
+ * Parallel merge sort for large arrays using POSIX threads.                 *
+ *                                                                           *
+ * Copyright (C) 2010-2020 Timo Bingmann                                     *
+ *                                                                           *
+ * This program is free software; you can redistribute it and/or modify it   *
+ * under the terms of the GNU General Public License as published by the     *
+ * Free Software Foundation; either version 3, or (at your option) any       *
+ * later version.                                                            *
+ *                                                                           *
+ * This program is distributed in the hope that it will be useful,           *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+ * GNU General Public License for more details.                              *
+ *                                                                           *
+ * You should have received a copy of the GNU General Public License         *
+ * along with this program; if not, write to the Free Software Foundation,   *
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.        *
+ *****************************************************************************/
+
+#ifndef _PSORT_H
+#define _PSORT_H 1
+
+#include <stddef.h>
+
+/**
+ * Sort an array like qsort(). Large arrays are split into one chunk
+ * per thread, which are sorted by qsort() concurrently and then merged
+ * pairwise in parallel rounds. The merge is stable with regard to the
+ * chunks. If threads is zero, the number of online processors is used.
+ * Without thread support this is plain qsort().
+ */
+void psort(void *base, size_t num, size_t size,
+	   int (*compar)(const void *, const void *),
+	   unsigned int threads);
+
+/**
+ * Returns the number of online processors, or 1 if unknown.
+ */
+unsigned int psort_ncpus(void);
+
+#endif /* _PSORT_H */
+
+/*****************************************************************************/
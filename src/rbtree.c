@@ -27,6 +27,7 @@
  *****************************************************************************/
 
 #include "rbtree.h"
+#include "arena.h"
 
 #include <stdlib.h>
 #include <assert.h>
@@ -39,8 +40,10 @@
  * - compare_keys(a,b) should return >0 if *a > *b, <0 if *a < *b, and
  *   0 otherwise.
  * - destroy_xyz(a) takes a pointer to either key or value object and
- *   must free it accordingly.
+ *   must free it accordingly. They may be NULL if nothing is owned.
  * - print_xyz(a) is used by rb_print() to dump the tree.
+ * - arena, if set, provides the nodes, which are then never freed
+ *   individually.
  */
 struct rb_tree
 {
@@ -51,6 +54,7 @@ struct rb_tree
     void (*print_value)(const void *a);
     struct rb_node *root, *nil;
     unsigned int size;
+    struct arena *arena;
 };
 
 /**
@@ -75,6 +79,7 @@ struct rb_tree *rb_create(int (*compare_keys_func)(const void*, const void*),
     tree->print_key = print_key_func;
     tree->print_value = print_value_func;
     tree->size = 0;
+    tree->arena = NULL;
 
     /* initialize nil and root nodes */
     temp = tree->nil = (struct rb_node*)malloc(sizeof(struct rb_node));
@@ -90,6 +95,38 @@ struct rb_tree *rb_create(int (*compare_keys_func)(const void*, const void*),
     return tree;
 }
 
+/**
+ * Take the nodes of the tree from an arena. Must be called while the
+ * tree is empty.
+ */
+void rb_set_arena(struct rb_tree *tree, struct arena *arena)
+{
+    assert(rb_isempty(tree));
+    tree->arena = arena;
+}
+
+/* allocate a new node from the arena or by malloc() */
+static struct rb_node *rb_newnode(struct rb_tree *tree)
+{
+    if (tree->arena)
+	return arena_alloc(tree->arena, sizeof(struct rb_node));
+
+    return (struct rb_node*)malloc(sizeof(struct rb_node));
+}
+
+/* free a node unless it is arena memory */
+static void rb_freenode(struct rb_tree *tree, struct rb_node *x)
+{
+    if (!tree->arena) free(x);
+}
+
+/* call the destroy callbacks, which are optional */
+static void rb_destroy_pair(struct rb_tree *tree, struct rb_node *x)
+{
+    if (tree->destroy_key) tree->destroy_key(x->key);
+    if (tree->destroy_value) tree->destroy_value(x->value);
+}
+
 /**
  * Returns true if the tree is empty.
  */
@@ -227,7 +264,7 @@ struct rb_node *rb_insert(struct rb_tree *tree, void *key, void *value)
 {
     struct rb_node *x, *y, *newnode;
 
-    x = (struct rb_node*)malloc(sizeof(struct rb_node));
+    x = rb_newnode(tree);
     x->key = key;
     x->value = value;
 
@@ -292,6 +329,64 @@ struct rb_node *rb_insert(struct rb_tree *tree, void *key, void *value)
     return newnode;
 }
 
+/**
+ * Internal function used by rb_build_sorted(). Builds a balanced
+ * subtree of n nodes below parent, fetching the keys in-order. All
+ * nodes at depth reddepth, the only incomplete level, are colored red.
+ */
+static struct rb_node *rb_build_helper(struct rb_tree *tree, unsigned int n,
+				       unsigned int depth, unsigned int reddepth,
+				       struct rb_node *parent,
+				       void (*next)(void *cookie, void **key, void **value),
+				       void *cookie)
+{
+    struct rb_node *x;
+    unsigned int nleft;
+
+    if (n == 0) return tree->nil;
+
+    nleft = (n - 1) / 2;
+
+    x = rb_newnode(tree);
+    x->parent = parent;
+    x->red = (depth == reddepth);
+
+    x->left = rb_build_helper(tree, nleft, depth + 1, reddepth, x, next, cookie);
+    next(cookie, &x->key, &x->value);
+    x->right = rb_build_helper(tree, n - 1 - nleft, depth + 1, reddepth, x, next, cookie);
+
+    return x;
+}
+
+/**
+ * Build the tree in linear time from n key, value pairs in sorted
+ * order, which are fetched by calling next() n times. Splitting each
+ * range at the middle yields a tree whose levels are complete except
+ * for the deepest one, hence coloring only that level red satisfies
+ * all invariants without any rotations. Returns 0 if the tree was not
+ * empty.
+ */
+int rb_build_sorted(struct rb_tree *tree, unsigned int n,
+		    void (*next)(void *cookie, void **key, void **value),
+		    void *cookie)
+{
+    unsigned int full = 0;
+
+    if (!rb_isempty(tree)) return 0;
+
+    /* number of complete levels: floor(log2(n+1)) */
+    while ((2u << full) - 1 <= n && full < 31) ++full;
+
+    tree->root->left = rb_build_helper(tree, n, 0, full, tree->root, next, cookie);
+    tree->size = n;
+
+#ifdef RBTREE_VERIFY
+    assert(rb_verify(tree));
+#endif
+
+    return 1;
+}
+
 /**
  * Return the successor node of x in the tree or tree->nil if there is
  * none.
@@ -357,9 +452,8 @@ static void rb_destroy_helper(struct rb_tree *tree, struct rb_node *x)
     {
 	rb_destroy_helper(tree, x->left);
 	rb_destroy_helper(tree, x->right);
-	tree->destroy_key(x->key);
-	tree->destroy_value(x->value);
-	free(x);
+	rb_destroy_pair(tree, x);
+	rb_freenode(tree, x);
     }
 }
 
@@ -369,7 +463,10 @@ static void rb_destroy_helper(struct rb_tree *tree, struct rb_node *x)
  */
 void rb_destroy(struct rb_tree *tree)
 {
-    rb_destroy_helper(tree, tree->root->left);
+    /* arena nodes without objects to destroy need no traversal */
+    if (!tree->arena || tree->destroy_key || tree->destroy_value)
+	rb_destroy_helper(tree, tree->root->left);
+
     free(tree->root);
     free(tree->nil);
     free(tree);
@@ -456,6 +553,31 @@ struct rb_node *rb_find(struct rb_tree *tree, const void *key)
     return x;
 }
 
+/**
+ * Find the first node whose key is not less than the given key. If
+ * all keys in the tree are smaller, the nil node is returned. Similar
+ * to STL's lower_bound().
+ */
+struct rb_node *rb_lower_bound(struct rb_tree *tree, const void *key)
+{
+    struct rb_node *x = tree->root->left;
+    struct rb_node *nil = tree->nil;
+    struct rb_node *y = nil;
+
+    while (x != nil)
+    {
+	if (tree->compare_keys(x->key, key) >= 0) { /* x->key >= q */
+	    y = x;
+	    x = x->left;
+	}
+	else {
+	    x = x->right;
+	}
+    }
+
+    return y;
+}
+
 /**
  * Internal function to rebalance the tree after a node is deleted.
  */
@@ -557,8 +679,7 @@ void rb_delete(struct rb_tree *tree, struct rb_node *z)
 
 	if (!(y->red)) rb_delete_fixup(tree, x);
   
-	tree->destroy_key(z->key);
-	tree->destroy_value(z->value);
+	rb_destroy_pair(tree, z);
 
 	y->left = z->left;
 	y->right = z->right;
@@ -572,15 +693,14 @@ void rb_delete(struct rb_tree *tree, struct rb_node *z)
 	else {
 	    z->parent->right = y;
 	}
-	free(z); 
+	rb_freenode(tree, z);
     }
     else
     {
-	tree->destroy_key(y->key);
-	tree->destroy_value(y->value);
+	rb_destroy_pair(tree, y);
 
 	if (!(y->red)) rb_delete_fixup(tree, x);
-	free(y);
+	rb_freenode(tree, y);
     }
   
     --tree->size;
@@ -42,6 +42,9 @@ struct rb_node
 /** opaque structure declaration */
 struct rb_tree;
 
+/** arena allocator declared in arena.h */
+struct arena;
+
 /**
  * Create a new red-black tree object. Function pointers to all
  * necessary callbacks must be provided. Returns a new tree object.
@@ -49,7 +52,7 @@ struct rb_tree;
  * - compare_keys(a,b) should return >0 if *a > *b, <0 if *a < *b, and
  *   0 otherwise.
  * - destroy_xyz(a) takes a pointer to either key or value object and
- *   must free it accordingly.
+ *   must free it accordingly. They may be NULL if nothing is owned.
  * - print_xyz(a) is used by rb_print() to dump the tree.
  */
 struct rb_tree *rb_create(int (*compare_keys_func)(const void*, const void*),
@@ -58,6 +61,14 @@ struct rb_tree *rb_create(int (*compare_keys_func)(const void*, const void*),
 			  void (*print_key_func)(const void*),
 			  void (*print_value_func)(const void*));
 
+/**
+ * Allocate all nodes of the tree from the arena, which must outlive
+ * it. Nodes are then released with the arena, and if no destroy
+ * callbacks are set, rb_destroy() does not traverse the tree. Must be
+ * called while the tree is empty.
+ */
+void rb_set_arena(struct rb_tree *tree, struct arena *arena);
+
 /**
  * Returns true if the tree is empty.
  */
@@ -85,6 +96,16 @@ struct rb_node *rb_end(struct rb_tree *tree);
  */
 struct rb_node *rb_insert(struct rb_tree *tree, void *key, void *value);
 
+/**
+ * Build the tree in linear time from n key, value pairs in sorted
+ * order, taking ownership of them. The pairs are fetched in-order by
+ * calling next(cookie, &key, &value) n times. The tree must be empty,
+ * returns 0 otherwise.
+ */
+int rb_build_sorted(struct rb_tree *tree, unsigned int n,
+		    void (*next)(void *cookie, void **key, void **value),
+		    void *cookie);
+
 /**
  * Return the successor node of x in the tree or tree->nil if there is
  * none.
@@ -115,6 +136,13 @@ void rb_print(struct rb_tree *tree);
  */
 struct rb_node *rb_find(struct rb_tree *tree, const void *key);
 
+/**
+ * Find the first node whose key is not less than the given key. If
+ * all keys in the tree are smaller, the nil node is returned. Similar
+ * to STL's lower_bound().
+ */
+struct rb_node *rb_lower_bound(struct rb_tree *tree, const void *key);
+
 /**
  * Delete a node from the tree and rebalance it.
  */
@@ -0,0 +1,393 @@
+/*****************************************************************************
+ * Binary sidecar index of a digest file, mapped instead of parsing it       *
+ *                                                                           *
+ * Copyright (C) 2010-2020 Timo Bingmann                                     *
+ *                                                                           *
+ * This program is free software; you can redistribute it and/or modify it   *
+ * under the terms of the GNU General Public License as published by the     *
+ * Free Software Foundation; either version 3, or (at your option) any       *
+ * later version.                                                            *
+ *                                                                           *
+ * This program is distributed in the hope that it will be useful,           *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+ * GNU General Public License for more details.                              *
+ *                                                                           *
+ * You should have received a copy of the GNU General Public License         *
+ * along with this program; if not, write to the Free Software Foundation,   *
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.        *
+ *****************************************************************************/
+
+#include "sumindex.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if !ON_WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static const char si_magic[8] = { 'd', 'i', 'g', 'u', 'p', 'i', 'x', '1' };
+
+/* written in native byte order, read back only by the same order */
+#define SI_BYTEORDER	0x01020304
+
+/** file header, followed by the records and the string pool */
+struct si_header
+{
+    char		magic[8];
+    uint32_t		byteorder;
+    uint32_t		type;
+    uint32_t		digestsize;
+    uint32_t		headerlines;
+    struct si_stamp	stamp;
+    uint64_t		count;
+    uint64_t		poolsize;
+};
+
+struct si_writer
+{
+    FILE*		fp;
+    char*		path;
+    char*		tmppath;
+    struct si_header	header;
+    size_t		stride;
+    unsigned char*	record;		/* buffer of stride bytes */
+    char*		pool;
+    size_t		poolmax;
+};
+
+struct sumindex
+{
+    void*		map;
+    size_t		mapsize;
+    const struct si_header* header;
+    const unsigned char* records;
+    const char*		pool;
+    size_t		stride;
+};
+
+/* size of a record including its digest, keeping records aligned */
+static size_t si_stride(unsigned int digestsize)
+{
+    return sizeof(struct si_record) + ((digestsize + 7) & ~7u);
+}
+
+#if !ON_WIN32
+
+struct si_writer *si_create(const char *path, uint32_t type,
+			    unsigned int digestsize, unsigned int headerlines)
+{
+    struct si_writer *w = calloc(1, sizeof(struct si_writer));
+
+    w->path = strdup(path);
+    w->tmppath = malloc(strlen(path) + 5);
+    strcpy(w->tmppath, path);
+    strcat(w->tmppath, ".tmp");
+
+    if ((w->fp = fopen(w->tmppath, "wb")) == NULL)
+    {
+	int err = errno;
+	free(w->tmppath);
+	free(w->path);
+	free(w);
+	errno = err;
+	return NULL;
+    }
+
+    memcpy(w->header.magic, si_magic, sizeof(w->header.magic));
+    w->header.byteorder = SI_BYTEORDER;
+    w->header.type = type;
+    w->header.digestsize = digestsize;
+    w->header.headerlines = headerlines;
+
+    w->stride = si_stride(digestsize);
+    w->record = calloc(1, w->stride);
+
+    /* the header is written last, once the counts are known */
+    fwrite(&w->header, sizeof(w->header), 1, w->fp);
+
+    return w;
+}
+
+/* append a string including its NUL to the pool, returns its offset */
+static uint64_t si_pool_add(struct si_writer *w, const char *str, size_t len)
+{
+    uint64_t offset = w->header.poolsize;
+
+    while (w->header.poolsize + len + 1 > w->poolmax)
+    {
+	w->poolmax = w->poolmax ? 2 * w->poolmax : 4096;
+	w->pool = realloc(w->pool, w->poolmax);
+    }
+
+    memcpy(w->pool + offset, str, len);
+    w->pool[offset + len] = 0;
+    w->header.poolsize += len + 1;
+
+    return offset;
+}
+
+void si_add(struct si_writer *w, const struct si_record *rec,
+	    const char *path, const char *target, const unsigned char *digest)
+{
+    struct si_record r = *rec;
+    size_t len = strlen(path);
+
+    r.pathlen = len;
+    r.path = si_pool_add(w, path, len);
+    r.target = 0;
+
+    memset(w->record, 0, w->stride);
+
+    if (r.flags & SI_SYMLINK)
+	r.target = si_pool_add(w, target, strlen(target));
+    else
+	memcpy(w->record + sizeof(r), digest, w->header.digestsize);
+
+    memcpy(w->record, &r, sizeof(r));
+
+    fwrite(w->record, w->stride, 1, w->fp);
+    ++w->header.count;
+}
+
+int si_finish(struct si_writer *w, const struct si_stamp *stamp)
+{
+    int ok, err;
+
+    w->header.stamp.size = stamp->size;
+    w->header.stamp.mtime = stamp->mtime;
+    w->header.stamp.crc = stamp->crc;
+
+    fwrite(w->pool, 1, w->header.poolsize, w->fp);
+
+    ok = (fseek(w->fp, 0, SEEK_SET) == 0 &&
+	  fwrite(&w->header, sizeof(w->header), 1, w->fp) == 1 &&
+	  fflush(w->fp) == 0 && !ferror(w->fp));
+    err = errno;
+
+    if (fclose(w->fp) != 0 && ok) {
+	ok = 0;
+	err = errno;
+    }
+
+    if (ok && rename(w->tmppath, w->path) != 0) {
+	ok = 0;
+	err = errno;
+    }
+
+    if (!ok) remove(w->tmppath);
+
+    free(w->pool);
+    free(w->record);
+    free(w->tmppath);
+    free(w->path);
+    free(w);
+
+    errno = err;
+    return ok;
+}
+
+void si_abort(struct si_writer *w)
+{
+    fclose(w->fp);
+    remove(w->tmppath);
+
+    free(w->pool);
+    free(w->record);
+    free(w->tmppath);
+    free(w->path);
+    free(w);
+}
+
+/* check the header and that all strings of records lie in the pool */
+static int si_check(const struct sumindex *si, const struct si_stamp *stamp)
+{
+    const struct si_header *h = si->header;
+    uint64_t i;
+
+    if (si->mapsize < sizeof(struct si_header) ||
+	memcmp(h->magic, si_magic, sizeof(h->magic)) != 0 ||
+	h->byteorder != SI_BYTEORDER)
+    {
+	errno = EINVAL;
+	return 0;
+    }
+
+    if (h->stamp.size != stamp->size || h->stamp.mtime != stamp->mtime ||
+	h->stamp.crc != stamp->crc)
+    {
+	errno = ESTALE;
+	return 0;
+    }
+
+    if (h->digestsize > 255 || h->poolsize == 0 ||
+	h->count > (si->mapsize - sizeof(struct si_header)) / si->stride ||
+	si->mapsize - sizeof(struct si_header) - h->count * si->stride != h->poolsize ||
+	si->pool[h->poolsize - 1] != 0)
+    {
+	errno = EINVAL;
+	return 0;
+    }
+
+    for (i = 0; i < h->count; ++i)
+    {
+	const struct si_record *r = si_get(si, i);
+
+	if (r->path >= h->poolsize || r->pathlen >= h->poolsize - r->path ||
+	    si->pool[r->path + r->pathlen] != 0 ||
+	    ((r->flags & SI_SYMLINK) && r->target >= h->poolsize))
+	{
+	    errno = EINVAL;
+	    return 0;
+	}
+    }
+
+    return 1;
+}
+
+struct sumindex *si_open(const char *path, const struct si_stamp *stamp)
+{
+    struct sumindex *si;
+    struct stat st;
+    int fd, err;
+
+    if ((fd = open(path, O_RDONLY)) < 0)
+	return NULL;
+
+    if (fstat(fd, &st) != 0 || (uint64_t)st.st_size > (size_t)-1)
+    {
+	err = errno;
+	close(fd);
+	errno = err;
+	return NULL;
+    }
+
+    if (st.st_size < (off_t)sizeof(struct si_header))
+    {
+	close(fd);
+	errno = EINVAL;
+	return NULL;
+    }
+
+    si = calloc(1, sizeof(struct sumindex));
+    si->mapsize = st.st_size;
+    si->map = mmap(NULL, si->mapsize, PROT_READ, MAP_PRIVATE, fd, 0);
+    err = errno;
+    close(fd);
+
+    if (si->map == MAP_FAILED)
+    {
+	free(si);
+	errno = err;
+	return NULL;
+    }
+
+    si->header = si->map;
+    si->records = (const unsigned char*)si->map + sizeof(struct si_header);
+    si->stride = si_stride(si->header->digestsize);
+    si->pool = (const char*)si->records;
+
+    if (si->header->count <= (si->mapsize - sizeof(struct si_header)) / si->stride)
+	si->pool += si->header->count * si->stride;
+
+    if (!si_check(si, stamp))
+    {
+	err = errno;
+	si_close(si);
+	errno = err;
+	return NULL;
+    }
+
+    return si;
+}
+
+void si_close(struct sumindex *si)
+{
+    munmap(si->map, si->mapsize);
+    free(si);
+}
+
+#else /* ON_WIN32 */
+
+struct si_writer *si_create(const char *path, uint32_t type,
+			    unsigned int digestsize, unsigned int headerlines)
+{
+    (void)path; (void)type; (void)digestsize; (void)headerlines;
+    errno = ENOSYS;
+    return NULL;
+}
+
+void si_add(struct si_writer *w, const struct si_record *rec,
+	    const char *path, const char *target, const unsigned char *digest)
+{
+    (void)w; (void)rec; (void)path; (void)target; (void)digest;
+}
+
+int si_finish(struct si_writer *w, const struct si_stamp *stamp)
+{
+    (void)w; (void)stamp;
+    errno = ENOSYS;
+    return 0;
+}
+
+void si_abort(struct si_writer *w)
+{
+    (void)w;
+}
+
+struct sumindex *si_open(const char *path, const struct si_stamp *stamp)
+{
+    (void)path; (void)stamp;
+    errno = ENOSYS;
+    return NULL;
+}
+
+void si_close(struct sumindex *si)
+{
+    (void)si;
+}
+
+#endif
+
+uint32_t si_type(const struct sumindex *si)
+{
+    return si->header->type;
+}
+
+unsigned int si_digestsize(const struct sumindex *si)
+{
+    return si->header->digestsize;
+}
+
+unsigned int si_headerlines(const struct sumindex *si)
+{
+    return si->header->headerlines;
+}
+
+uint64_t si_count(const struct sumindex *si)
+{
+    return si->header->count;
+}
+
+const struct si_record *si_get(const struct sumindex *si, uint64_t i)
+{
+    return (const struct si_record*)(si->records + i * si->stride);
+}
+
+const char *si_string(const struct sumindex *si, uint64_t offset)
+{
+    return si->pool + offset;
+}
+
+const unsigned char *si_digest(const struct si_record *rec)
+{
+    return (const unsigned char*)(rec + 1);
+}
+
+/*****************************************************************************/
@@ -0,0 +1,131 @@
+/*****************************************************************************
+ * Binary sidecar index of a digest file, mapped instead of parsing it       *
+ *                                                                           *
+ * Copyright (C) 2010-2020 Timo Bingmann                                     *
+ *                                                                           *
+ * This program is free software; you can redistribute it and/or modify it   *
+ * under the terms of the GNU General Public License as published by the     *
+ * Free Software Foundation; either version 3, or (at your option) any       *
+ * later version.                                                            *
+ *                                                                           *
+ * This program is distributed in the hope that it will be useful,           *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+ * GNU General Public License for more details.                              *
+ *                                                                           *
+ * You should have received a copy of the GNU General Public License         *
+ * along with this program; if not, write to the Free Software Foundation,   *
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.        *
+ *****************************************************************************/
+
+#ifndef _SUMINDEX_H
+#define _SUMINDEX_H 1
+
+#include <stddef.h>
+#include <inttypes.h>
+
+/**
+ * The sum index holds the records of a digest file in binary form: a
+ * header, fixed-width records in the order of the digest file, each
+ * followed by its digest bytes, and a pool of NUL-terminated path and
+ * symlink target strings. It is written next to the digest file and
+ * stamped with the text file's size, modification time and final
+ * CRC32, and it is only opened while the stamp matches, hence the text
+ * file remains the source of truth. The index is written to a
+ * temporary file, which replaces the old one when complete. Not
+ * available on Windows.
+ */
+
+/** suffix appended to the digest file name */
+#define SI_SUFFIX	".digup-index"
+
+/** record flags */
+#define SI_SYMLINK	1	/* target is set, there is no digest */
+#define SI_INODE	2	/* dev and ino are set */
+
+/** opaque structure declarations */
+struct sumindex;
+struct si_writer;
+
+/** identity of the text digest file the index was written for */
+struct si_stamp
+{
+    int64_t		size;
+    int64_t		mtime;
+    uint32_t		crc;
+};
+
+/** one file record, followed by the digest bytes in the index */
+struct si_record
+{
+    uint64_t		path;	/* offset in the string pool */
+    uint64_t		target;	/* offset of the symlink target */
+    int64_t		size;
+    int64_t		mtime;
+    uint64_t		dev;
+    uint64_t		ino;
+    uint32_t		pathlen;
+    uint32_t		flags;
+};
+
+/**
+ * Create a new index for path, which is written to a temporary file
+ * until si_finish(). type is stored for the caller, digestsize is the
+ * size of all digests and headerlines the number of lines preceding
+ * the first record in the digest file. Returns NULL and sets errno if
+ * the file cannot be created.
+ */
+struct si_writer *si_create(const char *path, uint32_t type,
+			    unsigned int digestsize, unsigned int headerlines);
+
+/**
+ * Append a record. The path, target and pathlen fields of rec are set
+ * from the given strings, target is only used with SI_SYMLINK and
+ * digest only without.
+ */
+void si_add(struct si_writer *w, const struct si_record *rec,
+	    const char *path, const char *target, const unsigned char *digest);
+
+/**
+ * Write the string pool and the header with the stamp, and replace the
+ * index at path. Returns 0 and sets errno if writing failed, in which
+ * case the temporary file is removed. The writer is released in either
+ * case.
+ */
+int si_finish(struct si_writer *w, const struct si_stamp *stamp);
+
+/**
+ * Remove the temporary file and release the writer, keeping the old
+ * index at path.
+ */
+void si_abort(struct si_writer *w);
+
+/**
+ * Map the index at path. Returns NULL and sets errno if it does not
+ * exist, is damaged (EINVAL) or does not match the stamp (ESTALE).
+ */
+struct sumindex *si_open(const char *path, const struct si_stamp *stamp);
+
+/** type, digest size, header lines and number of records of the index */
+uint32_t si_type(const struct sumindex *si);
+unsigned int si_digestsize(const struct sumindex *si);
+unsigned int si_headerlines(const struct sumindex *si);
+uint64_t si_count(const struct sumindex *si);
+
+/** the i-th record */
+const struct si_record *si_get(const struct sumindex *si, uint64_t i);
+
+/** the string at an offset in the pool, as found in a record */
+const char *si_string(const struct sumindex *si, uint64_t offset);
+
+/** the digest bytes following a record */
+const unsigned char *si_digest(const struct si_record *rec);
+
+/**
+ * Unmap and close the index.
+ */
+void si_close(struct sumindex *si);
+
+#endif /* _SUMINDEX_H */
+
+/*****************************************************************************/
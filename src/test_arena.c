@@ -0,0 +1,120 @@
+/*****************************************************************************
+ * test_arena - Tests for the arena allocator                                *
+ *                                                                           *
+ * Copyright (C) 2010-2020 Timo Bingmann                                     *
+ *                                                                           *
+ * This program is free software; you can redistribute it and/or modify it   *
+ * under the terms of the GNU General Public License as published by the     *
+ * Free Software Foundation; either version 3, or (at your option) any       *
+ * later version.                                                            *
+ *                                                                           *
+ * This program is distributed in the hope that it will be useful,           *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+ * GNU General Public License for more details.                              *
+ *                                                                           *
+ * You should have received a copy of the GNU General Public License         *
+ * along with this program; if not, write to the Free Software Foundation,   *
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.        *
+ *****************************************************************************/
+
+#include "arena.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+
+void test_alloc(void)
+{
+    int i;
+    char str[64];
+    char* strs[10000];
+    long long* nums[10000];
+
+    /* small blocks to test block chaining */
+    struct arena *a = arena_create(4096);
+
+    for (i = 0; i < 10000; i++)
+    {
+	snprintf(str, sizeof(str), "string%d", i);
+	strs[i] = arena_strdup(a, str);
+
+	nums[i] = arena_alloc(a, sizeof(long long));
+	assert( (uintptr_t)nums[i] % sizeof(long long) == 0 );
+	*nums[i] = i;
+    }
+
+    for (i = 0; i < 10000; i++)
+    {
+	snprintf(str, sizeof(str), "string%d", i);
+	assert( strcmp(strs[i], str) == 0 );
+	assert( *nums[i] == i );
+    }
+
+    /* large objects get their own block */
+    {
+	char *big = arena_calloc(a, 100000);
+	for (i = 0; i < 100000; i++)
+	    assert( big[i] == 0 );
+
+	assert( arena_size(a) >= 100000 );
+    }
+
+    /* allocation continues in the current block */
+    assert( strcmp(arena_strndup(a, "abcdef", 3), "abc") == 0 );
+    assert( strcmp(arena_strndup(a, "ab", 5), "ab") == 0 );
+
+    arena_destroy(a);
+}
+
+void test_merge(void)
+{
+    int i;
+    char str[64];
+    char* strs[1000];
+
+    struct arena *a = arena_create(4096);
+    struct arena *b = arena_create(4096);
+    struct arena *e = arena_create(0);
+
+    for (i = 0; i < 1000; i++)
+    {
+	snprintf(str, sizeof(str), "string%d", i);
+	strs[i] = arena_strdup(i % 2 ? a : b, str);
+    }
+
+    arena_merge(a, b);
+    arena_merge(a, e);
+
+    /* allocation continues after merging */
+    assert( strcmp(arena_strdup(a, "last"), "last") == 0 );
+
+    for (i = 0; i < 1000; i++)
+    {
+	snprintf(str, sizeof(str), "string%d", i);
+	assert( strcmp(strs[i], str) == 0 );
+    }
+
+    /* merging into an empty arena takes over the current block */
+    e = arena_create(0);
+    b = arena_create(0);
+    arena_strdup(b, "x");
+    arena_merge(e, b);
+    assert( arena_size(e) > 0 );
+    assert( strcmp(arena_strdup(e, "y"), "y") == 0 );
+
+    arena_destroy(e);
+    arena_destroy(a);
+}
+
+int main(void)
+{
+    test_alloc();
+    test_merge();
+
+    return 0;
+}
+
+/*****************************************************************************/
@@ -21,6 +21,7 @@
  *****************************************************************************/
 
 #include "digest.h"
+#include "crc32.h"
 
 #include <assert.h>
 #include <stdio.h>
@@ -46,6 +47,19 @@ void check(const void* str, unsigned int slen, struct digest_ctx* digctx,
     assert( digest_equal(digres, digref) );
     free(digres);
 
+    /* redo test with finish_into() a caller buffer */
+    {
+	unsigned char buf[1 + DIGEST_MAX_SIZE];
+	struct digest_result *out = (struct digest_result*)buf;
+
+	digctx->init(digctx);
+	digctx->process(digctx, str, slen);
+	digctx->finish_into(digctx, out);
+
+	assert( out->size == digctx->digest_size() );
+	assert( digest_equal(out, digref) );
+    }
+
     /* redo test with process_buffer() function */
     digres = digctx->process_buffer(str, slen);
     assert( digest_equal(digres, digref) );
@@ -54,6 +68,40 @@ void check(const void* str, unsigned int slen, struct digest_ctx* digctx,
     free(digref);
 }
 
+void check_hex_prefix(void)
+{
+    unsigned char buf[1 + 8];
+    struct digest_result* res = (struct digest_result*)buf;
+
+    assert( digest_hex2bin_prefix("00fFa9  name", 8, res) == 6 );
+    assert( res->size == 3 && buf[1] == 0x00 && buf[2] == 0xff && buf[3] == 0xa9 );
+
+    assert( digest_hex2bin_prefix("abc *name", 8, res) == 3 );
+    assert( digest_hex2bin_prefix("", 8, res) == 0 && res->size == 0 );
+
+    /* stops after maxsize bytes */
+    assert( digest_hex2bin_prefix("0123456789abcdef", 4, res) == 8 );
+    assert( res->size == 4 && buf[4] == 0x67 );
+}
+
+void check_crc32_combine(void)
+{
+    unsigned char buf[3000];
+    unsigned int i, split;
+
+    for (i = 0; i < sizeof(buf); ++i)
+	buf[i] = (unsigned char)(i * 7 + i / 13);
+
+    for (split = 0; split <= sizeof(buf); split += 250)
+    {
+	uint32_t crc1 = crc32(0, buf, split);
+	uint32_t crc2 = crc32(0, buf + split, sizeof(buf) - split);
+
+	assert( crc32_combine(crc1, crc2, sizeof(buf) - split) ==
+		crc32(0, buf, sizeof(buf)) );
+    }
+}
+
 int main(void)
 {
     struct digest_ctx digest_md5;
@@ -114,6 +162,9 @@ int main(void)
 	      "a1e61db1");
     }
 
+    check_hex_prefix();
+    check_crc32_combine();
+
     return 0;
 }
 
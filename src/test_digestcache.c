@@ -0,0 +1,192 @@
+/*****************************************************************************
+ * Test the machine-wide digest cache file.                                  *
+ *                                                                           *
+ * Copyright (C) 2010-2020 Timo Bingmann                                     *
+ *                                                                           *
+ * This program is free software; you can redistribute it and/or modify it   *
+ * under the terms of the GNU General Public License as published by the     *
+ * Free Software Foundation; either version 3, or (at your option) any       *
+ * later version.                                                            *
+ *                                                                           *
+ * This program is distributed in the hope that it will be useful,           *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+ * GNU General Public License for more details.                              *
+ *                                                                           *
+ * You should have received a copy of the GNU General Public License         *
+ * along with this program; if not, write to the Free Software Foundation,   *
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.        *
+ *****************************************************************************/
+
+#include "digestcache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <assert.h>
+
+static void make_key(struct dc_key *key, unsigned int i)
+{
+    memset(key, 0, sizeof(*key));
+    key->dev = 2049;
+    key->ino = 1000 + i;
+    key->mtime = 1300000000 + i;
+    key->size = 4096 * i;
+    key->type = 2;
+}
+
+static void make_digest(unsigned char *digest, unsigned int i)
+{
+    unsigned int j;
+
+    for (j = 0; j < 20; ++j)
+	digest[j] = (unsigned char)(i * 31 + j);
+}
+
+int main(void)
+{
+    char path[] = "/tmp/test_digestcache.XXXXXX";
+    struct digestcache *dc;
+    struct dc_key key;
+    unsigned char digest[DC_DIGEST_MAX], expect[DC_DIGEST_MAX];
+    unsigned int i, found;
+    FILE *fp;
+    int fd;
+
+    /* create an empty file name, dc_open() creates the cache */
+    fd = mkstemp(path);
+    assert( fd >= 0 );
+    close(fd);
+    unlink(path);
+
+    dc = dc_open(path, 1024);
+    assert( dc != NULL );
+
+    for (i = 0; i < 500; ++i)
+    {
+	make_key(&key, i);
+	make_digest(digest, i);
+	dc_store(dc, &key, digest, 20);
+    }
+
+    /* all entries are found, but not with other mtime, size or type */
+    for (i = 0; i < 500; ++i)
+    {
+	make_key(&key, i);
+	make_digest(expect, i);
+	assert( dc_lookup(dc, &key, digest) == 20 );
+	assert( memcmp(digest, expect, 20) == 0 );
+    }
+
+    make_key(&key, 7);
+    key.mtime++;
+    assert( dc_lookup(dc, &key, digest) == 0 );
+
+    make_key(&key, 7);
+    key.size++;
+    assert( dc_lookup(dc, &key, digest) == 0 );
+
+    make_key(&key, 7);
+    key.type = 3;
+    assert( dc_lookup(dc, &key, digest) == 0 );
+
+    /* a new state of the file replaces the entry */
+    make_key(&key, 7);
+    key.mtime++;
+    make_digest(digest, 99);
+    dc_store(dc, &key, digest, 20);
+    assert( dc_lookup(dc, &key, expect) == 20 );
+    assert( memcmp(digest, expect, 20) == 0 );
+
+    key.mtime--;
+    assert( dc_lookup(dc, &key, digest) == 0 );
+
+    dc_close(dc);
+
+    /* entries persist, the size parameter is ignored when reopening */
+    dc = dc_open(path, 64);
+    assert( dc != NULL );
+
+    make_key(&key, 123);
+    make_digest(expect, 123);
+    assert( dc_lookup(dc, &key, digest) == 20 );
+    assert( memcmp(digest, expect, 20) == 0 );
+
+    /* many more keys than slots: some are replaced, but none wrong */
+    for (i = 500; i < 5000; ++i)
+    {
+	make_key(&key, i);
+	make_digest(digest, i);
+	dc_store(dc, &key, digest, 20);
+    }
+
+    for (i = found = 0; i < 5000; ++i)
+    {
+	make_key(&key, i);
+	make_digest(expect, i);
+
+	if (i == 7) continue;
+
+	if (dc_lookup(dc, &key, digest)) {
+	    assert( memcmp(digest, expect, 20) == 0 );
+	    ++found;
+	}
+    }
+
+    assert( found >= 1024 / 2 && found <= 1024 );
+    printf("found %u of 5000 entries in 1024 slots\n", found);
+
+    dc_close(dc);
+
+    /* damaged slots are ignored */
+    fp = fopen(path, "r+b");
+    assert( fp != NULL );
+    fseek(fp, 0, SEEK_END);
+    {
+	long size = ftell(fp);
+	char buf[4096];
+	long pos;
+
+	memset(buf, 0x5A, sizeof(buf));
+
+	for (pos = 4096; pos + 4096 < size; pos += 3 * 4096) {
+	    fseek(fp, pos, SEEK_SET);
+	    fwrite(buf, 1, 37, fp);
+	}
+    }
+    fclose(fp);
+
+    dc = dc_open(path, 0);
+    assert( dc != NULL );
+
+    for (i = found = 0; i < 5000; ++i)
+    {
+	make_key(&key, i);
+	make_digest(expect, i);
+
+	if (i == 7) continue;
+
+	if (dc_lookup(dc, &key, digest)) {
+	    assert( memcmp(digest, expect, 20) == 0 );
+	    ++found;
+	}
+    }
+
+    printf("found %u entries after damaging slots\n", found);
+
+    dc_close(dc);
+
+    /* other files are rejected */
+    fp = fopen(path, "wb");
+    fprintf(fp, "not a digest cache\n");
+    fclose(fp);
+
+    assert( dc_open(path, 0) == NULL );
+
+    unlink(path);
+
+    return 0;
+}
+
+/*****************************************************************************/
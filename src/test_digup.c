@@ -23,6 +23,7 @@
 #include <assert.h>
 #include <stdlib.h>
 #include <string.h>
+#include <utime.h>
 
 /* evil but simple way to include the main program to run tests on it */
 #define main __mainx
@@ -67,9 +68,976 @@ void test_filename_escaping(void)
     free(str4);
 }
 
+void test_normalize_relpath(void)
+{
+    char buf[64];
+
+    strcpy(buf, "./a/b/");
+    assert( strcmp(normalize_relpath(buf), "a/b") == 0 );
+
+    strcpy(buf, ".//./a");
+    assert( strcmp(normalize_relpath(buf), "a") == 0 );
+
+    strcpy(buf, "./");
+    assert( strcmp(normalize_relpath(buf), "") == 0 );
+
+    strcpy(buf, ".");
+    assert( strcmp(normalize_relpath(buf), "") == 0 );
+
+    strcpy(buf, "a/..b/..c");
+    assert( strcmp(normalize_relpath(buf), "a/..b/..c") == 0 );
+
+    strcpy(buf, "/etc");
+    assert( normalize_relpath(buf) == NULL );
+
+    strcpy(buf, "a/../../b");
+    assert( normalize_relpath(buf) == NULL );
+
+    strcpy(buf, "a/..");
+    assert( normalize_relpath(buf) == NULL );
+}
+
+void test_parse_size(void)
+{
+    size_t size;
+
+    assert( parse_size("4096", &size) && size == 4096 );
+    assert( parse_size("64K", &size) && size == 64 * 1024 );
+    assert( parse_size("512m", &size) && size == 512 * 1024 * 1024 );
+    assert( parse_size("1G", &size) && size == 1024 * 1024 * 1024 );
+
+    assert( !parse_size("", &size) );
+    assert( !parse_size("M", &size) );
+    assert( !parse_size("10MB", &size) );
+    assert( !parse_size("1x", &size) );
+}
+
+void test_parse_inode_line(void)
+{
+    struct DigestReader dr;
+    const char* line;
+
+    gopt_digestfile = "test";
+    memset(&dr, 0, sizeof(dr));
+    dr.linenum = 1;
+
+    line = "#: mtime 1234 size 42 dev 2049 ino 1311768467463790320";
+    assert( parse_digestline(&dr, line, strlen(line)) >= 0 );
+    assert( dr.tempinfo.mtime == 1234 && dr.tempinfo.size == 42 );
+    assert( dr.tempinfo.hasinode );
+    assert( dr.tempinfo.inode.dev == 2049 && dr.tempinfo.inode.ino == 1311768467463790320ULL );
+
+    memset(&dr.tempinfo, 0, sizeof(dr.tempinfo));
+
+    line = "#: mtime 1234 size 42\n";
+    assert( parse_digestline(&dr, line, strlen(line)) >= 0 );
+    assert( !dr.tempinfo.hasinode );
+
+    line = "#: mtime 1234 size 42 ino x";
+    assert( parse_digestline(&dr, line, strlen(line)) == -1 );
+}
+
+/* set up and release the global file list like digup */
+static void filelist_setup(void)
+{
+    g_arena = arena_create(0);
+    g_dirtree = dt_create(g_arena);
+    g_filelist = rb_create(rbtree_dt_key_cmp, NULL, NULL, NULL, NULL);
+    rb_set_arena(g_filelist, g_arena);
+    g_fileextra = rb_create(rbtree_pointer_cmp, NULL, NULL, NULL, NULL);
+}
+
+static void filelist_teardown(void)
+{
+    free(g_loadlist);
+    g_loadlist = NULL;
+    g_loadlist_size = g_loadlist_max = 0;
+    gopt_digesttype = DT_NONE;
+
+    if (g_filehash) hi_destroy(g_filehash);
+    rb_destroy(g_filelist);
+    rb_destroy(g_fileextra);
+    dt_destroy(g_dirtree);
+    arena_destroy(g_arena);
+    g_filehash = NULL;
+    g_filelist = NULL;
+    g_fileextra = NULL;
+    g_dirtree = NULL;
+    g_arena = NULL;
+}
+
+/* load the digest file and replay its journal like digup, all entries
+ * are taken as seen */
+static void load_digestfile(void)
+{
+    struct rb_node* node;
+
+    filelist_setup();
+
+    assert( read_digestfile() );
+
+    for (node = rb_begin(g_filelist); node != rb_end(g_filelist);
+	 node = rb_successor(g_filelist, node))
+    {
+	((struct FileInfo*)node->value)->status = FS_SEEN;
+    }
+}
+
+void test_parse_inplace(void)
+{
+    /* records are parsed from a buffer holding the following lines */
+    const char* buf = "d41d8cd98f00b204e9800998ecf8427e *dir/a b\n#: mtime 5\n";
+    const char* nl = strchr(buf, '\n');
+    struct DigestReader dr;
+    char path[64];
+
+    gopt_digestfile = "test";
+    memset(&dr, 0, sizeof(dr));
+    dr.linenum = 1;
+
+    filelist_setup();
+
+    assert( parse_digestline(&dr, buf, nl + 1 - buf) == 1 );
+    assert( g_loadlist_size == 1 );
+    assert( strcmp(dt_key_path(g_loadlist[0].key, path), "dir/a b") == 0 );
+    assert( g_loadlist[0].fileinfo->digest.size == MD5_DIGEST_SIZE );
+    assert( gopt_digesttype == DT_MD5 );
+
+    filelist_teardown();
+}
+
+/* read the digest file line by line or with the given number of threads */
+static struct LoadEntry* read_loadlist(unsigned int threads, uint32_t* crc)
+{
+    struct DigestReader dr;
+    struct LoadEntry* list;
+
+    memset(&dr, 0, sizeof(dr));
+    assert( digestreader_open(&dr) && dr.map );
+
+    if (threads)
+    {
+	while (gopt_digesttype == DT_NONE && digestreader_next(&dr)) ;
+
+	digestreader_parallel(&dr, threads);
+    }
+
+    while (digestreader_next(&dr)) ;
+
+    *crc = dr.crc;
+    digestreader_close(&dr);
+
+    list = g_loadlist;
+    g_loadlist = NULL;
+    g_loadlist_max = 0;
+    gopt_digesttype = DT_NONE;
+
+    return list;
+}
+
+/* read a whole file into a NUL-terminated buffer */
+static char* read_file(const char* path, size_t* size)
+{
+    FILE* fp = fopen(path, "rb");
+    char* data;
+
+    assert( fp != NULL );
+    fseek(fp, 0, SEEK_END);
+    *size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+
+    data = malloc(*size + 1);
+    assert( fread(data, 1, *size, fp) == *size );
+    data[*size] = 0;
+    fclose(fp);
+
+    return data;
+}
+
+/* append a crc line holding the crc32 of all bytes written so far */
+static void write_crcline(FILE* fp, const char* path, const char* suffix)
+{
+    char* data;
+    size_t size;
+
+    assert( fflush(fp) == 0 );
+    data = read_file(path, &size);
+    fprintf(fp, "#: crc 0x%08x%s\n",
+	    crc32(0, (const unsigned char*)data, size), suffix);
+    free(data);
+}
+
+/* write a digest file with num records. Unless sorted, it uses
+ * --inodes and includes escaped names, separate target lines and a crc
+ * line in the middle. Sorted records are named by number and formatted
+ * like digup does, apart from the binary mode markers. */
+static void write_testfile(const char* path, size_t num, bool sorted)
+{
+    FILE* fp = fopen(path, "w");
+    size_t i;
+
+    assert( fp != NULL );
+
+    fprintf(fp, "# digest file\n");
+
+    if (!sorted)
+	fprintf(fp, "#: option --inodes\n");
+
+    for (i = 0; i < num; ++i)
+    {
+	fprintf(fp, "#: mtime %u size %u",
+		(unsigned)(1000 + i), (unsigned)(i * 3));
+
+	if (sorted)
+	{
+	    if (i % 97 == 5)
+		fprintf(fp, " target t%u\n#: symlink f%05u\n", (unsigned)i, (unsigned)i);
+	    else
+		fprintf(fp, "\n%032x *f%05u\n", (unsigned)i, (unsigned)i);
+
+	    continue;
+	}
+
+	fprintf(fp, " dev 7 ino %u\n", (unsigned)i);
+
+	if (i % 97 == 5)
+	{
+	    fprintf(fp, "#: target t%u\n", (unsigned)i);
+	    fprintf(fp, "#: symlink d%u/link%u\n", (unsigned)(i % 13), (unsigned)i);
+	}
+	else if (i % 31 == 3)
+	{
+	    fprintf(fp, "\\%032x *d%u/esc\\n%u\n",
+		    (unsigned)i, (unsigned)(i % 13), (unsigned)i);
+	}
+	else
+	{
+	    fprintf(fp, "%032x *d%u/file %u\n",
+		    (unsigned)i, (unsigned)(i % 13), (unsigned)i);
+	}
+
+	if (i == num / 2)
+	    write_crcline(fp, path, "");
+    }
+
+    write_crcline(fp, path, " eof");
+    fclose(fp);
+}
+
+/* check that two lists of loaded entries are equal */
+static void compare_loadlist(const struct LoadEntry* list1,
+			     const struct LoadEntry* list2, size_t size)
+{
+    size_t i;
+
+    for (i = 0; i < size; ++i)
+    {
+	const struct FileInfo* f1 = list1[i].fileinfo;
+	const struct FileInfo* f2 = list2[i].fileinfo;
+
+	assert( dt_key_cmp(list1[i].key, list2[i].key) == 0 );
+	assert( list1[i].linenum == list2[i].linenum );
+	assert( f1->mtime == f2->mtime && f1->size == f2->size );
+	assert( f1->digest.size == f2->digest.size );
+	assert( memcmp(&f1->digest, &f2->digest, 1 + f1->digest.size) == 0 );
+	assert( (fileinfo_symlink(f1) == NULL) == (fileinfo_symlink(f2) == NULL) );
+	assert( !fileinfo_symlink(f1) || strcmp(fileinfo_symlink(f1), fileinfo_symlink(f2)) == 0 );
+	assert( (fileinfo_inode(f1) == NULL) == (fileinfo_inode(f2) == NULL) );
+	assert( !fileinfo_inode(f1) || fileinfo_inode(f2)->ino == fileinfo_inode(f1)->ino );
+    }
+}
+
+void test_parse_parallel(void)
+{
+    char tmpname[] = "/tmp/test_digup.XXXXXX";
+    uint32_t crc1, crc2;
+    struct LoadEntry *list1, *list2;
+    size_t size;
+    unsigned int threads;
+
+    assert( close(mkstemp(tmpname)) == 0 );
+    write_testfile(tmpname, 3000, FALSE);
+
+    gopt_digestfile = tmpname;
+    gopt_batch = TRUE;
+
+    filelist_setup();
+
+    list1 = read_loadlist(0, &crc1);
+    size = g_loadlist_size;
+    assert( size == 3000 );
+
+    for (threads = 2; threads <= 17; threads += 5)
+    {
+	g_loadlist_size = 0;
+	list2 = read_loadlist(threads, &crc2);
+
+	assert( g_loadlist_size == size );
+	assert( crc2 == crc1 );
+
+	compare_loadlist(list1, list2, size);
+
+	free(list2);
+    }
+
+    free(list1);
+    g_loadlist_size = 0;
+    filelist_teardown();
+
+    gopt_batch = FALSE;
+    gopt_inodes = FALSE;
+    unlink(tmpname);
+}
+
+/* rewrite a digest file with --index and load it from the index */
+void test_sumindex_load(void)
+{
+    char tmpname[] = "/tmp/test_digup.XXXXXX";
+    char* indexname;
+    uint32_t crc;
+    struct DigestReader dr;
+    struct LoadEntry *list1, *list2;
+    struct utimbuf times;
+    size_t size;
+
+    assert( close(mkstemp(tmpname)) == 0 );
+    write_testfile(tmpname, 500, FALSE);
+
+    gopt_digestfile = tmpname;
+    gopt_batch = TRUE;
+
+    load_digestfile();
+
+    gopt_index = TRUE;
+    cmd_write();
+
+    /* the records of the index equal those parsed from the text */
+    list1 = read_loadlist(0, &crc);
+    size = g_loadlist_size;
+    assert( size == 500 );
+
+    g_loadlist_size = 0;
+    memset(&dr, 0, sizeof(dr));
+    assert( digestreader_open(&dr) );
+    assert( sumindex_read(&dr) );
+    assert( gopt_digesttype == DT_MD5 );
+    digestreader_close(&dr);
+
+    assert( g_loadlist_size == size );
+    list2 = g_loadlist;
+    compare_loadlist(list1, list2, size);
+
+    free(list1);
+
+    /* the index is ignored once the digest file was modified */
+    times.actime = times.modtime = time(NULL) + 10;
+    assert( utime(tmpname, &times) == 0 );
+
+    memset(&dr, 0, sizeof(dr));
+    assert( digestreader_open(&dr) );
+    assert( !sumindex_read(&dr) );
+    digestreader_close(&dr);
+
+    filelist_teardown();
+
+    indexname = sumindex_path();
+    unlink(indexname);
+    free(indexname);
+
+    gopt_batch = FALSE;
+    gopt_inodes = FALSE;
+    gopt_index = FALSE;
+    unlink(tmpname);
+}
+
+/* check the eof line holds the crc32 of all preceding bytes */
+static void check_eof_crc(const char* data, size_t size)
+{
+    char line[32];
+    size_t len = sprintf(line, "#: crc 0x%08x eof\n",
+			 crc32(0, (const unsigned char*)data, size - 22));
+
+    assert( len == 22 && size >= len );
+    assert( memcmp(data + size - len, line, len) == 0 );
+}
+
+/* format records through the buffered writer */
+void test_write_record(void)
+{
+    char tmpname[] = "/tmp/test_digup.XXXXXX";
+    struct DigestWriter* dw;
+    struct FileInfo *fi1, *fi2, *fi3;
+    struct FileExtra* extra;
+    unsigned int i;
+    char* data;
+    size_t size;
+
+    const char* expect =
+	"#: mtime 1300000000 size 42 dev 2049 ino 18446744073709551615\n"
+	"000102030405060708090a0b0c0d0e0f  dir/file\n"
+	"#: mtime -5 size 0\n"
+	"\\0f0e0d0c0b0a09080706050403020100  esc\\\\name\\nx\n"
+	"#: mtime 7 size 7 target tar get\n"
+	"#: symlink\\ link\\\\\n"
+	"#: crc 0x0d950fba eof\n";
+
+    filelist_setup();
+    assert( close(mkstemp(tmpname)) == 0 );
+
+    fi1 = fileinfo_alloc(16);
+    fi1->status = FS_SEEN;
+    fi1->mtime = 1300000000;
+    fi1->size = 42;
+    fi1->digest.size = 16;
+    extra = fileinfo_extra(fi1, TRUE);
+    extra->inode.dev = 2049;
+    extra->inode.ino = 18446744073709551615ULL;
+    extra->hasinode = TRUE;
+
+    fi2 = fileinfo_alloc(16);
+    fi2->status = FS_CHANGED;
+    fi2->mtime = -5;
+    fi2->digest.size = 16;
+
+    for (i = 0; i < 16; ++i) {
+	((unsigned char*)&fi1->digest + 1)[i] = i;
+	((unsigned char*)&fi2->digest + 1)[i] = 15 - i;
+    }
+
+    fi3 = fileinfo_alloc(0);
+    fi3->status = FS_SEEN;
+    fi3->mtime = fi3->size = 7;
+    fileinfo_extra(fi3, TRUE)->symlink = arena_strdup(g_arena, "tar get");
+
+    gopt_inodes = TRUE;
+
+    dw = digestwriter_open(tmpname);
+    assert( dw != NULL );
+
+    assert( digestfile_write_record(dw, "dir/file", fi1) );
+    assert( digestfile_write_record(dw, "esc\\name\nx", fi2) );
+    assert( digestfile_write_record(dw, "link\\", fi3) );
+
+    fi2->status = FS_UNSEEN;
+    assert( !digestfile_write_record(dw, "unseen", fi2) );
+
+    digestwriter_eof(dw);
+    assert( digestwriter_close(dw) );
+
+    data = read_file(tmpname, &size);
+    assert( size == strlen(expect) );
+    assert( memcmp(data, expect, size) == 0 );
+    free(data);
+
+    /* many records are written across several buffer flushes */
+    dw = digestwriter_open(tmpname);
+    assert( dw != NULL );
+
+    for (i = 0; i < 50000; ++i)
+	assert( digestfile_write_record(dw, "dir/file", fi1) );
+
+    digestwriter_eof(dw);
+    assert( digestwriter_close(dw) );
+
+    data = read_file(tmpname, &size);
+    assert( size > 2 * DIGESTWRITER_BUFSIZE );
+    check_eof_crc(data, size);
+    free(data);
+
+    filelist_teardown();
+
+    gopt_inodes = FALSE;
+    unlink(tmpname);
+}
+
+/* write the file list on several threads, which gives the same file */
+void test_write_parallel(void)
+{
+    char tmpname[] = "/tmp/test_digup.XXXXXX";
+    char* indexname;
+    char *data1, *data2;
+    size_t size1, size2;
+    const char *body1, *body2;
+    struct DigestReader dr;
+    struct rb_node* node;
+    unsigned int i = 0, threads;
+
+    assert( close(mkstemp(tmpname)) == 0 );
+    write_testfile(tmpname, 3000, FALSE);
+
+    gopt_digestfile = tmpname;
+    gopt_batch = TRUE;
+
+    filelist_setup();
+
+    assert( read_digestfile() );
+
+    /* format all records instead of copying their lines */
+    loadedfile_close();
+
+    /* some records are left out of the written file */
+    for (node = rb_begin(g_filelist); node != rb_end(g_filelist);
+	 node = rb_successor(g_filelist, node))
+    {
+	((struct FileInfo*)node->value)->status = (i++ % 11 == 4) ? FS_UNSEEN : FS_SEEN;
+    }
+
+    cmd_write();
+    data1 = read_file(tmpname, &size1);
+    check_eof_crc(data1, size1);
+
+    for (threads = 2; threads <= 5; ++threads)
+    {
+	gopt_writethreads = threads;
+	gopt_index = TRUE;
+	cmd_write();
+
+	/* the records are equal, the header has the date and --index */
+	data2 = read_file(tmpname, &size2);
+	check_eof_crc(data2, size2);
+	assert( strstr(data2, "\n#: option --index\n") != NULL );
+
+	body1 = strstr(data1, "\n#: mtime ");
+	body2 = strstr(data2, "\n#: mtime ");
+	assert( size1 - (body1 - data1) == size2 - (body2 - data2) );
+	assert( memcmp(body1, body2, size1 - (body1 - data1) - 22) == 0 );
+	free(data2);
+
+	/* the index written alongside is valid */
+	memset(&dr, 0, sizeof(dr));
+	assert( digestreader_open(&dr) );
+	g_loadlist_size = 0;
+	assert( sumindex_read(&dr) );
+	assert( g_loadlist_size == 3000 - 3000 / 11 - (3000 % 11 > 4) );
+	digestreader_close(&dr);
+
+	gopt_index = FALSE;
+    }
+
+    free(data1);
+
+    filelist_teardown();
+
+    indexname = sumindex_path();
+    unlink(indexname);
+    free(indexname);
+
+    gopt_batch = FALSE;
+    gopt_inodes = FALSE;
+    gopt_writethreads = 0;
+    unlink(tmpname);
+}
+
+/* load the digest file, parsing it on the given number of threads, and
+ * change or drop some records */
+static void load_sortedfile(unsigned int threads)
+{
+    struct DigestReader dr;
+    struct rb_node* node;
+    unsigned int i = 0;
+
+    filelist_setup();
+
+    memset(&dr, 0, sizeof(dr));
+    assert( digestreader_open(&dr) && dr.map );
+
+    loadedfile_init(&dr);
+
+    while (gopt_digesttype == DT_NONE && digestreader_next(&dr)) ;
+
+    if (threads)
+	digestreader_parallel(&dr, threads);
+
+    while (digestreader_next(&dr)) ;
+
+    digestreader_close(&dr);
+    loadlist_finish();
+
+    assert( g_loadedfile.valid && g_loadedfile.basesize == 1 + threads );
+
+    for (node = rb_begin(g_filelist); node != rb_end(g_filelist);
+	 node = rb_successor(g_filelist, node), ++i)
+    {
+	struct FileInfo* fileinfo = node->value;
+
+	assert( fileinfo->spanlen > 0 );
+
+	if (i % 2000 == 1000)
+	    fileinfo->status = FS_UNSEEN;
+	else if (i % 1500 == 3 && !fileinfo_symlink(fileinfo))
+	{
+	    fileinfo->status = FS_CHANGED;
+	    ((unsigned char*)(&fileinfo->digest + 1))[0] ^= 0xFF;
+	}
+	else
+	    fileinfo->status = (i % 7 == 2) ? FS_SKIPPED : FS_SEEN;
+    }
+}
+
+/* the lines of unchanged records are copied from the loaded file */
+void test_write_copy(void)
+{
+    char tmpname[] = "/tmp/test_digup.XXXXXX";
+    static const unsigned int threads[3][2] = { { 0, 0 }, { 3, 0 }, { 3, 2 } };
+    char *refname, *tmpfile, *data1, *data2;
+    size_t size1, size2, count;
+    const char *body1, *body2;
+    struct LoadEntry *list1, *list2;
+    uint32_t crc;
+    unsigned int i;
+
+    int fd = mkstemp(tmpname);
+    assert( fd >= 0 );
+    close(fd);
+
+    gopt_digestfile = tmpname;
+    gopt_batch = TRUE;
+
+    /* all records formatted */
+    write_testfile(tmpname, 6000, TRUE);
+    load_sortedfile(0);
+    loadedfile_close();
+    cmd_write();
+    filelist_teardown();
+
+    data1 = read_file(tmpname, &size1);
+    check_eof_crc(data1, size1);
+    assert( strstr(data1, " *") == NULL );
+
+    my_asprintf(&refname, "%s.ref", tmpname);
+    assert( rename(tmpname, refname) == 0 );
+
+    for (i = 0; i < 3; ++i)
+    {
+	write_testfile(tmpname, 6000, TRUE);
+	load_sortedfile(threads[i][0]);
+	gopt_writethreads = threads[i][1];
+	cmd_write();
+	filelist_teardown();
+
+	data2 = read_file(tmpname, &size2);
+	check_eof_crc(data2, size2);
+
+	/* unchanged lines are kept, changed records are formatted */
+	assert( strstr(data2, "00000000000000000000000000000000 *f00000\n") != NULL );
+	assert( strstr(data2, "  f00003\n") != NULL && strstr(data2, " *f00003\n") == NULL );
+	assert( strstr(data2, "f01000\n") == NULL );
+	assert( strstr(data2, "#: symlink f00005\n") != NULL );
+
+	/* only the binary mode markers differ */
+	body1 = strstr(data1, "\n#: mtime ");
+	body2 = strstr(data2, "\n#: mtime ");
+	assert( size1 - (body1 - data1) == size2 - (body2 - data2) );
+	free(data2);
+
+	/* the same records are loaded */
+	filelist_setup();
+	list2 = read_loadlist(0, &crc);
+	count = g_loadlist_size;
+	g_loadlist_size = 0;
+	gopt_digestfile = refname;
+	list1 = read_loadlist(0, &crc);
+	gopt_digestfile = tmpname;
+	assert( g_loadlist_size == count );
+	compare_loadlist(list1, list2, count);
+	free(list1);
+	free(list2);
+	filelist_teardown();
+    }
+
+    my_asprintf(&tmpfile, "%s.tmp", tmpname);
+    assert( access(tmpfile, F_OK) != 0 );
+    free(tmpfile);
+
+    free(data1);
+
+    gopt_batch = FALSE;
+    gopt_writethreads = 0;
+    unlink(refname);
+    unlink(tmpname);
+    free(refname);
+}
+
+/* change and drop some records and add one with an escaped name, which
+ * is dropped again in the next round */
+static void update_journalfile(unsigned int round)
+{
+    struct rb_node* node;
+    struct FileInfo* fileinfo;
+    char name[32];
+    unsigned int i = 0;
+
+    for (node = rb_begin(g_filelist); node != rb_end(g_filelist);
+	 node = rb_successor(g_filelist, node), ++i)
+    {
+	fileinfo = node->value;
+
+	if (i % 400 == 7 + round || filelist_path(node->key)[0] == 'g')
+	    fileinfo->status = FS_UNSEEN;
+	else if (i % 300 == 11 && !fileinfo_symlink(fileinfo))
+	{
+	    fileinfo->status = FS_CHANGED;
+	    ((unsigned char*)(&fileinfo->digest + 1))[1] ^= round + 1;
+	}
+    }
+
+    fileinfo = fileinfo_alloc(16);
+    fileinfo->status = FS_NEW;
+    fileinfo->size = round;
+    fileinfo->mtime = 2000 + round;
+    fileinfo->digest.size = 16;
+    memset(&fileinfo->digest + 1, round, 16);
+
+    sprintf(name, "g%u\nx", round);
+    filelist_insert(name, fileinfo);
+}
+
+/* write all loaded records to a new digest file and return its body */
+static char* write_fullfile(const char* path)
+{
+    char* digestfile = gopt_digestfile;
+    char* data;
+    size_t size;
+
+    gopt_digestfile = (char*)path;
+    gopt_journal = FALSE;
+    assert( !cmd_write() );
+    gopt_digestfile = digestfile;
+    gopt_journal = TRUE;
+
+    data = read_file(path, &size);
+    check_eof_crc(data, size);
+    unlink(path);
+
+    return data;
+}
+
+/* check that two written digest files have the same records, the eof
+ * line differs with the date in the header */
+static void compare_records(const char* data1, const char* data2)
+{
+    const char* body1 = strstr(data1, "\n#: mtime ");
+    const char* body2 = strstr(data2, "\n#: mtime ");
+
+    assert( strlen(body1) == strlen(body2) );
+    assert( memcmp(body1, body2, strlen(body1) - 22) == 0 );
+}
+
+/* updates are appended to the journal and replayed when loading */
+void test_journal(void)
+{
+    char tmpname[] = "/tmp/test_digup.XXXXXX";
+    char *journal, *refname, *outname, *data1, *data2, *ref, *out;
+    char name[32];
+    size_t size1, size2;
+    unsigned int round;
+    FILE* fp;
+
+    int fd = mkstemp(tmpname);
+    assert( fd >= 0 );
+    close(fd);
+
+    my_asprintf(&journal, "%s.journal", tmpname);
+    my_asprintf(&refname, "%s.ref", tmpname);
+    my_asprintf(&outname, "%s.out", tmpname);
+
+    gopt_digestfile = tmpname;
+    gopt_batch = TRUE;
+    gopt_journal = TRUE;
+
+    /* the option is saved by writing the whole file */
+    write_testfile(tmpname, 6000, TRUE);
+    load_digestfile();
+    assert( !cmd_write() );
+    filelist_teardown();
+
+    assert( access(journal, F_OK) != 0 );
+    data1 = read_file(tmpname, &size1);
+    assert( strstr(data1, "#: option --journal\n") != NULL );
+
+    for (round = 0; round < 3; ++round)
+    {
+	load_digestfile();
+	assert( g_journal.updates == round );
+
+	update_journalfile(round);
+	assert( !cmd_write() );
+	ref = write_fullfile(refname);
+	filelist_teardown();
+
+	/* the digest file is unchanged */
+	data2 = read_file(tmpname, &size2);
+	assert( size1 == size2 && memcmp(data1, data2, size1) == 0 );
+	free(data2);
+
+	/* the replayed records equal the updated ones */
+	load_digestfile();
+	assert( g_journal.updates == round + 1 );
+	out = write_fullfile(outname);
+	filelist_teardown();
+
+	compare_records(ref, out);
+
+	/* the new record of the previous round is deleted */
+	sprintf(name, "  g%u\\nx\n", round);
+	assert( strstr(out, name) != NULL );
+	sprintf(name, "  g%u\\nx\n", round - 1);
+	assert( strstr(out, name) == NULL );
+
+	free(out);
+	if (round < 2) free(ref);
+    }
+
+    /* an incomplete update is ignored and overwritten */
+    fp = fopen(journal, "ab");
+    assert( fp != NULL );
+    fprintf(fp, "#: mtime 1 size 1\n%032x  f00001\n#: crc 0x", 1);
+    fclose(fp);
+
+    load_digestfile();
+    assert( g_journal.updates == 3 );
+    out = write_fullfile(outname);
+    compare_records(ref, out);
+    filelist_teardown();
+    free(out);
+    free(ref);
+
+    load_digestfile();
+    update_journalfile(3);
+    assert( !cmd_write() );
+    filelist_teardown();
+
+    data2 = read_file(journal, &size2);
+    assert( strstr(data2, "#: mtime 1 size 1\n") == NULL );
+    free(data2);
+
+    load_digestfile();
+    assert( g_journal.updates == 4 );
+    filelist_teardown();
+
+    /* the journal is written into the digest file beyond the ratio */
+    gopt_journal_ratio = 0;
+    load_digestfile();
+    update_journalfile(4);
+    assert( !cmd_write() );
+    filelist_teardown();
+    gopt_journal_ratio = 10;
+
+    assert( access(journal, F_OK) != 0 );
+    data2 = read_file(tmpname, &size2);
+    check_eof_crc(data2, size2);
+    assert( strstr(data2, "#: option --journal\n") != NULL );
+    assert( strstr(data2, "  g4\\nx\n") != NULL );
+    free(data2);
+
+    /* a journal of another digest file is ignored */
+    fp = fopen(journal, "wb");
+    assert( fp != NULL );
+    fprintf(fp, JOURNAL_HEADER, 0);
+    fprintf(fp, "#: delete f00001\n");
+    fclose(fp);
+
+    load_digestfile();
+    assert( g_journal.updates == 0 && g_journal.filesize > 0 );
+    assert( filelist_find("f00001") != NULL );
+    filelist_teardown();
+
+    free(data1);
+
+    gopt_batch = FALSE;
+    gopt_journal = FALSE;
+    unlink(journal);
+    unlink(tmpname);
+    free(journal);
+    free(refname);
+    free(outname);
+}
+
+/* repeated writes like those of --watch append only the changes since
+ * the previous one to the journal, and nothing without changes */
+void test_journal_flush(void)
+{
+    char tmpname[] = "/tmp/test_digup.XXXXXX";
+    char *journal, *data1, *data2, *data3;
+    const char* p;
+    size_t size1, size2, size3;
+    unsigned int deletes;
+
+    assert( close(mkstemp(tmpname)) == 0 );
+    my_asprintf(&journal, "%s.journal", tmpname);
+
+    gopt_digestfile = tmpname;
+    gopt_batch = TRUE;
+    gopt_journal = TRUE;
+
+    /* the option is saved by writing the whole file */
+    write_testfile(tmpname, 6000, TRUE);
+    load_digestfile();
+    assert( !cmd_write() );
+    data1 = read_file(tmpname, &size1);
+
+    update_journalfile(0);
+    assert( !cmd_write() );
+    filelist_compact();
+    assert( g_journal.updates == 1 );
+    assert( g_filelist_seen == rb_size(g_filelist) );
+    data2 = read_file(journal, &size2);
+
+    /* a write without changes leaves both files alone */
+    assert( !cmd_write() );
+    filelist_compact();
+    assert( g_journal.updates == 1 );
+    data3 = read_file(journal, &size3);
+    assert( size2 == size3 && memcmp(data2, data3, size2) == 0 );
+    free(data3);
+
+    /* the records deleted by the first update are not deleted again */
+    update_journalfile(1);
+    assert( !cmd_write() );
+    filelist_compact();
+    assert( g_journal.updates == 2 );
+    data3 = read_file(journal, &size3);
+    assert( size3 > size2 && memcmp(data2, data3, size2) == 0 );
+    assert( strstr(data2, "#: delete f00007\n") != NULL );
+    assert( strstr(data3 + size2, "#: delete f00007\n") == NULL );
+
+    /* fifteen records and the new one of the first update */
+    for (p = data3 + size2, deletes = 0; (p = strstr(p, "#: delete")) != NULL; ++p)
+	++deletes;
+    assert( deletes == 16 );
+    free(data3);
+    free(data2);
+
+    data2 = read_file(tmpname, &size2);
+    assert( size1 == size2 && memcmp(data1, data2, size1) == 0 );
+    free(data2);
+    free(data1);
+
+    filelist_teardown();
+
+    gopt_batch = FALSE;
+    gopt_journal = FALSE;
+    unlink(journal);
+    unlink(tmpname);
+    free(journal);
+}
+
 int main(void)
 {
+    g_progname = "test_digup";
+
     test_filename_escaping();
+    test_normalize_relpath();
+    test_parse_size();
+    test_parse_inode_line();
+    test_parse_inplace();
+    test_parse_parallel();
+    test_sumindex_load();
+    test_write_record();
+    test_write_parallel();
+    test_write_copy();
+    test_journal();
+    test_journal_flush();
 
     return 0;
 }
@@ -0,0 +1,146 @@
+/*****************************************************************************
+ * Test directory tree keys against the order of plain path strings.         *
+ *                                                                           *
+ * Copyright (C) 2010-2020 Timo Bingmann                                     *
+ *                                                                           *
+ * This program is free software; you can redistribute it and/or modify it   *
+ * under the terms of the GNU General Public License as published by the     *
+ * Free Software Foundation; either version 3, or (at your option) any       *
+ * later version.                                                            *
+ *                                                                           *
+ * This program is distributed in the hope that it will be useful,           *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+ * GNU General Public License for more details.                              *
+ *                                                                           *
+ * You should have received a copy of the GNU General Public License         *
+ * along with this program; if not, write to the Free Software Foundation,   *
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.        *
+ *****************************************************************************/
+
+#include "dirtree.h"
+#include "arena.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#define NUM	2000
+
+static int sign(int x)
+{
+    return (x > 0) - (x < 0);
+}
+
+/* build a random path of up to four components from a small alphabet,
+ * including characters sorting before and after '/' */
+static void random_path(char* buf)
+{
+    static const char* parts[] = { "a", "b", "a.b", "a-", "a0", "ab", "b/c" };
+    int i, n = 1 + rand() % 4;
+
+    buf[0] = 0;
+
+    for (i = 0; i < n; ++i)
+    {
+	if (i) strcat(buf, "/");
+	strcat(buf, parts[rand() % 7]);
+    }
+}
+
+void test_order(void)
+{
+    int i, j;
+    char buf[256];
+    char* paths[NUM];
+    struct dt_key* keys[NUM];
+
+    struct arena* arena = arena_create(0);
+    struct dirtree* dt = dt_create(arena);
+
+    assert( dt_size(dt) == 1 );
+    assert( dt_find_dir(dt, "") == dt_root(dt) );
+
+    srand(42);
+
+    for (i = 0; i < NUM; ++i)
+    {
+	random_path(buf);
+	paths[i] = strdup(buf);
+	keys[i] = dt_intern(dt, paths[i]);
+
+	assert( dt_key_length(keys[i]) == strlen(paths[i]) );
+	assert( strcmp(dt_key_path(keys[i], buf), paths[i]) == 0 );
+    }
+
+    for (i = 0; i < NUM; ++i)
+    {
+	struct dt_key key, endkey;
+	char* endpath;
+
+	assert( dt_lookup(dt, paths[i], &key) );
+	assert( dt_key_equal(&key, keys[i]) );
+	assert( dt_key_hash(&key) == dt_key_hash(keys[i]) );
+
+	/* intern the path from a buffer with trailing characters */
+	sprintf(buf, "%s\nx/y", paths[i]);
+	assert( dt_key_equal(dt_intern_n(dt, buf, strlen(paths[i])), keys[i]) );
+
+	/* search key after all entries below the file's directory */
+	endkey.dir = keys[i]->dir;
+	endkey.name = NULL;
+	endpath = malloc(keys[i]->dir->pathlen + 2);
+	strcpy(endpath, keys[i]->dir->path);
+	strcat(endpath, "0");
+
+	for (j = 0; j < NUM; ++j)
+	{
+	    assert( sign(dt_key_cmp(keys[i], keys[j])) ==
+		    sign(strcmp(paths[i], paths[j])) );
+
+	    assert( dt_key_equal(keys[i], keys[j]) ==
+		    (strcmp(paths[i], paths[j]) == 0) );
+
+	    if (keys[i]->dir->pathlen)
+	    {
+		assert( sign(dt_key_cmp(&endkey, keys[j])) ==
+			sign(strcmp(endpath, paths[j])) );
+	    }
+	    else
+	    {
+		assert( dt_key_cmp(&endkey, keys[j]) > 0 );
+	    }
+
+	    assert( dt_within(keys[j]->dir, keys[i]->dir) ==
+		    (keys[i]->dir->pathlen == 0 ||
+		     (strncmp(paths[j], keys[i]->dir->path, keys[i]->dir->pathlen) == 0 &&
+		      paths[j][keys[i]->dir->pathlen] == '/')) );
+	}
+
+	free(endpath);
+    }
+
+    {
+	struct dt_key key;
+
+	assert( dt_find_dir(dt, "x") == NULL );
+	assert( dt_lookup(dt, "x/y", &key) == 0 );
+	assert( dt_lookup(dt, "y", &key) == 1 && key.dir == dt_root(dt) );
+    }
+
+    for (i = 0; i < NUM; ++i)
+	free(paths[i]);
+
+    dt_destroy(dt);
+    arena_destroy(arena);
+}
+
+int main(void)
+{
+    test_order();
+
+    return 0;
+}
+
+/*****************************************************************************/
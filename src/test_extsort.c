@@ -0,0 +1,108 @@
+/*****************************************************************************
+ * Test external merge sort with records spilled to many runs.               *
+ *                                                                           *
+ * Copyright (C) 2010-2020 Timo Bingmann                                     *
+ *                                                                           *
+ * This program is free software; you can redistribute it and/or modify it   *
+ * under the terms of the GNU General Public License as published by the     *
+ * Free Software Foundation; either version 3, or (at your option) any       *
+ * later version.                                                            *
+ *                                                                           *
+ * This program is distributed in the hope that it will be useful,           *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+ * GNU General Public License for more details.                              *
+ *                                                                           *
+ * You should have received a copy of the GNU General Public License         *
+ * along with this program; if not, write to the Free Software Foundation,   *
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.        *
+ *****************************************************************************/
+
+#include "extsort.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+struct record
+{
+    unsigned int key, seq;
+    /* followed by filler bytes derived from seq */
+};
+
+static int record_cmp(const void *a, const void *b)
+{
+    const struct record *x = a, *y = b;
+
+    if (x->key != y->key) return (x->key < y->key) ? -1 : 1;
+    return (x->seq < y->seq) ? -1 : (x->seq > y->seq);
+}
+
+/* sort num records with the given memory limit and check the result */
+void test_sort(size_t num, size_t memlimit, int expect_runs)
+{
+    struct extsort *es = es_create(memlimit, record_cmp);
+    union { struct record r; char b[sizeof(struct record) + 64]; } u;
+    struct record *r = &u.r;
+    char *buf = u.b;
+    const struct record *p, *q = NULL;
+    size_t i, len, n = 0;
+    unsigned int sum = 0, xsum = 0;
+
+    srand(4545);
+    for (i = 0; i < num; ++i)
+    {
+	r->key = rand() % (num / 4 + 1);
+	r->seq = i;
+	len = sizeof(struct record) + (i % 64);
+	memset(buf + sizeof(struct record), i & 0xFF, i % 64);
+
+	es_add(es, buf, len);
+	sum += r->key + r->seq;
+    }
+
+    assert( es_count(es) == num );
+
+    es_finish(es);
+
+    while ((p = es_next(es, &len)))
+    {
+	size_t j;
+
+	assert( len == sizeof(struct record) + (p->seq % 64) );
+	for (j = sizeof(struct record); j < len; ++j)
+	    assert( ((const unsigned char*)p)[j] == (p->seq & 0xFF) );
+
+	if (q) assert( record_cmp(q, p) < 0 );
+	xsum += p->key + p->seq;
+
+	/* keep a copy, the previous record becomes invalid */
+	memcpy(buf, p, sizeof(struct record));
+	q = r;
+	++n;
+    }
+
+    assert( n == num );
+    assert( sum == xsum );
+    assert( expect_runs ? es_runs(es) > 1 : es_runs(es) == 0 );
+
+    printf("sorted %u records in %u runs\n",
+	   (unsigned int)num, (unsigned int)es_runs(es));
+
+    es_destroy(es);
+}
+
+int main(void)
+{
+    test_sort(0, 4096, 0);
+    test_sort(1, 4096, 0);
+    test_sort(10000, 16*1024*1024, 0);
+    test_sort(10000, 64*1024, 1);
+    /* more runs than are merged at once */
+    test_sort(100000, 4096, 1);
+
+    return 0;
+}
+
+/*****************************************************************************/
@@ -0,0 +1,118 @@
+/*****************************************************************************
+ * test_hashindex - Tests for the path hash index                            *
+ *                                                                           *
+ * Copyright (C) 2010-2020 Timo Bingmann                                     *
+ *                                                                           *
+ * This program is free software; you can redistribute it and/or modify it   *
+ * under the terms of the GNU General Public License as published by the     *
+ * Free Software Foundation; either version 3, or (at your option) any       *
+ * later version.                                                            *
+ *                                                                           *
+ * This program is distributed in the hope that it will be useful,           *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+ * GNU General Public License for more details.                              *
+ *                                                                           *
+ * You should have received a copy of the GNU General Public License         *
+ * along with this program; if not, write to the Free Software Foundation,   *
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.        *
+ *****************************************************************************/
+
+#include "hashindex.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+void test_strings(void)
+{
+    int i;
+    char str[64];
+    char** keys = malloc(sizeof(char*) * 100000);
+
+    /* start small to test growing */
+    struct hashindex *hi = hi_create(0);
+
+    assert( hi_find(hi, "a") == NULL );
+
+    for (i = 0; i < 100000; i++)
+    {
+	snprintf(str, sizeof(str), "dir%d/file%d", i % 97, i);
+	keys[i] = strdup(str);
+
+	hi_insert(hi, keys[i], &keys[i]);
+    }
+
+    assert( hi_size(hi) == 100000 );
+    assert( hi_memory(hi) >= 100000 * (sizeof(uint64_t) + 2 * sizeof(void*)) );
+
+    for (i = 0; i < 100000; i++)
+    {
+	snprintf(str, sizeof(str), "dir%d/file%d", i % 97, i);
+	assert( hi_find(hi, str) == &keys[i] );
+    }
+
+    assert( hi_find(hi, "dir0/file1") == NULL );
+    assert( hi_find(hi, "") == NULL );
+
+    /* replace value of existing key */
+    hi_insert(hi, keys[42], NULL);
+    assert( hi_size(hi) == 100000 );
+    assert( hi_find(hi, keys[42]) == NULL );
+
+    hi_insert(hi, keys[42], keys);
+    assert( hi_find(hi, "dir42/file42") == keys );
+
+    hi_destroy(hi);
+
+    for (i = 0; i < 100000; i++)
+	free(keys[i]);
+    free(keys);
+}
+
+/* keys are pointers to integers, compared by value */
+static uint64_t int_hash(const void *key)
+{
+    return *(const int*)key * 0x9E3779B97F4A7C15ULL;
+}
+
+static int int_equal(const void *a, const void *b)
+{
+    return *(const int*)a == *(const int*)b;
+}
+
+void test_custom(void)
+{
+    int i, k;
+    int* keys = malloc(sizeof(int) * 10000);
+
+    struct hashindex *hi = hi_create_custom(0, int_hash, int_equal);
+
+    for (i = 0; i < 10000; i++)
+    {
+	keys[i] = 3 * i;
+	hi_insert(hi, &keys[i], &keys[i]);
+    }
+
+    assert( hi_size(hi) == 10000 );
+
+    for (i = 0; i < 30000; i++)
+    {
+	k = i;
+	assert( hi_find(hi, &k) == (i % 3 == 0 ? &keys[i / 3] : NULL) );
+    }
+
+    hi_destroy(hi);
+    free(keys);
+}
+
+int main(void)
+{
+    test_strings();
+    test_custom();
+
+    return 0;
+}
+
+/*****************************************************************************/
@@ -0,0 +1,148 @@
+/*****************************************************************************
+ * Tests for the Include/Exclude Glob Pattern Matcher                        *
+ *                                                                           *
+ * Test cases: glob syntax, anchoring, directory patterns and pruning.       *
+ *                                                                           *
+ * Copyright (C) 2010-2020 Timo Bingmann                                     *
+ *                                                                           *
+ * This program is free software; you can redistribute it and/or modify it   *
+ * under the terms of the GNU General Public License as published by the     *
+ * Free Software Foundation; either version 3, or (at your option) any       *
+ * later version.                                                            *
+ *                                                                           *
+ * This program is distributed in the hope that it will be useful,           *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+ * GNU General Public License for more details.                              *
+ *                                                                           *
+ * You should have received a copy of the GNU General Public License         *
+ * along with this program; if not, write to the Free Software Foundation,   *
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.        *
+ *****************************************************************************/
+
+#include "pathmatch.h"
+
+#include <stdlib.h>
+#include <assert.h>
+
+void test_exclude(void)
+{
+    struct pathmatch *pm = pm_create();
+
+    /* no patterns: everything is selected */
+    assert( pm_match_path(pm, "a/b/c") );
+
+    assert( pm_add(pm, "*.o", 0) );
+    assert( pm_add(pm, "/build/", 0) );
+    assert( pm_add(pm, "doc/**/*.tmp", 0) );
+    assert( pm_add(pm, "cache[0-9]", 0) );
+
+    assert( pm_has_include(pm) == 0 );
+
+    assert( !pm_match_path(pm, "x.o") );
+    assert( !pm_match_path(pm, "src/deep/x.o") );
+    assert( pm_match_path(pm, "src/x.oo") );
+    assert( pm_match_path(pm, "src/x.c") );
+
+    /* anchored directory pattern */
+    assert( !pm_match_path(pm, "build/x.c") );
+    assert( pm_match_path(pm, "src/build/x.c") );
+    assert( pm_match_path(pm, "build") ); /* a file, not a directory */
+
+    /* double star matches zero or more directories */
+    assert( !pm_match_path(pm, "doc/a.tmp") );
+    assert( !pm_match_path(pm, "doc/x/y/a.tmp") );
+    assert( pm_match_path(pm, "src/doc/a.tmp") );
+
+    /* character class matches whole directory */
+    assert( !pm_match_path(pm, "a/cache1/file") );
+    assert( pm_match_path(pm, "a/cacheX/file") );
+
+    pm_destroy(pm);
+}
+
+void test_include(void)
+{
+    struct pathmatch *pm = pm_create();
+
+    pm_state root[4], dir[4], file[4];
+
+    assert( pm_add(pm, "photos/2024", 1) );
+    assert( pm_add(pm, "*.[jJ][pP][gG]", 1) );
+    assert( pm_add(pm, "photos/2024/raw/", 0) );
+
+    assert( pm_has_include(pm) );
+    assert( pm_state_words(pm) <= 4 );
+
+    assert( pm_match_path(pm, "photos/2024/a.png") );
+    assert( pm_match_path(pm, "photos/2024/x/y/z") );
+    assert( !pm_match_path(pm, "photos/2024/raw/a.png") );
+    assert( !pm_match_path(pm, "photos/2023/a.png") );
+    assert( pm_match_path(pm, "photos/2023/a.jpg") );
+    assert( pm_match_path(pm, "photos/2023/b.JPG") );
+    assert( !pm_match_path(pm, "photos/2023/a.jpeg") );
+    assert( !pm_match_path(pm, "photos/2024a/b") );
+
+    /* incremental classification as done by the directory scan */
+    pm_root(pm, root);
+
+    pm_enter(pm, root, "photos", dir);
+    assert( pm_classify(pm, dir, 1) == PM_PARTIAL );
+
+    pm_enter(pm, dir, "2024", file);
+    assert( pm_classify(pm, file, 1) & PM_INCLUDED );
+
+    pm_enter(pm, root, "music", dir);
+    assert( pm_classify(pm, dir, 1) == PM_PARTIAL ); /* *.jpg may match below */
+
+    pm_destroy(pm);
+
+    /* without unanchored includes, other directories are pruned */
+    pm = pm_create();
+    assert( pm_add(pm, "photos/2024/", 1) );
+
+    pm_root(pm, root);
+    pm_enter(pm, root, "music", dir);
+    assert( pm_classify(pm, dir, 1) == 0 );
+
+    pm_enter(pm, root, "photos", dir);
+    assert( pm_classify(pm, dir, 1) == PM_PARTIAL );
+
+    pm_destroy(pm);
+}
+
+void test_syntax(void)
+{
+    struct pathmatch *pm = pm_create();
+
+    assert( pm_add(pm, "", 1) == 0 );
+    assert( pm_add(pm, "/", 1) == 0 );
+    assert( pm_add(pm, "[abc", 1) == 0 );
+    assert( pm_add(pm, "abc\\", 1) == 0 );
+    assert( pm_has_include(pm) == 0 );
+
+    assert( pm_add(pm, "\\*x", 1) );
+    assert( pm_add(pm, "[]]y", 1) );
+    assert( pm_add(pm, "v[!a-c]", 1) );
+
+    assert( pm_match_path(pm, "*x") );
+    assert( !pm_match_path(pm, "ax") );
+    assert( pm_match_path(pm, "d/]y") );
+    assert( pm_match_path(pm, "vd") );
+    assert( !pm_match_path(pm, "vb") );
+
+    pm_destroy(pm);
+}
+
+int main(void)
+{
+    test_exclude();
+
+    test_include();
+
+    test_syntax();
+
+    return 0;
+}
+
+/*****************************************************************************/
@@ -0,0 +1,86 @@
+/*****************************************************************************
+ * test_psort - Tests for the parallel merge sort                            *
+ *                                                                           *
+ * Copyright (C) 2010-2020 Timo Bingmann                                     *
+ *                                                                           *
+ * This program is free software; you can redistribute it and/or modify it   *
+ * under the terms of the GNU General Public License as published by the     *
+ * Free Software Foundation; either version 3, or (at your option) any       *
+ * later version.                                                            *
+ *                                                                           *
+ * This program is distributed in the hope that it will be useful,           *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+ * GNU General Public License for more details.                              *
+ *                                                                           *
+ * You should have received a copy of the GNU General Public License         *
+ * along with this program; if not, write to the Free Software Foundation,   *
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.        *
+ *****************************************************************************/
+
+#include "psort.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+struct item
+{
+    unsigned int key, pos;
+};
+
+static int item_cmp(const void *a, const void *b)
+{
+    const struct item *x = a, *y = b;
+    return (x->key < y->key) ? -1 : (x->key > y->key);
+}
+
+/* sort with the given number of threads and check the result */
+void test_sort(size_t num, unsigned int threads)
+{
+    struct item *arr = malloc(sizeof(struct item) * num);
+    size_t i;
+
+    srand(4545);
+    for (i = 0; i < num; ++i)
+    {
+	arr[i].key = rand() % (num / 4 + 1);
+	arr[i].pos = i;
+    }
+
+    psort(arr, num, sizeof(struct item), item_cmp, threads);
+
+    for (i = 1; i < num; ++i)
+	assert( arr[i-1].key <= arr[i].key );
+
+    /* check that it is a permutation */
+    {
+	unsigned char *seen = calloc(num, 1);
+
+	for (i = 0; i < num; ++i)
+	{
+	    assert( !seen[arr[i].pos] );
+	    seen[arr[i].pos] = 1;
+	}
+
+	free(seen);
+    }
+
+    free(arr);
+}
+
+int main(void)
+{
+    test_sort(0, 4);
+    test_sort(1000, 4);
+    test_sort(200000, 1);
+    test_sort(200000, 2);
+    test_sort(200001, 3);
+    test_sort(300007, 7);
+    test_sort(100000, 0);
+
+    return 0;
+}
+
+/*****************************************************************************/
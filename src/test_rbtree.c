@@ -21,6 +21,7 @@
  *****************************************************************************/
 
 #include "rbtree.h"
+#include "arena.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -231,6 +232,124 @@ void test_integers_multi(int factor)
     rb_destroy(tree);
 }
 
+void test_lower_bound(void)
+{
+    int i;
+    intptr_t val;
+    struct rb_node *node;
+
+    struct rb_tree *tree = rb_create(integer_cmp,
+				     integer_free, integer_free,
+				     integer_print, integer_print);
+
+    assert( rb_lower_bound(tree, (void*)0) == rb_end(tree) );
+
+    /* insert even numbers, each one twice */
+    for (i = 0; i < 2000; i++)
+    {
+	val = 2 * (i % 1000);
+	rb_insert(tree, (void*)val, (void*)(intptr_t)i);
+    }
+
+    for (i = -1; i < 1999; i++)
+    {
+	val = i;
+	node = rb_lower_bound(tree, (void*)val);
+	assert(node != rb_end(tree));
+	assert((intptr_t)node->key == (i + 1) / 2 * 2);
+
+	/* must return the first of the duplicate keys */
+	node = rb_predecessor(tree, node);
+	assert(node == rb_end(tree) || (intptr_t)node->key < val);
+    }
+
+    val = 1999;
+    assert( rb_lower_bound(tree, (void*)val) == rb_end(tree) );
+
+    rb_destroy(tree);
+}
+
+/* sequence of even integers for rb_build_sorted() */
+static void next_even(void *cookie, void **key, void **value)
+{
+    intptr_t *counter = cookie;
+
+    *key = (void*)(2 * *counter);
+    *value = (void*)*counter;
+    ++*counter;
+}
+
+void test_build_sorted(void)
+{
+    unsigned int n;
+
+    for (n = 0; n < 600; n += (n < 70 ? 1 : 37))
+    {
+	intptr_t i, counter = 0;
+	struct rb_node *node;
+
+	struct rb_tree *tree = rb_create(integer_cmp,
+					 integer_free, integer_free,
+					 integer_print, integer_print);
+
+	assert( rb_build_sorted(tree, n, next_even, &counter) );
+	assert( counter == (intptr_t)n );
+	assert( rb_size(tree) == n );
+	assert( rb_verify(tree) );
+
+	/* in-order traversal yields the sequence */
+	for (i = 0, node = rb_begin(tree); node != rb_end(tree);
+	     node = rb_successor(tree, node), ++i)
+	{
+	    assert( (intptr_t)node->key == 2 * i );
+	    assert( (intptr_t)node->value == i );
+	}
+	assert( i == (intptr_t)n );
+
+	for (i = 0; i < (intptr_t)n; ++i)
+	    assert( rb_find(tree, (void*)(2 * i)) != NULL );
+
+	/* tree must accept further inserts */
+	for (i = 0; i < 50; ++i)
+	    rb_insert(tree, (void*)(2 * i + 1), (void*)i);
+
+	assert( rb_verify(tree) );
+	assert( rb_size(tree) == n + 50 );
+
+	/* build into a non-empty tree fails */
+	counter = 0;
+	assert( rb_build_sorted(tree, 1, next_even, &counter) == 0 );
+
+	rb_destroy(tree);
+    }
+}
+
+void test_arena_nodes(void)
+{
+    intptr_t i, counter = 0;
+
+    struct arena *arena = arena_create(0);
+
+    struct rb_tree *tree = rb_create(integer_cmp, NULL, NULL,
+				     integer_print, integer_print);
+
+    rb_set_arena(tree, arena);
+
+    assert( rb_build_sorted(tree, 1000, next_even, &counter) );
+
+    for (i = 0; i < 1000; ++i)
+	rb_insert(tree, (void*)(2 * i + 1), (void*)i);
+
+    for (i = 0; i < 500; ++i)
+	rb_delete(tree, rb_find(tree, (void*)(4 * i)));
+
+    assert( rb_verify(tree) );
+    assert( rb_size(tree) == 1500 );
+
+    rb_destroy(tree);
+    arena_destroy(arena);
+}
+
 int main(void)
 {
     int i;
@@ -242,6 +361,12 @@ int main(void)
     for (i = 10; i < 100; ++i)
 	test_integers_multi(i);
 
+    test_lower_bound();
+
+    test_build_sorted();
+
+    test_arena_nodes();
+
     return 0;
 }
 
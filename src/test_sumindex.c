@@ -0,0 +1,163 @@
+/*****************************************************************************
+ * Test the binary sidecar index of a digest file.                           *
+ *                                                                           *
+ * Copyright (C) 2010-2020 Timo Bingmann                                     *
+ *                                                                           *
+ * This program is free software; you can redistribute it and/or modify it   *
+ * under the terms of the GNU General Public License as published by the     *
+ * Free Software Foundation; either version 3, or (at your option) any       *
+ * later version.                                                            *
+ *                                                                           *
+ * This program is distributed in the hope that it will be useful,           *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+ * GNU General Public License for more details.                              *
+ *                                                                           *
+ * You should have received a copy of the GNU General Public License         *
+ * along with this program; if not, write to the Free Software Foundation,   *
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.        *
+ *****************************************************************************/
+
+#include "sumindex.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <assert.h>
+
+#define NUM	1000
+
+static void make_record(struct si_record *rec, char *path, char *target,
+			unsigned char *digest, unsigned int i)
+{
+    unsigned int j;
+
+    memset(rec, 0, sizeof(*rec));
+    rec->size = 4096 * (int64_t)i;
+    rec->mtime = 1300000000 + i;
+
+    sprintf(path, "dir%u/file %u", i % 7, i);
+    sprintf(target, "../target%u", i);
+
+    if (i % 10 == 3)
+	rec->flags |= SI_SYMLINK;
+
+    if (i % 3 == 0) {
+	rec->flags |= SI_INODE;
+	rec->dev = 2049;
+	rec->ino = 1000 + i;
+    }
+
+    for (j = 0; j < 20; ++j)
+	digest[j] = (unsigned char)(i * 31 + j);
+}
+
+static void write_index(const char *path, const struct si_stamp *stamp)
+{
+    struct si_writer *w = si_create(path, 2, 20, 3);
+    struct si_record rec;
+    char name[64], target[64];
+    unsigned char digest[20];
+    unsigned int i;
+
+    assert( w != NULL );
+
+    for (i = 0; i < NUM; ++i)
+    {
+	make_record(&rec, name, target, digest, i);
+	si_add(w, &rec, name, target, digest);
+    }
+
+    assert( si_finish(w, stamp) );
+}
+
+int main(void)
+{
+    char path[] = "/tmp/test_sumindex.XXXXXX";
+    struct si_stamp stamp, other;
+    struct si_writer *w;
+    struct sumindex *si;
+    struct si_record expect;
+    char name[64], target[64];
+    unsigned char digest[20];
+    unsigned int i;
+    FILE *fp;
+    long size;
+    int fd;
+
+    fd = mkstemp(path);
+    assert( fd >= 0 );
+    close(fd);
+    unlink(path);
+
+    stamp.size = 123456;
+    stamp.mtime = 1400000000;
+    stamp.crc = 0xdeadbeef;
+
+    assert( si_open(path, &stamp) == NULL && errno == ENOENT );
+
+    write_index(path, &stamp);
+
+    si = si_open(path, &stamp);
+    assert( si != NULL );
+    assert( si_type(si) == 2 && si_digestsize(si) == 20 );
+    assert( si_headerlines(si) == 3 && si_count(si) == NUM );
+
+    for (i = 0; i < NUM; ++i)
+    {
+	const struct si_record *rec = si_get(si, i);
+
+	make_record(&expect, name, target, digest, i);
+
+	assert( rec->size == expect.size && rec->mtime == expect.mtime );
+	assert( rec->flags == expect.flags );
+	assert( rec->dev == expect.dev && rec->ino == expect.ino );
+	assert( rec->pathlen == strlen(name) );
+	assert( strcmp(si_string(si, rec->path), name) == 0 );
+
+	if (rec->flags & SI_SYMLINK)
+	    assert( strcmp(si_string(si, rec->target), target) == 0 );
+	else
+	    assert( memcmp(si_digest(rec), digest, 20) == 0 );
+    }
+
+    si_close(si);
+
+    /* any change of the digest file's stamp invalidates the index */
+    other = stamp;
+    other.crc ^= 1;
+    assert( si_open(path, &other) == NULL && errno == ESTALE );
+
+    other = stamp;
+    other.mtime += 1;
+    assert( si_open(path, &other) == NULL && errno == ESTALE );
+
+    /* an aborted writer keeps the old index */
+    w = si_create(path, 2, 20, 3);
+    assert( w != NULL );
+    make_record(&expect, name, target, digest, 0);
+    si_add(w, &expect, name, target, digest);
+    si_abort(w);
+
+    si = si_open(path, &stamp);
+    assert( si != NULL && si_count(si) == NUM );
+    si_close(si);
+
+    /* a truncated index is rejected */
+    fp = fopen(path, "r+b");
+    assert( fp != NULL );
+    fseek(fp, 0, SEEK_END);
+    size = ftell(fp);
+    fclose(fp);
+    assert( truncate(path, size - 1) == 0 );
+
+    assert( si_open(path, &stamp) == NULL && errno == EINVAL );
+
+    unlink(path);
+
+    return 0;
+}
+
+/*****************************************************************************/